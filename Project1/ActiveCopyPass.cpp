@@ -13,11 +13,6 @@ void ActiveCopyPass::upload_buffer(byte *data, u32 length, RID dest_buf) {
 	SDL_GPUBuffer *buffer = m_renderer->get_buffer(dest_buf);
 	bool cycle_buffer = true;
 
-	SDL_GPUTransferBufferLocation source = {
-		.transfer_buffer = m_upload,
-		.offset = 0
-	};
-	
 	SDL_GPUBufferRegion dest = {
 		.buffer = buffer,
 	};
@@ -27,8 +22,14 @@ void ActiveCopyPass::upload_buffer(byte *data, u32 length, RID dest_buf) {
 		u32 size = length > TRANSFER_BUFFER_SIZE ? TRANSFER_BUFFER_SIZE : length;
 		length -= size;
 
-		memmove(SDL_MapGPUTransferBuffer(m_renderer->get_device(), m_upload, true), data, size);
-		SDL_UnmapGPUTransferBuffer(m_renderer->get_device(), m_upload);
+		// Staging memory belongs to the current frame, so nothing is overwritten while the GPU may still read it
+		SDL_GPUTransferBufferLocation source;
+		bool cycle_staging;
+		source.transfer_buffer = m_renderer->allocate_staging(size, &source.offset, &cycle_staging);
+
+		byte *dst = (byte *) SDL_MapGPUTransferBuffer(m_renderer->get_device(), source.transfer_buffer, cycle_staging);
+		memmove(dst + source.offset, data + offset, size);
+		SDL_UnmapGPUTransferBuffer(m_renderer->get_device(), source.transfer_buffer);
 		
 		dest.offset = offset;
 		dest.size = size;
@@ -42,40 +43,17 @@ void ActiveCopyPass::upload_buffer(byte *data, u32 length, RID dest_buf) {
 }
 
 void ActiveCopyPass::upload_texture(byte *data, u32 length, RID dest_tex) {
+	upload_texture(data, length, dest_tex, TextureUploadRegion{});
+}
+
+void ActiveCopyPass::upload_texture(byte *data, u32 length, RID dest_tex, const TextureUploadRegion &region) {
 	SDL_GPUTexture *texture = m_renderer->get_texture(dest_tex);
 	auto &info = m_renderer->get_texture_info(dest_tex);
 
-	u32 pixel_size = SDL_GPUTextureFormatTexelBlockSize(info.format);
-	u32 bytes_per_row = pixel_size * info.width;
-
-	// TODO: bytes_per_row currently cannot exceed TRANSFER_BUFFER_SIZE
-	// FIX: Break rows up too. *Should* be easy
-	
-	// The number of rows per group
-	u32 max_rows = TRANSFER_BUFFER_SIZE / bytes_per_row;
-	u32 extra_rows = info.height % max_rows;
-	u32 num_groups = info.height / max_rows;
-
-	u32 bytes_per_layer = bytes_per_row * info.height;
-
-	SDL_GPUTextureTransferInfo ti = {
-		.transfer_buffer = m_upload,
-		.offset = 0,
-		.pixels_per_row = info.width,
-		.rows_per_layer = info.height,
-	};
-
-	SDL_GPUTextureRegion region = {
-		.texture = texture,
-		.mip_level = 0,
-		.layer = 0,
-		.x = 0,
-		.y = 0,
-		.z = 0,
-		.w = info.width,
-		/*Height omitted*/
-		.d = 1
-	};
+	if (region.mip_level >= info.mip_levels) {
+		std::cout << "Texture upload targets mip level " << region.mip_level << " of " << info.mip_levels << "\n";
+		return;
+	}
 
 	// Gotta love APIs
 	bool use_layer_field;
@@ -100,45 +78,117 @@ void ActiveCopyPass::upload_texture(byte *data, u32 length, RID dest_tex) {
 		break;
 	}
 
-	bool cycle_texture = true;
+	// Size of the targeted mip level. Only 3D textures shrink in depth
+	u32 level_w = std::max(info.width >> region.mip_level, 1u);
+	u32 level_h = std::max(info.height >> region.mip_level, 1u);
+	u32 level_layers = info.type == SDL_GPU_TEXTURETYPE_3D ? std::max(info.depth >> region.mip_level, 1u) : info.depth;
+
+	u32 w = region.w ? region.w : level_w - std::min(region.x, level_w);
+	u32 h = region.h ? region.h : level_h - std::min(region.y, level_h);
+	u32 num_layers = region.num_layers ? region.num_layers : level_layers - std::min(region.first_layer, level_layers);
+
+	if (w == 0 || h == 0 || num_layers == 0 ||
+		region.x + w > level_w || region.y + h > level_h || region.first_layer + num_layers > level_layers) {
+		std::cout << "Texture upload region is empty or out of bounds\n";
+		return;
+	}
+
+	u32 pixel_size = SDL_GPUTextureFormatTexelBlockSize(info.format);
+	u32 src_bytes_per_row = pixel_size * level_w;
+	u32 src_bytes_per_layer = src_bytes_per_row * level_h;
+
+	if ((u64) src_bytes_per_layer * (region.first_layer + num_layers) > length) {
+		std::cout << "Texture upload data is too short for the region\n";
+		return;
+	}
+
+	// Rows wider than the transfer buffer are split into column spans, uploaded one row at a time
+	u32 span_w = std::min(w, TRANSFER_BUFFER_SIZE / pixel_size);
+	u32 bytes_per_span_row = pixel_size * span_w;
+
+	// The number of rows per group
+	u32 max_rows = TRANSFER_BUFFER_SIZE / bytes_per_span_row;
+
+	SDL_GPUTextureTransferInfo ti = {
+		.transfer_buffer = nullptr,
+		.offset = 0,
+		/*Pixels per row omitted*/
+		/*Rows omitted*/
+	};
+
+	SDL_GPUTextureRegion dest = {
+		.texture = texture,
+		.mip_level = region.mip_level,
+		.layer = 0,
+		/*X omitted*/
+		.y = 0,
+		.z = 0,
+		/*Width omitted*/
+		/*Height omitted*/
+		.d = 1
+	};
+
+	// Cycling discards the previous contents, so it is only safe when the whole base level is replaced (the
+	// rest of the chain is regenerated from it)
+	bool cycle_texture = region.mip_level == 0 && w == level_w && h == level_h && num_layers == level_layers;
 
-	for (u32 layer = 0; layer < info.depth; ++layer) {
+	for (u32 layer = region.first_layer; layer < region.first_layer + num_layers; ++layer) {
 		if (use_layer_field) {
-			region.layer = layer;
+			dest.layer = layer;
 		} else {
-			region.z = layer;
+			dest.z = layer;
 		}
 
-		region.h = max_rows;
+		for (u32 column = 0; column < w; column += span_w) {
+			u32 columns = std::min(span_w, w - column);
+			u32 bytes_per_row = pixel_size * columns;
 
-		for (u32 i = 0; i < num_groups; ++i) {
-			u32 offset = layer * bytes_per_layer + max_rows * i * bytes_per_row;
+			// Full rows are contiguous in the source, so they can be copied in one go
+			bool full_rows = columns == level_w;
 
-			region.y = i * max_rows;
+			for (u32 row = 0; row < h; row += max_rows) {
+				u32 rows = std::min(max_rows, h - row);
 
-			memmove(SDL_MapGPUTransferBuffer(m_renderer->get_device(), m_upload, true), data + offset, bytes_per_row * max_rows);
-			SDL_UnmapGPUTransferBuffer(m_renderer->get_device(), m_upload);
+				const byte *src = data + layer * src_bytes_per_layer + (region.y + row) * src_bytes_per_row + (region.x + column) * pixel_size;
 
-			SDL_UploadToGPUTexture(m_cp, &ti, &region, cycle_texture);
-			// Only cycle the first time
-			cycle_texture = false;
-		}
+				bool cycle_staging;
+				ti.transfer_buffer = m_renderer->allocate_staging(bytes_per_row * rows, &ti.offset, &cycle_staging);
 
-		if (extra_rows == 0) {
-			continue;
-		}
+				byte *dst = (byte *) SDL_MapGPUTransferBuffer(m_renderer->get_device(), ti.transfer_buffer, cycle_staging) + ti.offset;
 
-		u32 offset = layer * bytes_per_layer + num_groups * bytes_per_row * max_rows;
+				if (full_rows) {
+					memmove(dst, src, bytes_per_row * rows);
+				} else {
+					for (u32 i = 0; i < rows; ++i) {
+						memmove(dst + i * bytes_per_row, src + i * src_bytes_per_row, bytes_per_row);
+					}
+				}
 
-		region.y = num_groups * max_rows;
-		region.h = extra_rows;
+				SDL_UnmapGPUTransferBuffer(m_renderer->get_device(), ti.transfer_buffer);
 
-		memmove(SDL_MapGPUTransferBuffer(m_renderer->get_device(), m_upload, true), data + offset, bytes_per_row * extra_rows);
-		SDL_UnmapGPUTransferBuffer(m_renderer->get_device(), m_upload);
+				ti.pixels_per_row = columns;
+				ti.rows_per_layer = rows;
+				dest.x = region.x + column;
+				dest.y = region.y + row;
+				dest.w = columns;
+				dest.h = rows;
 
-		SDL_UploadToGPUTexture(m_cp, &ti, &region, cycle_texture);
-		cycle_texture = false;
+				SDL_UploadToGPUTexture(m_cp, &ti, &dest, cycle_texture);
+				// Only cycle the first time
+				cycle_texture = false;
+			}
+		}
 	}
 
-	info.dirty_mip = info.mip_levels > 1;
+	// Only the base level feeds the rest of the chain
+	if (region.mip_level == 0) {
+		m_renderer->mark_mips_dirty(dest_tex, TextureRect{
+			.x = region.x,
+			.y = region.y,
+			.w = w,
+			.h = h,
+			.first_layer = region.first_layer,
+			.num_layers = num_layers
+		});
+	}
 }
@@ -3,14 +3,26 @@
 
 class Renderer;
 
+// Describes the part of a texture targeted by an upload. Zero-sized dimensions extend to the edge of the mip level
+struct TextureUploadRegion {
+	u32 x = 0;
+	u32 y = 0;
+	u32 w = 0;
+	u32 h = 0;
+
+	u32 mip_level = 0;
+
+	// For 3D textures, these are depth slices instead
+	u32 first_layer = 0;
+	u32 num_layers = 0;
+};
+
 class ActiveCopyPass {
 	Renderer *m_renderer;
 
 	SDL_GPUCommandBuffer *m_cb;
 	SDL_GPUCopyPass *m_cp;
 
-	SDL_GPUTransferBuffer *m_upload;
-
 	friend class Renderer;
 	friend class RenderRetarget;
 
@@ -26,7 +38,18 @@ public:
 
 	void upload_buffer(byte *data, u32 length, RID dest_buf);
 
+	// Uploads the entire base level of every layer
 	void upload_texture(byte *data, u32 length, RID dest_tex);
 
+	/// <summary>
+	/// Uploads part of a single mip level. Only the texels inside the region are transferred, and only the
+	/// mips derived from that region are regenerated afterwards
+	/// </summary>
+	/// <param name="data">- The full contents of the mip level for every layer, tightly packed</param>
+	/// <param name="length">- The length of data</param>
+	/// <param name="dest_tex">- An RID representing the texture</param>
+	/// <param name="region">- The part of the texture to upload</param>
+	void upload_texture(byte *data, u32 length, RID dest_tex, const TextureUploadRegion &region);
+
 	inline bool is_valid() const { return m_renderer; }
 };
\ No newline at end of file
@@ -12,14 +12,61 @@ ActiveRenderPass::ActiveRenderPass():
 void ActiveRenderPass::use_shader(RID shader) {
 	if (!is_valid()) return;
 
+	if (!m_renderer->is_shader_valid(shader)) {
+		std::cout << "Tried to use shader " << *shader << ", which was never built\n";
+		return;
+	}
+
 	SDL_BindGPUGraphicsPipeline(m_rp, m_renderer->get_shader(shader));
 	m_active_shader = shader;
 }
 
 void ActiveRenderPass::upload_vertex_uniform_buffer(u32 slot, const void *data, u32 length) {
+	const auto &sizes = m_renderer->get_shader_info(m_active_shader).vert_uniform_sizes;
+	if (slot >= sizes.size() || length < sizes[slot]) {
+		std::cout << "Vertex uniform slot " << slot << " expects " << (slot < sizes.size() ? sizes[slot] : 0) << " bytes, got " << length << "\n";
+	}
+
 	SDL_PushGPUVertexUniformData(m_cb, slot, data, length);
 }
 
+void ActiveRenderPass::upload_fragment_uniform_buffer(u32 slot, const void *data, u32 length) {
+	const auto &sizes = m_renderer->get_shader_info(m_active_shader).frag_uniform_sizes;
+	if (slot >= sizes.size() || length < sizes[slot]) {
+		std::cout << "Fragment uniform slot " << slot << " expects " << (slot < sizes.size() ? sizes[slot] : 0) << " bytes, got " << length << "\n";
+	}
+
+	SDL_PushGPUFragmentUniformData(m_cb, slot, data, length);
+}
+
+bool ActiveRenderPass::uses_vert_uniform(u32 slot) const {
+	const auto &sizes = m_renderer->get_shader_info(m_active_shader).vert_uniform_sizes;
+	return slot < sizes.size() && sizes[slot] > 0;
+}
+
+bool ActiveRenderPass::uses_frag_uniform(u32 slot) const {
+	const auto &sizes = m_renderer->get_shader_info(m_active_shader).frag_uniform_sizes;
+	return slot < sizes.size() && sizes[slot] > 0;
+}
+
+void ActiveRenderPass::bind_vert_storage_buffers(u32 first_slot, const std::vector<RID> &buffers) {
+	std::vector<SDL_GPUBuffer *> handles(buffers.size());
+	for (u32 i = 0; i < buffers.size(); i++) {
+		handles[i] = m_renderer->get_buffer(buffers[i]);
+	}
+
+	SDL_BindGPUVertexStorageBuffers(m_rp, first_slot, handles.data(), handles.size());
+}
+
+void ActiveRenderPass::bind_frag_storage_buffers(u32 first_slot, const std::vector<RID> &buffers) {
+	std::vector<SDL_GPUBuffer *> handles(buffers.size());
+	for (u32 i = 0; i < buffers.size(); i++) {
+		handles[i] = m_renderer->get_buffer(buffers[i]);
+	}
+
+	SDL_BindGPUFragmentStorageBuffers(m_rp, first_slot, handles.data(), handles.size());
+}
+
 void ActiveRenderPass::bind_mesh(u32 vertex_count, RID vbuf1, RID vbuf2) {
 	auto &pi = m_renderer->get_shader_info(m_active_shader);
 
@@ -118,6 +165,24 @@ void ActiveRenderPass::bind_mesh_indexed(u32 index_count, RID indices, RID vbuf1
 	SDL_BindGPUIndexBuffer(m_rp, &ibb, SDL_GPU_INDEXELEMENTSIZE_32BIT);
 }
 
+bool ActiveRenderPass::update_sampler_cache(std::vector<SDL_GPUTextureSamplerBinding> &cache, u32 first_slot,
+	const SDL_GPUTextureSamplerBinding *bindings, u32 count) {
+	if (cache.size() < first_slot + count) {
+		cache.resize(first_slot + count, { .texture = nullptr, .sampler = nullptr });
+	}
+
+	bool changed = false;
+	for (u32 i = 0; i < count; ++i) {
+		SDL_GPUTextureSamplerBinding &cached = cache[first_slot + i];
+		if (cached.texture != bindings[i].texture || cached.sampler != bindings[i].sampler) {
+			cached = bindings[i];
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
 void ActiveRenderPass::bind_vert_samplers(u32 first_slot, const std::vector<RID> &samplers, const std::vector<RID> &textures) {
 	assert(samplers.size() == textures.size());
 
@@ -129,7 +194,9 @@ void ActiveRenderPass::bind_vert_samplers(u32 first_slot, const std::vector<RID>
 		};
 	}
 
-	SDL_BindGPUFragmentSamplers(m_rp, first_slot, bindings, samplers.size());
+	if (update_sampler_cache(m_vert_sampler_cache, first_slot, bindings, samplers.size())) {
+		SDL_BindGPUVertexSamplers(m_rp, first_slot, bindings, samplers.size());
+	}
 	delete[] bindings;
 }
 
@@ -144,7 +211,9 @@ void ActiveRenderPass::bind_frag_samplers(u32 first_slot, const std::vector<RID>
 		};
 	}
 
-	SDL_BindGPUFragmentSamplers(m_rp, first_slot, bindings, samplers.size());
+	if (update_sampler_cache(m_frag_sampler_cache, first_slot, bindings, samplers.size())) {
+		SDL_BindGPUFragmentSamplers(m_rp, first_slot, bindings, samplers.size());
+	}
 	delete[] bindings;
 }
 
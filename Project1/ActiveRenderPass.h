@@ -14,6 +14,14 @@ class ActiveRenderPass {
 	u32 m_vertex_count = 0;
 	bool m_indexed = false;
 
+	// What is currently bound to each sampler slot, so draws sharing textures (eg. an atlas) skip rebinding
+	std::vector<SDL_GPUTextureSamplerBinding> m_vert_sampler_cache;
+	std::vector<SDL_GPUTextureSamplerBinding> m_frag_sampler_cache;
+
+	// Returns false if the slots already hold these bindings. Otherwise, records them and returns true
+	static bool update_sampler_cache(std::vector<SDL_GPUTextureSamplerBinding> &cache, u32 first_slot,
+		const SDL_GPUTextureSamplerBinding *bindings, u32 count);
+
 	friend class Renderer;
 	friend class RenderRetarget;
 
@@ -40,6 +48,32 @@ public:
 	/// <param name="length">- The length of the data</param>
 	void upload_vertex_uniform_buffer(u32 slot, const void *data, u32 length);
 
+	/// <summary>
+	/// Uploads data to a fragment uniform buffer
+	/// </summary>
+	/// <param name="slot">- The binding component of the layout</param>
+	/// <param name="data">- A pointer to binary data</param>
+	/// <param name="length">- The length of the data</param>
+	void upload_fragment_uniform_buffer(u32 slot, const void *data, u32 length);
+
+	// Returns true if the bound pipeline's vertex or fragment stage declares a uniform block at the slot
+	bool uses_vert_uniform(u32 slot) const;
+	bool uses_frag_uniform(u32 slot) const;
+
+	/// <summary>
+	/// Binds read-only storage buffers for the vertex shader, eg. a UniformArena
+	/// </summary>
+	/// <param name="first_slot">- The binding index of the first buffer</param>
+	/// <param name="buffers">- The RIDs representing the buffers</param>
+	void bind_vert_storage_buffers(u32 first_slot, const std::vector<RID> &buffers);
+
+	/// <summary>
+	/// Binds read-only storage buffers for the fragment shader, eg. a UniformArena
+	/// </summary>
+	/// <param name="first_slot">- The binding index of the first buffer</param>
+	/// <param name="buffers">- The RIDs representing the buffers</param>
+	void bind_frag_storage_buffers(u32 first_slot, const std::vector<RID> &buffers);
+
 	/// <summary>
 	/// Assigns mesh data to subsequent draw calls
 	/// </summary>
@@ -66,7 +100,7 @@ public:
 	void bind_mesh_indexed(u32 vertex_count, RID indices, RID vbuf1, RID vbuf2 = U32_BAD);
 
 	/// <summary>
-	/// Binds the samplers for the vertex shader
+	/// Binds the samplers for the vertex shader. Does nothing if the slots already hold the same bindings
 	/// </summary>
 	/// <param name="first_slot">- The binding index of the first sampler</param>
 	/// <param name="samplers">- The RIDs representing the samplers</param>
@@ -74,7 +108,7 @@ public:
 	void bind_vert_samplers(u32 first_slot, const std::vector<RID> &samplers, const std::vector<RID> &textures);
 
 	/// <summary>
-	/// Binds the samplers for the fragment shader
+	/// Binds the samplers for the fragment shader. Does nothing if the slots already hold the same bindings
 	/// </summary>
 	/// <param name="first_slot">- The binding index of the first sampler</param>
 	/// <param name="samplers">- The RIDs representing the samplers</param>
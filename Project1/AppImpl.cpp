@@ -5,78 +5,340 @@
 
 #include "MiniLibs/lodepng.h"
 
+// Points towards the sun
+static const vec3 SUN_DIRECTION = glm::normalize(vec3(-1.0f, 1.0f, 1.0f));
+
+// Anti-aliasing of the window passes, off by default. Multisampled depth can't be sampled, so above 1 Hi-Z occlusion
+// culling is off; the CPU occlusion culling still runs
+static const SDL_GPUSampleCount WINDOW_SAMPLES = SDL_GPU_SAMPLECOUNT_1;
+
+// Main pass draws recorded per job. Enough that recording them costs more than scheduling the job
+static const u32 DRAWS_PER_LIST = 256;
+
 void AppImpl::process_tick() {
+	// Waits for the GPU to finish the frame that last used this frame's resources. Both passes below are
+	// recorded into one command buffer, submitted by end_frame()
+	m_renderer.begin_frame();
+
+	// Swap in any shaders that were edited since the last frame
+	m_shader_compiler.poll(m_renderer);
+	m_shader0.poll(m_renderer);
+	m_shadow_shader.poll(m_renderer);
+	m_prepass_shader.poll(m_renderer);
+
+	// Pick up the depth pyramid and overdraw counts of a frame the GPU has finished
+	m_hiz.poll();
+	m_overdraw.poll();
+
+	m_this_tick_ms = SDL_GetTicks();
+
+	// Gather every draw's constants up front, so they reach the GPU in one upload
+	m_draw_uniforms.reset();
+
+	// Move the camera. Its view constants are recomputed once here, not per draw
+	mat4x4 eye = glm::identity<mat4x4>();
+	eye = glm::translate(eye, vec3(cos(m_this_tick_ms / 1000.0f), sin(m_this_tick_ms / 1000.0f), 0.0f));
+	m_camera.set_transform(eye);
+
+	// Animate, then bring every world matrix up to date at once
+	m_scene.set_rotation(m_node0, glm::angleAxis(m_this_tick_ms / 1000.0f, vec3(0.0, 1.0, 0.0)));
+	m_scene.update();
+
+	sync_transforms(m_entities, m_scene);
+	update_bounds(m_entities);
+
+	// Static shadow casters are hashed along the way, so cached shadows are redrawn when one is added, removed or moved
+	u64 static_hash = HASH_SEED;
+
+	m_renderables.clear();
+	m_renderable_bounds.clear();
+	m_entities.each<Transform, Bounds, MeshRef, MaterialRef>(
+		[&](Entity entity, Transform &transform, Bounds &bounds, MeshRef &mesh, MaterialRef &material) {
+			const ShadowCaster *caster = m_entities.get<ShadowCaster>(entity);
+			if (caster && caster->is_static) {
+				static_hash = hash_bytes(&entity, sizeof(entity), static_hash);
+				static_hash = hash_bytes(&bounds.world, sizeof(bounds.world), static_hash);
+			}
+
+			m_renderables.push_back(Renderable{ .entity = entity, .transform = &transform, .mesh = &mesh, .material = &material, .caster = caster });
+			m_renderable_bounds.push_back(bounds.world);
+		}
+	);
+
+	m_draw_index_of.assign(m_renderables.size(), U32_BAD);
+
+	// The query order, and so the BVH's object indices, only changes with the world's layout. Otherwise moving
+	// objects only need their boxes refitted
+	if (m_entities.get_layout_version() != m_bvh_layout) {
+		m_bvh.build(m_renderable_bounds);
+		m_bvh_layout = m_entities.get_layout_version();
+	} else {
+		m_bvh.refit(m_renderable_bounds);
+	}
+
+	// Cull, and push the constants of whatever is left
+	m_visible_indices.clear();
+	m_bvh.query_frustum(Frustum::from_matrix(m_camera.get_constants().viewproj), m_visible_indices);
+
+	// Draw this frame's occluders on the CPU and test what the frustum kept against them. The Hi-Z culler then gets
+	// whatever they didn't hide
+	m_occlusion.begin(m_camera.get_constants().viewproj);
+	m_entities.each<Transform, Occluder>([&](Entity entity, Transform &transform, Occluder &occluder) {
+		m_occlusion.add_occluder(*occluder.mesh, transform.world);
+	});
+	m_occlusion.rasterize();
+	m_occlusion_culled = m_occlusion.cull(m_renderable_bounds, m_visible_indices);
+
+	m_hiz.cull(m_renderable_bounds, m_visible_indices);
+
+	const mat4x4 &view = m_camera.get_constants().view;
+
+	m_visible.clear();
+	for (u32 index : m_visible_indices) {
+		const Renderable &renderable = m_renderables[index];
+		float depth = -(view * vec4(m_renderable_bounds[index].center(), 1.0f)).z;
+
+		m_visible.push_back(VisibleDraw{ .mesh = renderable.mesh, .material = renderable.material, .uniforms = push_draw(index), .depth = depth });
+	}
+
+	if (m_count_overdraw) m_unsorted = m_visible;
+
+	// Everything drawn is opaque or alpha tested, so it can all go front to back within each variant. Sorting by depth
+	// alone would switch pipelines on nearly every draw. Opaque draws go first, since alpha tested ones lose early-Z
+	if (m_sort_draws) {
+		std::sort(m_visible.begin(), m_visible.end(), [](const VisibleDraw &a, const VisibleDraw &b) {
+			u32 a_alpha = a.material->features & SHADERFEATURE_ALPHA_TEST;
+			u32 b_alpha = b.material->features & SHADERFEATURE_ALPHA_TEST;
+			if (a_alpha != b_alpha) return a_alpha < b_alpha;
+
+			if (a.material->shader != b.material->shader) return a.material->shader < b.material->shader;
+			if (a.material->features != b.material->features) return a.material->features < b.material->features;
+
+			return a.depth < b.depth;
+		});
+	}
+
+	// Fit the shadow cascades to the camera and cull casters per cascade. Occlusion doesn't apply, casters hidden
+	// from the camera can still shadow what it sees
+	m_shadows.update(m_camera, SUN_DIRECTION, static_hash);
+
+	for (u32 cascade = 0; cascade < m_shadows.get_cascade_count(); cascade++) {
+		m_caster_indices.clear();
+		m_bvh.query_frustum(m_shadows.get_frustum(cascade), m_caster_indices);
+
+		m_shadow_draws[cascade][0].clear();
+		m_shadow_draws[cascade][1].clear();
+
+		for (u32 index : m_caster_indices) {
+			const Renderable &renderable = m_renderables[index];
+			if (!renderable.caster) continue;
+
+			bool is_static = renderable.caster->is_static;
+			if (is_static && !m_shadows.needs_static(cascade)) continue;
+
+			m_shadow_draws[cascade][is_static].push_back(
+				VisibleDraw{ .mesh = renderable.mesh, .material = renderable.material, .uniforms = push_draw(index), .depth = 0.0f });
+		}
+	}
+
+	// Sort the lights into the camera's froxels, while the draws above wait for the copy pass
+	m_lights.clear();
+	m_entities.each<Transform, Light>([&](Entity entity, Transform &transform, Light &light) {
+		vec3 position = vec3(transform.world[3]);
+
+		if (light.type == LIGHTTYPE_SPOT) {
+			vec3 direction = -glm::normalize(vec3(transform.world[2]));
+			m_lights.add_spot(position, direction, light.range, light.inner_angle, light.outer_angle, light.color);
+		} else {
+			m_lights.add_point(position, light.range, light.color);
+		}
+	});
+	m_lights.build(m_camera);
+
 	ActiveCopyPass acp = m_renderer.begin_copy_pass();
 	if (acp.is_valid()) {
 		m_mesh0.upload(acp);
 		m_mesh1.upload(acp);
 
-		acp.upload_texture(m_texturedata0.data(), m_texturedata0.size(), m_texture0);
+		m_texture0.upload(acp);
+
+		m_draw_uniforms.upload(acp);
+		m_lights.upload(acp);
 	}
 	m_renderer.end_copy_pass(std::move(acp));
 
-	ActiveRenderPass arp = m_renderer.begin_window_render_pass();
-	if (arp.is_valid()) {
-		m_this_tick_ms = SDL_GetTicks();
-		
-		std::cout << "Frame: " << m_frame_num << "  FPS: " << 1000.0 / (float) (m_this_tick_ms - m_last_tick_ms) << "\n";
+	m_shadows.render([&](ActiveRenderPass &arp, u32 cascade, bool statics) {
+		draw_depth_only(arp, m_shadow_shader, m_shadow_draws[cascade][statics], [&](ActiveRenderPass &arp) {
+			m_shadows.get_camera(cascade).bind(arp);
+			m_draw_uniforms.bind_vertex(arp, 0);
+		});
+	});
+
+	// Keep the depth for the occlusion culling of later frames, if it can read it
+	WindowPassInfo window_pass = {
+		.depth_store_op = m_renderer.can_sample_depth() ? SDL_GPU_STOREOP_STORE : SDL_GPU_STOREOP_DONT_CARE
+	};
+
+	ActiveRenderPass arp = m_renderer.begin_window_render_pass(window_pass);
+	bool drawn = arp.is_valid();
+	if (drawn) {
+		std::cout << "Frame: " << m_frame_num << "  FPS: " << 1000.0 / (float) (m_this_tick_ms - m_last_tick_ms)
+			<< "  Occluded: " << m_occlusion_culled << " (CPU) " << m_hiz.get_culled_count() << "/" << m_hiz.get_tested_count() << " (Hi-Z)"
+			<< "  Static shadow redraws: " << m_shadows.get_static_redraw_count()
+			<< "  Lights: " << m_lights.get_light_count() << " (" << m_lights.get_max_per_cluster() << " per froxel at most)"
+			<< "  Pre-pass: " << (m_depth_prepass ? "on" : "off") << "  Sorted: " << (m_sort_draws ? "on" : "off");
+
+		if (m_count_overdraw && m_overdraw.has_result()) {
+			std::cout << "  Overdraw: " << m_overdraw.get_baseline() << " -> " << m_overdraw.get_current() << " per pixel";
+		}
+		std::cout << "\n";
 
 		m_frame_num++;
 		m_last_tick_ms = m_this_tick_ms;
 
-		arp.use_shader(m_shader0);
-		
-		// First draw
+		// The main pass then only shades the nearest surface of each pixel, with LESS_OR_EQUAL
+		if (m_depth_prepass) {
+			draw_depth_only(arp, m_prepass_shader, m_visible, [&](ActiveRenderPass &arp) {
+				m_camera.bind(arp);
+				m_draw_uniforms.bind_vertex(arp, 0);
+			});
+		}
 
-		m_mesh0.bind(arp);
+		// get() may queue compiles, so the variants are picked here rather than on the workers. Ones that aren't
+		// compiled yet resolve to the generic one
+		m_visible_shaders.resize(m_visible.size());
+		RID first_shader = U32_BAD;
 
-		arp.bind_frag_samplers(0, {m_quality_sampler}, {m_texture0});
+		for (u32 i = 0; i < m_visible.size(); i++) {
+			m_visible_shaders[i] = m_visible[i].material->shader->get(m_visible[i].material->features);
+			if (*first_shader == U32_BAD) first_shader = m_visible_shaders[i];
+		}
 
-		// Upload uniforms
-		float bd0f[32] = { 0 };
+		// Nothing to draw with until the shaders are fixed
+		if (*first_shader != U32_BAD) {
+			// The per-pass data stays bound across pipeline changes, so it only needs a pipeline to check against
+			arp.use_shader(first_shader);
+			m_camera.bind(arp);
+			m_shadows.bind(arp);
+			m_lights.bind(arp);
+			m_draw_uniforms.bind_vertex(arp, 0);
 
-		// Generate projection & eye matrix, then copy to uniform buffer
-		mat4x4 eye = glm::identity<mat4x4>();
-		eye = glm::translate(eye, vec3(cos(m_this_tick_ms / 1000.0f), sin(m_this_tick_ms / 1000.0f), 0.0f));
+			DrawCommandList::record_parallel(m_draw_lists, m_visible.size(), DRAWS_PER_LIST, [&](DrawCommandList &list, u32 begin, u32 end) {
+				RID bound_shader = U32_BAD;
 
-		mat4x4 eyeproj = m_renderer.generate_perspective(deg_to_rad(90.0)) * glm::inverse(eye);
-		memmove((byte *) (bd0f + 0), (void *) &eyeproj, sizeof(eyeproj));
+				for (u32 i = begin; i < end; i++) {
+					const VisibleDraw &draw = m_visible[i];
 
-		// Same for world matrix, but invert first
-		mat4x4 world = glm::identity<mat4x4>();
-		world = glm::translate(world, vec3(0.0f, 0.0f, -2.0f));
+					RID shader = m_visible_shaders[i];
+					if (*shader == U32_BAD) continue;
 
-		world *= glm::mat4x4(glm::angleAxis(m_this_tick_ms / 1000.0f, vec3(0.0, 1.0, 0.0)));
-		memmove((byte *) (bd0f + 16), (void *) &world, sizeof(world));
+					if (*shader != *bound_shader) {
+						list.use_shader(shader);
+						bound_shader = shader;
+					}
 
-		arp.upload_vertex_uniform_buffer(0, (void *) bd0f, sizeof(bd0f));
+					draw.mesh->mesh->bind(list);
 
-		arp.draw();
+					list.bind_frag_samplers(0, {draw.material->sampler}, {draw.material->texture});
 
-		// Second draw
+					UniformArena::select(list, DRAW_UNIFORM_SLOT, draw.uniforms);
 
-		m_mesh1.bind(arp);
+					list.draw();
+				}
+			});
 
-		// Reupload uniforms
-		world = glm::identity<mat4x4>();
-		world = glm::translate(world, vec3(0.0f, -4.0f, -4.0f));
-		world = glm::scale(world, vec3(10.0));
-		world *= glm::mat4x4(glm::angleAxis(deg_to_rad(-90.0), vec3(1.0, 0.0, 0.0)));
-		memmove((byte *) (bd0f + 16), (void *) &world, sizeof(world));
+			for (const DrawCommandList &list : m_draw_lists) {
+				list.replay(arp);
+			}
+		}
+	}
+	m_renderer.end_render_pass(std::move(arp));
 
-		arp.upload_vertex_uniform_buffer(0, (void *) bd0f, sizeof(bd0f));
+	if (drawn) m_hiz.build(m_camera.get_constants().viewproj);
 
-		arp.draw();
+	if (drawn && m_count_overdraw) {
+		m_overdraw.count([&](ActiveRenderPass &arp, ShaderPermutations &shader, OverdrawPass pass) {
+			draw_depth_only(arp, shader, pass == OVERDRAWPASS_BASELINE ? m_unsorted : m_visible, [&](ActiveRenderPass &arp) {
+				m_camera.bind(arp);
+				m_draw_uniforms.bind_vertex(arp, 0);
+				OverdrawCounter::bind(arp, pass);
+			});
+		}, m_depth_prepass);
 	}
-	m_renderer.end_render_pass(std::move(arp));
+
+	m_renderer.end_frame();
 
 	//std::this_thread::sleep_for(std::chrono::milliseconds(15));
 }
 
+u32 AppImpl::push_draw(u32 renderable) {
+	if (m_draw_index_of[renderable] == U32_BAD) {
+		DrawData dd = { .world = m_renderables[renderable].transform->world };
+		m_draw_index_of[renderable] = m_draw_uniforms.push(dd);
+	}
+
+	return m_draw_index_of[renderable];
+}
+
+void AppImpl::draw_depth_only(ActiveRenderPass &arp, ShaderPermutations &shader_set, const std::vector<VisibleDraw> &draws,
+	const std::function<void(ActiveRenderPass &arp)> &bind_pass)
+{
+	RID bound_shader = U32_BAD;
+
+	for (const VisibleDraw &draw : draws) {
+		// Only alpha testing changes what depth looks like
+		u32 features = draw.material->features & SHADERFEATURE_ALPHA_TEST;
+
+		RID shader = shader_set.get(features);
+		if (*shader == U32_BAD) continue;
+
+		if (*shader != *bound_shader) {
+			arp.use_shader(shader);
+
+			if (*bound_shader == U32_BAD) {
+				bind_pass(arp);
+			}
+
+			bound_shader = shader;
+		}
+
+		draw.mesh->mesh->bind(arp);
+
+		// The generic variant stands in until the alpha tested one is ready, and has no texture to bind
+		if (features && shader_set.is_ready(features)) {
+			arp.bind_frag_samplers(0, {draw.material->sampler}, {draw.material->texture});
+		}
+
+		UniformArena::select(arp, DRAW_UNIFORM_SLOT, draw.uniforms);
+
+		arp.draw();
+	}
+}
+
 void AppImpl::process_sdl_event(SDL_Event &event) {
 	switch (event.type) {
 	case SDL_EVENT_WINDOW_RESIZED: {
 		m_renderer.resize_window((u32) event.window.data1, (u32) event.window.data2);
+		m_camera.set_projection(m_renderer.generate_perspective(deg_to_rad(90.0)), 0.01f, 4096.0f);
+		m_camera.set_viewport((float) event.window.data1, (float) event.window.data2);
+	} break;
+	case SDL_EVENT_MOUSE_BUTTON_DOWN: {
+		// Pick against the boxes of the last tick
+		const ViewConstants &view = m_camera.get_constants();
+		Ray ray = Ray::from_screen(view.viewproj, vec2(event.button.x, event.button.y), vec2(view.params.z, view.params.w));
+
+		u32 object;
+		float distance;
+		if (m_bvh.raycast(ray, INFINITY, &object, &distance)) {
+			std::cout << "Picked entity " << m_renderables[object].entity.index << " at distance " << distance << "\n";
+		}
+	} break;
+	case SDL_EVENT_KEY_DOWN: {
+		if (event.key.repeat) break;
+
+		if (event.key.key == SDLK_P) m_depth_prepass = !m_depth_prepass;
+		if (event.key.key == SDLK_O) m_sort_draws = !m_sort_draws;
+		if (event.key.key == SDLK_C) m_count_overdraw = !m_count_overdraw;
 	} break;
 	case SDL_EVENT_WINDOW_CLOSE_REQUESTED: {
 		if (event.window.windowID == SDL_GetWindowID(m_main_window)) {
@@ -111,21 +373,13 @@ void AppImpl::init() {
 		{ MESHATTRIBUTE_FLOAT3, "NORMAL"},
 	};
 
-	// Create shader
+	// Create shader. Resource counts are read from the compiled shaders
 	ShaderStageInfo vert_stage = {
-			.path = "shader0.vert.spv",
-			.num_samplers = 0,
-			.num_storage_textures = 0,
-			.num_storage_buffers = 0,
-			.num_uniform_buffers = 1,
+		.path = "shader0.vert",
 	};
 
 	ShaderStageInfo frag_stage = {
-		.path = "shader0.frag.spv",
-		.num_samplers = 1,
-		.num_storage_textures = 0,
-		.num_storage_buffers = 0,
-		.num_uniform_buffers = 0,
+		.path = "shader0.frag",
 	};
 
 	PipelineInfo pip_info = {
@@ -139,10 +393,54 @@ void AppImpl::init() {
 		},
 		.vert_attribs = m_mesh_attributes,
 		.inst_attribs = {},
+		.cull_mode = SDL_GPU_CULLMODE_NONE,
+		// Passes the depth the pre-pass laid down, if it ran
+		.depth_compare = SDL_GPU_COMPAREOP_LESS_OR_EQUAL,
+		.sample_count = m_renderer.set_window_sample_count(WINDOW_SAMPLES)
+	};
+
+	// Same pitch and targets, so it shares the window pass and the mesh buffers. Only positions are read, and the UVs
+	// by alpha tested variants
+	new (&m_prepass_shader) ShaderPermutations(m_renderer, m_shader_compiler, { .path = "depth_only.vert" }, { .path = "depth_only.frag" },
+		make_depth_prepass_info(pip_info), depth_only_pipeline);
+	m_prepass_shader.prewarm(SHADERFEATURE_ALPHA_TEST);
+
+	// Compiled from GLSL at runtime, so edits to the sources show up without restarting. Variants are built on first use
+	new (&m_shader0) ShaderPermutations(m_renderer, m_shader_compiler, vert_stage, frag_stage, std::move(pip_info));
+	m_shader0.prewarm(SHADERFEATURE_ALPHA_TEST);
+
+	// Shadows from the sun. The casters draw depth only, with the cascades' format and bias
+	new (&m_shadows) ShadowCascades(m_renderer, m_shader_compiler);
+
+	PipelineInfo shadow_info = {
+		.depth_test = true,
+		.stencil_test = false,
+		.targets = {},
+		.vert_attribs = m_mesh_attributes,
+		.inst_attribs = {},
 		.cull_mode = SDL_GPU_CULLMODE_NONE
 	};
+	m_shadows.caster_pipeline(shadow_info);
+
+	new (&m_shadow_shader) ShaderPermutations(m_renderer, m_shader_compiler, { .path = "depth_only.vert" }, { .path = "depth_only.frag" },
+		std::move(shadow_info), depth_only_pipeline);
+	m_shadow_shader.prewarm(SHADERFEATURE_ALPHA_TEST);
+
+	new (&m_hiz) HiZCuller(m_renderer, m_shader_compiler);
 
-	m_shader0 = m_renderer.add_shader(vert_stage, frag_stage, std::move(pip_info));
+	new (&m_lights) ClusteredLights(&m_renderer);
+
+	new (&m_overdraw) OverdrawCounter(m_renderer, m_shader_compiler, m_mesh_attributes);
+
+	m_camera = Camera::perspective(deg_to_rad(90.0), (float) window_w, (float) window_h);
+
+	// Place the objects. The scene computes their world matrices each tick
+	m_node0 = m_scene.create_node(U32_BAD, vec3(0.0f, 0.0f, -2.0f));
+	m_node1 = m_scene.create_node(U32_BAD, vec3(0.0f, -4.0f, -4.0f),
+		glm::angleAxis(deg_to_rad(-90.0), vec3(1.0, 0.0, 0.0)), vec3(10.0));
+
+	// Per-draw constants for the whole frame
+	new (&m_draw_uniforms) UniformArena(m_renderer, sizeof(DrawData));
 
 	// Load mesh
 	u32 mesh0dl;
@@ -158,9 +456,10 @@ void AppImpl::init() {
 	byte *t0db= read_whole_file("texture0.png", &td0bl);
 
 	std::vector<byte> t0dbv(t0db, t0db + td0bl);
+	std::vector<byte> t0pixels;
 	
 	unsigned int w, h;
-	lodepng::decode(m_texturedata0, w, h, t0dbv, LCT_RGBA, 8);
+	lodepng::decode(t0pixels, w, h, t0dbv, LCT_RGBA, 8);
 
 	SDL_GPUTextureCreateInfo t0ci = {
 		.type = SDL_GPU_TEXTURETYPE_2D,
@@ -172,15 +471,66 @@ void AppImpl::init() {
 		.num_levels = 0,
 	};
 
-	m_texture0 = m_renderer.create_texture(&t0ci);
+	new (&m_texture0) Texture(m_renderer, t0ci, std::move(t0pixels));
 
 	m_quality_sampler = m_renderer.create_sampler(true, false, 4.0f);
 	m_precise_sampler = m_renderer.create_sampler(false, true);
+
+	// The renderable objects. Their transforms follow the scene nodes placed above
+	m_entities.create(
+		Transform{ .node = m_node0 },
+		Bounds{ .local = m_mesh0.get_bounds() },
+		MeshRef{ .mesh = &m_mesh0 },
+		MaterialRef{ .shader = &m_shader0, .features = SHADERFEATURE_NONE, .texture = m_texture0.get_rid(), .sampler = m_quality_sampler },
+		ShadowCaster{ .is_static = false }
+	);
+
+	// Uses the generic variant until the alpha tested one is compiled. It gets no Occluder: what shows through its
+	// cut-outs is unknown, so no solid shape is sure to lie inside it
+	m_entities.create(
+		Transform{ .node = m_node1 },
+		Bounds{ .local = m_mesh1.get_bounds() },
+		MeshRef{ .mesh = &m_mesh1 },
+		MaterialRef{ .shader = &m_shader0, .features = SHADERFEATURE_ALPHA_TEST, .texture = m_texture0.get_rid(), .sampler = m_quality_sampler },
+		ShadowCaster{ .is_static = true }
+	);
+
+	// A field of small lights around the objects, a quarter of them spot lights shining down
+	std::default_random_engine rng(5489u);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	for (u32 i = 0; i < 1024; i++) {
+		vec3 position = vec3(unit(rng) * 24.0f - 12.0f, unit(rng) * 4.0f - 3.5f, unit(rng) * -20.0f);
+		vec3 color = vec3(unit(rng), unit(rng), unit(rng)) * 0.5f;
+
+		if (i % 4 == 0) {
+			mat4x4 world = glm::translate(glm::identity<mat4x4>(), position + vec3(0.0f, 2.0f, 0.0f));
+			world = glm::rotate(world, deg_to_rad(-90.0f), vec3(1.0f, 0.0f, 0.0f));
+
+			m_entities.create(
+				Transform{ .world = world },
+				Light{ .type = LIGHTTYPE_SPOT, .color = color * 4.0f, .range = 4.0f, .inner_angle = 0.3f, .outer_angle = 0.5f }
+			);
+		} else {
+			m_entities.create(
+				Transform{ .world = glm::translate(glm::identity<mat4x4>(), position) },
+				Light{ .type = LIGHTTYPE_POINT, .color = color, .range = 1.0f + unit(rng) * 2.0f }
+			);
+		}
+	}
 }
 
 void AppImpl::any_close() {
+	m_entities.clear();
+
 	m_mesh0.destroy();
 	m_mesh1.destroy();
+	m_texture0.destroy();
+	m_draw_uniforms.destroy();
+	m_hiz.destroy();
+	m_shadows.destroy();
+	m_lights.destroy();
+	m_overdraw.destroy();
 
 	m_renderer.clean_resources(RendererCleanupExclude::NONE);
 
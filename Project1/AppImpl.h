@@ -3,9 +3,49 @@
 #include "Application.h"
 #include "Renderer.h"
 #include "Mesh.h"
+#include "Texture.h"
+#include "ShaderCompiler.h"
+#include "ShaderPermutations.h"
+#include "UniformArena.h"
+#include "DrawCommandList.h"
+#include "Camera.h"
+#include "SceneGraph.h"
+#include "EntityWorld.h"
+#include "Components.h"
+#include "Bvh.h"
+#include "HiZCuller.h"
+#include "OcclusionRasterizer.h"
+#include "ShadowCascades.h"
+#include "ClusteredLights.h"
+#include "OverdrawCounter.h"
 
 #include <SDL3/SDL_gpu.h>
 
+// Matches DrawData in shader0.vert. View data is pushed separately by the Camera
+struct DrawData {
+	mat4x4 world;
+};
+
+// An entity that can be drawn. The pointers are into the EntityWorld's chunks and only valid until its layout changes
+struct Renderable {
+	Entity entity;
+	const Transform *transform;
+	const MeshRef *mesh;
+	const MaterialRef *material;
+	// nullptr if it casts no shadow
+	const ShadowCaster *caster;
+};
+
+// A Renderable that passed culling this frame
+struct VisibleDraw {
+	const MeshRef *mesh;
+	const MaterialRef *material;
+	u32 uniforms;
+
+	// View depth of the center of its bounds, to sort by
+	float depth;
+};
+
 class AppImpl : public Application {
 	SDL_Window *m_main_window;
 
@@ -15,7 +55,7 @@ class AppImpl : public Application {
 	Mesh m_mesh0;
 	Mesh m_mesh1;
 
-	RID m_texture0;
+	Texture m_texture0;
 	
 	RID m_quality_sampler;
 	RID m_precise_sampler;
@@ -24,16 +64,86 @@ class AppImpl : public Application {
 
 	AttributeList m_mesh_attributes;
 
-	RID m_shader0;
+	ShaderCompiler m_shader_compiler;
+
+	ShaderPermutations m_shader0;
+	ShaderPermutations m_shadow_shader;
+	// Position-only variants of m_shader0's pipeline, for the depth pre-pass
+	ShaderPermutations m_prepass_shader;
+
+	UniformArena m_draw_uniforms;
+
+	Camera m_camera;
+
+	SceneGraph m_scene;
+	u32 m_node0;
+	u32 m_node1;
+
+	EntityWorld m_entities;
+	// Gathered every tick, in query order. The BVH indexes into these
+	std::vector<Renderable> m_renderables;
+	std::vector<Aabb> m_renderable_bounds;
+
+	Bvh m_bvh;
+	u32 m_bvh_layout = U32_BAD;
+
+	// Removes what this frame's occluders hide, after frustum culling
+	OcclusionRasterizer m_occlusion;
+	u32 m_occlusion_culled = 0;
+
+	// Removes what the last frames' depth hides, after frustum culling
+	HiZCuller m_hiz;
+
+	std::vector<u32> m_visible_indices;
+	std::vector<VisibleDraw> m_visible;
+
+	// The main pass's variant of each visible draw
+	std::vector<RID> m_visible_shaders;
+	// The main pass's draws, recorded in chunks on the workers and replayed into the window pass in order
+	std::vector<DrawCommandList> m_draw_lists;
+
+	// Lay down depth before shading, so each pixel is only shaded once. Toggled with P
+	bool m_depth_prepass = true;
+	// Draw front to back, so nearer objects hide further ones from the depth test. Toggled with O
+	bool m_sort_draws = true;
+
+	// Counts what the two above save. Toggled with C
+	OverdrawCounter m_overdraw;
+	bool m_count_overdraw = false;
+	// m_visible before sorting, kept while counting
+	std::vector<VisibleDraw> m_unsorted;
+
+	ShadowCascades m_shadows;
+	// The casters of each cascade this frame, dynamic then static. Static ones are only gathered for cascades whose
+	// cache is redrawn
+	std::vector<VisibleDraw> m_shadow_draws[MAX_SHADOW_CASCADES][2];
+	std::vector<u32> m_caster_indices;
+
+	// Every Light entity, sorted into the camera's froxels each tick
+	ClusteredLights m_lights;
+
+	// The draw constants of each renderable, U32_BAD until something draws it this frame
+	std::vector<u32> m_draw_index_of;
 
 	u32 m_frame_num = 0;
 	u32 m_last_tick_ms = 0;
 	u32 m_this_tick_ms = 0;
 
-	std::vector<byte> m_texturedata0;
-
 	void any_close();
 
+	// Pushes a renderable's draw constants the first time it is drawn this frame, and returns their index
+	u32 push_draw(u32 renderable);
+
+	/// <summary>
+	/// Draws a list with one set of depth-only variants, eg. shadow casters or a depth pre-pass
+	/// </summary>
+	/// <param name="arp">- The pass to draw in</param>
+	/// <param name="shader">- Picks the variant of each draw. Only alpha testing is kept from their features</param>
+	/// <param name="draws">- What to draw</param>
+	/// <param name="bind_pass">- Pushes the per-pass data, eg. the view. Called once the first pipeline is bound</param>
+	void draw_depth_only(ActiveRenderPass &arp, ShaderPermutations &shader, const std::vector<VisibleDraw> &draws,
+		const std::function<void(ActiveRenderPass &arp)> &bind_pass);
+
 protected:
 	void process_tick() override;
 	void process_sdl_event(SDL_Event &event) override;
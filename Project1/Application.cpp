@@ -1,4 +1,5 @@
 #include "Application.h"
+#include "JobSystem.h"
 
 void Application::fail() {
 	m_state = SDL_APP_FAILURE;
@@ -9,14 +10,22 @@ void Application::_init() {
 
 	SDL_Init(SDL_INIT_EVENTS | SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
+	// Before init(), so loading can already use the workers
+	JobSystem::start();
+
 	init();
 }
 
 SDL_AppResult Application::_process() {
+	JobSystem::pump_main();
 	process_tick();
 	return m_state;
 }
 
+void Application::_quit() {
+	JobSystem::stop();
+}
+
 SDL_AppResult Application::_on_sdl_event(SDL_Event &event) {
 	process_sdl_event(event);
 	return m_state;
@@ -23,6 +23,8 @@ public:
 	inline virtual void _on_fail() {}
 	inline virtual void _on_success() {}
 	SDL_AppResult _process();
+	// Called after _on_fail() or _on_success(), once the app has let go of its resources
+	void _quit();
 	SDL_AppResult _on_sdl_event(SDL_Event &event);
 
 	void fail();
@@ -0,0 +1,94 @@
+#include "Bounds.h"
+
+Aabb Aabb::transformed(const mat4x4 &transform) const {
+	if (is_empty()) return *this;
+
+	// Arvo's method: each output axis is the translation plus the smallest/largest contribution of every input axis
+	Aabb result;
+	result.min = vec3(transform[3]);
+	result.max = vec3(transform[3]);
+
+	for (u32 i = 0; i < 3; i++) {
+		vec3 a = vec3(transform[i]) * min[i];
+		vec3 b = vec3(transform[i]) * max[i];
+
+		result.min += glm::min(a, b);
+		result.max += glm::max(a, b);
+	}
+
+	return result;
+}
+
+Frustum Frustum::from_matrix(const mat4x4 &viewproj) {
+	// Gribb & Hartmann, on the rows of the matrix
+	vec4 r0 = glm::row(viewproj, 0);
+	vec4 r1 = glm::row(viewproj, 1);
+	vec4 r2 = glm::row(viewproj, 2);
+	vec4 r3 = glm::row(viewproj, 3);
+
+	Frustum frustum;
+	frustum.planes[0] = r3 + r0;
+	frustum.planes[1] = r3 - r0;
+	frustum.planes[2] = r3 + r1;
+	frustum.planes[3] = r3 - r1;
+	frustum.planes[4] = r3 + r2;
+	frustum.planes[5] = r3 - r2;
+
+	for (vec4 &plane : frustum.planes) {
+		plane /= glm::length(vec3(plane));
+	}
+
+	return frustum;
+}
+
+bool Frustum::intersects(const Aabb &box) const {
+	vec3 center = box.center();
+	vec3 extent = box.extent();
+
+	for (const vec4 &plane : planes) {
+		// The box's furthest extent along the plane's normal
+		float radius = glm::dot(extent, glm::abs(vec3(plane)));
+		if (glm::dot(vec3(plane), center) + plane.w < -radius) return false;
+	}
+
+	return true;
+}
+
+bool Frustum::contains(const Aabb &box) const {
+	vec3 center = box.center();
+	vec3 extent = box.extent();
+
+	for (const vec4 &plane : planes) {
+		float radius = glm::dot(extent, glm::abs(vec3(plane)));
+		if (glm::dot(vec3(plane), center) + plane.w < radius) return false;
+	}
+
+	return true;
+}
+
+Ray Ray::from_screen(const mat4x4 &viewproj, vec2 pixel, vec2 viewport) {
+	vec2 ndc = vec2(pixel.x / viewport.x * 2.0f - 1.0f, 1.0f - pixel.y / viewport.y * 2.0f);
+
+	mat4x4 inverse = glm::inverse(viewproj);
+	vec4 near_point = inverse * vec4(ndc, -1.0f, 1.0f);
+	vec4 far_point = inverse * vec4(ndc, 1.0f, 1.0f);
+
+	vec3 origin = vec3(near_point) / near_point.w;
+	return Ray{ .origin = origin, .direction = glm::normalize(vec3(far_point) / far_point.w - origin) };
+}
+
+bool Ray::intersects(const Aabb &box, const vec3 &inv_direction, float max_t, float *o_t) const {
+	vec3 t0 = (box.min - origin) * inv_direction;
+	vec3 t1 = (box.max - origin) * inv_direction;
+
+	vec3 t_near = glm::min(t0, t1);
+	vec3 t_far = glm::max(t0, t1);
+
+	float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+	float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_t));
+
+	if (enter > exit) return false;
+
+	*o_t = enter;
+	return true;
+}
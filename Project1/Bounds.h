@@ -0,0 +1,74 @@
+#pragma once
+
+#include "common.h"
+
+// An axis-aligned bounding box. Empty boxes have min > max, so expanding one by a point gives that point
+struct Aabb {
+	vec3 min = vec3(INFINITY);
+	vec3 max = vec3(-INFINITY);
+
+	inline bool is_empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+	inline vec3 center() const { return (min + max) * 0.5f; }
+	inline vec3 extent() const { return (max - min) * 0.5f; }
+
+	// Half the surface area, which is all the SAH needs
+	inline float half_area() const {
+		vec3 d = max - min;
+		return is_empty() ? 0.0f : d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	inline void expand(const vec3 &point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	inline void expand(const Aabb &other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	inline bool contains(const Aabb &other) const {
+		return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::greaterThanEqual(max, other.max));
+	}
+
+	inline bool overlaps(const Aabb &other) const {
+		return glm::all(glm::lessThanEqual(min, other.max)) && glm::all(glm::greaterThanEqual(max, other.min));
+	}
+
+	// The box around this one after a transform. Exact for the box's corners, so it may grow under rotation
+	Aabb transformed(const mat4x4 &transform) const;
+};
+
+// Six inward-facing planes (xyz = normal, w = distance) of a view volume
+struct Frustum {
+	vec4 planes[6];
+
+	// Extracts the planes from a view-projection matrix with glm's default -1 to 1 depth range, like the Camera's
+	static Frustum from_matrix(const mat4x4 &viewproj);
+
+	// Conservative: may return true for boxes just outside a corner of the frustum
+	bool intersects(const Aabb &box) const;
+
+	// Whether the box is entirely inside, so nothing within it needs testing
+	bool contains(const Aabb &box) const;
+};
+
+struct Ray {
+	vec3 origin;
+	// Not required to be normalized; hit distances are in multiples of it
+	vec3 direction;
+
+	// Creates a ray from the camera through a point on the screen, in pixels from the top left
+	static Ray from_screen(const mat4x4 &viewproj, vec2 pixel, vec2 viewport);
+
+	/// <summary>
+	/// Slab test against a box
+	/// </summary>
+	/// <param name="box">- The box to test</param>
+	/// <param name="inv_direction">- 1 / direction, computed once per ray</param>
+	/// <param name="max_t">- Hits further than this are ignored</param>
+	/// <param name="o_t">- Set to the distance where the ray enters the box, or 0 if it starts inside</param>
+	/// <returns>Whether the ray hits the box before max_t</returns>
+	bool intersects(const Aabb &box, const vec3 &inv_direction, float max_t, float *o_t) const;
+};
@@ -0,0 +1,355 @@
+#include "Bvh.h"
+#include "JobSystem.h"
+
+#include <SDL3/SDL_timer.h>
+
+// Candidate split planes per axis. More bins find slightly better splits at the cost of slower builds
+static constexpr u32 BVH_BINS = 16;
+
+// Subtrees with more objects than this are built as separate jobs
+static constexpr u32 BVH_PARALLEL_THRESHOLD = 8192;
+
+void Bvh::build(const std::vector<Aabb> &bounds, u32 max_leaf_size) {
+	u32 count = bounds.size();
+
+	m_bounds = bounds;
+	m_objects.resize(count);
+	for (u32 i = 0; i < count; i++) m_objects[i] = i;
+
+	m_nodes.clear();
+	if (count == 0) return;
+
+	// Copies of the boxes and their centroids, kept in the same order as m_objects while partitioning, so every pass
+	// over a node reads memory in order. Empty boxes get a centroid too, so they can be partitioned like any other
+	BuildData data;
+	data.boxes = bounds;
+	data.centroids.resize(count);
+	data.max_leaf_size = std::max(max_leaf_size, 1u);
+
+	Aabb root_box;
+	for (u32 i = 0; i < count; i++) {
+		data.centroids[i] = bounds[i].is_empty() ? vec3(0.0f) : bounds[i].center();
+		root_box.expand(bounds[i]);
+	}
+
+	// A binary tree with n leaves has at most 2n - 1 nodes
+	m_nodes.resize(count * 2 - 1);
+	m_nodes[0] = BvhNode{ .bounds = root_box, .first = 0, .count = count };
+	m_node_count = 1;
+
+	build_node(0, data);
+
+	m_nodes.resize(m_node_count);
+}
+
+void Bvh::build_node(u32 node, BuildData &data) {
+	u32 first = m_nodes[node].first;
+	u32 count = m_nodes[node].count;
+
+	if (count <= data.max_leaf_size) return;
+
+	u32 *objects = m_objects.data() + first;
+	Aabb *boxes = data.boxes.data() + first;
+	vec3 *centroids = data.centroids.data() + first;
+
+	Aabb centroid_box;
+	for (u32 i = 0; i < count; i++) centroid_box.expand(centroids[i]);
+
+	vec3 size = centroid_box.max - centroid_box.min;
+	u32 axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+	u32 split = count / 2;
+	Aabb left_bounds, right_bounds;
+	bool bounds_known = false;
+
+	if (size[axis] > 0.0f) {
+		// Bin the centroids along the widest axis, then sweep the bins from both sides for the cheapest split
+		float scale = BVH_BINS / size[axis];
+		float origin = centroid_box.min[axis];
+		auto bin_of = [&](const vec3 &centroid) {
+			return std::min((u32) ((centroid[axis] - origin) * scale), BVH_BINS - 1);
+		};
+
+		Aabb bin_boxes[BVH_BINS];
+		u32 bin_counts[BVH_BINS] = {};
+		for (u32 i = 0; i < count; i++) {
+			u32 bin = bin_of(centroids[i]);
+			bin_boxes[bin].expand(boxes[i]);
+			bin_counts[bin]++;
+		}
+
+		Aabb right_boxes[BVH_BINS];
+		float right_costs[BVH_BINS];
+		Aabb right_box;
+		u32 right_count = 0;
+		for (u32 bin = BVH_BINS - 1; bin > 0; bin--) {
+			right_box.expand(bin_boxes[bin]);
+			right_count += bin_counts[bin];
+			right_boxes[bin] = right_box;
+			right_costs[bin] = right_box.half_area() * right_count;
+		}
+
+		float best_cost = INFINITY;
+		u32 best_bin = 0;
+		Aabb left_box;
+		u32 left_count = 0;
+		for (u32 bin = 1; bin < BVH_BINS; bin++) {
+			left_box.expand(bin_boxes[bin - 1]);
+			left_count += bin_counts[bin - 1];
+
+			float cost = left_box.half_area() * left_count + right_costs[bin];
+			if (left_count > 0 && left_count < count && cost < best_cost) {
+				best_cost = cost;
+				best_bin = bin;
+				left_bounds = left_box;
+			}
+		}
+
+		if (best_bin > 0) {
+			right_bounds = right_boxes[best_bin];
+			bounds_known = true;
+
+			// Hoare partition, swapping the three arrays together
+			u32 i = 0, j = count;
+			while (true) {
+				while (i < j && bin_of(centroids[i]) < best_bin) i++;
+				while (i < j && bin_of(centroids[j - 1]) >= best_bin) j--;
+				if (i >= j) break;
+
+				j--;
+				std::swap(objects[i], objects[j]);
+				std::swap(boxes[i], boxes[j]);
+				std::swap(centroids[i], centroids[j]);
+				i++;
+			}
+			split = i;
+		}
+	}
+
+	// Falls back to halving the list when every centroid is in the same place
+	if (!bounds_known) {
+		for (u32 i = 0; i < split; i++) left_bounds.expand(boxes[i]);
+		for (u32 i = split; i < count; i++) right_bounds.expand(boxes[i]);
+	}
+
+	u32 children = m_node_count.fetch_add(2);
+	m_nodes[children] = BvhNode{ .bounds = left_bounds, .first = first, .count = split };
+	m_nodes[children + 1] = BvhNode{ .bounds = right_bounds, .first = first + split, .count = count - split };
+
+	m_nodes[node].first = children;
+	m_nodes[node].count = 0;
+
+	if (count > BVH_PARALLEL_THRESHOLD) {
+		JobCounter counter;
+		JobSystem::run([&, children] { build_node(children, data); }, &counter);
+		build_node(children + 1, data);
+		JobSystem::wait(counter);
+	} else {
+		build_node(children, data);
+		build_node(children + 1, data);
+	}
+}
+
+void Bvh::refit(const std::vector<Aabb> &bounds) {
+	assert(bounds.size() == m_objects.size());
+
+	m_bounds = bounds;
+
+	// Children are always allocated after their parent, so walking backwards visits them first
+	for (u32 i = m_nodes.size(); i-- > 0;) {
+		BvhNode &node = m_nodes[i];
+
+		Aabb box;
+		if (node.is_leaf()) {
+			for (u32 j = node.first; j < node.first + node.count; j++) box.expand(bounds[m_objects[j]]);
+		} else {
+			box = m_nodes[node.first].bounds;
+			box.expand(m_nodes[node.first + 1].bounds);
+		}
+
+		node.bounds = box;
+	}
+}
+
+void Bvh::query_frustum(const Frustum &frustum, std::vector<u32> &o_visible) const {
+	if (m_nodes.empty()) return;
+
+	// Node index, with the top bit set once an ancestor was found entirely inside
+	const u32 INSIDE = 0x80000000u;
+
+	// The build doesn't bound the depth, so the stack grows as needed. It is kept per thread to skip reallocating
+	thread_local std::vector<u32> stack;
+	stack.assign(1, 0);
+
+	while (!stack.empty()) {
+		u32 entry = stack.back();
+		stack.pop_back();
+		const BvhNode &node = m_nodes[entry & ~INSIDE];
+		bool inside = entry & INSIDE;
+
+		if (!inside) {
+			if (node.bounds.is_empty() || !frustum.intersects(node.bounds)) continue;
+			if (frustum.contains(node.bounds)) inside = true;
+		}
+
+		if (node.is_leaf()) {
+			for (u32 i = node.first; i < node.first + node.count; i++) {
+				const Aabb &box = m_bounds[m_objects[i]];
+				if (box.is_empty() || (!inside && !frustum.intersects(box))) continue;
+
+				o_visible.push_back(m_objects[i]);
+			}
+			continue;
+		}
+
+		stack.push_back(node.first | (inside ? INSIDE : 0));
+		stack.push_back((node.first + 1) | (inside ? INSIDE : 0));
+	}
+}
+
+void Bvh::query_box(const Aabb &box, std::vector<u32> &o_objects) const {
+	if (m_nodes.empty() || box.is_empty()) return;
+
+	std::vector<u32> stack = { 0 };
+
+	while (!stack.empty()) {
+		const BvhNode &node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.bounds.is_empty() || !node.bounds.overlaps(box)) continue;
+
+		if (node.is_leaf()) {
+			for (u32 i = node.first; i < node.first + node.count; i++) {
+				const Aabb &object_box = m_bounds[m_objects[i]];
+				if (!object_box.is_empty() && object_box.overlaps(box)) o_objects.push_back(m_objects[i]);
+			}
+		} else {
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+		}
+	}
+}
+
+bool Bvh::raycast(const Ray &ray, float max_t, u32 *o_object, float *o_t) const {
+	if (m_nodes.empty()) return false;
+
+	vec3 inv_direction = 1.0f / ray.direction;
+
+	// Grows as needed, like query_frustum()'s
+	thread_local std::vector<u32> stack;
+	stack.assign(1, 0);
+
+	bool hit = false;
+	float t;
+
+	while (!stack.empty()) {
+		const BvhNode &node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.bounds.is_empty() || !ray.intersects(node.bounds, inv_direction, max_t, &t)) continue;
+
+		if (node.is_leaf()) {
+			for (u32 i = node.first; i < node.first + node.count; i++) {
+				const Aabb &box = m_bounds[m_objects[i]];
+
+				if (!box.is_empty() && ray.intersects(box, inv_direction, max_t, &t)) {
+					// Shrinking max_t culls everything behind the closest hit so far
+					max_t = t;
+					*o_object = m_objects[i];
+					*o_t = t;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the far one is more likely to be culled
+		float t_left, t_right;
+		bool left = ray.intersects(m_nodes[node.first].bounds, inv_direction, max_t, &t_left);
+		bool right = ray.intersects(m_nodes[node.first + 1].bounds, inv_direction, max_t, &t_right);
+
+		if (left && right) {
+			bool left_first = t_left <= t_right;
+			stack.push_back(left_first ? node.first + 1 : node.first);
+			stack.push_back(left_first ? node.first : node.first + 1);
+		} else if (left) {
+			stack.push_back(node.first);
+		} else if (right) {
+			stack.push_back(node.first + 1);
+		}
+	}
+
+	return hit;
+}
+
+void Bvh::benchmark(u32 count) {
+	// A city-sized field of boxes of mixed sizes
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+	std::uniform_real_distribution<float> height(0.0f, 50.0f);
+	std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+	std::vector<Aabb> bounds(count);
+	for (Aabb &box : bounds) {
+		vec3 center = vec3(position(rng), height(rng), position(rng));
+		box.min = center - vec3(size(rng));
+		box.max = center + vec3(size(rng));
+	}
+
+	auto elapsed_ms = [](u64 begin) { return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency(); };
+
+	Bvh bvh;
+
+	u64 begin = SDL_GetPerformanceCounter();
+	bvh.build(bounds);
+	double build_ms = elapsed_ms(begin);
+
+	for (Aabb &box : bounds) {
+		vec3 offset = vec3(size(rng) - 2.75f, 0.0f, size(rng) - 2.75f) * 0.1f;
+		box.min += offset;
+		box.max += offset;
+	}
+
+	begin = SDL_GetPerformanceCounter();
+	bvh.refit(bounds);
+	double refit_ms = elapsed_ms(begin);
+
+	// Cameras at head height looking across the field in different directions
+	const u32 VIEWS = 64;
+	mat4x4 proj = glm::perspectiveFov(deg_to_rad(90.0f), 16.0f, 9.0f, 0.1f, 500.0f);
+
+	std::vector<u32> visible;
+	u64 total_visible = 0;
+
+	begin = SDL_GetPerformanceCounter();
+	for (u32 i = 0; i < VIEWS; i++) {
+		float angle = i * glm::two_pi<float>() / VIEWS;
+		mat4x4 view = glm::lookAt(vec3(0.0f, 2.0f, 0.0f), vec3(cos(angle), 2.0f, sin(angle)), vec3(0.0f, 1.0f, 0.0f));
+
+		visible.clear();
+		bvh.query_frustum(Frustum::from_matrix(proj * view), visible);
+		total_visible += visible.size();
+	}
+	double frustum_ms = elapsed_ms(begin) / VIEWS;
+
+	const u32 RAYS = 100000;
+	u32 hits = 0;
+
+	begin = SDL_GetPerformanceCounter();
+	for (u32 i = 0; i < RAYS; i++) {
+		Ray ray = { .origin = vec3(position(rng), 100.0f, position(rng)) };
+		ray.direction = glm::normalize(vec3(position(rng), -1000.0f, position(rng)) * 0.1f);
+
+		u32 object;
+		float t;
+		if (bvh.raycast(ray, INFINITY, &object, &t)) hits++;
+	}
+	double ray_ms = elapsed_ms(begin);
+
+	std::cout << "BVH benchmark: " << count << " objects, " << bvh.get_node_count() << " nodes, "
+		<< JobSystem::get_worker_count() << " workers\n";
+	std::cout << "\tBuild: " << build_ms << "ms\n";
+	std::cout << "\tRefit: " << refit_ms << "ms\n";
+	std::cout << "\tFrustum query: " << frustum_ms << "ms (" << total_visible / VIEWS << " visible)\n";
+	std::cout << "\tRaycast: " << RAYS / ray_ms * 1000.0 << " rays/s (" << hits << " hits)\n";
+}
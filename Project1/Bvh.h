@@ -0,0 +1,91 @@
+#pragma once
+
+#include "common.h"
+#include "Bounds.h"
+
+#include <atomic>
+
+struct BvhNode {
+	Aabb bounds;
+
+	// Leaves: the range [first, first + count) of the BVH's object list. Interior nodes: count is 0, and the
+	// children are first and first + 1
+	u32 first;
+	u32 count;
+
+	inline bool is_leaf() const { return count > 0; }
+};
+
+/* Bvh
+ * A bounding volume hierarchy over object boxes, for culling and picking large scenes without testing every object.
+ * Objects are referred to by their index in the array given to build().
+ *
+ * build() splits nodes with a binned surface area heuristic, spreading large subtrees across the JobSystem's workers.
+ * Objects that move a little are handled by refit(), which keeps the tree's shape and only recomputes its boxes; the
+ * tree gets looser as objects move apart, so rebuild once in a while or when objects are added or removed.
+*/
+class Bvh {
+	std::vector<BvhNode> m_nodes;
+	std::vector<u32> m_objects;
+
+	// The boxes given to build() or refit(), tested at the leaves
+	std::vector<Aabb> m_bounds;
+
+	// Only used while building, to hand out child pairs from several workers
+	std::atomic<u32> m_node_count = 0;
+
+	// Scratch arrays for build(), permuted along with m_objects
+	struct BuildData {
+		std::vector<Aabb> boxes;
+		std::vector<vec3> centroids;
+		u32 max_leaf_size;
+	};
+
+	// Splits m_nodes[node], whose bounds are already set, until its leaves have at most max_leaf_size objects
+	void build_node(u32 node, BuildData &data);
+
+public:
+	Bvh() = default;
+
+	Bvh(const Bvh &) = delete;
+	Bvh &operator=(const Bvh &) = delete;
+
+	/// <summary>
+	/// Builds the tree from scratch
+	/// </summary>
+	/// <param name="bounds">- The box of every object. Empty boxes are kept but never found by queries</param>
+	/// <param name="max_leaf_size">- Nodes with at most this many objects aren't split</param>
+	void build(const std::vector<Aabb> &bounds, u32 max_leaf_size = 4);
+
+	// Recomputes every node's box from the objects' new boxes. bounds must have the size given to build()
+	void refit(const std::vector<Aabb> &bounds);
+
+	/// <summary>
+	/// Finds every object whose box intersects the frustum. Subtrees entirely inside it are added without testing
+	/// </summary>
+	/// <param name="frustum">- The view volume</param>
+	/// <param name="o_visible">- Receives the indices of the objects. Not cleared first</param>
+	void query_frustum(const Frustum &frustum, std::vector<u32> &o_visible) const;
+
+	// Finds every object whose box overlaps the given box. Not cleared first
+	void query_box(const Aabb &box, std::vector<u32> &o_objects) const;
+
+	/// <summary>
+	/// Finds the object whose box the ray enters first
+	/// </summary>
+	/// <param name="ray">- The ray to cast</param>
+	/// <param name="max_t">- Hits further than this are ignored</param>
+	/// <param name="o_object">- Set to the index of the hit object</param>
+	/// <param name="o_t">- Set to the hit distance</param>
+	/// <returns>Whether anything was hit</returns>
+	bool raycast(const Ray &ray, float max_t, u32 *o_object, float *o_t) const;
+
+	inline u32 get_node_count() const { return m_nodes.size(); }
+	inline u32 get_object_count() const { return m_objects.size(); }
+
+	/// <summary>
+	/// Times building, refitting and querying a BVH over a random scene and prints the results
+	/// </summary>
+	/// <param name="count">- The number of objects</param>
+	static void benchmark(u32 count = 1000000);
+};
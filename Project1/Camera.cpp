@@ -0,0 +1,63 @@
+#include "Camera.h"
+
+Camera Camera::perspective(float fov_rad, float width, float height, float near, float far) {
+	Camera camera;
+	camera.set_projection(glm::perspectiveFov(fov_rad, width, height, near, far), near, far);
+	camera.set_viewport(width, height);
+
+	return camera;
+}
+
+Camera Camera::orthographic(float half_width, float half_height, float near, float far) {
+	Camera camera;
+	camera.set_projection(glm::ortho(-half_width, half_width, -half_height, half_height, near, far), near, far);
+	camera.set_viewport(half_width * 2.0f, half_height * 2.0f);
+
+	return camera;
+}
+
+void Camera::set_transform(const mat4x4 &transform) {
+	m_transform = transform;
+	m_dirty = true;
+}
+
+void Camera::look_at(const vec3 &eye, const vec3 &target, const vec3 &up) {
+	set_transform(glm::inverse(glm::lookAt(eye, target, up)));
+}
+
+void Camera::set_projection(const mat4x4 &projection, float near, float far) {
+	m_projection = projection;
+	m_near = near;
+	m_far = far;
+	m_dirty = true;
+}
+
+void Camera::set_viewport(float width, float height) {
+	m_viewport = vec2(width, height);
+	m_dirty = true;
+}
+
+const ViewConstants &Camera::get_constants() const {
+	if (!m_dirty) return m_constants;
+
+	m_constants.view = glm::inverse(m_transform);
+	m_constants.proj = m_projection;
+	m_constants.viewproj = m_projection * m_constants.view;
+	m_constants.eye = vec4(vec3(m_transform[3]), 1.0f);
+	m_constants.params = vec4(m_near, m_far, m_viewport.x, m_viewport.y);
+
+	m_dirty = false;
+	return m_constants;
+}
+
+void Camera::bind(ActiveRenderPass &arp, u32 slot) const {
+	const ViewConstants &constants = get_constants();
+
+	if (arp.uses_vert_uniform(slot)) {
+		arp.upload_vertex_uniform_buffer(slot, &constants, sizeof(constants));
+	}
+
+	if (arp.uses_frag_uniform(slot)) {
+		arp.upload_fragment_uniform_buffer(slot, &constants, sizeof(constants));
+	}
+}
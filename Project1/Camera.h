@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include "ActiveRenderPass.h"
+
+// Uniform slots shared by every shader that uses a Camera. Per-view data sits in its own slot so it is pushed once
+// per pass, while per-object data is selected per draw
+inline constexpr u32 VIEW_UNIFORM_SLOT = 0;
+inline constexpr u32 DRAW_UNIFORM_SLOT = 1;
+
+// Matches ViewData in the shaders, laid out for std140
+struct ViewConstants {
+	mat4x4 view;
+	mat4x4 proj;
+	mat4x4 viewproj;
+
+	// xyz is the eye position in world space
+	vec4 eye;
+	// x = near plane, y = far plane, zw = viewport size in pixels
+	vec4 params;
+};
+
+/* Camera
+ * One view of the scene: the main camera, a shadow caster, a mirror... The view constants are only recomputed when
+ * the camera changes, and bind() pushes them once for every draw that follows in the pass.
+*/
+class Camera {
+	mat4x4 m_transform = glm::identity<mat4x4>();
+	mat4x4 m_projection = glm::identity<mat4x4>();
+
+	float m_near = 0.01f;
+	float m_far = 4096.0f;
+	vec2 m_viewport = vec2(1.0f);
+
+	mutable ViewConstants m_constants;
+	mutable bool m_dirty = true;
+
+public:
+	Camera() = default;
+
+	/// <summary>
+	/// Creates a camera with a perspective projection
+	/// </summary>
+	/// <param name="fov_rad">- The vertical field of view in radians</param>
+	/// <param name="width">- The width of the viewport</param>
+	/// <param name="height">- The height of the viewport</param>
+	/// <param name="near">- The distance to the near plane</param>
+	/// <param name="far">- The distance to the far plane</param>
+	static Camera perspective(float fov_rad, float width, float height, float near = 0.01f, float far = 4096.0f);
+
+	/// <summary>
+	/// Creates a camera with an orthographic projection centered on its view axis, eg. for a directional light
+	/// </summary>
+	/// <param name="half_width">- Half the width of the view volume</param>
+	/// <param name="half_height">- Half the height of the view volume</param>
+	/// <param name="near">- The distance to the near plane</param>
+	/// <param name="far">- The distance to the far plane</param>
+	static Camera orthographic(float half_width, float half_height, float near, float far);
+
+	// Sets the camera-to-world transform. The camera looks down its local -Z
+	void set_transform(const mat4x4 &transform);
+	void look_at(const vec3 &eye, const vec3 &target, const vec3 &up = vec3(0.0f, 1.0f, 0.0f));
+
+	void set_projection(const mat4x4 &projection, float near, float far);
+	void set_viewport(float width, float height);
+
+	inline const mat4x4 &get_transform() const { return m_transform; }
+	inline const mat4x4 &get_projection() const { return m_projection; }
+
+	// Recomputes the constants if the camera changed since the last call
+	const ViewConstants &get_constants() const;
+
+	/// <summary>
+	/// Pushes the view constants to whichever stages of the bound pipeline declare ViewData. Call after use_shader().
+	/// Stays bound for the rest of the pass unless another view is bound
+	/// </summary>
+	/// <param name="arp">- The pass to push to</param>
+	/// <param name="slot">- The uniform slot of ViewData</param>
+	void bind(ActiveRenderPass &arp, u32 slot = VIEW_UNIFORM_SLOT) const;
+};
@@ -0,0 +1,441 @@
+#include "ClusteredLights.h"
+#include "JobSystem.h"
+
+#include <bit>
+
+#include <SDL3/SDL_timer.h>
+
+// SSE2 is part of every x64 CPU, so unlike AVX2 it needs no runtime check
+#if defined(_M_X64) || defined(__x86_64__)
+#define CLUSTER_SSE 1
+#include <emmintrin.h>
+#else
+#define CLUSTER_SSE 0
+#endif
+
+ClusteredLights::ClusteredLights(Renderer *renderer, const ClusterSettings &settings):
+	m_renderer(renderer),
+	m_settings(settings),
+	m_use_simd(CLUSTER_SSE)
+{
+	m_rows.resize(CLUSTER_SLICES * CLUSTER_TILES_Y);
+	m_grid.assign(CLUSTER_COUNT * 2, 0);
+	m_constants = {};
+
+	if (!renderer) return;
+
+	// Room for a few hundred lights up front, the buffers grow in upload()
+	m_light_capacity = sizeof(GpuLight) * 256;
+	m_index_capacity = sizeof(u32) * 4096;
+
+	m_light_buffer = renderer->create_buffer(SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ, m_light_capacity);
+	m_grid_buffer = renderer->create_buffer(SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ, m_grid.size() * sizeof(u32));
+	m_index_buffer = renderer->create_buffer(SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ, m_index_capacity);
+}
+
+void ClusteredLights::destroy() {
+	if (!m_renderer) return;
+
+	m_renderer->destroy_buffer(m_light_buffer);
+	m_renderer->destroy_buffer(m_grid_buffer);
+	m_renderer->destroy_buffer(m_index_buffer);
+
+	m_renderer = nullptr;
+}
+
+void ClusteredLights::clear() {
+	m_lights.clear();
+	m_spheres.clear();
+}
+
+void ClusteredLights::add_point(const vec3 &position, float range, const vec3 &color) {
+	m_lights.push_back(GpuLight{
+		.position_range = vec4(position, range),
+		.color = vec4(color, 1.0f),
+		.direction_cone = vec4(0.0f, 0.0f, 0.0f, -1.0f),
+	});
+
+	m_spheres.push_back(vec4(position, range));
+}
+
+void ClusteredLights::add_spot(const vec3 &position, const vec3 &direction, float range, float inner_angle, float outer_angle,
+	const vec3 &color)
+{
+	float cos_outer = std::cos(outer_angle);
+	float cos_inner = std::max(std::cos(inner_angle), cos_outer);
+
+	m_lights.push_back(GpuLight{
+		.position_range = vec4(position, range),
+		.color = vec4(color, 1.0f / std::max(cos_inner - cos_outer, 1e-4f)),
+		.direction_cone = vec4(direction, cos_outer),
+	});
+
+	// The smallest sphere around the cone. Narrow cones are bounded through their tip and rim, wide ones by the
+	// circle of their rim
+	if (outer_angle > glm::quarter_pi<float>()) {
+		m_spheres.push_back(vec4(position + direction * range * cos_outer, range * std::sin(outer_angle)));
+	} else {
+		float radius = range / (2.0f * cos_outer);
+		m_spheres.push_back(vec4(position + direction * radius, radius));
+	}
+}
+
+u32 ClusteredLights::slice_of(float depth) const {
+	if (depth < m_constants.slicing.z) return 0;
+
+	// Non-negative from the first split on, so the conversion only truncates
+	u32 slice = (u32) (std::log(depth) * m_constants.slicing.x + m_constants.slicing.y) + 1;
+	return std::min(slice, CLUSTER_SLICES - 1);
+}
+
+void ClusteredLights::build_rows(const mat4x4 &projection, float near, float far) {
+	m_rows_projection = projection;
+	m_rows_near = near;
+	m_rows_far = far;
+
+	float split = std::clamp(m_settings.near_split, near, far * 0.5f);
+	float scale = (CLUSTER_SLICES - 1) / std::log(far / split);
+	m_constants.slicing = vec4(scale, -std::log(split) * scale, split, (float) CLUSTER_SLICES);
+
+	// View space directions through the tile corners, reaching depth 1. Row 0 is at the top of the screen
+	mat4x4 inverse = glm::inverse(projection);
+	vec3 corners[CLUSTER_TILES_Y + 1][CLUSTER_TILES_X + 1];
+
+	for (u32 y = 0; y <= CLUSTER_TILES_Y; y++) {
+		for (u32 x = 0; x <= CLUSTER_TILES_X; x++) {
+			vec2 ndc = vec2(x / (float) CLUSTER_TILES_X * 2.0f - 1.0f, 1.0f - y / (float) CLUSTER_TILES_Y * 2.0f);
+			vec4 point = inverse * vec4(ndc, 0.0f, 1.0f);
+			vec3 direction = vec3(point) / point.w;
+			corners[y][x] = direction / -direction.z;
+		}
+	}
+
+	for (u32 z = 0; z < CLUSTER_SLICES; z++) {
+		float slice_near = z == 0 ? near : split * std::exp((z - 1) / scale);
+		float slice_far = z == CLUSTER_SLICES - 1 ? far : split * std::exp(z / scale);
+
+		for (u32 y = 0; y < CLUSTER_TILES_Y; y++) {
+			ClusterRow &row = m_rows[z * CLUSTER_TILES_Y + y];
+
+			for (u32 x = 0; x < CLUSTER_TILES_X; x++) {
+				Aabb box;
+				for (u32 c = 0; c < 4; c++) {
+					const vec3 &corner = corners[y + c / 2][x + c % 2];
+					box.expand(corner * slice_near);
+					box.expand(corner * slice_far);
+				}
+
+				row.min_x[x] = box.min.x; row.max_x[x] = box.max.x;
+				row.min_y[x] = box.min.y; row.max_y[x] = box.max.y;
+				row.min_z[x] = box.min.z; row.max_z[x] = box.max.z;
+			}
+		}
+	}
+}
+
+u32 ClusteredLights::test_row(const ClusterRow &row, const LightBounds &light) const {
+	u32 mask = 0;
+	float radius_sq = light.radius * light.radius;
+
+	for (u32 x = light.x0; x <= light.x1; x++) {
+		// How far the sphere's center is outside the box along each axis, grouped like the SSE path
+		float dx = std::max(row.min_x[x] - light.center.x, 0.0f) + std::max(light.center.x - row.max_x[x], 0.0f);
+		float dy = std::max(row.min_y[x] - light.center.y, 0.0f) + std::max(light.center.y - row.max_y[x], 0.0f);
+		float dz = std::max(row.min_z[x] - light.center.z, 0.0f) + std::max(light.center.z - row.max_z[x], 0.0f);
+
+		if (dx * dx + dy * dy + dz * dz <= radius_sq) mask |= 1u << x;
+	}
+
+	return mask;
+}
+
+#if CLUSTER_SSE
+u32 ClusteredLights::test_row_simd(const ClusterRow &row, const LightBounds &light) const {
+	__m128 cx = _mm_set1_ps(light.center.x);
+	__m128 cy = _mm_set1_ps(light.center.y);
+	__m128 cz = _mm_set1_ps(light.center.z);
+	__m128 radius_sq = _mm_set1_ps(light.radius * light.radius);
+	__m128 zero = _mm_setzero_ps();
+
+	auto outside = [&](const float *min, const float *max, __m128 center) {
+		return _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min), center), zero), _mm_max_ps(_mm_sub_ps(center, _mm_loadu_ps(max)), zero));
+	};
+
+	u32 mask = 0;
+	for (u32 x = light.x0 & ~3u; x <= light.x1; x += 4) {
+		__m128 dx = outside(row.min_x + x, row.max_x + x, cx);
+		__m128 dy = outside(row.min_y + x, row.max_y + x, cy);
+		__m128 dz = outside(row.min_z + x, row.max_z + x, cz);
+
+		__m128 distance_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		mask |= (u32) _mm_movemask_ps(_mm_cmple_ps(distance_sq, radius_sq)) << x;
+	}
+
+	// Whole vectors were tested, keep only the tiles the light's range covers
+	u32 range = ((2u << light.x1) - 1) & ~((1u << light.x0) - 1);
+	return mask & range;
+}
+#else
+u32 ClusteredLights::test_row_simd(const ClusterRow &row, const LightBounds &light) const {
+	return test_row(row, light);
+}
+#endif
+
+void ClusteredLights::build_slice(u32 slice) {
+	std::vector<RowHit> &hits = m_slice_hits[slice];
+	std::vector<u32> &indices = m_slice_indices[slice];
+	hits.clear();
+
+	for (const LightBounds &light : m_bounds) {
+		if (slice < light.z0 || slice > light.z1) continue;
+
+		for (u32 y = light.y0; y <= light.y1; y++) {
+			const ClusterRow &row = m_rows[slice * CLUSTER_TILES_Y + y];
+
+			u32 mask = m_use_simd ? test_row_simd(row, light) : test_row(row, light);
+			if (mask) hits.push_back(RowHit{ .light = light.light, .row = y, .mask = mask });
+		}
+	}
+
+	// Count, then lay the froxels' lists out one after another and fill them in light order
+	u32 *grid = m_grid.data() + slice * CLUSTER_TILES_X * CLUSTER_TILES_Y * 2;
+	u32 counts[CLUSTER_TILES_X * CLUSTER_TILES_Y] = {};
+
+	for (const RowHit &hit : hits) {
+		for (u32 mask = hit.mask; mask; mask &= mask - 1) {
+			counts[hit.row * CLUSTER_TILES_X + std::countr_zero(mask)]++;
+		}
+	}
+
+	u32 total = 0;
+	for (u32 c = 0; c < CLUSTER_TILES_X * CLUSTER_TILES_Y; c++) {
+		grid[c * 2] = total;
+		grid[c * 2 + 1] = 0;
+		total += counts[c];
+	}
+
+	indices.resize(total);
+	for (const RowHit &hit : hits) {
+		for (u32 mask = hit.mask; mask; mask &= mask - 1) {
+			u32 c = hit.row * CLUSTER_TILES_X + std::countr_zero(mask);
+			indices[grid[c * 2] + grid[c * 2 + 1]++] = hit.light;
+		}
+	}
+}
+
+void ClusteredLights::build(const Camera &camera) {
+	const ViewConstants &view = camera.get_constants();
+
+	float near = view.params.x;
+	float far = std::min(view.params.y, m_settings.max_distance);
+
+	if (view.proj != m_rows_projection || near != m_rows_near || far != m_rows_far) {
+		build_rows(view.proj, near, far);
+	}
+
+	m_constants.tiles = vec4(CLUSTER_TILES_X / view.params.z, CLUSTER_TILES_Y / view.params.w, CLUSTER_TILES_X, CLUSTER_TILES_Y);
+
+	// Bring the lights into view space and find the froxels each may touch
+	m_bounds.clear();
+	for (u32 i = 0; i < m_spheres.size(); i++) {
+		vec3 center = vec3(view.view * vec4(vec3(m_spheres[i]), 1.0f));
+		float radius = m_spheres[i].w;
+
+		float depth = -center.z;
+		if (depth + radius <= near || depth - radius >= far) continue;
+
+		LightBounds light = {
+			.center = center, .radius = radius, .light = i,
+			.x0 = 0, .y0 = 0, .z0 = slice_of(std::max(depth - radius, near)),
+			.x1 = CLUSTER_TILES_X - 1, .y1 = CLUSTER_TILES_Y - 1, .z1 = slice_of(std::min(depth + radius, far)),
+		};
+
+		// Spheres reaching behind the near plane can cover any tile. Otherwise, the corners of their box bound them
+		if (depth - radius > near) {
+			vec2 ndc_min = vec2(INFINITY), ndc_max = vec2(-INFINITY);
+			for (u32 c = 0; c < 8; c++) {
+				vec3 corner = center + vec3(c & 1 ? radius : -radius, c & 2 ? radius : -radius, c & 4 ? radius : -radius);
+				vec4 clip = view.proj * vec4(corner, 1.0f);
+
+				vec2 ndc = vec2(clip) / clip.w;
+				ndc_min = glm::min(ndc_min, ndc);
+				ndc_max = glm::max(ndc_max, ndc);
+			}
+
+			if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f) continue;
+
+			auto tile = [](float t, u32 count) { return (u32) std::clamp(t * count, 0.0f, count - 1.0f); };
+			light.x0 = tile(ndc_min.x * 0.5f + 0.5f, CLUSTER_TILES_X);
+			light.x1 = tile(ndc_max.x * 0.5f + 0.5f, CLUSTER_TILES_X);
+			light.y0 = tile(0.5f - ndc_max.y * 0.5f, CLUSTER_TILES_Y);
+			light.y1 = tile(0.5f - ndc_min.y * 0.5f, CLUSTER_TILES_Y);
+		}
+
+		m_bounds.push_back(light);
+	}
+
+	// A job per slice, then join the slices' lists
+	parallel_for(CLUSTER_SLICES, [&](u32 slice) { build_slice(slice); });
+
+	m_indices.clear();
+	m_max_per_cluster = 0;
+
+	for (u32 slice = 0; slice < CLUSTER_SLICES; slice++) {
+		u32 base = m_indices.size();
+
+		u32 *grid = m_grid.data() + slice * CLUSTER_TILES_X * CLUSTER_TILES_Y * 2;
+		for (u32 c = 0; c < CLUSTER_TILES_X * CLUSTER_TILES_Y; c++) {
+			grid[c * 2] += base;
+			m_max_per_cluster = std::max(m_max_per_cluster, grid[c * 2 + 1]);
+		}
+
+		m_indices.insert(m_indices.end(), m_slice_indices[slice].begin(), m_slice_indices[slice].end());
+	}
+}
+
+void ClusteredLights::upload(ActiveCopyPass &acp) {
+	if (!m_renderer) return;
+
+	// Grow geometrically so a busy frame doesn't reallocate every frame after it
+	auto reserve = [&](RID buffer, u32 &capacity, u32 size) {
+		if (size <= capacity) return;
+
+		while (capacity < size) capacity *= 2;
+		m_renderer->resize_buffer(buffer, capacity);
+	};
+
+	u32 light_bytes = m_lights.size() * sizeof(GpuLight);
+	u32 index_bytes = m_indices.size() * sizeof(u32);
+
+	reserve(m_light_buffer, m_light_capacity, light_bytes);
+	reserve(m_index_buffer, m_index_capacity, index_bytes);
+
+	if (light_bytes) acp.upload_buffer((byte *) m_lights.data(), light_bytes, m_light_buffer);
+	if (index_bytes) acp.upload_buffer((byte *) m_indices.data(), index_bytes, m_index_buffer);
+	acp.upload_buffer((byte *) m_grid.data(), m_grid.size() * sizeof(u32), m_grid_buffer);
+}
+
+void ClusteredLights::bind(ActiveRenderPass &arp) const {
+	arp.bind_frag_storage_buffers(CLUSTER_STORAGE_SLOT, { m_light_buffer, m_grid_buffer, m_index_buffer });
+	arp.upload_fragment_uniform_buffer(CLUSTER_UNIFORM_SLOT, &m_constants, sizeof(m_constants));
+}
+
+void ClusteredLights::set_simd_enabled(bool enabled) {
+	m_use_simd = enabled && CLUSTER_SSE;
+}
+
+void ClusteredLights::benchmark(u32 max_lights) {
+	const u32 RUNS = 32;
+	const u32 SAMPLES_PER_LIGHT = 16;
+	const float AREA = 200.0f;
+
+	Camera camera = Camera::perspective(deg_to_rad(90.0f), 1920.0f, 1080.0f, 0.1f, 1000.0f);
+	camera.look_at(vec3(0.0f, 2.0f, 0.0f), vec3(0.0f, 2.0f, -1.0f));
+
+	// Small lights scattered over a street scene in front of the camera, like lamps, windows and effects
+	std::default_random_engine rng(5489u);
+	std::uniform_real_distribution<float> across(-AREA * 0.5f, AREA * 0.5f);
+	std::uniform_real_distribution<float> ahead(-AREA, 0.0f);
+	std::uniform_real_distribution<float> height(0.0f, 8.0f);
+	std::uniform_real_distribution<float> range(1.0f, 6.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	auto elapsed_ms = [](u64 begin) { return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency(); };
+
+	std::cout << "Cluster benchmark: " << CLUSTER_TILES_X << "x" << CLUSTER_TILES_Y << "x" << CLUSTER_SLICES << " froxels, "
+		<< JobSystem::get_worker_count() << " workers\n";
+
+	ClusteredLights lights(nullptr);
+
+	for (u32 count = 256; count <= max_lights; count *= 4) {
+		lights.clear();
+		for (u32 i = 0; i < count; i++) {
+			vec3 position = vec3(across(rng), height(rng), ahead(rng));
+			if (i % 4 == 0) {
+				lights.add_spot(position, vec3(0.0f, -1.0f, 0.0f), range(rng) * 2.0f, 0.4f, 0.6f, vec3(1.0f));
+			} else {
+				lights.add_point(position, range(rng), vec3(1.0f));
+			}
+		}
+
+		// The scalar build's lists, for the SSE build to be checked against
+		std::vector<u32> scalar_grid, scalar_indices;
+
+		for (bool simd : { false, true }) {
+			lights.set_simd_enabled(simd);
+			if (simd && !lights.is_simd_enabled()) {
+				std::cout << "\t\tSSE: not available in this build\n";
+				break;
+			}
+
+			u64 begin = SDL_GetPerformanceCounter();
+			for (u32 run = 0; run < RUNS; run++) {
+				lights.build(camera);
+			}
+			double ms = elapsed_ms(begin) / RUNS;
+
+			std::cout << "\t" << count << " lights, " << (simd ? "SSE" : "Scalar") << ": " << ms << "ms per build, "
+				<< lights.m_bounds.size() << " in view, " << lights.get_index_count() / (float) CLUSTER_COUNT
+				<< " per froxel (max " << lights.get_max_per_cluster() << ")\n";
+
+			if (!simd) {
+				scalar_grid = lights.m_grid;
+				scalar_indices = lights.m_indices;
+			}
+		}
+
+		// Both fill each froxel's list in light order, so they must match exactly
+		if (lights.is_simd_enabled()) {
+			u32 mismatched = 0;
+			for (u32 c = 0; c < CLUSTER_COUNT; c++) {
+				u32 length = scalar_grid[c * 2 + 1];
+				const u32 *expected = scalar_indices.data() + scalar_grid[c * 2];
+				const u32 *found = lights.m_indices.data() + lights.m_grid[c * 2];
+
+				if (lights.m_grid[c * 2 + 1] != length || !std::equal(expected, expected + length, found)) mismatched++;
+			}
+
+			if (mismatched) {
+				std::cout << "\t\tScalar and SSE disagree on " << mismatched << " froxels\n";
+			} else {
+				std::cout << "\t\tScalar and SSE match on every froxel\n";
+			}
+		}
+
+		// Every light must be in the list of each froxel its sphere reaches. Pick points inside each sphere, find
+		// their froxel the way shader0.frag does, and look for the light there
+		const ViewConstants &view = camera.get_constants();
+		float near = view.params.x;
+		float far = std::min(view.params.y, lights.m_settings.max_distance);
+
+		u32 samples = 0, missed = 0;
+		for (u32 i = 0; i < lights.m_spheres.size(); i++) {
+			const vec4 &sphere = lights.m_spheres[i];
+
+			for (u32 k = 0; k < SAMPLES_PER_LIGHT; k++) {
+				vec3 offset;
+				do {
+					offset = vec3(unit(rng), unit(rng), unit(rng));
+				} while (glm::dot(offset, offset) > 1.0f);
+
+				vec4 point = view.view * vec4(vec3(sphere) + offset * sphere.w, 1.0f);
+				float depth = -point.z;
+				if (depth <= near || depth >= far) continue;
+
+				vec4 clip = view.proj * point;
+				vec2 ndc = vec2(clip) / clip.w;
+				if (glm::abs(ndc.x) >= 1.0f || glm::abs(ndc.y) >= 1.0f) continue;
+
+				u32 x = (u32) ((ndc.x * 0.5f + 0.5f) * CLUSTER_TILES_X);
+				u32 y = (u32) ((0.5f - ndc.y * 0.5f) * CLUSTER_TILES_Y);
+				u32 c = (lights.slice_of(depth) * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+
+				const u32 *list = lights.m_indices.data() + lights.m_grid[c * 2];
+				samples++;
+				missed += std::find(list, list + lights.m_grid[c * 2 + 1], i) == list + lights.m_grid[c * 2 + 1];
+			}
+		}
+
+		std::cout << "\t\t" << missed << " of " << samples << " sample points in view are missing their light\n";
+	}
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "Bounds.h"
+
+// The view is split into this many tiles across, tiles down, and depth slices. 16 tiles across make a row of
+// clusters exactly four SSE vectors
+inline constexpr u32 CLUSTER_TILES_X = 16;
+inline constexpr u32 CLUSTER_TILES_Y = 9;
+inline constexpr u32 CLUSTER_SLICES = 24;
+inline constexpr u32 CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+
+// Fragment slots of the light data. ViewData and ShadowData take uniform slots 0 and 1. The storage buffers come
+// after the fragment shader's samplers, so the lights, grid and indices take storage slots 0 to 2
+inline constexpr u32 CLUSTER_UNIFORM_SLOT = 2;
+inline constexpr u32 CLUSTER_STORAGE_SLOT = 0;
+
+// Matches LightData in shader0.frag, laid out for std430
+struct GpuLight {
+	// xyz = world position, w = range
+	vec4 position_range;
+	// rgb = color times intensity, w = 1 / (cos inner angle - cos outer angle)
+	vec4 color;
+	// xyz = the way a spot light shines, w = cos outer angle. Point lights have a zero direction and -1, so their
+	// cone is everywhere
+	vec4 direction_cone;
+};
+
+// Matches ClusterData in shader0.frag, laid out for std140
+struct ClusterConstants {
+	// x = slice scale, y = slice bias, z = depth of the first split, w = slice count
+	vec4 slicing;
+	// xy = tiles per pixel, zw = tiles across and down
+	vec4 tiles;
+};
+
+struct ClusterSettings {
+	// Slice 0 covers everything nearer than this. The rest are split logarithmically from here, so a tiny near
+	// plane doesn't spend most slices on the first few centimeters
+	float near_split = 1.0f;
+	// Lights further than this are dropped
+	float max_distance = 200.0f;
+};
+
+/* ClusteredLights
+ * Many point and spot lights at a cost that depends on how many touch each pixel, not how many there are. The view
+ * is split into a grid of froxels (CLUSTER_TILES_X by CLUSTER_TILES_Y tiles, CLUSTER_SLICES slices in depth) and
+ * each froxel gets a list of the lights whose bounding sphere overlaps it. shader0.frag finds its froxel from the
+ * pixel position and view depth and only shades those lights.
+ *
+ * The lists are built on the CPU every frame: lights are brought into view space, then each slice is filled by a
+ * job on the JobSystem, testing a light's sphere against a row of froxel boxes four at a time with SSE where the CPU
+ * has it. The froxel boxes only change with the projection, so they are cached.
+ *
+ * Spot lights are culled by the sphere around their cone, which is tight for narrow cones and no worse than a point
+ * light for wide ones.
+*/
+class ClusteredLights {
+	// The view space boxes of one row of froxels, laid out for SIMD
+	struct ClusterRow {
+		float min_x[CLUSTER_TILES_X], max_x[CLUSTER_TILES_X];
+		float min_y[CLUSTER_TILES_X], max_y[CLUSTER_TILES_X];
+		float min_z[CLUSTER_TILES_X], max_z[CLUSTER_TILES_X];
+	};
+
+	// A light's view space sphere and the froxels it may touch
+	struct LightBounds {
+		vec3 center;
+		float radius;
+		// Index into m_lights
+		u32 light;
+		u32 x0, y0, z0, x1, y1, z1;
+	};
+
+	// Some froxels of a row touched by a light, one bit per tile
+	struct RowHit {
+		u32 light;
+		u32 row;
+		u32 mask;
+	};
+
+	Renderer *m_renderer = nullptr;
+	ClusterSettings m_settings;
+
+	std::vector<GpuLight> m_lights;
+	// The world space sphere around each light, xyz = center, w = radius
+	std::vector<vec4> m_spheres;
+	// The lights in view this frame
+	std::vector<LightBounds> m_bounds;
+
+	// Indexed by slice * CLUSTER_TILES_Y + row
+	std::vector<ClusterRow> m_rows;
+	mat4x4 m_rows_projection = mat4x4(0.0f);
+	float m_rows_near = 0.0f;
+	float m_rows_far = 0.0f;
+
+	// Built by each slice's job, then joined into m_indices
+	std::vector<RowHit> m_slice_hits[CLUSTER_SLICES];
+	std::vector<u32> m_slice_indices[CLUSTER_SLICES];
+
+	// Offset into m_indices and light count of each froxel
+	std::vector<u32> m_grid;
+	std::vector<u32> m_indices;
+
+	ClusterConstants m_constants;
+
+	RID m_light_buffer = U32_BAD;
+	RID m_grid_buffer = U32_BAD;
+	RID m_index_buffer = U32_BAD;
+	u32 m_light_capacity = 0;
+	u32 m_index_capacity = 0;
+
+	u32 m_max_per_cluster = 0;
+
+	bool m_use_simd;
+
+	// Recomputes the froxel boxes for a projection
+	void build_rows(const mat4x4 &projection, float near, float far);
+
+	// Which slice a view depth falls in, like shader0.frag does
+	u32 slice_of(float depth) const;
+
+	// Fills one slice's froxels and its part of the indices, with slice-local offsets
+	void build_slice(u32 slice);
+
+	// The tiles of a row whose box overlaps the sphere, among [x0, x1]
+	u32 test_row(const ClusterRow &row, const LightBounds &light) const;
+	u32 test_row_simd(const ClusterRow &row, const LightBounds &light) const;
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline ClusteredLights() {}
+
+	/// <summary>
+	/// Creates the storage buffers. They grow as needed
+	/// </summary>
+	/// <param name="renderer">- The Renderer to create the buffers on, or nullptr to only build the lists on the CPU</param>
+	/// <param name="settings">- (Optional) How the view is sliced</param>
+	ClusteredLights(Renderer *renderer, const ClusterSettings &settings = {});
+
+	ClusteredLights(const ClusteredLights &) = delete;
+	ClusteredLights &operator=(const ClusteredLights &) = delete;
+
+	inline ~ClusteredLights() { destroy(); }
+
+	void destroy();
+
+	// Forgets the lights of the last frame
+	void clear();
+
+	/// <summary>
+	/// Adds a light shining in every direction
+	/// </summary>
+	/// <param name="position">- Where the light is, in world space</param>
+	/// <param name="range">- How far it reaches. It fades smoothly to nothing there</param>
+	/// <param name="color">- Its color, times its intensity</param>
+	void add_point(const vec3 &position, float range, const vec3 &color);
+
+	/// <summary>
+	/// Adds a light shining in a cone
+	/// </summary>
+	/// <param name="position">- The tip of the cone, in world space</param>
+	/// <param name="direction">- The cone's axis. Must be normalized</param>
+	/// <param name="range">- How far it reaches along any direction</param>
+	/// <param name="inner_angle">- Where the cone starts to fade, in radians from the axis</param>
+	/// <param name="outer_angle">- Where the cone ends. Below 90 degrees</param>
+	/// <param name="color">- Its color, times its intensity</param>
+	void add_spot(const vec3 &position, const vec3 &direction, float range, float inner_angle, float outer_angle, const vec3 &color);
+
+	// Assigns the lights to the camera's froxels, across the JobSystem's workers
+	void build(const Camera &camera);
+
+	// Copies the lights and lists to the GPU, growing the buffers first if needed
+	void upload(ActiveCopyPass &acp);
+
+	// Binds the buffers and pushes the cluster constants for shader0.frag. Call after use_shader()
+	void bind(ActiveRenderPass &arp) const;
+
+	// Whether SSE is used. On by default on x64; turning it on elsewhere does nothing
+	void set_simd_enabled(bool enabled);
+	inline bool is_simd_enabled() const { return m_use_simd; }
+
+	inline const std::vector<GpuLight> &get_lights() const { return m_lights; }
+	inline u32 get_light_count() const { return m_lights.size(); }
+	inline u32 get_index_count() const { return m_indices.size(); }
+	inline u32 get_max_per_cluster() const { return m_max_per_cluster; }
+
+	// Offset into get_indices() and light count of a froxel
+	inline std::pair<u32, u32> get_cluster(u32 cluster) const { return { m_grid[cluster * 2], m_grid[cluster * 2 + 1] }; }
+	inline const std::vector<u32> &get_indices() const { return m_indices; }
+	inline const ClusterConstants &get_constants() const { return m_constants; }
+
+	/// <summary>
+	/// Times building the lists for growing numbers of lights, with and without SSE, and prints the results
+	/// </summary>
+	/// <param name="max_lights">- The largest number of lights to try</param>
+	static void benchmark(u32 max_lights = 16384);
+};
@@ -0,0 +1,18 @@
+#include "Components.h"
+#include "SceneGraph.h"
+
+void sync_transforms(EntityWorld &world, const SceneGraph &scene) {
+	world.each_chunk<Transform>([&](u32 count, const Entity *entities, Transform *transforms) {
+		for (u32 i = 0; i < count; i++) {
+			if (transforms[i].node != U32_BAD) transforms[i].world = scene.get_world(transforms[i].node);
+		}
+	});
+}
+
+void update_bounds(EntityWorld &world) {
+	world.each_chunk_parallel<Transform, Bounds>([](u32 count, const Entity *entities, Transform *transforms, Bounds *bounds) {
+		for (u32 i = 0; i < count; i++) {
+			bounds[i].world = bounds[i].local.transformed(transforms[i].world);
+		}
+	});
+}
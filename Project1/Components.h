@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.h"
+#include "Bounds.h"
+#include "EntityWorld.h"
+
+class Mesh;
+class ShaderPermutations;
+class SceneGraph;
+struct OccluderMesh;
+
+// Where an entity is. If node is set, world is copied from that SceneGraph node by sync_transforms()
+struct Transform {
+	mat4x4 world = glm::identity<mat4x4>();
+	u32 node = U32_BAD;
+};
+
+// What an entity draws. The Mesh must outlive the entity
+struct MeshRef {
+	Mesh *mesh;
+};
+
+// How an entity is drawn
+struct MaterialRef {
+	ShaderPermutations *shader;
+	// ShaderFeature flags of the variant to draw with
+	u32 features;
+
+	RID texture;
+	RID sampler;
+};
+
+// The entity's box in its own space and in the world, for culling. world is kept up to date by update_bounds()
+struct Bounds {
+	Aabb local;
+	Aabb world;
+};
+
+// Casts shadows. Static casters are cached by ShadowCascades and only redrawn when they or the light change, so set
+// is_static only for entities that rarely move
+struct ShadowCaster {
+	bool is_static;
+};
+
+enum LightType : u32 {
+	LIGHTTYPE_POINT,
+	LIGHTTYPE_SPOT,
+};
+
+// Lights what is around the entity, from its Transform's position. Spot lights shine down the Transform's -Z. Drawn
+// through ClusteredLights, so there can be thousands
+struct Light {
+	LightType type;
+	// Times the intensity
+	vec3 color;
+	float range;
+
+	// Spot lights only, in radians from the axis: where the cone starts to fade, and where it ends
+	float inner_angle = 0.0f;
+	float outer_angle = 0.0f;
+};
+
+// Hides what is behind the entity from the OcclusionRasterizer. The OccluderMesh must outlive the entity
+struct Occluder {
+	const OccluderMesh *mesh;
+};
+
+// Copies the world matrices of entities that follow a scene node. Call after SceneGraph::update()
+void sync_transforms(EntityWorld &world, const SceneGraph &scene);
+
+// Recomputes the world bounds of every entity with a Transform and Bounds, across the JobSystem's workers
+void update_bounds(EntityWorld &world);
@@ -0,0 +1,149 @@
+#include "DepthPyramid.h"
+
+// Below this many objects, culling isn't worth handing to other threads
+static constexpr u32 PARALLEL_CULL_THRESHOLD = 2048;
+
+bool project_box(const Aabb &box, const mat4x4 &viewproj, u32 width, u32 height, ProjectedBox *o_projected) {
+	if (box.is_empty()) return false;
+
+	vec2 ndc_min = vec2(INFINITY);
+	vec2 ndc_max = vec2(-INFINITY);
+	float nearest = INFINITY;
+
+	for (u32 i = 0; i < 8; i++) {
+		vec3 corner = vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+		vec4 clip = viewproj * vec4(corner, 1.0f);
+
+		// Behind or at the camera, the projection flips
+		if (clip.w <= 1e-5f) return false;
+
+		vec3 ndc = vec3(clip) / clip.w;
+		ndc_min = glm::min(ndc_min, vec2(ndc));
+		ndc_max = glm::max(ndc_max, vec2(ndc));
+		nearest = std::min(nearest, ndc.z);
+	}
+
+	// Crossing the near plane, or entirely off screen. The latter is the frustum culling's business
+	if (nearest <= 0.0f) return false;
+	if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f) return false;
+
+	// y is flipped so row 0 is the top of the screen
+	auto to_texel = [](float ndc, u32 size) {
+		return (u32) std::clamp((ndc * 0.5f + 0.5f) * size, 0.0f, (float) size - 1.0f);
+	};
+
+	o_projected->nearest = nearest;
+	o_projected->x0 = to_texel(ndc_min.x, width);
+	o_projected->x1 = to_texel(ndc_max.x, width);
+	o_projected->y0 = to_texel(-ndc_max.y, height);
+	o_projected->y1 = to_texel(-ndc_min.y, height);
+
+	return true;
+}
+
+u32 remove_occluded(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible,
+	const std::function<bool(const Aabb &)> &is_occluded)
+{
+	u32 count = io_visible.size();
+	std::vector<byte> occluded(count);
+
+	if (count < PARALLEL_CULL_THRESHOLD) {
+		for (u32 i = 0; i < count; i++) occluded[i] = is_occluded(bounds[io_visible[i]]);
+	} else {
+		u32 num_blocks = (count + 1023) / 1024;
+		parallel_for(num_blocks, [&](u32 block) {
+			u32 end = std::min(block * 1024 + 1024, count);
+			for (u32 i = block * 1024; i < end; i++) occluded[i] = is_occluded(bounds[io_visible[i]]);
+		});
+	}
+
+	u32 kept = 0;
+	for (u32 i = 0; i < count; i++) {
+		if (!occluded[i]) io_visible[kept++] = io_visible[i];
+	}
+	io_visible.resize(kept);
+
+	return count - kept;
+}
+
+void DepthPyramid::build(const float *depth, u32 width, u32 height, const mat4x4 &viewproj) {
+	m_viewproj = viewproj;
+
+	if (width == 0 || height == 0) {
+		m_levels.clear();
+		return;
+	}
+
+	// Keep the levels' memory between builds, the size rarely changes
+	u32 count = 1;
+	for (u32 w = width, h = height; w > 1 || h > 1; w = std::max(w / 2, 1u), h = std::max(h / 2, 1u)) count++;
+	m_levels.resize(count);
+
+	m_levels[0].width = width;
+	m_levels[0].height = height;
+	m_levels[0].depths.assign(depth, depth + width * height);
+
+	for (u32 l = 1; l < count; l++) {
+		const Level &src = m_levels[l - 1];
+		Level &dst = m_levels[l];
+
+		dst.width = std::max(src.width / 2, 1u);
+		dst.height = std::max(src.height / 2, 1u);
+		dst.depths.resize(dst.width * dst.height);
+
+		for (u32 y = 0; y < dst.height; y++) {
+			// The last row and column also take in the odd one out, so no source texel is skipped
+			u32 y0 = y * 2;
+			u32 y1 = y + 1 == dst.height ? src.height - 1 : std::min(y0 + 1, src.height - 1);
+
+			for (u32 x = 0; x < dst.width; x++) {
+				u32 x0 = x * 2;
+				u32 x1 = x + 1 == dst.width ? src.width - 1 : std::min(x0 + 1, src.width - 1);
+
+				float furthest = 0.0f;
+				for (u32 sy = y0; sy <= y1; sy++) {
+					for (u32 sx = x0; sx <= x1; sx++) {
+						furthest = std::max(furthest, src.depths[sy * src.width + sx]);
+					}
+				}
+
+				dst.depths[y * dst.width + x] = furthest;
+			}
+		}
+	}
+}
+
+void DepthPyramid::clear() {
+	m_levels.clear();
+}
+
+bool DepthPyramid::is_occluded(const Aabb &box) const {
+	if (m_levels.empty()) return false;
+
+	ProjectedBox p;
+	if (!project_box(box, m_viewproj, m_levels[0].width, m_levels[0].height, &p)) return false;
+
+	// Each level halves the indices exactly, since texel i of a level covers texels 2i and 2i + 1 of the one below
+	u32 level = 0;
+	while (level + 1 < m_levels.size() && ((p.x1 >> level) - (p.x0 >> level) > 1 || (p.y1 >> level) - (p.y0 >> level) > 1)) {
+		level++;
+	}
+
+	const Level &l = m_levels[level];
+	u32 lx0 = std::min(p.x0 >> level, l.width - 1), lx1 = std::min(p.x1 >> level, l.width - 1);
+	u32 ly0 = std::min(p.y0 >> level, l.height - 1), ly1 = std::min(p.y1 >> level, l.height - 1);
+
+	for (u32 y = ly0; y <= ly1; y++) {
+		for (u32 x = lx0; x <= lx1; x++) {
+			if (p.nearest <= l.depths[y * l.width + x]) return false;
+		}
+	}
+
+	return true;
+}
+
+u32 DepthPyramid::cull(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible) const {
+	if (m_levels.empty()) return 0;
+
+	return remove_occluded(bounds, io_visible, [this](const Aabb &box) { return is_occluded(box); });
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "common.h"
+#include "Bounds.h"
+
+// A box projected onto a depth buffer, for occlusion tests
+struct ProjectedBox {
+	// The depth of the box's nearest point
+	float nearest;
+	// The texels its projection touches, inclusive, with row 0 at the top of the screen
+	u32 x0, y0, x1, y1;
+};
+
+/// <summary>
+/// Projects a box onto a depth buffer holding clip.z / clip.w, like DepthPyramid and OcclusionRasterizer use
+/// </summary>
+/// <param name="box">- The box to project</param>
+/// <param name="viewproj">- The view-projection the depth buffer was rendered with</param>
+/// <param name="width">- The width of the depth buffer</param>
+/// <param name="height">- The height of the depth buffer</param>
+/// <param name="o_projected">- The box's nearest depth and texel rectangle</param>
+/// <returns>False if the box can't be occluded: it is empty, off screen or crosses the near plane</returns>
+bool project_box(const Aabb &box, const mat4x4 &viewproj, u32 width, u32 height, ProjectedBox *o_projected);
+
+/// <summary>
+/// Removes the occluded objects from a list, spreading large lists across the JobSystem's workers
+/// </summary>
+/// <param name="bounds">- The box of every object</param>
+/// <param name="io_visible">- Indices into bounds. Occluded ones are removed, keeping the order of the rest</param>
+/// <param name="is_occluded">- The test, called from any worker</param>
+/// <returns>The number of objects removed</returns>
+u32 remove_occluded(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible,
+	const std::function<bool(const Aabb &)> &is_occluded);
+
+/* DepthPyramid
+ * A CPU-side hierarchical Z buffer: a depth buffer and a chain of half-size levels, each texel holding the furthest
+ * depth of the texels it covers. A box is occluded if even its nearest point is behind the furthest depth of every
+ * texel its projection touches; picking the level where that is at most 2x2 texels keeps each test to a few reads.
+ *
+ * The depth buffer can come from anywhere (a GPU readback, a software rasterizer...) as long as it holds
+ * clip.z / clip.w with nearer being smaller, and row 0 is the top of the screen.
+*/
+class DepthPyramid {
+	struct Level {
+		u32 width;
+		u32 height;
+		std::vector<float> depths;
+	};
+
+	std::vector<Level> m_levels;
+
+	// The view-projection the depth was rendered with. Boxes are projected with it, not the current camera's
+	mat4x4 m_viewproj;
+
+public:
+	DepthPyramid() = default;
+
+	/// <summary>
+	/// Replaces the pyramid with one built from a depth buffer
+	/// </summary>
+	/// <param name="depth">- width * height depths, row by row</param>
+	/// <param name="width">- The width of the depth buffer</param>
+	/// <param name="height">- The height of the depth buffer</param>
+	/// <param name="viewproj">- The view-projection the depth buffer was rendered with</param>
+	void build(const float *depth, u32 width, u32 height, const mat4x4 &viewproj);
+
+	// Forgets the pyramid. Nothing is occluded until the next build()
+	void clear();
+
+	inline bool is_valid() const { return !m_levels.empty(); }
+
+	// Conservative: boxes that are off screen or cross the near plane are never occluded
+	bool is_occluded(const Aabb &box) const;
+
+	/// <summary>
+	/// Removes the occluded objects from a list, spreading large lists across the JobSystem's workers
+	/// </summary>
+	/// <param name="bounds">- The box of every object</param>
+	/// <param name="io_visible">- Indices into bounds. Occluded ones are removed, keeping the order of the rest</param>
+	/// <returns>The number of objects removed</returns>
+	u32 cull(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible) const;
+
+	inline u32 get_level_count() const { return m_levels.size(); }
+	inline const mat4x4 &get_viewproj() const { return m_viewproj; }
+};
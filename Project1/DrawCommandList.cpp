@@ -0,0 +1,177 @@
+#include "DrawCommandList.h"
+
+u32 DrawCommandList::push_payload(const void *data, u32 length) {
+	u32 offset = m_payload.size();
+	m_payload.resize(offset + length);
+	memcpy(m_payload.data() + offset, data, length);
+
+	return offset;
+}
+
+u32 DrawCommandList::push_rids(const std::vector<RID> &rids) {
+	u32 offset = m_payload.size();
+	m_payload.resize(offset + rids.size() * sizeof(RID));
+	memcpy(m_payload.data() + offset, rids.data(), rids.size() * sizeof(RID));
+
+	return offset;
+}
+
+void DrawCommandList::clear() {
+	m_commands.clear();
+	m_payload.clear();
+	m_draw_count = 0;
+}
+
+void DrawCommandList::use_shader(RID shader) {
+	m_commands.push_back(Command{ .type = DRAWCOMMAND_USE_SHADER, .args = { *shader } });
+}
+
+void DrawCommandList::bind_mesh(u32 vertex_count, RID vbuf1, RID vbuf2) {
+	m_commands.push_back(Command{ .type = DRAWCOMMAND_BIND_MESH, .args = { vertex_count, *vbuf1, *vbuf2 } });
+}
+
+void DrawCommandList::bind_mesh_indexed(u32 vertex_count, RID indices, RID vbuf1, RID vbuf2) {
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_BIND_MESH_INDEXED,
+		.args = { vertex_count, *indices, *vbuf1, *vbuf2 }
+	});
+}
+
+void DrawCommandList::bind_vert_samplers(u32 first_slot, const std::vector<RID> &samplers, const std::vector<RID> &textures) {
+	assert(samplers.size() == textures.size());
+
+	u32 offset = push_rids(samplers);
+	push_rids(textures);
+
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_VERT_SAMPLERS,
+		.args = { first_slot, (u32) samplers.size() },
+		.payload_offset = offset,
+		.payload_size = (u32) (samplers.size() * 2 * sizeof(RID))
+	});
+}
+
+void DrawCommandList::bind_frag_samplers(u32 first_slot, const std::vector<RID> &samplers, const std::vector<RID> &textures) {
+	assert(samplers.size() == textures.size());
+
+	u32 offset = push_rids(samplers);
+	push_rids(textures);
+
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_FRAG_SAMPLERS,
+		.args = { first_slot, (u32) samplers.size() },
+		.payload_offset = offset,
+		.payload_size = (u32) (samplers.size() * 2 * sizeof(RID))
+	});
+}
+
+void DrawCommandList::bind_vert_storage_buffers(u32 first_slot, const std::vector<RID> &buffers) {
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_VERT_STORAGE,
+		.args = { first_slot, (u32) buffers.size() },
+		.payload_offset = push_rids(buffers),
+		.payload_size = (u32) (buffers.size() * sizeof(RID))
+	});
+}
+
+void DrawCommandList::bind_frag_storage_buffers(u32 first_slot, const std::vector<RID> &buffers) {
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_FRAG_STORAGE,
+		.args = { first_slot, (u32) buffers.size() },
+		.payload_offset = push_rids(buffers),
+		.payload_size = (u32) (buffers.size() * sizeof(RID))
+	});
+}
+
+void DrawCommandList::upload_vertex_uniform_buffer(u32 slot, const void *data, u32 length) {
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_VERT_UNIFORM,
+		.args = { slot },
+		.payload_offset = push_payload(data, length),
+		.payload_size = length
+	});
+}
+
+void DrawCommandList::upload_fragment_uniform_buffer(u32 slot, const void *data, u32 length) {
+	m_commands.push_back(Command{
+		.type = DRAWCOMMAND_FRAG_UNIFORM,
+		.args = { slot },
+		.payload_offset = push_payload(data, length),
+		.payload_size = length
+	});
+}
+
+void DrawCommandList::draw(u32 num_instances) {
+	m_commands.push_back(Command{ .type = DRAWCOMMAND_DRAW, .args = { num_instances } });
+	m_draw_count++;
+}
+
+void DrawCommandList::replay(ActiveRenderPass &arp) const {
+	if (!arp.is_valid()) return;
+
+	// Uniform data of any length may come before the RIDs, so they are copied out rather than read in place
+	auto rids = [&](const Command &command, u32 first, u32 count) {
+		std::vector<RID> out(count, RID(U32_BAD));
+		memcpy(out.data(), m_payload.data() + command.payload_offset + first * sizeof(RID), count * sizeof(RID));
+		return out;
+	};
+
+	u32 bound_shader = U32_BAD;
+
+	for (const Command &command : m_commands) {
+		const u32 *args = command.args;
+
+		switch (command.type) {
+		case DRAWCOMMAND_USE_SHADER:
+			// Chunks sorted by material tend to repeat the same pipeline
+			if (args[0] == bound_shader) break;
+
+			arp.use_shader(args[0]);
+			bound_shader = args[0];
+			break;
+		case DRAWCOMMAND_BIND_MESH:
+			arp.bind_mesh(args[0], args[1], args[2]);
+			break;
+		case DRAWCOMMAND_BIND_MESH_INDEXED:
+			arp.bind_mesh_indexed(args[0], args[1], args[2], args[3]);
+			break;
+		case DRAWCOMMAND_VERT_SAMPLERS:
+			arp.bind_vert_samplers(args[0], rids(command, 0, args[1]), rids(command, args[1], args[1]));
+			break;
+		case DRAWCOMMAND_FRAG_SAMPLERS:
+			arp.bind_frag_samplers(args[0], rids(command, 0, args[1]), rids(command, args[1], args[1]));
+			break;
+		case DRAWCOMMAND_VERT_STORAGE:
+			arp.bind_vert_storage_buffers(args[0], rids(command, 0, args[1]));
+			break;
+		case DRAWCOMMAND_FRAG_STORAGE:
+			arp.bind_frag_storage_buffers(args[0], rids(command, 0, args[1]));
+			break;
+		case DRAWCOMMAND_VERT_UNIFORM:
+			arp.upload_vertex_uniform_buffer(args[0], m_payload.data() + command.payload_offset, command.payload_size);
+			break;
+		case DRAWCOMMAND_FRAG_UNIFORM:
+			arp.upload_fragment_uniform_buffer(args[0], m_payload.data() + command.payload_offset, command.payload_size);
+			break;
+		case DRAWCOMMAND_DRAW:
+			arp.draw(args[0]);
+			break;
+		}
+	}
+}
+
+void DrawCommandList::record_parallel(std::vector<DrawCommandList> &lists, u32 count, u32 chunk_size,
+	const std::function<void(DrawCommandList &list, u32 begin, u32 end)> &record) {
+	chunk_size = std::max(chunk_size, 1u);
+	u32 num_chunks = (count + chunk_size - 1) / chunk_size;
+
+	lists.resize(num_chunks);
+
+	parallel_for(num_chunks, [&](u32 chunk) {
+		DrawCommandList &list = lists[chunk];
+		list.clear();
+
+		u32 begin = chunk * chunk_size;
+		record(list, begin, std::min(begin + chunk_size, count));
+	});
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include "ActiveRenderPass.h"
+
+enum DrawCommandType : u32 {
+	DRAWCOMMAND_USE_SHADER,
+	DRAWCOMMAND_BIND_MESH,
+	DRAWCOMMAND_BIND_MESH_INDEXED,
+	DRAWCOMMAND_VERT_SAMPLERS,
+	DRAWCOMMAND_FRAG_SAMPLERS,
+	DRAWCOMMAND_VERT_STORAGE,
+	DRAWCOMMAND_FRAG_STORAGE,
+	DRAWCOMMAND_VERT_UNIFORM,
+	DRAWCOMMAND_FRAG_UNIFORM,
+	DRAWCOMMAND_DRAW,
+};
+
+/* DrawCommandList
+ * Records the calls of an ActiveRenderPass without touching SDL, so draws can be recorded on any thread and replayed
+ * into the pass on the thread that owns it. SDL only allows one render pass per target and command buffers can't be
+ * shared between threads, so splitting a pass across command buffers would cost a load/store of every target per
+ * chunk; replaying a compact list is far cheaper.
+ *
+ * Use record_parallel() to split a frame's draws into chunks recorded by worker threads.
+*/
+class DrawCommandList {
+	struct Command {
+		DrawCommandType type;
+
+		// Meaning depends on the type, see replay()
+		u32 args[4];
+
+		// Range of m_payload holding RIDs or uniform data
+		u32 payload_offset;
+		u32 payload_size;
+	};
+
+	std::vector<Command> m_commands;
+	std::vector<byte> m_payload;
+
+	u32 m_draw_count = 0;
+
+	u32 push_payload(const void *data, u32 length);
+	u32 push_rids(const std::vector<RID> &rids);
+
+public:
+	DrawCommandList() = default;
+
+	// Forgets every command, keeping the memory for the next frame
+	void clear();
+
+	// These match the ActiveRenderPass functions of the same name
+	void use_shader(RID shader);
+	void bind_mesh(u32 vertex_count, RID vbuf1, RID vbuf2 = U32_BAD);
+	void bind_mesh_indexed(u32 vertex_count, RID indices, RID vbuf1, RID vbuf2 = U32_BAD);
+	void bind_vert_samplers(u32 first_slot, const std::vector<RID> &samplers, const std::vector<RID> &textures);
+	void bind_frag_samplers(u32 first_slot, const std::vector<RID> &samplers, const std::vector<RID> &textures);
+	void bind_vert_storage_buffers(u32 first_slot, const std::vector<RID> &buffers);
+	void bind_frag_storage_buffers(u32 first_slot, const std::vector<RID> &buffers);
+	void upload_vertex_uniform_buffer(u32 slot, const void *data, u32 length);
+	void upload_fragment_uniform_buffer(u32 slot, const void *data, u32 length);
+	void draw(u32 num_instances = 1);
+
+	// Issues every recorded command to the pass, skipping pipeline binds that wouldn't change anything
+	void replay(ActiveRenderPass &arp) const;
+
+	inline u32 get_command_count() const { return m_commands.size(); }
+	inline u32 get_draw_count() const { return m_draw_count; }
+
+	/// <summary>
+	/// Splits count items into chunks and records each chunk into its own list on a worker thread
+	/// </summary>
+	/// <param name="lists">- Receives one list per chunk. Existing lists are cleared and reused</param>
+	/// <param name="count">- The number of items to record</param>
+	/// <param name="chunk_size">- The number of items per chunk. Large enough to amortize the scheduling</param>
+	/// <param name="record">- Records items [begin, end) into list. Must not call SDL</param>
+	static void record_parallel(std::vector<DrawCommandList> &lists, u32 count, u32 chunk_size,
+		const std::function<void(DrawCommandList &list, u32 begin, u32 end)> &record);
+};
@@ -0,0 +1,158 @@
+#include "EntityWorld.h"
+
+u32 EntityWorld::find_archetype(u64 mask) {
+	auto found = m_archetype_of_mask.find(mask);
+	if (found != m_archetype_of_mask.end()) return found->second;
+
+	Archetype archetype;
+	archetype.mask = mask;
+	std::fill(std::begin(archetype.columns), std::end(archetype.columns), U32_BAD);
+
+	u32 row_size = sizeof(Entity);
+	for (u32 id = 0; id < MAX_COMPONENT_TYPES; id++) {
+		if (!(mask & (1ull << id))) continue;
+
+		archetype.columns[id] = archetype.components.size();
+		archetype.components.push_back(id);
+		row_size += component_infos[id].size;
+	}
+
+	// Start from the capacity ignoring padding, and shrink until every array fits once aligned
+	u32 capacity = sizeof(Chunk::data) / row_size;
+	while (true) {
+		archetype.offsets.clear();
+
+		u32 offset = capacity * sizeof(Entity);
+		for (u32 id : archetype.components) {
+			const ComponentInfo &info = component_infos[id];
+
+			offset = (offset + info.alignment - 1) / info.alignment * info.alignment;
+			archetype.offsets.push_back(offset);
+			offset += capacity * info.size;
+		}
+
+		if (offset <= sizeof(Chunk::data)) break;
+		capacity--;
+	}
+
+	archetype.capacity = capacity;
+
+	u32 index = m_archetypes.size();
+	m_archetypes.push_back(std::move(archetype));
+	m_archetype_of_mask[mask] = index;
+
+	return index;
+}
+
+u32 EntityWorld::allocate_row(u32 archetype_index, Entity entity) {
+	Archetype &archetype = m_archetypes[archetype_index];
+	m_layout_version++;
+
+	u32 row = archetype.entity_count++;
+	if (row / archetype.capacity >= archetype.chunks.size()) {
+		Chunk *chunk = new Chunk;
+		chunk->count = 0;
+		archetype.chunks.push_back(chunk);
+	}
+
+	Chunk *chunk = chunk_of(archetype, row);
+	((Entity *) chunk->data)[chunk->count++] = entity;
+
+	EntityRecord &record = m_records[entity.index];
+	record.archetype = archetype_index;
+	record.row = row;
+
+	return row;
+}
+
+void EntityWorld::free_row(u32 archetype_index, u32 row) {
+	Archetype &archetype = m_archetypes[archetype_index];
+	m_layout_version++;
+
+	u32 last = --archetype.entity_count;
+	Chunk *last_chunk = archetype.chunks.back();
+
+	if (row != last) {
+		Chunk *chunk = chunk_of(archetype, row);
+
+		Entity moved = ((Entity *) last_chunk->data)[last % archetype.capacity];
+		((Entity *) chunk->data)[row % archetype.capacity] = moved;
+
+		for (u32 column = 0; column < archetype.components.size(); column++) {
+			memcpy(component_at(archetype, row, column), component_at(archetype, last, column),
+				component_infos[archetype.components[column]].size);
+		}
+
+		m_records[moved.index].row = row;
+	}
+
+	if (--last_chunk->count == 0) {
+		delete last_chunk;
+		archetype.chunks.pop_back();
+	}
+}
+
+void EntityWorld::move_entity(Entity entity, u64 mask) {
+	EntityRecord record = m_records[entity.index];
+
+	u32 target = find_archetype(mask);
+	u32 row = allocate_row(target, entity);
+
+	// find_archetype() may have grown m_archetypes, so only take references now
+	Archetype &from = m_archetypes[record.archetype];
+	Archetype &to = m_archetypes[target];
+
+	for (u32 column = 0; column < from.components.size(); column++) {
+		u32 id = from.components[column];
+		if (to.columns[id] == U32_BAD) continue;
+
+		memcpy(component_at(to, row, to.columns[id]), component_at(from, record.row, column), component_infos[id].size);
+	}
+
+	free_row(record.archetype, record.row);
+}
+
+void *EntityWorld::get_component(Entity entity, u32 component) {
+	if (!is_alive(entity)) return nullptr;
+
+	const EntityRecord &record = m_records[entity.index];
+	const Archetype &archetype = m_archetypes[record.archetype];
+
+	u32 column = archetype.columns[component];
+	if (column == U32_BAD) return nullptr;
+
+	return component_at(archetype, record.row, column);
+}
+
+void EntityWorld::clear() {
+	for (Archetype &archetype : m_archetypes) {
+		for (Chunk *chunk : archetype.chunks) {
+			delete chunk;
+		}
+	}
+
+	m_archetypes.clear();
+	m_archetype_of_mask.clear();
+	m_records.clear();
+	m_free_indices.clear();
+	m_layout_version++;
+}
+
+bool EntityWorld::is_alive(Entity entity) const {
+	return entity.index < m_records.size()
+		&& m_records[entity.index].generation == entity.generation
+		&& m_records[entity.index].archetype != U32_BAD;
+}
+
+void EntityWorld::destroy(Entity entity) {
+	if (!is_alive(entity)) return;
+
+	EntityRecord &record = m_records[entity.index];
+	free_row(record.archetype, record.row);
+
+	record.generation++;
+	record.archetype = U32_BAD;
+	record.row = U32_BAD;
+
+	m_free_indices.push_back(entity.index);
+}
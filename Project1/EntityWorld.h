@@ -0,0 +1,245 @@
+#pragma once
+
+#include "common.h"
+
+#include <type_traits>
+#include <typeinfo>
+
+// 16 KiB per chunk, header included. Small enough that a chunk's columns stay in L1/L2 while a query walks them
+inline constexpr u32 ENTITY_CHUNK_SIZE = 16384;
+
+// Component types are tracked in a 64-bit mask
+inline constexpr u32 MAX_COMPONENT_TYPES = 64;
+
+struct Entity {
+	u32 index = U32_BAD;
+	// Bumped every time the index is reused, so stale handles are detected
+	u32 generation = 0;
+
+	inline bool operator==(const Entity &other) const { return index == other.index && generation == other.generation; }
+};
+
+struct ComponentInfo {
+	u32 size;
+	u32 alignment;
+	const char *name;
+};
+
+// Every component type used so far, indexed by component id
+inline std::vector<ComponentInfo> component_infos;
+
+/// <summary>
+/// Returns the id of a component type, registering it on first use. Components are moved with memcpy, so they must
+/// be trivially copyable: store RIDs and pointers, not owning objects
+/// </summary>
+template<class T> u32 component_id() {
+	static_assert(std::is_trivially_copyable_v<T>, "Components must be trivially copyable");
+
+	static const u32 id = [] {
+		component_infos.push_back(ComponentInfo{ .size = sizeof(T), .alignment = alignof(T), .name = typeid(T).name() });
+		assert(component_infos.size() <= MAX_COMPONENT_TYPES);
+		return (u32) component_infos.size() - 1;
+	}();
+
+	return id;
+}
+
+template<class... Ts> u64 component_mask() {
+	return (0ull | ... | (1ull << component_id<Ts>()));
+}
+
+/* EntityWorld
+ * Stores entities by archetype: every entity with exactly the same set of components lives in the same archetype,
+ * whose components are packed one array per type into 16 KiB chunks. A query visits every archetype that has the
+ * components it asks for and hands over whole arrays, so iterating touches nothing but the data it uses.
+ *
+ * Adding or removing a component moves the entity to another archetype, which copies all of its components; prefer
+ * creating entities with everything they'll need. Removing an entity moves the last one of its archetype into the
+ * hole, keeping chunks packed.
+ *
+ * Pointers returned by get() and handed to queries are invalidated by any create, destroy, add or remove.
+*/
+class EntityWorld {
+	struct Chunk {
+		u32 count;
+		alignas(64) byte data[ENTITY_CHUNK_SIZE - 64];
+	};
+
+	struct Archetype {
+		u64 mask;
+
+		// Sorted component ids, and for each, the offset of its array in a chunk
+		std::vector<u32> components;
+		std::vector<u32> offsets;
+
+		// Component id -> index into components, U32_BAD if it doesn't have it
+		u32 columns[MAX_COMPONENT_TYPES];
+
+		// The Entity array comes first in every chunk
+		u32 capacity;
+
+		std::vector<Chunk *> chunks;
+		u32 entity_count = 0;
+	};
+
+	struct EntityRecord {
+		u32 generation = 0;
+		u32 archetype = U32_BAD;
+		u32 row = U32_BAD;
+	};
+
+	std::vector<Archetype> m_archetypes;
+	Map<u64, u32> m_archetype_of_mask;
+
+	std::vector<EntityRecord> m_records;
+	std::vector<u32> m_free_indices;
+
+	u32 m_layout_version = 0;
+
+	u32 find_archetype(u64 mask);
+
+	// Reserves a row at the end of the archetype for the entity. Its components are uninitialized
+	u32 allocate_row(u32 archetype, Entity entity);
+
+	// Fills the hole at row with the archetype's last entity
+	void free_row(u32 archetype, u32 row);
+
+	// Moves an entity to the archetype with the given mask, keeping the components both have
+	void move_entity(Entity entity, u64 mask);
+
+	inline Chunk *chunk_of(const Archetype &archetype, u32 row) const { return archetype.chunks[row / archetype.capacity]; }
+
+	inline byte *component_at(const Archetype &archetype, u32 row, u32 column) const {
+		return chunk_of(archetype, row)->data + archetype.offsets[column] +
+			(row % archetype.capacity) * component_infos[archetype.components[column]].size;
+	}
+
+	void *get_component(Entity entity, u32 component);
+
+public:
+	EntityWorld() = default;
+
+	EntityWorld(const EntityWorld &) = delete;
+	EntityWorld &operator=(const EntityWorld &) = delete;
+
+	inline ~EntityWorld() { clear(); }
+
+	// Destroys every entity and frees every chunk
+	void clear();
+
+	bool is_alive(Entity entity) const;
+
+	// Creates an entity with the given components
+	template<class... Ts> Entity create(const Ts &...components) {
+		u64 mask = component_mask<Ts...>();
+
+		Entity entity;
+		if (!m_free_indices.empty()) {
+			entity.index = m_free_indices.back();
+			m_free_indices.pop_back();
+		} else {
+			entity.index = m_records.size();
+			m_records.emplace_back();
+		}
+		entity.generation = m_records[entity.index].generation;
+
+		u32 archetype = find_archetype(mask);
+		u32 row = allocate_row(archetype, entity);
+
+		(memcpy(component_at(m_archetypes[archetype], row, m_archetypes[archetype].columns[component_id<Ts>()]),
+			&components, sizeof(Ts)), ...);
+
+		return entity;
+	}
+
+	void destroy(Entity entity);
+
+	// Adds or replaces a component
+	template<class T> void add(Entity entity, const T &component) {
+		if (!is_alive(entity)) return;
+
+		u64 bit = 1ull << component_id<T>();
+		const EntityRecord &record = m_records[entity.index];
+
+		if (!(m_archetypes[record.archetype].mask & bit)) {
+			move_entity(entity, m_archetypes[record.archetype].mask | bit);
+		}
+
+		*get<T>(entity) = component;
+	}
+
+	template<class T> void remove(Entity entity) {
+		if (!is_alive(entity)) return;
+
+		u64 bit = 1ull << component_id<T>();
+		const EntityRecord &record = m_records[entity.index];
+
+		if (m_archetypes[record.archetype].mask & bit) {
+			move_entity(entity, m_archetypes[record.archetype].mask & ~bit);
+		}
+	}
+
+	// Returns nullptr if the entity is dead or doesn't have the component
+	template<class T> T *get(Entity entity) { return (T *) get_component(entity, component_id<T>()); }
+
+	template<class T> bool has(Entity entity) { return get<T>(entity) != nullptr; }
+
+	/// <summary>
+	/// Calls func(count, entities, components...) once per chunk holding every requested component. The arrays are
+	/// count long and indexed together
+	/// </summary>
+	template<class... Ts, class F> void each_chunk(F &&func) {
+		u64 mask = component_mask<Ts...>();
+
+		for (Archetype &archetype : m_archetypes) {
+			if ((archetype.mask & mask) != mask || archetype.entity_count == 0) continue;
+
+			for (Chunk *chunk : archetype.chunks) {
+				func(chunk->count, (const Entity *) chunk->data,
+					(Ts *) (chunk->data + archetype.offsets[archetype.columns[component_id<Ts>()]])...);
+			}
+		}
+	}
+
+	// Like each_chunk(), but chunks are spread across the JobSystem's workers. func must not touch the world's layout
+	template<class... Ts, class F> void each_chunk_parallel(F &&func) {
+		u64 mask = component_mask<Ts...>();
+
+		// Gather the chunks first, so they can be split evenly whatever archetype they come from
+		std::vector<std::pair<Archetype *, Chunk *>> chunks;
+		for (Archetype &archetype : m_archetypes) {
+			if ((archetype.mask & mask) != mask) continue;
+
+			for (Chunk *chunk : archetype.chunks) chunks.emplace_back(&archetype, chunk);
+		}
+
+		parallel_for(chunks.size(), [&](u32 i) {
+			auto [archetype, chunk] = chunks[i];
+			func(chunk->count, (const Entity *) chunk->data,
+				(Ts *) (chunk->data + archetype->offsets[archetype->columns[component_id<Ts>()]])...);
+		});
+	}
+
+	// Calls func(entity, components &...) for every entity holding every requested component
+	template<class... Ts, class F> void each(F &&func) {
+		each_chunk<Ts...>([&](u32 count, const Entity *entities, Ts *...components) {
+			for (u32 i = 0; i < count; i++) func(entities[i], components[i]...);
+		});
+	}
+
+	// The number of entities holding every requested component
+	template<class... Ts> u32 count() {
+		u64 mask = component_mask<Ts...>();
+
+		u32 total = 0;
+		for (const Archetype &archetype : m_archetypes) {
+			if ((archetype.mask & mask) == mask) total += archetype.entity_count;
+		}
+		return total;
+	}
+
+	inline u32 get_archetype_count() const { return m_archetypes.size(); }
+
+	// Changes whenever an entity moves in memory, ie. whenever the order queries visit entities in may have changed
+	inline u32 get_layout_version() const { return m_layout_version; }
+};
@@ -0,0 +1,165 @@
+#include "HiZCuller.h"
+
+// Matches the Params block of hiz_downsample.comp
+struct DownsampleParams {
+	int32_t src_size[2];
+	int32_t dst_size[2];
+};
+
+HiZCuller::HiZCuller(Renderer &renderer, ShaderCompiler &compiler):
+	m_renderer(&renderer), m_readback(renderer)
+{
+	if (!renderer.can_sample_depth()) {
+		// Renderer::set_window_sample_count() already said so if it's multisampled
+		if (renderer.get_window_sample_count() == SDL_GPU_SAMPLECOUNT_1) {
+			std::cout << "The window's depth can't be sampled on this device, occlusion culling is off\n";
+		}
+		return;
+	}
+
+	std::vector<byte> spirv;
+	std::string log;
+	if (!compiler.compile_compute("hiz_downsample.comp", "", &spirv, &log)) {
+		std::cout << "Could not compile hiz_downsample.comp, occlusion culling is off:\n" << log << "\n";
+		return;
+	}
+
+	SDL_GPUComputePipelineCreateInfo ci = {
+		.code_size = spirv.size(),
+		.code = spirv.data(),
+		.entrypoint = "main",
+		.format = SDL_GPU_SHADERFORMAT_SPIRV,
+		.num_samplers = 1,
+		.num_readwrite_storage_textures = 1,
+		.num_uniform_buffers = 1,
+		.threadcount_x = 8,
+		.threadcount_y = 8,
+		.threadcount_z = 1,
+	};
+
+	m_downsample = SDL_CreateGPUComputePipeline(renderer.get_device(), &ci);
+	if (!m_downsample) {
+		std::cout << "SDL Error: " << SDL_GetError() << "\n";
+		return;
+	}
+
+	m_sampler = renderer.create_sampler(false, true);
+}
+
+void HiZCuller::destroy() {
+	if (!m_renderer) return;
+
+	destroy_levels();
+
+	m_readback.destroy();
+
+	if (m_downsample) {
+		SDL_ReleaseGPUComputePipeline(m_renderer->get_device(), m_downsample);
+		m_downsample = nullptr;
+	}
+
+	m_renderer = nullptr;
+}
+
+void HiZCuller::create_levels() {
+	destroy_levels();
+
+	// Level 0 is already half the window, the full size would only be read once
+	u32 width = std::max(m_renderer->get_window_width() / 2, 1u);
+	u32 height = std::max(m_renderer->get_window_height() / 2, 1u);
+
+	while (true) {
+		SDL_GPUTextureCreateInfo ci = {
+			.type = SDL_GPU_TEXTURETYPE_2D,
+			.format = SDL_GPU_TEXTUREFORMAT_R32_FLOAT,
+			.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_COMPUTE_STORAGE_WRITE,
+			.width = width,
+			.height = height,
+			.layer_count_or_depth = 1,
+			.num_levels = 1,
+		};
+
+		m_levels.push_back(m_renderer->create_texture(&ci));
+		m_level_sizes.emplace_back(width, height);
+
+		if (width <= HIZ_READBACK_WIDTH) {
+			m_readback_level = m_levels.size() - 1;
+			break;
+		}
+
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+}
+
+void HiZCuller::destroy_levels() {
+	for (RID level : m_levels) {
+		m_renderer->destroy_texture(level);
+	}
+
+	m_levels.clear();
+	m_level_sizes.clear();
+}
+
+void HiZCuller::poll() {
+	m_readback.poll([&](const void *texels, u32 width, u32 height, u32 slot) {
+		m_pyramid.build((const float *) texels, width, height, m_readback_viewprojs[slot]);
+	});
+}
+
+void HiZCuller::build(const mat4x4 &viewproj) {
+	SDL_GPUCommandBuffer *cb = m_renderer ? m_renderer->get_frame_command_buffer() : nullptr;
+	// The window may have been made multisampled since
+	if (!m_downsample || !cb || !m_renderer->can_sample_depth()) return;
+
+	u32 window_w = m_renderer->get_window_width();
+	u32 window_h = m_renderer->get_window_height();
+
+	if (m_levels.empty() || m_level_sizes[0].first != std::max(window_w / 2, 1u) ||
+		m_level_sizes[0].second != std::max(window_h / 2, 1u))
+	{
+		create_levels();
+	}
+
+	// Reduce the depth texture, then each level into the next
+	for (u32 i = 0; i < m_levels.size(); i++) {
+		SDL_GPUTexture *src = i == 0 ? m_renderer->get_depth_texture() : m_renderer->get_texture(m_levels[i - 1]);
+		u32 src_w = i == 0 ? window_w : m_level_sizes[i - 1].first;
+		u32 src_h = i == 0 ? window_h : m_level_sizes[i - 1].second;
+
+		auto [dst_w, dst_h] = m_level_sizes[i];
+
+		SDL_GPUStorageTextureReadWriteBinding dst = {
+			.texture = m_renderer->get_texture(m_levels[i]),
+			.mip_level = 0,
+			.layer = 0,
+			.cycle = true,
+		};
+
+		SDL_GPUComputePass *pass = SDL_BeginGPUComputePass(cb, &dst, 1, nullptr, 0);
+		SDL_BindGPUComputePipeline(pass, m_downsample);
+
+		SDL_GPUTextureSamplerBinding binding = { .texture = src, .sampler = m_renderer->get_sampler(m_sampler) };
+		SDL_BindGPUComputeSamplers(pass, 0, &binding, 1);
+
+		DownsampleParams params = {
+			.src_size = { (int32_t) src_w, (int32_t) src_h },
+			.dst_size = { (int32_t) dst_w, (int32_t) dst_h },
+		};
+		SDL_PushGPUComputeUniformData(cb, 0, &params, sizeof(params));
+
+		SDL_DispatchGPUCompute(pass, (dst_w + 7) / 8, (dst_h + 7) / 8, 1);
+		SDL_EndGPUComputePass(pass);
+	}
+
+	// Download the small level
+	auto [width, height] = m_level_sizes[m_readback_level];
+
+	u32 slot = m_readback.download(m_renderer->get_texture(m_levels[m_readback_level]), width, height, sizeof(float));
+	if (slot != U32_BAD) m_readback_viewprojs[slot] = viewproj;
+}
+
+void HiZCuller::cull(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible) {
+	m_tested = io_visible.size();
+	m_culled = m_pyramid.cull(bounds, io_visible);
+}
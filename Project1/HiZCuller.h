@@ -0,0 +1,91 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+#include "ShaderCompiler.h"
+#include "DepthPyramid.h"
+#include "TextureReadback.h"
+
+// Levels read back to the CPU are at most this wide. Smaller reads arrive sooner and are cheaper to test against
+inline constexpr u32 HIZ_READBACK_WIDTH = 256;
+
+/* HiZCuller
+ * Occlusion culling against the previous frame's depth. After the window pass, build() reduces the window's depth
+ * texture into a pyramid with a compute shader and downloads its first level narrower than HIZ_READBACK_WIDTH. Once
+ * the GPU is done with that frame (FRAMES_IN_FLIGHT frames later) the download becomes a DepthPyramid that cull()
+ * tests objects against on the CPU.
+ *
+ * The depth is a few frames old, so fast moving occluders can wrongly hide objects for a frame or two. Boxes are
+ * projected with the view-projection the depth was rendered with, which keeps camera motion from doing the same.
+ *
+ * The window's depth has to be stored for this to see anything: end the last window pass with
+ * WindowPassInfo::depth_store_op = SDL_GPU_STOREOP_STORE. Without compute support or a sampleable depth texture,
+ * is_gpu_available() is false and nothing is culled. A multisampled window (Renderer::set_window_sample_count())
+ * has no sampleable depth either.
+*/
+class HiZCuller {
+	Renderer *m_renderer = nullptr;
+
+	SDL_GPUComputePipeline *m_downsample = nullptr;
+	RID m_sampler = U32_BAD;
+
+	// One texture per level: SDL can't sample one mip of a texture while writing another in the same pass
+	std::vector<RID> m_levels;
+	std::vector<std::pair<u32, u32>> m_level_sizes;
+	u32 m_readback_level = 0;
+
+	TextureReadback m_readback;
+	// The view-projection of the depth in each readback slot
+	mat4x4 m_readback_viewprojs[FRAMES_IN_FLIGHT];
+
+	DepthPyramid m_pyramid;
+
+	u32 m_tested = 0;
+	u32 m_culled = 0;
+
+	// (Re)creates the level textures for the current window size
+	void create_levels();
+	void destroy_levels();
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline HiZCuller() {}
+
+	/// <summary>
+	/// Compiles the downsampling shader. Check is_gpu_available() for whether it worked
+	/// </summary>
+	/// <param name="renderer">- The Renderer whose window depth is culled against</param>
+	/// <param name="compiler">- Compiles hiz_downsample.comp</param>
+	HiZCuller(Renderer &renderer, ShaderCompiler &compiler);
+
+	HiZCuller(const HiZCuller &) = delete;
+	HiZCuller &operator=(const HiZCuller &) = delete;
+
+	inline ~HiZCuller() { destroy(); }
+
+	void destroy();
+
+	inline bool is_gpu_available() const { return m_downsample && m_renderer->can_sample_depth(); }
+
+	// Turns finished downloads into the pyramid cull() uses. Call after Renderer::begin_frame()
+	void poll();
+
+	/// <summary>
+	/// Records the pyramid reduction and download into the frame. Call after the last window pass of the frame
+	/// </summary>
+	/// <param name="viewproj">- The view-projection the window's depth was rendered with</param>
+	void build(const mat4x4 &viewproj);
+
+	/// <summary>
+	/// Removes the objects hidden behind the last pyramid that arrived. Also updates the counters
+	/// </summary>
+	/// <param name="bounds">- The box of every object</param>
+	/// <param name="io_visible">- Indices into bounds, eg. from a frustum query. Occluded ones are removed</param>
+	void cull(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible);
+
+	inline const DepthPyramid &get_pyramid() const { return m_pyramid; }
+
+	// Counters for the last cull()
+	inline u32 get_tested_count() const { return m_tested; }
+	inline u32 get_culled_count() const { return m_culled; }
+};
@@ -0,0 +1,307 @@
+#include "JobSystem.h"
+
+#include <SDL3/SDL_timer.h>
+
+bool JobDeque::push(Job *job) {
+	int64_t b = m_bottom.load(std::memory_order_relaxed);
+	int64_t t = m_top.load(std::memory_order_acquire);
+	if (b - t >= (int64_t) CAPACITY) return false;
+
+	m_jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_bottom.store(b + 1, std::memory_order_relaxed);
+
+	return true;
+}
+
+Job *JobDeque::pop() {
+	int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+	m_bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = m_top.load(std::memory_order_relaxed);
+
+	if (t > b) {
+		// Empty
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = m_jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (t == b) {
+		// Last job, race the thieves for it
+		if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			job = nullptr;
+		}
+		m_bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+Job *JobDeque::steal() {
+	int64_t t = m_top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = m_bottom.load(std::memory_order_acquire);
+
+	if (t >= b) return nullptr;
+
+	Job *job = m_jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+		return nullptr;
+	}
+
+	return job;
+}
+
+void JobSystem::start(u32 num_workers) {
+	if (s_running) return;
+
+	if (num_workers == AUTO_WORKERS) {
+		num_workers = std::max(SDL_GetNumLogicalCPUCores(), 1) - 1;
+	}
+
+	s_deques.push_back(new JobDeque());
+	s_worker = 0;
+
+	for (u32 i = 1; i <= num_workers; i++) {
+		s_deques.push_back(new JobDeque());
+	}
+
+	s_running = true;
+
+	for (u32 i = 1; i <= num_workers; i++) {
+		s_threads.emplace_back(&JobSystem::worker_loop, i);
+	}
+}
+
+void JobSystem::stop() {
+	if (!s_running) return;
+
+	// Drain everything first, jobs may be holding counters someone is about to wait on
+	while (Job *job = find_job()) {
+		execute(job);
+	}
+
+	{
+		std::lock_guard lock(s_sleep_mutex);
+		s_running = false;
+	}
+	s_wake.notify_all();
+
+	for (std::thread &thread : s_threads) {
+		thread.join();
+	}
+	s_threads.clear();
+
+	for (JobDeque *deque : s_deques) {
+		delete deque;
+	}
+	s_deques.clear();
+
+	s_worker = U32_BAD;
+	s_queued = 0;
+
+	pump_main();
+}
+
+void JobSystem::worker_loop(u32 index) {
+	s_worker = index;
+
+	while (true) {
+		if (Job *job = find_job()) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock lock(s_sleep_mutex);
+		// run() notifies without taking the lock, so don't sleep for long in case that wake-up was missed
+		s_wake.wait_for(lock, std::chrono::milliseconds(1), [] { return !s_running || s_queued.load() > 0; });
+		if (!s_running) return;
+	}
+}
+
+Job *JobSystem::find_job() {
+	u32 self = s_worker;
+
+	if (self != U32_BAD) {
+		if (Job *job = s_deques[self]->pop()) {
+			s_queued--;
+			return job;
+		}
+	}
+
+	{
+		std::lock_guard lock(s_inject_mutex);
+		if (!s_inject.empty()) {
+			Job *job = s_inject.front();
+			s_inject.pop_front();
+			s_queued--;
+			return job;
+		}
+	}
+
+	// Start at a different victim per worker so thieves don't all hammer the same deque
+	u32 count = s_deques.size();
+	u32 start = self == U32_BAD ? 0 : self + 1;
+
+	for (u32 i = 0; i < count; i++) {
+		u32 victim = (start + i) % count;
+		if (victim == self) continue;
+
+		if (Job *job = s_deques[victim]->steal()) {
+			s_queued--;
+			return job;
+		}
+	}
+
+	return nullptr;
+}
+
+void JobSystem::execute(Job *job) {
+	job->func();
+
+	if (job->counter) {
+		job->counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+
+	delete job;
+}
+
+void JobSystem::run(std::function<void()> func, JobCounter *counter) {
+	if (counter) {
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job *job = new Job{ .func = std::move(func), .counter = counter };
+
+	if (!s_running) {
+		execute(job);
+		return;
+	}
+
+	s_queued++;
+
+	u32 self = s_worker;
+	if (self == U32_BAD || !s_deques[self]->push(job)) {
+		std::lock_guard lock(s_inject_mutex);
+		s_inject.push_back(job);
+	}
+
+	s_wake.notify_one();
+}
+
+void JobSystem::run_on_main(std::function<void()> func) {
+	std::lock_guard lock(s_main_mutex);
+	s_main_jobs.push_back(std::move(func));
+}
+
+void JobSystem::pump_main() {
+	std::vector<std::function<void()>> jobs;
+	{
+		std::lock_guard lock(s_main_mutex);
+		jobs.swap(s_main_jobs);
+	}
+
+	for (auto &func : jobs) {
+		func();
+	}
+}
+
+void JobSystem::wait(JobCounter &counter) {
+	bool on_main = s_worker == 0;
+
+	while (!counter.is_done()) {
+		if (Job *job = find_job()) {
+			execute(job);
+		} else if (on_main) {
+			pump_main();
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::parallel_for(u32 count, u32 grain, const std::function<void(u32)> &func) {
+	if (count == 0) return;
+
+	if (grain == 0) {
+		// A few batches per worker lets fast workers pick up the slack of slow ones
+		grain = std::max(count / (std::max(get_worker_count(), 1u) * 4), 1u);
+	}
+
+	JobCounter counter;
+	for (u32 begin = 0; begin < count; begin += grain) {
+		u32 end = std::min(begin + grain, count);
+
+		run([&func, begin, end] {
+			for (u32 i = begin; i < end; i++) func(i);
+		}, &counter);
+	}
+
+	wait(counter);
+}
+
+// Sums a range by splitting it in half until the pieces are small, like a parallel reduction or tree build
+static u64 fork_join_sum(const std::vector<u32> &values, u32 begin, u32 end) {
+	if (end - begin <= 4096) {
+		u64 sum = 0;
+		for (u32 i = begin; i < end; i++) {
+			// Enough work per element that scheduling isn't all that gets measured
+			u64 x = values[i];
+			for (u32 k = 0; k < 16; k++) x = x * 6364136223846793005ull + 1442695040888963407ull;
+			sum += x >> 32;
+		}
+		return sum;
+	}
+
+	u32 mid = begin + (end - begin) / 2;
+	u64 left = 0;
+
+	JobCounter counter;
+	JobSystem::run([&] { left = fork_join_sum(values, begin, mid); }, &counter);
+	u64 right = fork_join_sum(values, mid, end);
+	JobSystem::wait(counter);
+
+	return left + right;
+}
+
+void JobSystem::benchmark(u32 max_workers) {
+	if (max_workers == 0) {
+		max_workers = std::max(SDL_GetNumLogicalCPUCores(), 1);
+	}
+
+	std::vector<u32> values(1 << 22);
+	for (u32 i = 0; i < values.size(); i++) values[i] = i;
+
+	bool was_running = s_running;
+	stop();
+
+	// Doubling, with max_workers itself as the last step
+	std::vector<u32> worker_counts;
+	for (u32 workers = 1; workers < max_workers; workers *= 2) worker_counts.push_back(workers);
+	worker_counts.push_back(max_workers);
+
+	double base_ms = 0.0;
+	for (u32 workers : worker_counts) {
+		// The caller counts as a worker, so 1 runs everything on this thread
+		start(workers - 1);
+
+		// Warm up the threads and caches before timing
+		fork_join_sum(values, 0, values.size());
+
+		const u32 RUNS = 5;
+		u64 begin = SDL_GetPerformanceCounter();
+		u64 result = 0;
+		for (u32 run = 0; run < RUNS; run++) {
+			result += fork_join_sum(values, 0, values.size());
+		}
+		double ms = (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency() / RUNS;
+
+		stop();
+
+		if (workers == 1) base_ms = ms;
+		std::cout << "Job benchmark: " << workers << " workers: " << ms << "ms (" << base_ms / ms << "x) [" << result << "]\n";
+	}
+
+	if (was_running) start();
+}
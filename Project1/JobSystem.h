@@ -0,0 +1,132 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Counts the jobs still running in a group. Pass it to JobSystem::run() and wait on it with JobSystem::wait()
+struct JobCounter {
+	std::atomic<u32> pending = 0;
+
+	inline bool is_done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+struct Job {
+	std::function<void()> func;
+	JobCounter *counter;
+};
+
+/* JobDeque
+ * Chase-Lev work-stealing deque of fixed capacity. The owning worker pushes and pops at the bottom (LIFO, so it
+ * keeps working on what is hot in its cache); other workers steal from the top (FIFO, taking the oldest and
+ * usually largest pieces of work).
+*/
+class JobDeque {
+	static constexpr u32 CAPACITY = 4096;
+
+	std::atomic<int64_t> m_top = 0;
+	std::atomic<int64_t> m_bottom = 0;
+	std::atomic<Job *> m_jobs[CAPACITY];
+
+public:
+	// Owner only. Returns false if the deque is full
+	bool push(Job *job);
+
+	// Owner only. Returns nullptr if the deque is empty
+	Job *pop();
+
+	// Any thread. Returns nullptr if the deque is empty or another thread won the race
+	Job *steal();
+};
+
+/* JobSystem
+ * A work-stealing scheduler shared by the whole program. Started by Application::_init() with a worker per spare
+ * core; the main thread counts as worker 0, so it can run and steal jobs while waiting.
+ *
+ * Jobs must not call SDL functions that have to run on the main thread (windows, events, GPU submission). Hand
+ * those to run_on_main(), which runs them at the start of the next tick, or during a wait() on the main thread.
+ *
+ * Dependencies are expressed by waiting: a job can run() children and wait() on their counter, and waiting helps
+ * run other jobs instead of blocking the worker.
+*/
+class JobSystem {
+	inline static std::vector<std::thread> s_threads;
+	inline static std::vector<JobDeque *> s_deques;
+
+	// Jobs submitted from threads that aren't workers, eg. the shader compiler's
+	inline static std::mutex s_inject_mutex;
+	inline static std::deque<Job *> s_inject;
+
+	inline static std::mutex s_main_mutex;
+	inline static std::vector<std::function<void()>> s_main_jobs;
+
+	// Sleeping workers are woken when this goes above 0
+	inline static std::atomic<u32> s_queued = 0;
+	inline static std::mutex s_sleep_mutex;
+	inline static std::condition_variable s_wake;
+
+	inline static std::atomic<bool> s_running = false;
+
+	// Index into s_deques of the calling thread, U32_BAD for threads that aren't workers
+	inline static thread_local u32 s_worker = U32_BAD;
+
+	static void worker_loop(u32 index);
+
+	// Takes a job from the calling worker's deque, the injection queue or another worker, in that order
+	static Job *find_job();
+
+	static void execute(Job *job);
+
+public:
+	// Passed to start() for one worker per spare core
+	static constexpr u32 AUTO_WORKERS = U32_BAD;
+
+	/// <summary>
+	/// Starts the workers. The calling thread becomes worker 0 and should be the main thread
+	/// </summary>
+	/// <param name="num_workers">- (Optional) The number of threads to start besides the caller. 0 runs every job on
+	/// the caller</param>
+	static void start(u32 num_workers = AUTO_WORKERS);
+
+	// Finishes every queued job, then joins the workers
+	static void stop();
+
+	inline static bool is_running() { return s_running; }
+
+	// The number of threads running jobs, including the main thread
+	inline static u32 get_worker_count() { return s_deques.size(); }
+
+	/// <summary>
+	/// Queues a job. Runs it immediately if the system isn't running
+	/// </summary>
+	/// <param name="func">- The work to do</param>
+	/// <param name="counter">- (Optional) Incremented now and decremented once the job finishes</param>
+	static void run(std::function<void()> func, JobCounter *counter = nullptr);
+
+	// Queues a function to run on the main thread, eg. to create SDL objects from a job's results
+	static void run_on_main(std::function<void()> func);
+
+	// Runs the jobs queued by run_on_main(). Called by Application every tick
+	static void pump_main();
+
+	// Runs other jobs until the counter reaches 0. On the main thread, this also pumps the main queue
+	static void wait(JobCounter &counter);
+
+	/// <summary>
+	/// Splits [0, count) into batches and runs func(i) for each i across the workers, returning once all are done
+	/// </summary>
+	/// <param name="count">- The number of iterations</param>
+	/// <param name="grain">- Iterations per job. 0 picks a size giving each worker a few jobs to balance with</param>
+	/// <param name="func">- Called once per iteration, from any worker</param>
+	static void parallel_for(u32 count, u32 grain, const std::function<void(u32)> &func);
+
+	/// <summary>
+	/// Times a recursive fork-join workload with 1 worker up to max_workers and prints the speedup of each.
+	/// Restarts the system, so call it before anything else uses it
+	/// </summary>
+	/// <param name="max_workers">- The largest worker count to try. 0 means one per core</param>
+	static void benchmark(u32 max_workers = 0);
+};
@@ -1,10 +1,12 @@
 #include "Mesh.h"
+#include "DrawCommandList.h"
 
 Mesh Mesh::parse_tg_model(Renderer &renderer, const tg::Model &model, const AttributeList &attributes) {
 	u32 attrib_stride = attribute_list_size(attributes);
 
 	std::vector<byte> data;
 	std::vector<u32> indices;
+	Aabb bounds;
 
 	if (model.meshes.size() == 1 && model.meshes[0].primitives.size() == 1) {
 		const tg::Primitive &prim = model.meshes[0].primitives[0];
@@ -19,6 +21,12 @@ Mesh Mesh::parse_tg_model(Renderer &renderer, const tg::Model &model, const Attr
 
 			const tg::Accessor &acc = model.accessors[prim.attributes.at(attributes[i].second)];
 
+			// glTF requires POSITION to carry its min and max
+			if (attributes[i].second == "POSITION" && acc.minValues.size() == 3 && acc.maxValues.size() == 3) {
+				bounds.expand(vec3(acc.minValues[0], acc.minValues[1], acc.minValues[2]));
+				bounds.expand(vec3(acc.maxValues[0], acc.maxValues[1], acc.maxValues[2]));
+			}
+
 			if (i == 0) {
 				data.resize(acc.count * attrib_stride);
 			}
@@ -153,7 +161,7 @@ Mesh Mesh::parse_tg_model(Renderer &renderer, const tg::Model &model, const Attr
 		std::cout << "Model has " << model.meshes.size() << " meshes and " << model.meshes[0].primitives.size() << " primitives in the first mesh\n";
 	}
 
-	return Mesh(renderer, std::move(data), std::move(indices));
+	return Mesh(renderer, std::move(data), std::move(indices), {}, bounds);
 }
 
 Mesh Mesh::load_glb_memory(Renderer &renderer, const byte *data, u32 length, const AttributeList &attributes) {
@@ -180,8 +188,8 @@ Mesh Mesh::load_gltf_string(Renderer &renderer, const std::string &data, const A
 	return parse_tg_model(renderer, model, attributes);
 }
 
-Mesh::Mesh(Renderer &renderer, std::vector<byte> vertices, std::vector<u32> indices, std::vector<byte> instances):
-	m_renderer(&renderer), m_vertices(vertices), m_indices(indices), m_instances(instances), m_dirtiness(DIRTY_VERTICES)
+Mesh::Mesh(Renderer &renderer, std::vector<byte> vertices, std::vector<u32> indices, std::vector<byte> instances, const Aabb &bounds):
+	m_renderer(&renderer), m_vertices(vertices), m_indices(indices), m_instances(instances), m_dirtiness(DIRTY_VERTICES), m_bounds(bounds)
 {
 	m_vertbuf = renderer.create_buffer(SDL_GPU_BUFFERUSAGE_VERTEX, vertices.size());
 
@@ -252,3 +260,11 @@ void Mesh::bind(ActiveRenderPass &arp) {
 		arp.bind_mesh(m_vertices.size(), m_vertbuf, m_instbuf);
 	}
 }
+
+void Mesh::bind(DrawCommandList &list) {
+	if (*m_indexbuf != U32_BAD) {
+		list.bind_mesh_indexed(m_indices.size(), m_indexbuf, m_vertbuf, m_instbuf);
+	} else {
+		list.bind_mesh(m_vertices.size(), m_vertbuf, m_instbuf);
+	}
+}
@@ -3,6 +3,7 @@
 #include "common.h"
 #include "Renderer.h"
 #include "MeshAttributes.h"
+#include "Bounds.h"
 
 #define TINYGLTF_NO_STB_IMAGE
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -10,6 +11,8 @@
 #define TINYGLTF_NO_EXCEPTION
 #include "MiniLibs/tiny_gltf.h"
 
+class DrawCommandList;
+
 namespace tg = tinygltf;
 using tg::TinyGLTF;
 
@@ -30,6 +33,8 @@ class Mesh {
 
 	u32 m_dirtiness = DIRTY_NONE;
 
+	Aabb m_bounds = {};
+
 	static Mesh parse_tg_model(Renderer &renderer, const tg::Model &model, const AttributeList &attributes);
 
 public:
@@ -46,7 +51,8 @@ public:
 	/// <param name="vertices">- The initial per-vertex data</param>
 	/// <param name="indices">- The index data. If this is empty, the mesh will not be indexed</param>
 	/// <param name="instances">- (Optional) The initial per-instance data. If this is empty, the mesh will not support instancing</param>
-	Mesh(Renderer &renderer, std::vector<byte> vertices, std::vector<u32> indices, std::vector<byte> instances = {});
+	/// <param name="bounds">- (Optional) The bounds of the vertex positions, for culling</param>
+	Mesh(Renderer &renderer, std::vector<byte> vertices, std::vector<u32> indices, std::vector<byte> instances = {}, const Aabb &bounds = {});
 
 	Mesh(const Mesh &) = delete;
 	Mesh &operator=(const Mesh &) = delete;
@@ -63,6 +69,13 @@ public:
 	
 	// No support for updating indices
 
+	// The bounds of the vertex positions. Read from glTF files; meshes built from raw data must be given them
+	inline const Aabb &get_bounds() const { return m_bounds; }
+	inline void set_bounds(const Aabb &bounds) { m_bounds = bounds; }
+
 	void upload(ActiveCopyPass &acp);
 	void bind(ActiveRenderPass &arp);
+
+	// Records the bind for a later replay, eg. from a worker thread
+	void bind(DrawCommandList &list);
 };
\ No newline at end of file
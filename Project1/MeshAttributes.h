@@ -21,6 +21,13 @@ inline constexpr u32 mesh_attribute_sizes[MESHATTRIBUTE_MAX] = {
 	16,
 };
 
+inline constexpr u32 mesh_attribute_components[MESHATTRIBUTE_MAX] = {
+	1,
+	2,
+	3,
+	4,
+};
+
 inline constexpr MeshAttribute SDL_GPUVertexElementFormat_to_common(SDL_GPUVertexElementFormat attribute) {
 	switch (attribute) {
 	case SDL_GPU_VERTEXELEMENTFORMAT_FLOAT:
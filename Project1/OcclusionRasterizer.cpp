@@ -0,0 +1,469 @@
+#include "OcclusionRasterizer.h"
+#include "JobSystem.h"
+
+#include <random>
+
+#include <SDL3/SDL_cpuinfo.h>
+#include <SDL3/SDL_timer.h>
+
+// The AVX2 paths are compiled on every x64 build and picked at runtime, so the build doesn't need /arch:AVX2
+#if defined(_M_X64) || defined(__x86_64__)
+#define OCCLUSION_AVX2 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+#else
+#define OCCLUSION_AVX2 0
+#endif
+
+// A triangle's edge functions and depth plane, and the pixels of a tile it may cover
+struct TriangleSetup {
+	// Edge i is a[i] * x + b[i] * y + c[i], positive inside
+	float a[3], b[3], c[3];
+	// Depth is za * x + zb * y + zc
+	float za, zb, zc;
+
+	u32 x0, y0, x1, y1;
+};
+
+static bool setup_triangle(const vec3 v[3], u32 tile_x0, u32 tile_y0, u32 tile_x1, u32 tile_y1, TriangleSetup *o_setup) {
+	// Pixels whose centers may be inside
+	float min_x = std::min({ v[0].x, v[1].x, v[2].x }), max_x = std::max({ v[0].x, v[1].x, v[2].x });
+	float min_y = std::min({ v[0].y, v[1].y, v[2].y }), max_y = std::max({ v[0].y, v[1].y, v[2].y });
+
+	float fx0 = std::max(std::ceil(min_x - 0.5f), (float) tile_x0);
+	float fx1 = std::min(std::floor(max_x - 0.5f), (float) tile_x1);
+	float fy0 = std::max(std::ceil(min_y - 0.5f), (float) tile_y0);
+	float fy1 = std::min(std::floor(max_y - 0.5f), (float) tile_y1);
+	if (fx0 > fx1 || fy0 > fy1) return false;
+
+	o_setup->x0 = (u32) fx0;
+	o_setup->x1 = (u32) fx1;
+	o_setup->y0 = (u32) fy0;
+	o_setup->y1 = (u32) fy1;
+
+	for (u32 i = 0; i < 3; i++) {
+		const vec3 &from = v[i];
+		const vec3 &to = v[(i + 1) % 3];
+
+		o_setup->a[i] = from.y - to.y;
+		o_setup->b[i] = to.x - from.x;
+		o_setup->c[i] = -(o_setup->a[i] * from.x + o_setup->b[i] * from.y);
+	}
+
+	vec3 d1 = v[1] - v[0];
+	vec3 d2 = v[2] - v[0];
+	float area = d1.x * d2.y - d1.y * d2.x;
+
+	o_setup->za = (d1.z * d2.y - d2.z * d1.y) / area;
+	o_setup->zb = (d2.z * d1.x - d1.z * d2.x) / area;
+	o_setup->zc = v[0].z - o_setup->za * v[0].x - o_setup->zb * v[0].y;
+
+	return true;
+}
+
+OccluderMesh OccluderMesh::box(const Aabb &box) {
+	OccluderMesh mesh;
+
+	for (u32 i = 0; i < 8; i++) {
+		mesh.positions.push_back(vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z));
+	}
+
+	// Two triangles per face, counter-clockwise seen from outside
+	mesh.indices = {
+		0, 4, 6,  0, 6, 2, // -x
+		1, 3, 7,  1, 7, 5, // +x
+		0, 1, 5,  0, 5, 4, // -y
+		2, 6, 7,  2, 7, 3, // +y
+		0, 2, 3,  0, 3, 1, // -z
+		4, 5, 7,  4, 7, 6, // +z
+	};
+
+	return mesh;
+}
+
+OcclusionRasterizer::OcclusionRasterizer(u32 width, u32 height):
+	m_width((std::max(width, 1u) + 7) / 8 * 8),
+	m_height(std::max(height, 1u))
+{
+	m_tiles_x = (m_width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+	m_tiles_y = (m_height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+
+	m_depth.resize(m_width * m_height, 1.0f);
+	m_bins.resize(m_tiles_x * m_tiles_y);
+
+	m_viewproj = glm::identity<mat4x4>();
+
+	set_avx2_enabled(true);
+}
+
+void OcclusionRasterizer::set_avx2_enabled(bool enabled) {
+#if OCCLUSION_AVX2
+	m_use_avx2 = enabled && SDL_HasAVX2();
+#else
+	m_use_avx2 = false;
+#endif
+}
+
+void OcclusionRasterizer::begin(const mat4x4 &viewproj) {
+	m_viewproj = viewproj;
+
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+
+	m_triangles.clear();
+	for (std::vector<u32> &bin : m_bins) {
+		bin.clear();
+	}
+
+	m_submitted = 0;
+}
+
+void OcclusionRasterizer::add_occluder(const OccluderMesh &mesh, const mat4x4 &world, bool two_sided) {
+	mat4x4 transform = m_viewproj * world;
+
+	m_clip.resize(mesh.positions.size());
+	for (u32 i = 0; i < mesh.positions.size(); i++) {
+		m_clip[i] = transform * vec4(mesh.positions[i], 1.0f);
+	}
+
+	m_submitted += mesh.indices.size() / 3;
+
+	for (u32 i = 0; i + 2 < mesh.indices.size(); i += 3) {
+		vec4 in[3] = { m_clip[mesh.indices[i]], m_clip[mesh.indices[i + 1]], m_clip[mesh.indices[i + 2]] };
+
+		// Entirely outside one side of the view volume. Beyond the far plane counts, since depth is cleared to it
+		if ((in[0].x > in[0].w && in[1].x > in[1].w && in[2].x > in[2].w) ||
+			(in[0].x < -in[0].w && in[1].x < -in[1].w && in[2].x < -in[2].w) ||
+			(in[0].y > in[0].w && in[1].y > in[1].w && in[2].y > in[2].w) ||
+			(in[0].y < -in[0].w && in[1].y < -in[1].w && in[2].y < -in[2].w) ||
+			(in[0].z > in[0].w && in[1].z > in[1].w && in[2].z > in[2].w) ||
+			(in[0].z < 0.0f && in[1].z < 0.0f && in[2].z < 0.0f))
+		{
+			continue;
+		}
+
+		if (in[0].z >= 0.0f && in[1].z >= 0.0f && in[2].z >= 0.0f) {
+			add_triangle(in[0], in[1], in[2], two_sided);
+			continue;
+		}
+
+		// Clip to depth 0, which leaves a triangle or a quad
+		vec4 out[4];
+		u32 count = 0;
+
+		for (u32 v = 0; v < 3; v++) {
+			const vec4 &a = in[v];
+			const vec4 &b = in[(v + 1) % 3];
+
+			if (a.z >= 0.0f) out[count++] = a;
+			if ((a.z >= 0.0f) != (b.z >= 0.0f)) out[count++] = a + (b - a) * (a.z / (a.z - b.z));
+		}
+
+		for (u32 v = 2; v < count; v++) {
+			add_triangle(out[0], out[v - 1], out[v], two_sided);
+		}
+	}
+}
+
+void OcclusionRasterizer::add_triangle(const vec4 &c0, const vec4 &c1, const vec4 &c2, bool two_sided) {
+	ScreenTriangle triangle;
+
+	const vec4 *clip[3] = { &c0, &c1, &c2 };
+	for (u32 i = 0; i < 3; i++) {
+		float inv_w = 1.0f / clip[i]->w;
+		triangle.v[i] = vec3(
+			(clip[i]->x * inv_w * 0.5f + 0.5f) * m_width,
+			(0.5f - clip[i]->y * inv_w * 0.5f) * m_height,
+			clip[i]->z * inv_w
+		);
+	}
+
+	// With y pointing down, counter-clockwise triangles have a negative area. Flip those to make the edge functions
+	// positive inside
+	vec3 d1 = triangle.v[1] - triangle.v[0];
+	vec3 d2 = triangle.v[2] - triangle.v[0];
+	float area = d1.x * d2.y - d1.y * d2.x;
+
+	if (!(area < 0.0f || (two_sided && area > 0.0f))) return;
+	if (area < 0.0f) std::swap(triangle.v[1], triangle.v[2]);
+
+	float min_x = std::min({ triangle.v[0].x, triangle.v[1].x, triangle.v[2].x });
+	float max_x = std::max({ triangle.v[0].x, triangle.v[1].x, triangle.v[2].x });
+	float min_y = std::min({ triangle.v[0].y, triangle.v[1].y, triangle.v[2].y });
+	float max_y = std::max({ triangle.v[0].y, triangle.v[1].y, triangle.v[2].y });
+
+	// The pixel centers it may cover
+	float fx0 = std::max(std::ceil(min_x - 0.5f), 0.0f);
+	float fx1 = std::min(std::floor(max_x - 0.5f), m_width - 1.0f);
+	float fy0 = std::max(std::ceil(min_y - 0.5f), 0.0f);
+	float fy1 = std::min(std::floor(max_y - 0.5f), m_height - 1.0f);
+	if (fx0 > fx1 || fy0 > fy1) return;
+
+	u32 index = m_triangles.size();
+	m_triangles.push_back(triangle);
+
+	for (u32 ty = (u32) fy0 / OCCLUSION_TILE_HEIGHT; ty <= (u32) fy1 / OCCLUSION_TILE_HEIGHT; ty++) {
+		for (u32 tx = (u32) fx0 / OCCLUSION_TILE_WIDTH; tx <= (u32) fx1 / OCCLUSION_TILE_WIDTH; tx++) {
+			m_bins[ty * m_tiles_x + tx].push_back(index);
+		}
+	}
+}
+
+void OcclusionRasterizer::rasterize() {
+	// Tiles don't share pixels, so each can be drawn on its own
+	parallel_for(m_bins.size(), [&](u32 tile) {
+		if (m_bins[tile].empty()) return;
+
+#if OCCLUSION_AVX2
+		if (m_use_avx2) {
+			rasterize_tile_avx2(tile);
+			return;
+		}
+#endif
+		rasterize_tile(tile);
+	});
+}
+
+void OcclusionRasterizer::rasterize_tile(u32 tile) {
+	u32 tile_x0 = tile % m_tiles_x * OCCLUSION_TILE_WIDTH;
+	u32 tile_y0 = tile / m_tiles_x * OCCLUSION_TILE_HEIGHT;
+	u32 tile_x1 = std::min(tile_x0 + OCCLUSION_TILE_WIDTH, m_width) - 1;
+	u32 tile_y1 = std::min(tile_y0 + OCCLUSION_TILE_HEIGHT, m_height) - 1;
+
+	for (u32 index : m_bins[tile]) {
+		TriangleSetup s;
+		if (!setup_triangle(m_triangles[index].v, tile_x0, tile_y0, tile_x1, tile_y1, &s)) continue;
+
+		for (u32 y = s.y0; y <= s.y1; y++) {
+			float py = y + 0.5f;
+			float *row = &m_depth[y * m_width];
+
+			// Grouped like the AVX2 path, so both cover the same pixels
+			float e0_row = s.b[0] * py + s.c[0];
+			float e1_row = s.b[1] * py + s.c[1];
+			float e2_row = s.b[2] * py + s.c[2];
+			float z_row = s.zb * py + s.zc;
+
+			for (u32 x = s.x0; x <= s.x1; x++) {
+				float px = x + 0.5f;
+
+				if (s.a[0] * px + e0_row < 0.0f || s.a[1] * px + e1_row < 0.0f || s.a[2] * px + e2_row < 0.0f) continue;
+
+				row[x] = std::min(row[x], s.za * px + z_row);
+			}
+		}
+	}
+}
+
+#if OCCLUSION_AVX2
+AVX2_FUNCTION void OcclusionRasterizer::rasterize_tile_avx2(u32 tile) {
+	u32 tile_x0 = tile % m_tiles_x * OCCLUSION_TILE_WIDTH;
+	u32 tile_y0 = tile / m_tiles_x * OCCLUSION_TILE_HEIGHT;
+	u32 tile_x1 = std::min(tile_x0 + OCCLUSION_TILE_WIDTH, m_width) - 1;
+	u32 tile_y1 = std::min(tile_y0 + OCCLUSION_TILE_HEIGHT, m_height) - 1;
+
+	const __m256 lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (u32 index : m_bins[tile]) {
+		TriangleSetup s;
+		if (!setup_triangle(m_triangles[index].v, tile_x0, tile_y0, tile_x1, tile_y1, &s)) continue;
+
+		__m256 a0 = _mm256_set1_ps(s.a[0]), a1 = _mm256_set1_ps(s.a[1]), a2 = _mm256_set1_ps(s.a[2]);
+		__m256 za = _mm256_set1_ps(s.za);
+
+		// Tiles start on multiples of 8, so widening the span to whole vectors stays within the tile. The extra
+		// pixels fail the edge tests
+		u32 x0 = s.x0 & ~7u;
+
+		for (u32 y = s.y0; y <= s.y1; y++) {
+			float py = y + 0.5f;
+			float *row = &m_depth[y * m_width];
+
+			__m256 e0_row = _mm256_set1_ps(s.b[0] * py + s.c[0]);
+			__m256 e1_row = _mm256_set1_ps(s.b[1] * py + s.c[1]);
+			__m256 e2_row = _mm256_set1_ps(s.b[2] * py + s.c[2]);
+			__m256 z_row = _mm256_set1_ps(s.zb * py + s.zc);
+
+			for (u32 x = x0; x <= s.x1; x += 8) {
+				__m256 px = _mm256_add_ps(_mm256_set1_ps((float) x), lanes);
+
+				// Multiply then add, not FMA, so the results round exactly like the scalar path's
+				__m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), e0_row);
+				__m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), e1_row);
+				__m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), e2_row);
+
+				__m256 inside = _mm256_and_ps(
+					_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+					_mm256_cmp_ps(e2, zero, _CMP_GE_OQ)
+				);
+				if (_mm256_testz_ps(inside, inside)) continue;
+
+				__m256 depth = _mm256_loadu_ps(row + x);
+				__m256 z = _mm256_min_ps(depth, _mm256_add_ps(_mm256_mul_ps(za, px), z_row));
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(depth, z, inside));
+			}
+		}
+	}
+}
+#endif
+
+bool OcclusionRasterizer::is_occluded(const Aabb &box) const {
+#if OCCLUSION_AVX2
+	if (m_use_avx2) return is_occluded_avx2(box);
+#endif
+
+	ProjectedBox p;
+	if (!project_box(box, m_viewproj, m_width, m_height, &p)) return false;
+
+	float threshold = p.nearest - OCCLUSION_DEPTH_BIAS;
+
+	for (u32 y = p.y0; y <= p.y1; y++) {
+		const float *row = &m_depth[y * m_width];
+
+		for (u32 x = p.x0; x <= p.x1; x++) {
+			if (row[x] >= threshold) return false;
+		}
+	}
+
+	return true;
+}
+
+#if OCCLUSION_AVX2
+AVX2_FUNCTION bool OcclusionRasterizer::is_occluded_avx2(const Aabb &box) const {
+	ProjectedBox p;
+	if (!project_box(box, m_viewproj, m_width, m_height, &p)) return false;
+
+	__m256 threshold = _mm256_set1_ps(p.nearest - OCCLUSION_DEPTH_BIAS);
+
+	// Rows are whole vectors, so load whole vectors and mask off the pixels outside the span
+	const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	__m256 first = _mm256_set1_ps((float) p.x0);
+	__m256 last = _mm256_set1_ps((float) p.x1);
+
+	for (u32 x = p.x0 & ~7u; x <= p.x1; x += 8) {
+		__m256 px = _mm256_add_ps(_mm256_set1_ps((float) x), lanes);
+		__m256 in_span = _mm256_and_ps(_mm256_cmp_ps(px, first, _CMP_GE_OQ), _mm256_cmp_ps(px, last, _CMP_LE_OQ));
+
+		for (u32 y = p.y0; y <= p.y1; y++) {
+			__m256 visible = _mm256_cmp_ps(_mm256_loadu_ps(&m_depth[y * m_width + x]), threshold, _CMP_GE_OQ);
+			if (!_mm256_testz_ps(visible, in_span)) return false;
+		}
+	}
+
+	return true;
+}
+#endif
+
+u32 OcclusionRasterizer::cull(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible) const {
+	return remove_occluded(bounds, io_visible, [this](const Aabb &box) { return is_occluded(box); });
+}
+
+void OcclusionRasterizer::benchmark(u32 blocks) {
+	// A grid of buildings with streets between them, and small props scattered everywhere
+	const float SPACING = 24.0f;
+	const u32 PROPS = 200000;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> footprint(12.0f, 18.0f);
+	std::uniform_real_distribution<float> height(8.0f, 80.0f);
+	std::uniform_real_distribution<float> position(0.0f, blocks * SPACING);
+	std::uniform_real_distribution<float> size(0.5f, 3.0f);
+
+	std::vector<mat4x4> buildings;
+	std::vector<Aabb> bounds;
+
+	for (u32 z = 0; z < blocks; z++) {
+		for (u32 x = 0; x < blocks; x++) {
+			vec3 extent = vec3(footprint(rng), height(rng), footprint(rng));
+			vec3 center = vec3((x + 0.5f) * SPACING, extent.y * 0.5f, (z + 0.5f) * SPACING);
+
+			buildings.push_back(glm::scale(glm::translate(glm::identity<mat4x4>(), center), extent));
+			bounds.push_back(Aabb{ .min = center - extent * 0.5f, .max = center + extent * 0.5f });
+		}
+	}
+
+	for (u32 i = 0; i < PROPS; i++) {
+		vec3 extent = vec3(size(rng), size(rng), size(rng));
+		vec3 base = vec3(position(rng), 0.0f, position(rng));
+		bounds.push_back(Aabb{ .min = base - vec3(extent.x, 0.0f, extent.z), .max = base + extent });
+	}
+
+	OccluderMesh unit_box = OccluderMesh::box(Aabb{ .min = vec3(-0.5f), .max = vec3(0.5f) });
+
+	// Standing in a street in the middle of the city, looking around
+	const u32 VIEWS = 16;
+	mat4x4 proj = glm::perspectiveFov(deg_to_rad(90.0f), 16.0f, 9.0f, 0.1f, 2000.0f);
+	vec3 eye = vec3(blocks / 2 * SPACING, 2.0f, (blocks / 2 + 0.5f) * SPACING);
+
+	auto elapsed_ms = [](u64 begin) { return (SDL_GetPerformanceCounter() - begin) * 1000.0 / SDL_GetPerformanceFrequency(); };
+
+	std::cout << "Occlusion benchmark: " << buildings.size() << " buildings, " << bounds.size() << " objects, "
+		<< JobSystem::get_worker_count() << " workers\n";
+
+	OcclusionRasterizer rasterizer;
+	std::vector<u64> culled_per_mode;
+	// The depth of every view, per mode, to check the two paths agree texel for texel
+	std::vector<std::vector<float>> depth_per_mode;
+
+	for (bool avx2 : { false, true }) {
+		rasterizer.set_avx2_enabled(avx2);
+		if (avx2 && !rasterizer.is_avx2_enabled()) {
+			std::cout << "\tAVX2: not supported by this CPU\n";
+			break;
+		}
+
+		double raster_ms = 0.0, test_ms = 0.0;
+		u64 submitted = 0, drawn = 0, culled = 0;
+		std::vector<float> &depths = depth_per_mode.emplace_back();
+
+		for (u32 v = 0; v < VIEWS; v++) {
+			float angle = v * glm::two_pi<float>() / VIEWS;
+			mat4x4 view = glm::lookAt(eye, eye + vec3(cos(angle), 0.0f, sin(angle)), vec3(0.0f, 1.0f, 0.0f));
+
+			u64 begin = SDL_GetPerformanceCounter();
+			rasterizer.begin(proj * view);
+			for (const mat4x4 &building : buildings) {
+				rasterizer.add_occluder(unit_box, building);
+			}
+			rasterizer.rasterize();
+			raster_ms += elapsed_ms(begin);
+
+			submitted += rasterizer.get_submitted_count();
+			drawn += rasterizer.get_triangle_count();
+			depths.insert(depths.end(), rasterizer.get_depth(), rasterizer.get_depth() + rasterizer.get_width() * rasterizer.get_height());
+
+			// One thread, to measure the test itself
+			begin = SDL_GetPerformanceCounter();
+			for (const Aabb &box : bounds) {
+				culled += rasterizer.is_occluded(box);
+			}
+			test_ms += elapsed_ms(begin);
+		}
+
+		culled_per_mode.push_back(culled);
+
+		std::cout << "\t" << (avx2 ? "AVX2" : "Scalar") << ": "
+			<< submitted / raster_ms / 1000.0 << "M tris/s (" << drawn / VIEWS << " of " << submitted / VIEWS
+			<< " drawn per view, " << raster_ms / VIEWS << "ms), "
+			<< bounds.size() * VIEWS / test_ms / 1000.0 << "M tests/s ("
+			<< culled * 100.0 / (bounds.size() * VIEWS) << "% occluded)\n";
+	}
+
+	if (depth_per_mode.size() == 2) {
+		u64 texels = 0;
+		for (u64 i = 0; i < depth_per_mode[0].size(); i++) {
+			texels += memcmp(&depth_per_mode[0][i], &depth_per_mode[1][i], sizeof(float)) != 0;
+		}
+
+		if (texels == 0 && culled_per_mode[0] == culled_per_mode[1]) {
+			std::cout << "\tScalar and AVX2 match on every texel and test\n";
+		} else {
+			std::cout << "\tScalar and AVX2 disagree on " << texels << " texels and "
+				<< (int64_t) culled_per_mode[1] - (int64_t) culled_per_mode[0] << " tests\n";
+		}
+	}
+}
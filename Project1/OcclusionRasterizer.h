@@ -0,0 +1,125 @@
+#pragma once
+
+#include "common.h"
+#include "Bounds.h"
+#include "DepthPyramid.h"
+
+// The depth buffer is split into tiles of this size, each rasterized by one job. The width is a multiple of 8 so
+// every row of a tile is whole 8-wide vectors
+inline constexpr u32 OCCLUSION_TILE_WIDTH = 32;
+inline constexpr u32 OCCLUSION_TILE_HEIGHT = 16;
+
+// Boxes have to be this far behind the occluders in depth to be culled, so an occluder's own box isn't hidden by it
+inline constexpr float OCCLUSION_DEPTH_BIAS = 1e-6f;
+
+// A few large triangles standing in for an object when occluding. They should lie within the object they stand for,
+// and within its solid parts: an alpha tested object's cut-outs must not be covered
+struct OccluderMesh {
+	std::vector<vec3> positions;
+	// Counter-clockwise triangles, like glTF's
+	std::vector<u32> indices;
+
+	// The twelve triangles of a box, facing outward
+	static OccluderMesh box(const Aabb &box);
+};
+
+/* OcclusionRasterizer
+ * Occlusion culling on the CPU within the frame, with no GPU readback. A handful of occluders are rasterized into a
+ * small depth buffer, then object boxes are tested against it: a box is occluded if even its nearest point is behind
+ * every texel its projection covers.
+ *
+ * Triangles are binned into tiles, and the tiles are rasterized in parallel on the JobSystem. Rows are processed 8
+ * pixels at a time with AVX2 when the CPU has it, and one at a time otherwise. Texels only hold the depth at their
+ * center, so keep the buffer small and the occluders inside what they stand for.
+ *
+ * Depth is clip.z / clip.w with nearer being smaller and row 0 at the top of the screen, like DepthPyramid wants, and
+ * geometry in front of depth 0 is clipped like the GPU does with the Camera's projection.
+*/
+class OcclusionRasterizer {
+	struct ScreenTriangle {
+		// Pixels for xy, depth for z
+		vec3 v[3];
+	};
+
+	u32 m_width;
+	u32 m_height;
+	u32 m_tiles_x;
+	u32 m_tiles_y;
+
+	std::vector<float> m_depth;
+
+	// Scratch space for the clip-space vertices of an occluder
+	std::vector<vec4> m_clip;
+
+	mat4x4 m_viewproj;
+
+	std::vector<ScreenTriangle> m_triangles;
+	// Indices into m_triangles of the triangles touching each tile
+	std::vector<std::vector<u32>> m_bins;
+
+	u32 m_submitted = 0;
+
+	bool m_use_avx2;
+
+	// Projects a triangle already clipped to depth 0 and bins it
+	void add_triangle(const vec4 &c0, const vec4 &c1, const vec4 &c2, bool two_sided);
+
+	void rasterize_tile(u32 tile);
+	void rasterize_tile_avx2(u32 tile);
+
+	bool is_occluded_avx2(const Aabb &box) const;
+
+public:
+	/// <summary>
+	/// Creates the depth buffer
+	/// </summary>
+	/// <param name="width">- Rounded up to a multiple of 8</param>
+	/// <param name="height">- The height in pixels</param>
+	OcclusionRasterizer(u32 width = 320, u32 height = 180);
+
+	OcclusionRasterizer(const OcclusionRasterizer &) = delete;
+	OcclusionRasterizer &operator=(const OcclusionRasterizer &) = delete;
+
+	// Clears the depth and forgets the occluders of the last frame
+	void begin(const mat4x4 &viewproj);
+
+	/// <summary>
+	/// Clips, projects and bins the triangles of an occluder. Nothing is drawn until rasterize()
+	/// </summary>
+	/// <param name="mesh">- The occluder's triangles</param>
+	/// <param name="world">- The occluder's world matrix</param>
+	/// <param name="two_sided">- Whether to keep triangles facing away. Only needed for meshes that aren't closed</param>
+	void add_occluder(const OccluderMesh &mesh, const mat4x4 &world, bool two_sided = false);
+
+	// Draws the binned triangles, across the JobSystem's workers
+	void rasterize();
+
+	// Conservative: boxes that are off screen or cross the near plane are never occluded
+	bool is_occluded(const Aabb &box) const;
+
+	/// <summary>
+	/// Removes the occluded objects from a list, spreading large lists across the JobSystem's workers
+	/// </summary>
+	/// <param name="bounds">- The box of every object</param>
+	/// <param name="io_visible">- Indices into bounds. Occluded ones are removed, keeping the order of the rest</param>
+	/// <returns>The number of objects removed</returns>
+	u32 cull(const std::vector<Aabb> &bounds, std::vector<u32> &io_visible) const;
+
+	// Whether AVX2 is used. On by default when the CPU supports it; turning it on otherwise does nothing
+	void set_avx2_enabled(bool enabled);
+	inline bool is_avx2_enabled() const { return m_use_avx2; }
+
+	inline const float *get_depth() const { return m_depth.data(); }
+	inline u32 get_width() const { return m_width; }
+	inline u32 get_height() const { return m_height; }
+
+	// Triangles given to add_occluder() since begin(), and how many of them survived clipping and culling
+	inline u32 get_submitted_count() const { return m_submitted; }
+	inline u32 get_triangle_count() const { return m_triangles.size(); }
+
+	/// <summary>
+	/// Times rasterizing and testing a synthetic city, with and without AVX2, and prints the results
+	/// </summary>
+	/// <param name="blocks">- The city is blocks * blocks buildings</param>
+	static void benchmark(u32 blocks = 64);
+};
@@ -0,0 +1,105 @@
+#include "OverdrawCounter.h"
+
+#include <glm/gtc/packing.hpp>
+
+static constexpr SDL_GPUTextureFormat COUNT_FORMAT = SDL_GPU_TEXTUREFORMAT_R16G16_FLOAT;
+
+static PipelineInfo make_count_info(const AttributeList &vert_attribs) {
+	return PipelineInfo{
+		.depth_test = true,
+		.stencil_test = false,
+		.targets = { { .format = COUNT_FORMAT, .alpha_blending = false, .additive_blending = true } },
+		.vert_attribs = vert_attribs,
+		.inst_attribs = {},
+		.cull_mode = SDL_GPU_CULLMODE_NONE,
+		.depth_compare = SDL_GPU_COMPAREOP_LESS_OR_EQUAL,
+	};
+}
+
+OverdrawCounter::OverdrawCounter(Renderer &renderer, ShaderCompiler &compiler, const AttributeList &vert_attribs):
+	m_renderer(&renderer),
+	m_shader(renderer, compiler, { .path = "depth_only.vert" }, { .path = "overdraw.frag" }, make_count_info(vert_attribs),
+		depth_only_pipeline),
+	m_readback(renderer)
+{
+	m_shader.prewarm(SHADERFEATURE_ALPHA_TEST);
+}
+
+void OverdrawCounter::destroy() {
+	if (!m_renderer) return;
+
+	if (*m_counts != U32_BAD) m_renderer->destroy_screen_texture(m_counts);
+	if (*m_depth != U32_BAD) m_renderer->destroy_screen_texture(m_depth);
+
+	m_readback.destroy();
+
+	m_renderer = nullptr;
+}
+
+void OverdrawCounter::poll() {
+	if (!m_renderer) return;
+
+	m_shader.poll(*m_renderer);
+
+	m_readback.poll([&](const void *data, u32 width, u32 height, u32 slot) {
+		const u32 *texels = (const u32 *) data;
+
+		m_baseline = m_current = m_covered = 0;
+
+		for (u32 i = 0; i < width * height; i++) {
+			vec2 counts = glm::unpackHalf2x16(texels[i]);
+
+			m_baseline += (u64) counts.x;
+			m_current += (u64) counts.y;
+			m_covered += counts.x > 0.0f;
+		}
+	});
+}
+
+void OverdrawCounter::count(const OverdrawDrawFunc &draw, bool prepass) {
+	SDL_GPUCommandBuffer *cb = m_renderer ? m_renderer->get_frame_command_buffer() : nullptr;
+	if (!cb) return;
+
+	if (*m_counts == U32_BAD) {
+		m_counts = m_renderer->create_screen_texture(COUNT_FORMAT, SDL_GPU_TEXTUREUSAGE_COLOR_TARGET);
+		m_depth = m_renderer->create_screen_texture(SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT, SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET);
+	}
+
+	// The baseline into red, then the frame into green over fresh depth
+	for (u32 i = 0; i < 2; i++) {
+		CustomInfo info = {
+			.color_targets = { {
+				.texture = m_renderer->get_screen_texture(m_counts),
+				.load_op = i == 0 ? SDL_GPU_LOADOP_CLEAR : SDL_GPU_LOADOP_LOAD,
+				.cycle = i == 0,
+			} },
+			.depth_texture = m_renderer->get_screen_texture(m_depth),
+			.depth_store_op = SDL_GPU_STOREOP_DONT_CARE,
+			.stencil_store_op = SDL_GPU_STOREOP_DONT_CARE,
+		};
+
+		ActiveRenderPass arp = m_renderer->begin_custom_render_pass(std::move(info));
+		if (arp.is_valid()) {
+			if (i == 0) {
+				draw(arp, m_shader, OVERDRAWPASS_BASELINE);
+			} else {
+				if (prepass) draw(arp, m_shader, OVERDRAWPASS_PREPASS);
+				draw(arp, m_shader, OVERDRAWPASS_CURRENT);
+			}
+		}
+		m_renderer->end_render_pass(std::move(arp));
+	}
+
+	m_readback.download(m_renderer->get_screen_texture(m_counts), m_renderer->get_window_width(),
+		m_renderer->get_window_height(), sizeof(u32));
+}
+
+void OverdrawCounter::bind(ActiveRenderPass &arp, OverdrawPass pass) {
+	static const vec4 WEIGHTS[] = {
+		vec4(1.0f, 0.0f, 0.0f, 0.0f),
+		vec4(0.0f),
+		vec4(0.0f, 1.0f, 0.0f, 0.0f),
+	};
+
+	arp.upload_fragment_uniform_buffer(OVERDRAW_WEIGHT_SLOT, &WEIGHTS[pass], sizeof(vec4));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+#include "ShaderCompiler.h"
+#include "ShaderPermutations.h"
+#include "TextureReadback.h"
+
+// Fragment uniform slot of the weight in overdraw.frag
+inline constexpr u32 OVERDRAW_WEIGHT_SLOT = 0;
+
+// The draws of a count, in the order count() asks for them
+enum OverdrawPass : u32 {
+	// Every draw in gather order, with no pre-pass. What the frame would cost with neither
+	OVERDRAWPASS_BASELINE,
+	// The frame's pre-pass, if it has one. Only lays down depth
+	OVERDRAWPASS_PREPASS,
+	// The frame's draws in the order it drew them
+	OVERDRAWPASS_CURRENT,
+};
+
+// Draws one pass of a count with shader, which takes the vertex layout the counter was created with. The pass has no
+// pipeline bound yet; call OverdrawCounter::bind() after the first use_shader()
+using OverdrawDrawFunc = std::function<void(ActiveRenderPass &arp, ShaderPermutations &shader, OverdrawPass pass)>;
+
+/* OverdrawCounter
+ * A debug counter of how many fragments the main pass shades per pixel, to see what the depth pre-pass and
+ * front-to-back sorting save. count() replays the frame's draws with the main pass's depth state (LESS_OR_EQUAL with
+ * writes) into a two channel float texture with additive blending: the baseline into red, then the frame as it was
+ * drawn into green, each over its own depth. The texture is downloaded and summed on the CPU once the GPU is done
+ * with it, FRAMES_IN_FLIGHT frames later.
+ *
+ * Counts assume early depth testing, which shaders that discard may not get, and are exact up to 2048 fragments per
+ * pixel. The replay costs about as much as the frame's geometry again, so only count while looking at the numbers.
+*/
+class OverdrawCounter {
+	Renderer *m_renderer = nullptr;
+
+	ShaderPermutations m_shader;
+
+	// Screen textures, created by the first count()
+	RID m_counts = U32_BAD;
+	RID m_depth = U32_BAD;
+
+	TextureReadback m_readback;
+
+	// From the last readback
+	u64 m_baseline = 0;
+	u64 m_current = 0;
+	u64 m_covered = 0;
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline OverdrawCounter() {}
+
+	/// <summary>
+	/// Builds the counting shaders. The textures are only created once something is counted
+	/// </summary>
+	/// <param name="renderer">- The Renderer the frame is drawn with</param>
+	/// <param name="compiler">- Compiles depth_only.vert and overdraw.frag</param>
+	/// <param name="vert_attribs">- The vertex layout of the meshes drawn</param>
+	OverdrawCounter(Renderer &renderer, ShaderCompiler &compiler, const AttributeList &vert_attribs);
+
+	OverdrawCounter(const OverdrawCounter &) = delete;
+	OverdrawCounter &operator=(const OverdrawCounter &) = delete;
+
+	inline ~OverdrawCounter() { destroy(); }
+
+	void destroy();
+
+	// Creates finished shader variants and sums finished downloads. Call after Renderer::begin_frame()
+	void poll();
+
+	/// <summary>
+	/// Records the counting passes and the download into the frame. Call between passes
+	/// </summary>
+	/// <param name="draw">- Draws the frame's draws for each pass</param>
+	/// <param name="prepass">- Whether the frame drew a depth pre-pass, and OVERDRAWPASS_PREPASS should be drawn</param>
+	void count(const OverdrawDrawFunc &draw, bool prepass);
+
+	// Pushes the weight of a pass to overdraw.frag. Call after use_shader()
+	static void bind(ActiveRenderPass &arp, OverdrawPass pass);
+
+	// Whether a count has come back yet
+	inline bool has_result() const { return m_covered; }
+
+	// Fragments shaded per pixel covered by anything, in the last count that came back
+	inline float get_baseline() const { return m_covered ? m_baseline / (float) m_covered : 0.0f; }
+	inline float get_current() const { return m_covered ? m_current / (float) m_covered : 0.0f; }
+};
@@ -0,0 +1,513 @@
+#include "RenderGraph.h"
+
+GraphPassBuilder::GraphPassBuilder(RenderGraph &graph, u32 pass):
+	m_graph(&graph), m_pass(pass)
+{}
+
+void GraphPassBuilder::write_color(const std::string &name) {
+	u32 resource = m_graph->find_resource(name);
+	if (resource == U32_BAD) return;
+
+	m_graph->m_passes[m_pass].color_writes.push_back(resource);
+	m_graph->m_resources[resource].writers.push_back(m_pass);
+	m_graph->m_resources[resource].usage |= SDL_GPU_TEXTUREUSAGE_COLOR_TARGET;
+}
+
+void GraphPassBuilder::write_depth(const std::string &name) {
+	u32 resource = m_graph->find_resource(name);
+	if (resource == U32_BAD) return;
+
+	m_graph->m_passes[m_pass].depth_write = resource;
+	m_graph->m_resources[resource].writers.push_back(m_pass);
+	m_graph->m_resources[resource].usage |= SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
+}
+
+void GraphPassBuilder::write_window() {
+	m_graph->m_passes[m_pass].writes_window = true;
+}
+
+void GraphPassBuilder::read(const std::string &name) {
+	u32 resource = m_graph->find_resource(name);
+	if (resource == U32_BAD) return;
+
+	m_graph->m_passes[m_pass].reads.push_back(resource);
+	m_graph->m_resources[resource].readers.push_back(m_pass);
+	m_graph->m_resources[resource].usage |= SDL_GPU_TEXTUREUSAGE_SAMPLER;
+}
+
+void GraphPassBuilder::keep() {
+	m_graph->m_passes[m_pass].keep = true;
+}
+
+RenderGraph::RenderGraph(Renderer &renderer):
+	m_renderer(&renderer)
+{}
+
+RenderGraph &RenderGraph::operator=(RenderGraph &&other) noexcept {
+	if (this == &other) return *this;
+
+	destroy();
+
+	m_renderer = other.m_renderer;
+	m_resources = std::move(other.m_resources);
+	m_resource_names = std::move(other.m_resource_names);
+	m_passes = std::move(other.m_passes);
+	m_order = std::move(other.m_order);
+	m_pool = std::move(other.m_pool);
+	m_stats = other.m_stats;
+	m_compiled = other.m_compiled;
+
+	other.m_renderer = nullptr;
+	other.m_pool.clear();
+	other.reset();
+
+	return *this;
+}
+
+void RenderGraph::destroy() {
+	if (!m_renderer) return;
+
+	for (PhysicalTexture &physical : m_pool) {
+		m_renderer->destroy_texture(physical.texture);
+	}
+	m_pool.clear();
+
+	reset();
+
+	m_renderer = nullptr;
+}
+
+void RenderGraph::reset() {
+	m_resources.clear();
+	m_resource_names.clear();
+	m_passes.clear();
+	m_order.clear();
+
+	m_compiled = false;
+}
+
+u32 RenderGraph::find_resource(const std::string &name) {
+	auto it = m_resource_names.find(name);
+	if (it == m_resource_names.end()) {
+		std::cout << "Render graph has no texture named " << name << "\n";
+		return U32_BAD;
+	}
+
+	return it->second;
+}
+
+void RenderGraph::create_texture(const std::string &name, const GraphTextureInfo &info) {
+	if (m_resource_names.contains(name)) {
+		std::cout << "Render graph texture " << name << " declared twice\n";
+		return;
+	}
+
+	m_resource_names[name] = m_resources.size();
+	m_resources.push_back(Resource{
+		.name = name,
+		.info = info
+	});
+}
+
+void RenderGraph::import_texture(const std::string &name, RID texture, bool output) {
+	if (m_resource_names.contains(name)) {
+		std::cout << "Render graph texture " << name << " declared twice\n";
+		return;
+	}
+
+	const TextureState &state = m_renderer->get_texture_info(texture);
+
+	m_resource_names[name] = m_resources.size();
+	m_resources.push_back(Resource{
+		.name = name,
+		.info = {
+			.format = state.format,
+			.width = state.width,
+			.height = state.height,
+			.clear = false
+		},
+		.imported = true,
+		.output = output,
+		.texture = texture
+	});
+}
+
+void RenderGraph::add_pass(const std::string &name, const GraphSetupFunc &setup, GraphExecuteFunc execute) {
+	m_passes.push_back(Pass{
+		.name = name,
+		.execute = std::move(execute)
+	});
+
+	GraphPassBuilder builder(*this, m_passes.size() - 1);
+	setup(builder);
+
+	m_compiled = false;
+}
+
+void RenderGraph::cull_passes() {
+	u32 count = m_passes.size();
+
+	// Work out each pass's dependencies from the order the passes were added
+	for (u32 p = 0; p < count; p++) {
+		Pass &pass = m_passes[p];
+
+		for (u32 r : pass.reads) {
+			const std::vector<u32> &writers = m_resources[r].writers;
+
+			// Read the latest writes added before this pass. If there are none, the producers were added later
+			bool any_before = std::any_of(writers.begin(), writers.end(), [&](u32 w) { return w < p; });
+			for (u32 w : writers) {
+				if (w != p && (w < p || !any_before)) {
+					pass.after.push_back(w);
+					pass.needs.push_back(w);
+				}
+			}
+		}
+
+		// Window passes draw over each other in the order they were added
+		if (pass.writes_window) {
+			for (u32 q = 0; q < p; q++) {
+				if (m_passes[q].writes_window) pass.after.push_back(q);
+			}
+		}
+
+		std::vector<u32> writes = pass.color_writes;
+		if (pass.depth_write != U32_BAD) writes.push_back(pass.depth_write);
+
+		for (u32 r : writes) {
+			// Earlier writers are loaded from, so they are needed as well as ordered
+			for (u32 w : m_resources[r].writers) {
+				if (w < p) {
+					pass.after.push_back(w);
+					pass.needs.push_back(w);
+				}
+			}
+
+			// Earlier readers of earlier writes must see them before they are overwritten
+			for (u32 q : m_resources[r].readers) {
+				if (q >= p) continue;
+
+				const std::vector<u32> &writers = m_resources[r].writers;
+				if (std::any_of(writers.begin(), writers.end(), [&](u32 w) { return w < q; })) {
+					pass.after.push_back(q);
+				}
+			}
+		}
+	}
+
+	// Anything observable outside the graph is a root
+	std::vector<u32> stack;
+	for (u32 p = 0; p < count; p++) {
+		Pass &pass = m_passes[p];
+		pass.culled = true;
+
+		bool root = pass.writes_window || pass.keep;
+		for (u32 r : pass.color_writes) root |= m_resources[r].output;
+		if (pass.depth_write != U32_BAD) root |= m_resources[pass.depth_write].output;
+
+		if (root) {
+			pass.culled = false;
+			stack.push_back(p);
+		}
+	}
+
+	while (!stack.empty()) {
+		u32 p = stack.back();
+		stack.pop_back();
+
+		for (u32 q : m_passes[p].needs) {
+			if (!m_passes[q].culled) continue;
+
+			m_passes[q].culled = false;
+			stack.push_back(q);
+		}
+	}
+}
+
+bool RenderGraph::order_passes() {
+	u32 count = m_passes.size();
+
+	std::vector<u32> pending(count, 0);
+	std::vector<std::vector<u32>> dependents(count);
+
+	for (u32 p = 0; p < count; p++) {
+		if (m_passes[p].culled) continue;
+
+		for (u32 q : m_passes[p].after) {
+			if (m_passes[q].culled) continue;
+
+			pending[p]++;
+			dependents[q].push_back(p);
+		}
+	}
+
+	// Among the passes that are ready, always take the one added first
+	std::vector<u32> ready;
+	auto later_first = [](u32 a, u32 b) { return a > b; };
+
+	for (u32 p = 0; p < count; p++) {
+		if (!m_passes[p].culled && pending[p] == 0) ready.push_back(p);
+	}
+	std::make_heap(ready.begin(), ready.end(), later_first);
+
+	m_order.clear();
+	while (!ready.empty()) {
+		std::pop_heap(ready.begin(), ready.end(), later_first);
+		u32 p = ready.back();
+		ready.pop_back();
+
+		m_order.push_back(p);
+
+		for (u32 d : dependents[p]) {
+			if (--pending[d] == 0) {
+				ready.push_back(d);
+				std::push_heap(ready.begin(), ready.end(), later_first);
+			}
+		}
+	}
+
+	for (u32 p = 0; p < count; p++) {
+		if (!m_passes[p].culled && pending[p] > 0) {
+			std::cout << "Render graph pass " << m_passes[p].name << " is part of a dependency cycle\n";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RenderGraph::allocate_textures() {
+	for (Resource &resource : m_resources) {
+		resource.first_use = U32_BAD;
+		resource.first_write = U32_BAD;
+		resource.last_use = U32_BAD;
+	}
+
+	for (u32 i = 0; i < m_order.size(); i++) {
+		const Pass &pass = m_passes[m_order[i]];
+
+		auto use = [&](u32 r, bool write) {
+			Resource &resource = m_resources[r];
+			if (resource.first_use == U32_BAD) resource.first_use = i;
+			if (write && resource.first_write == U32_BAD) resource.first_write = i;
+			resource.last_use = i;
+		};
+
+		for (u32 r : pass.reads) use(r, false);
+		for (u32 r : pass.color_writes) use(r, true);
+		if (pass.depth_write != U32_BAD) use(pass.depth_write, true);
+	}
+
+	// Hand out textures in the order they start being used, so a texture freed by one pass can be picked up
+	// by a later one
+	std::vector<u32> transient;
+	for (u32 r = 0; r < m_resources.size(); r++) {
+		Resource &resource = m_resources[r];
+		if (resource.imported || resource.first_use == U32_BAD) continue;
+
+		if (resource.info.width == 0) resource.info.width = m_renderer->get_window_width();
+		if (resource.info.height == 0) resource.info.height = m_renderer->get_window_height();
+
+		transient.push_back(r);
+	}
+
+	std::sort(transient.begin(), transient.end(), [&](u32 a, u32 b) {
+		return m_resources[a].first_use < m_resources[b].first_use;
+	});
+
+	for (PhysicalTexture &physical : m_pool) {
+		physical.used = false;
+	}
+
+	for (u32 r : transient) {
+		Resource &resource = m_resources[r];
+
+		PhysicalTexture *match = nullptr;
+		for (PhysicalTexture &physical : m_pool) {
+			if (physical.format != resource.info.format || physical.usage != resource.usage) continue;
+			if (physical.width != resource.info.width || physical.height != resource.info.height) continue;
+			if (physical.used && physical.busy_until >= resource.first_use) continue;
+
+			match = &physical;
+			break;
+		}
+
+		if (!match) {
+			SDL_GPUTextureCreateInfo ci = {
+				.type = SDL_GPU_TEXTURETYPE_2D,
+				.format = resource.info.format,
+				.usage = resource.usage,
+				.width = resource.info.width,
+				.height = resource.info.height,
+				.layer_count_or_depth = 1,
+				.num_levels = 1,
+				.sample_count = SDL_GPU_SAMPLECOUNT_1
+			};
+
+			m_pool.push_back(PhysicalTexture{
+				.texture = m_renderer->create_texture(&ci),
+				.format = resource.info.format,
+				.usage = resource.usage,
+				.width = resource.info.width,
+				.height = resource.info.height
+			});
+			match = &m_pool.back();
+		}
+
+		match->used = true;
+		match->busy_until = resource.last_use;
+		resource.texture = match->texture;
+	}
+
+	// Whatever this frame didn't need is stale, eg. sized for the window before a resize
+	u32 kept = 0;
+	for (u32 i = 0; i < m_pool.size(); i++) {
+		if (m_pool[i].used) {
+			m_pool[kept++] = m_pool[i];
+		} else {
+			m_renderer->destroy_texture(m_pool[i].texture);
+		}
+	}
+	m_pool.resize(kept);
+
+	m_stats.transient_textures = transient.size();
+	m_stats.physical_textures = m_pool.size();
+}
+
+void RenderGraph::choose_ops(u32 resource, u32 position, SDL_GPULoadOp *o_load, SDL_GPUStoreOp *o_store) const {
+	const Resource &r = m_resources[resource];
+
+	if (r.imported || r.first_write < position) {
+		*o_load = SDL_GPU_LOADOP_LOAD;
+	} else {
+		*o_load = r.info.clear ? SDL_GPU_LOADOP_CLEAR : SDL_GPU_LOADOP_DONT_CARE;
+	}
+
+	*o_store = r.imported || r.last_use > position ? SDL_GPU_STOREOP_STORE : SDL_GPU_STOREOP_DONT_CARE;
+}
+
+bool RenderGraph::compile() {
+	m_stats = {};
+
+	for (Pass &pass : m_passes) {
+		pass.after.clear();
+		pass.needs.clear();
+
+		bool has_targets = pass.writes_window || !pass.color_writes.empty() || pass.depth_write != U32_BAD;
+		if (!has_targets) {
+			std::cout << "Render graph pass " << pass.name << " writes nothing\n";
+			return false;
+		}
+
+		if (pass.writes_window && (!pass.color_writes.empty() || pass.depth_write != U32_BAD)) {
+			std::cout << "Render graph pass " << pass.name << " writes to both the window and textures\n";
+			return false;
+		}
+	}
+
+	cull_passes();
+	if (!order_passes()) return false;
+
+	allocate_textures();
+
+	m_stats.passes_executed = m_order.size();
+	m_stats.passes_culled = m_passes.size() - m_order.size();
+
+	m_compiled = true;
+	return true;
+}
+
+void RenderGraph::execute() {
+	if (!m_compiled && !compile()) return;
+
+	u32 window_passes_left = 0;
+	for (u32 p : m_order) {
+		if (m_passes[p].writes_window) window_passes_left++;
+	}
+	bool window_written = false;
+
+	// Outside of a frame each pass gets a command buffer of its own, which presents a swapchain texture of its own
+	if (window_passes_left > 1 && !m_renderer->get_frame_command_buffer()) {
+		std::cout << "Render graphs with several window passes must be executed inside a frame\n";
+		return;
+	}
+
+	for (u32 i = 0; i < m_order.size(); i++) {
+		Pass &pass = m_passes[m_order[i]];
+
+		ActiveRenderPass arp;
+		if (pass.writes_window) {
+			// Later window passes draw over the first, so only it clears and only the last discards depth
+			window_passes_left--;
+
+			WindowPassInfo info = {};
+			if (window_written) {
+				info.load_op = SDL_GPU_LOADOP_LOAD;
+				info.depth_load_op = SDL_GPU_LOADOP_LOAD;
+				info.stencil_load_op = SDL_GPU_LOADOP_LOAD;
+			}
+			if (window_passes_left > 0) {
+				info.depth_store_op = SDL_GPU_STOREOP_STORE;
+				info.stencil_store_op = SDL_GPU_STOREOP_STORE;
+
+				// The next pass loads the samples, not the resolved swapchain
+				if (m_renderer->get_window_sample_count() != SDL_GPU_SAMPLECOUNT_1) {
+					info.store_op = SDL_GPU_STOREOP_RESOLVE_AND_STORE;
+				}
+			}
+			window_written = true;
+
+			arp = m_renderer->begin_window_render_pass(info);
+		} else {
+			CustomInfo info = {};
+
+			for (u32 r : pass.color_writes) {
+				CustomTargetInfo target = {
+					.texture = m_renderer->get_texture(m_resources[r].texture),
+					.clear_color = m_resources[r].info.clear_color,
+					// Cycling would give aliased textures separate memory again
+					.cycle = false
+				};
+				choose_ops(r, i, &target.load_op, &target.store_op);
+
+				info.color_targets.push_back(target);
+			}
+
+			info.depth_enabled = pass.depth_write != U32_BAD;
+			if (info.depth_enabled) {
+				const Resource &depth = m_resources[pass.depth_write];
+
+				info.depth_texture = m_renderer->get_texture(depth.texture);
+				info.clear_depth = depth.info.clear_depth;
+				info.depth_cycle = false;
+				choose_ops(pass.depth_write, i, &info.depth_load_op, &info.depth_store_op);
+				info.clear_stencil = 0;
+				info.stencil_load_op = info.depth_load_op;
+				info.stencil_store_op = info.depth_store_op;
+			}
+
+			// Targets share a size, so any of them gives the viewport
+			const Resource &first = m_resources[pass.color_writes.empty() ? pass.depth_write : pass.color_writes[0]];
+			info.viewport = {
+				.x = 0.0f,
+				.y = 0.0f,
+				.w = (float) first.info.width,
+				.h = (float) first.info.height,
+				.min_depth = 0.0f,
+				.max_depth = 1.0f
+			};
+
+			arp = m_renderer->begin_custom_render_pass(std::move(info));
+		}
+
+		if (arp.is_valid() && pass.execute) {
+			pass.execute(arp, *this);
+		}
+		m_renderer->end_render_pass(std::move(arp));
+	}
+}
+
+RID RenderGraph::get_texture(const std::string &name) {
+	u32 resource = find_resource(name);
+	return resource == U32_BAD ? RID(U32_BAD) : m_resources[resource].texture;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+
+#include <functional>
+
+// Describes a texture created and owned by a RenderGraph
+struct GraphTextureInfo {
+	SDL_GPUTextureFormat format;
+
+	// 0 means the size of the window
+	u32 width = 0;
+	u32 height = 0;
+
+	// Used when the first pass to write the texture starts. If false, its contents start out undefined
+	bool clear = true;
+	SDL_FColor clear_color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float clear_depth = 1.0f;
+};
+
+// Counters for the last RenderGraph::compile()
+struct RenderGraphStats {
+	u32 passes_executed;
+	u32 passes_culled;
+
+	// Textures the graph describes vs. the ones actually allocated to back them
+	u32 transient_textures;
+	u32 physical_textures;
+};
+
+class RenderGraph;
+
+/* GraphPassBuilder
+ * Given to a pass's setup function to declare what the pass reads and writes. Nothing is allocated yet.
+*/
+class GraphPassBuilder {
+	RenderGraph *m_graph;
+	u32 m_pass;
+
+	friend class RenderGraph;
+
+	GraphPassBuilder(RenderGraph &graph, u32 pass);
+public:
+	// Renders to the texture as a color target. Targets are bound in the order they are declared
+	void write_color(const std::string &name);
+
+	// Renders to the texture as the depth target
+	void write_depth(const std::string &name);
+
+	// Renders to the window. The window's own depth texture is used, so write_depth() must not be called
+	void write_window();
+
+	// Samples the texture. Its RID can be fetched with RenderGraph::get_texture() while executing
+	void read(const std::string &name);
+
+	// Keeps the pass even if nothing uses what it writes, eg. because it also writes a buffer the graph can't see
+	void keep();
+};
+
+using GraphSetupFunc = std::function<void(GraphPassBuilder &builder)>;
+using GraphExecuteFunc = std::function<void(ActiveRenderPass &arp, RenderGraph &graph)>;
+
+/* RenderGraph
+ * Orders and runs render passes from what they declare to read and write, instead of the order they were added.
+ *
+ * compile() does the bookkeeping a hand-written frame would otherwise get wrong:
+ * - Passes whose output never reaches the window, an output texture or a kept pass are culled.
+ * - Passes are ordered so every read happens after all writes to the texture, keeping the order they were added
+ *   where the dependencies allow it.
+ * - Each target is cleared (or left undefined) by its first writer and loaded by later ones, and only stored if a
+ *   later pass needs it.
+ * - Transient textures whose lifetimes don't overlap share one allocation. SDL doesn't expose memory aliasing, so
+ *   only textures with the same format, size and usage can share.
+ *
+ * The graph is meant to be rebuilt every frame with reset(). The textures backing it are kept between frames and
+ * only reallocated when the descriptions or window size change.
+*/
+class RenderGraph {
+	struct Resource {
+		std::string name;
+		GraphTextureInfo info;
+
+		// Imported textures are never aliased, and are always loaded and stored
+		bool imported = false;
+		bool output = false;
+		RID texture = U32_BAD;
+
+		SDL_GPUTextureUsageFlags usage = 0;
+
+		std::vector<u32> writers;
+		std::vector<u32> readers;
+
+		// Execution order indices, set by compile(). U32_BAD if no surviving pass uses it
+		u32 first_use;
+		u32 first_write;
+		u32 last_use;
+	};
+
+	struct Pass {
+		std::string name;
+		GraphExecuteFunc execute;
+
+		std::vector<u32> color_writes;
+		u32 depth_write = U32_BAD;
+		std::vector<u32> reads;
+
+		bool writes_window = false;
+		bool keep = false;
+
+		// Passes that must run first. Only the ones in needs also keep this pass's inputs alive
+		std::vector<u32> after;
+		std::vector<u32> needs;
+
+		bool culled = false;
+	};
+
+	struct PhysicalTexture {
+		RID texture;
+
+		SDL_GPUTextureFormat format;
+		SDL_GPUTextureUsageFlags usage;
+		u32 width, height;
+
+		// Execution index of the last pass that uses it this frame
+		u32 busy_until;
+		bool used;
+	};
+
+	Renderer *m_renderer = nullptr;
+
+	std::vector<Resource> m_resources;
+	Map<std::string, u32> m_resource_names;
+
+	std::vector<Pass> m_passes;
+	std::vector<u32> m_order;
+
+	std::vector<PhysicalTexture> m_pool;
+
+	RenderGraphStats m_stats = {};
+	bool m_compiled = false;
+
+	friend class GraphPassBuilder;
+
+	u32 find_resource(const std::string &name);
+
+	// Marks needed passes, working back from the ones whose output is observable
+	void cull_passes();
+
+	// Topologically sorts the surviving passes. Returns false if the declarations form a cycle
+	bool order_passes();
+
+	// Assigns every transient resource a texture from the pool, sharing between disjoint lifetimes
+	void allocate_textures();
+
+	// Chooses the load and store ops of one attachment of the pass at execution index position
+	void choose_ops(u32 resource, u32 position, SDL_GPULoadOp *o_load, SDL_GPUStoreOp *o_store) const;
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline RenderGraph() {}
+
+	RenderGraph(Renderer &renderer);
+
+	RenderGraph(const RenderGraph &) = delete;
+	RenderGraph &operator=(const RenderGraph &) = delete;
+
+	// Moved-from graphs own no textures, so only the new one frees them
+	inline RenderGraph(RenderGraph &&other) noexcept { *this = std::move(other); }
+	RenderGraph &operator=(RenderGraph &&other) noexcept;
+
+	inline ~RenderGraph() { destroy(); }
+
+	// Frees every texture the graph allocated
+	void destroy();
+
+	// Forgets every pass and resource, keeping the allocated textures for the next frame
+	void reset();
+
+	/// <summary>
+	/// Declares a texture that only lives for the frame. It may share memory with other transient textures
+	/// </summary>
+	/// <param name="name">- The name passes refer to it by</param>
+	/// <param name="info">- A description of the texture</param>
+	void create_texture(const std::string &name, const GraphTextureInfo &info);
+
+	/// <summary>
+	/// Declares a texture that lives outside of the graph, eg. a shadow map kept between frames
+	/// </summary>
+	/// <param name="name">- The name passes refer to it by</param>
+	/// <param name="texture">- An RID from Renderer::create_texture()</param>
+	/// <param name="output">- If true, passes writing it are never culled</param>
+	void import_texture(const std::string &name, RID texture, bool output);
+
+	/// <summary>
+	/// Adds a pass. setup runs immediately to declare what the pass uses; execute runs from execute()
+	/// </summary>
+	/// <param name="name">- Used in error messages</param>
+	/// <param name="setup">- Declares the pass's reads and writes</param>
+	/// <param name="execute">- Records the pass's draws</param>
+	void add_pass(const std::string &name, const GraphSetupFunc &setup, GraphExecuteFunc execute);
+
+	// Culls, orders and allocates. Called by execute() if needed. Returns false if the graph is invalid
+	bool compile();
+
+	// Runs every surviving pass in order. Call between Renderer::begin_frame() and end_frame()
+	void execute();
+
+	// Returns the texture backing a resource, eg. to sample it. Only valid after compile()
+	RID get_texture(const std::string &name);
+
+	inline const RenderGraphStats &get_stats() const { return m_stats; }
+};
@@ -0,0 +1,57 @@
+#include "RenderGraphTest.h"
+
+#ifdef _DEBUG
+
+#include "RenderGraph.h"
+
+bool test_render_graph_window_passes() {
+	if (!SDL_Init(SDL_INIT_VIDEO)) {
+		std::cout << "SDL Error: " << SDL_GetError() << "\n";
+		return false;
+	}
+
+	SDL_Window *window = SDL_CreateWindow("Render graph test", 256, 256, SDL_WINDOW_VULKAN);
+	if (!window) {
+		std::cout << "SDL Error: " << SDL_GetError() << "\n";
+		SDL_Quit();
+		return false;
+	}
+
+	bool passed;
+	{
+		Renderer renderer(window);
+		RenderGraph graph(renderer);
+
+		// The passes that ran, in order
+		std::vector<u32> drawn;
+		for (u32 i = 0; i < 2; i++) {
+			graph.add_pass("window " + std::to_string(i),
+				[](GraphPassBuilder &builder) { builder.write_window(); },
+				[&drawn, i](ActiveRenderPass &arp, RenderGraph &graph) { drawn.push_back(i); });
+		}
+
+		// Outside of a frame each pass would present a swapchain texture of its own
+		graph.execute();
+		bool refused = drawn.empty();
+
+		renderer.begin_frame();
+		graph.execute();
+		u32 acquires = renderer.get_swapchain_acquire_count();
+		renderer.end_frame();
+
+		// The passes only run if the window could be drawn to, but the swapchain is acquired either way
+		bool in_order = drawn.empty() || drawn == std::vector<u32>{ 0, 1 };
+		passed = refused && graph.get_stats().passes_executed == 2 && in_order && acquires == 1;
+
+		std::cout << "Render graph window passes: " << (refused ? "refused" : "ran") << " outside a frame, "
+			<< drawn.size() << " drawn " << (in_order ? "in order" : "out of order") << " inside one, swapchain acquired "
+			<< acquires << " time(s) - " << (passed ? "passed" : "FAILED") << "\n";
+	}
+
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+
+	return passed;
+}
+
+#endif
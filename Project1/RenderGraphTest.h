@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common.h"
+
+// Debug builds only, run with --render-graph-test
+#ifdef _DEBUG
+
+/// <summary>
+/// Runs a graph of two window passes on a window of its own. It must refuse to run them outside a frame, and inside
+/// one run them in order on a single swapchain texture
+/// </summary>
+/// <returns>True if the test passed. The result is also printed</returns>
+bool test_render_graph_window_passes();
+
+#endif
@@ -3,7 +3,22 @@
 RenderRetarget::RenderRetarget(Renderer &renderer, SDL_Window *window) :
 	m_renderer(&renderer), m_targ_window(window)
 {
+	SDL_GetWindowSizeInPixels(window, &m_winw, &m_winh);
+
 	SDL_ClaimWindowForGPUDevice(m_renderer->m_device, m_targ_window);
+
+	// The window's depth, always the first screen texture like the Renderer's. match_sample_count() makes it multisampled
+	create_screen_texture(SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT, m_renderer->get_window_depth_usage(SDL_GPU_SAMPLECOUNT_1));
+	match_sample_count();
+
+	m_viewport = {
+		.x = 0.0f,
+		.y = 0.0f,
+		.w = (float) m_winw,
+		.h = (float) m_winh,
+		.min_depth = 0.0f,
+		.max_depth = 1.0f
+	};
 }
 
 RenderRetarget::~RenderRetarget() {
@@ -13,9 +28,18 @@ RenderRetarget::~RenderRetarget() {
 void RenderRetarget::release() {
 	if (!m_renderer) return;
 
+	// A frame still in flight may use them, so they go once it has retired
+	FrameContext &frame = m_renderer->m_frames[m_renderer->m_frame_index];
+
 	for (u32 i = 0; i < m_screen_textures.size(); i++) {
 		if (m_screen_textures[i])
-			SDL_ReleaseGPUTexture(m_renderer->m_device, m_screen_textures[i]);
+			frame.textures.push_back(m_screen_textures[i]);
+	}
+	m_screen_textures.clear();
+
+	if (m_window_msaa) {
+		frame.textures.push_back(m_window_msaa);
+		m_window_msaa = nullptr;
 	}
 
 	SDL_ReleaseWindowFromGPUDevice(m_renderer->m_device, m_targ_window);
@@ -23,25 +47,89 @@ void RenderRetarget::release() {
 	m_renderer = nullptr;
 }
 
+void RenderRetarget::resize_window(u32 new_w, u32 new_h) {
+	m_winw = new_w;
+	m_winh = new_h;
+
+	m_viewport.w = (float) new_w;
+	m_viewport.h = (float) new_h;
+
+	FrameContext &frame = m_renderer->m_frames[m_renderer->m_frame_index];
+
+	for (u32 i = 0; i < m_screen_textures.size(); ++i) {
+		if (!m_screen_textures[i]) continue;
+
+		frame.textures.push_back(m_screen_textures[i]);
+		m_screen_textures[i] = create_window_sized(m_screen_tex_infos[i]);
+	}
+
+	if (m_window_msaa) {
+		frame.textures.push_back(m_window_msaa);
+		m_window_msaa = create_window_sized({
+			.format = SDL_GetGPUSwapchainTextureFormat(m_renderer->m_device, m_targ_window),
+			.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+			.sample_count = m_screen_tex_infos[0].sample_count
+		});
+	}
+}
+
+void RenderRetarget::match_sample_count() {
+	SDL_GPUSampleCount sample_count = m_renderer->get_window_sample_count();
+	if (sample_count == m_screen_tex_infos[0].sample_count) return;
+
+	FrameContext &frame = m_renderer->m_frames[m_renderer->m_frame_index];
+
+	frame.textures.push_back(m_screen_textures[0]);
+	m_screen_tex_infos[0].usage = m_renderer->get_window_depth_usage(sample_count);
+	m_screen_tex_infos[0].sample_count = sample_count;
+	m_screen_textures[0] = create_window_sized(m_screen_tex_infos[0]);
+
+	if (m_window_msaa) {
+		frame.textures.push_back(m_window_msaa);
+		m_window_msaa = nullptr;
+	}
+
+	if (sample_count != SDL_GPU_SAMPLECOUNT_1) {
+		m_window_msaa = create_window_sized({
+			.format = SDL_GetGPUSwapchainTextureFormat(m_renderer->m_device, m_targ_window),
+			.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+			.sample_count = sample_count
+		});
+	}
+}
+
 mat4x4 RenderRetarget::generate_perspective(float fov_rad) {
 	return glm::perspectiveFov(fov_rad, m_viewport.w, m_viewport.h, 0.01f, 4096.0f);
 }
 
-ActiveRenderPass RenderRetarget::begin_window_render_pass() {
-	SDL_GPUCommandBuffer *cb = SDL_AcquireGPUCommandBuffer(m_renderer->m_device);
+ActiveRenderPass RenderRetarget::begin_window_render_pass(const WindowPassInfo &description) {
+	// Pipelines for window passes are built with the Renderer's count, which may have changed
+	match_sample_count();
+
+	SDL_GPUCommandBuffer *cb = m_renderer->acquire_command_buffer();
+
+	bool in_frame = cb == m_renderer->m_frame_cb;
 
 	SDL_GPUTexture *color_target_tex = NULL;
 
-	if (!SDL_AcquireGPUSwapchainTexture(cb, m_targ_window, &color_target_tex, NULL, NULL)) {
-		SDL_CancelGPUCommandBuffer(cb);
-		return ActiveRenderPass();
-	}
+	// A command buffer may only acquire the swapchain once, and presents whatever it acquired
+	if (in_frame && m_swapchain_serial == m_renderer->m_frame_cb_serial) {
+		color_target_tex = m_swapchain;
+	} else {
+		if (!SDL_AcquireGPUSwapchainTexture(cb, m_targ_window, &color_target_tex, NULL, NULL)) {
+			m_renderer->abandon_command_buffer(cb);
+			return ActiveRenderPass();
+		}
 
-	// NOTE: Use SDL_SubmitGPUCommandBuffer from here ======
+		if (in_frame) {
+			m_swapchain = color_target_tex;
+			m_swapchain_serial = m_renderer->m_frame_cb_serial;
+		}
+	}
 
 	// Not a bad thing. Just means the window cannot display anything more at this point
 	if (!color_target_tex) {
-		SDL_SubmitGPUCommandBuffer(cb);
+		m_renderer->finish_command_buffer(cb);
 		return ActiveRenderPass();
 	}
 
@@ -50,22 +138,29 @@ ActiveRenderPass RenderRetarget::begin_window_render_pass() {
 			.texture = color_target_tex,
 			.mip_level = 0,
 			.layer_or_depth_plane = 0,
-			.clear_color = {0.0f, 0.0f, 0.0f, 0.0f},
-			.load_op = SDL_GPU_LOADOP_CLEAR,
-			.store_op = SDL_GPU_STOREOP_STORE,
-			.cycle = true
+			.clear_color = description.clear_color,
+			.load_op = description.load_op,
+			.store_op = description.store_op,
+			.cycle = description.load_op != SDL_GPU_LOADOP_LOAD
 		}
 	};
 
+	// Draw into the samples and resolve them into the swapchain, which is overwritten whole
+	if (m_window_msaa) {
+		ctis[0].texture = m_window_msaa;
+		ctis[0].resolve_texture = color_target_tex;
+		if (description.store_op == SDL_GPU_STOREOP_STORE) ctis[0].store_op = SDL_GPU_STOREOP_RESOLVE;
+	}
+
 	SDL_GPUDepthStencilTargetInfo dsti = {
 		.texture = m_screen_textures[0],
-		.clear_depth = 1.0,
-		.load_op = SDL_GPU_LOADOP_CLEAR,
-		.store_op = SDL_GPU_STOREOP_STORE,
-		.stencil_load_op = SDL_GPU_LOADOP_CLEAR,
-		.stencil_store_op = SDL_GPU_STOREOP_STORE,
-		.cycle = true,
-		.clear_stencil = 0,
+		.clear_depth = description.clear_depth,
+		.load_op = description.depth_load_op,
+		.store_op = description.depth_store_op,
+		.stencil_load_op = description.stencil_load_op,
+		.stencil_store_op = description.stencil_store_op,
+		.cycle = description.depth_load_op != SDL_GPU_LOADOP_LOAD && description.stencil_load_op != SDL_GPU_LOADOP_LOAD,
+		.clear_stencil = description.clear_stencil,
 	};
 
 
@@ -80,29 +175,41 @@ ActiveRenderPass RenderRetarget::begin_window_render_pass() {
 	return arp;
 }
 
-RID RenderRetarget::create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage) {
-	SDL_GPUTextureCreateInfo ci = {
-		.type = SDL_GPU_TEXTURETYPE_2D,
+RID RenderRetarget::create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage,
+	SDL_GPUSampleCount sample_count)
+{
+	m_screen_tex_infos.push_back({
 		.format = format,
 		.usage = usage,
+		.sample_count = sample_count
+		});
+	m_screen_textures.push_back(create_window_sized(m_screen_tex_infos.back()));
+
+	return RID(m_screen_textures.size() - 1);
+}
+
+SDL_GPUTexture *RenderRetarget::create_window_sized(const ScreenTextureInfo &info) {
+	SDL_GPUTextureCreateInfo ci = {
+		.type = SDL_GPU_TEXTURETYPE_2D,
+		.format = info.format,
+		.usage = info.usage,
 		.width = (u32) m_winw,
 		.height = (u32) m_winh,
 		.layer_count_or_depth = 1,
 		.num_levels = 1,
-		.sample_count = SDL_GPU_SAMPLECOUNT_1
+		.sample_count = info.sample_count
 	};
 
-	m_screen_textures.push_back(SDL_CreateGPUTexture(m_renderer->m_device, &ci));
-	m_screen_tex_infos.push_back({
-		.format = format,
-		.usage = usage
-		});
+	SDL_GPUTexture *texture = SDL_CreateGPUTexture(m_renderer->m_device, &ci);
+	if (!texture) {
+		std::cout << "SDL Error: " << SDL_GetError() << "\n";
+	}
 
-	return RID(m_screen_textures.size() - 1);
+	return texture;
 }
 
 void RenderRetarget::destroy_screen_texture(RID texture) {
-	SDL_ReleaseGPUTexture(m_renderer->m_device, m_screen_textures[*texture]);
+	m_renderer->m_frames[m_renderer->m_frame_index].textures.push_back(m_screen_textures[*texture]);
 
 	m_screen_textures[*texture] = nullptr;
 }
\ No newline at end of file
@@ -18,6 +18,19 @@ class RenderRetarget {
 	std::vector<SDL_GPUTexture *> m_screen_textures;
 	std::vector<ScreenTextureInfo> m_screen_tex_infos;
 
+	// The multisampled color target while the Renderer's window sample count is above 1, otherwise nullptr
+	SDL_GPUTexture *m_window_msaa = nullptr;
+
+	// The swapchain texture acquired into the Renderer's frame command buffer, shared by every window pass recorded
+	// into it like FrameContext::swapchain. Only valid while m_swapchain_serial matches the Renderer's
+	SDL_GPUTexture *m_swapchain = nullptr;
+	u64 m_swapchain_serial = 0;
+
+	SDL_GPUTexture *create_window_sized(const ScreenTextureInfo &info);
+
+	// Brings the depth and color targets to the Renderer's window sample count, if it changed since
+	void match_sample_count();
+
 public:
 	// This does nothing and initializes nothing. NEVER use instances initialized this way.
 	inline RenderRetarget() {}
@@ -49,10 +62,14 @@ public:
 	mat4x4 generate_perspective(float fov_rad);
 
 	/// <summary>
-	/// Begins a render pass. The render pass will target the window that was specified at creation
+	/// Begins a render pass. The render pass will target the window that was specified at creation. Inside a frame,
+	/// every window pass on this instance draws to the same swapchain texture, acquired by the first. It is drawn with
+	/// the Renderer's window sample count like its own window passes, so the same pipelines can be used, as long as
+	/// both windows have the same swapchain format
 	/// </summary>
+	/// <param name="description">- (Optional) How the color and depth targets are loaded and stored</param>
 	/// <returns>An ActiveRenderPass which should be ended with end_render_pass() on the original Renderer</returns>
-	ActiveRenderPass begin_window_render_pass();
+	ActiveRenderPass begin_window_render_pass(const WindowPassInfo &description = {});
 
 	/// <summary>
 	/// Creates a 2D texture that resizes to the screen size. Once freed, the slot will not be reused, so
@@ -60,8 +77,10 @@ public:
 	/// </summary>
 	/// <param name="format">- The SDL format of the texture</param>
 	/// <param name="usage">- The SDL flags describing its purpose</param>
+	/// <param name="sample_count">- (Optional) Samples per pixel</param>
 	/// <returns>An RID representing the texture</returns>
-	RID create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage);
+	RID create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage,
+		SDL_GPUSampleCount sample_count = SDL_GPU_SAMPLECOUNT_1);
 
 	// Returns the SDL handle for the RID representing the texture. This handle should only be acquired from
 	// create_screen_texture(), and only from this instance
@@ -2,7 +2,7 @@
 
 u32 Renderer::get_unused_buffer() {
 	for (u32 i = 0; i < m_buffers.size(); ++i) {
-		if (!m_buffers[i]) {
+		if (!m_buffers[i] && !m_buffer_retiring[i]) {
 			return i;
 		}
 	}
@@ -11,14 +11,78 @@ u32 Renderer::get_unused_buffer() {
 
 u32 Renderer::get_unused_texture() {
 	for (u32 i = 0; i < m_user_textures.size(); ++i) {
-		if (!m_user_textures[i]) {
+		if (!m_user_textures[i] && !m_texture_retiring[i]) {
 			return i;
 		}
 	}
 	return U32_BAD;
 }
 
+void Renderer::regenerate_mips(SDL_GPUCommandBuffer *cb, u32 texture) {
+	TextureState &state = m_texture_states[texture];
+	const TextureRect &rect = state.dirty_rect;
+
+	state.dirty_mip = false;
+
+	bool whole = rect.x == 0 && rect.y == 0 && rect.w == state.width && rect.h == state.height;
+	bool layered = state.type == SDL_GPU_TEXTURETYPE_2D || state.type == SDL_GPU_TEXTURETYPE_2D_ARRAY;
+
+	// Partial rebuilds blit level by level, which only makes sense for plain 2D layers
+	if (whole || !layered) {
+		SDL_GenerateMipmapsForGPUTexture(cb, m_user_textures[texture]);
+		return;
+	}
+
+	for (u32 layer = rect.first_layer; layer < rect.first_layer + rect.num_layers; ++layer) {
+		u32 x0 = rect.x;
+		u32 y0 = rect.y;
+		u32 x1 = rect.x + rect.w;
+		u32 y1 = rect.y + rect.h;
+
+		for (u32 level = 1; level < state.mip_levels; ++level) {
+			u32 level_w = std::max(state.width >> level, 1u);
+			u32 level_h = std::max(state.height >> level, 1u);
+
+			// Round outwards so every texel touched by the previous level is rebuilt
+			x0 >>= 1;
+			y0 >>= 1;
+			x1 = std::min((x1 + 1) >> 1, level_w);
+			y1 = std::min((y1 + 1) >> 1, level_h);
+
+			u32 src_w = std::max(state.width >> (level - 1), 1u);
+			u32 src_h = std::max(state.height >> (level - 1), 1u);
+
+			SDL_GPUBlitInfo bi = {
+				.source = {
+					.texture = m_user_textures[texture],
+					.mip_level = level - 1,
+					.layer_or_depth_plane = layer,
+					.x = x0 * 2,
+					.y = y0 * 2,
+					.w = std::min(x1 * 2, src_w) - x0 * 2,
+					.h = std::min(y1 * 2, src_h) - y0 * 2
+				},
+				.destination = {
+					.texture = m_user_textures[texture],
+					.mip_level = level,
+					.layer_or_depth_plane = layer,
+					.x = x0,
+					.y = y0,
+					.w = x1 - x0,
+					.h = y1 - y0
+				},
+				.load_op = SDL_GPU_LOADOP_LOAD,
+				.filter = SDL_GPU_FILTER_LINEAR,
+				.cycle = false
+			};
+
+			SDL_BlitGPUTexture(cb, &bi);
+		}
+	}
+}
+
 Renderer::Renderer(SDL_Window *window):
+	m_shader_cache(SHADER_CACHE_PATH),
 	m_targ_window(window)
 {
 	m_device = SDL_CreateGPUDevice(SDL_GPU_SHADERFORMAT_SPIRV, true, NULL);
@@ -27,9 +91,7 @@ Renderer::Renderer(SDL_Window *window):
 
 	SDL_ClaimWindowForGPUDevice(m_device, window);
 
-	create_screen_texture(
-		SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT,
-		SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET);
+	create_screen_texture(SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT, get_window_depth_usage(SDL_GPU_SAMPLECOUNT_1));
 
 	m_viewport = {
 		.x = 0.0f,
@@ -45,7 +107,9 @@ Renderer::Renderer(SDL_Window *window):
 		.size = TRANSFER_BUFFER_SIZE
 	};
 
-	m_upload_buffer = SDL_CreateGPUTransferBuffer(m_device, &utbci);
+	for (FrameContext &frame : m_frames) {
+		frame.upload = SDL_CreateGPUTransferBuffer(m_device, &utbci);
+	}
 
 	SDL_GPUTransferBufferCreateInfo dtbci = {
 		.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD,
@@ -72,6 +136,13 @@ void Renderer::clean_resources(RendererCleanupExclude exclude) {
 	case RendererCleanupExclude::DEFAULT:
 		break;
 	}
+
+	// Nothing may still be in use once resources start disappearing
+	end_frame();
+	SDL_WaitForGPUIdle(m_device);
+	for (FrameContext &frame : m_frames) {
+		retire_frame(frame);
+	}
 	
 	for (u32 i = 0; i < m_buffers.size(); ++i) {
 		if (m_buffers[i]) {
@@ -80,6 +151,7 @@ void Renderer::clean_resources(RendererCleanupExclude exclude) {
 	}
 	m_buffers.clear();
 	m_buffer_infos.clear();
+	m_buffer_retiring.clear();
 
 	// Unless we don't exclude internals, exclude the first screen texture (the depth texture)
 	if (exclude_internals) {
@@ -98,6 +170,11 @@ void Renderer::clean_resources(RendererCleanupExclude exclude) {
 		}
 		m_screen_textures.clear();
 		m_screen_tex_infos.clear();
+
+		if (m_window_msaa) {
+			SDL_ReleaseGPUTexture(m_device, m_window_msaa);
+			m_window_msaa = nullptr;
+		}
 	}
 
 
@@ -108,6 +185,8 @@ void Renderer::clean_resources(RendererCleanupExclude exclude) {
 	}
 	m_user_textures.clear();
 	m_texture_states.clear();
+	m_texture_retiring.clear();
+	m_mip_queue.clear();
 
 	for (u32 i = 0; i < m_samplers.size(); ++i) {
 		if (m_samplers[i]) {
@@ -118,11 +197,16 @@ void Renderer::clean_resources(RendererCleanupExclude exclude) {
 
 	if (!exclude_shaders) {
 		m_shaders.clear();
+		m_shader_cache.clear_pipelines();
 	}
 
 	if (!exclude_internals) {
-		SDL_ReleaseGPUTransferBuffer(m_device, m_upload_buffer);
-		m_upload_buffer = nullptr;
+		m_shader_cache.save();
+
+		for (FrameContext &frame : m_frames) {
+			SDL_ReleaseGPUTransferBuffer(m_device, frame.upload);
+			frame.upload = nullptr;
+		}
 		SDL_ReleaseGPUTransferBuffer(m_device, m_download_buffer);
 		m_download_buffer = nullptr;
 
@@ -135,10 +219,149 @@ void Renderer::clean_resources(RendererCleanupExclude exclude) {
 }
 
 RID Renderer::add_shader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo &&pip) {
-	m_shaders.emplace_back(vs, fs, std::move(pip), m_device);
+	if (vs.code.empty() && !m_shader_cache.read_file(vs.path, &vs.code)) {
+		std::cout << "Could not read vertex shader " << vs.path << "\n";
+	}
+
+	if (fs.code.empty() && !m_shader_cache.read_file(fs.path, &fs.code)) {
+		std::cout << "Could not read fragment shader " << fs.path << "\n";
+	}
+
+	u64 key = hash_pipeline_info(pip, hash_stage_info(fs, hash_stage_info(vs)));
+
+	u32 existing = m_shader_cache.find_pipeline(key);
+	if (existing != U32_BAD) {
+		return RID(existing);
+	}
+
+	m_shaders.emplace_back(std::move(vs), std::move(fs), std::move(pip), m_device);
+
+	// Mismatched layouts are reported by VisualShader, don't hand out an RID that would fail on the GPU
+	if (!m_shaders.back().is_valid()) {
+		m_shaders.pop_back();
+		return RID(U32_BAD);
+	}
+
+	m_shader_cache.add_pipeline(key, m_shaders.size() - 1);
+
 	return RID(m_shaders.size() - 1);
 }
 
+std::vector<RID> Renderer::add_shaders(std::vector<ShaderBatchEntry> batch) {
+	u32 count = batch.size();
+
+	std::vector<RID> rids(count, RID(U32_BAD));
+	std::vector<u64> keys(count);
+
+	// Uncached files are read by the workers and stored afterwards, the cache isn't written while they run
+	std::vector<byte> read_vs(count, 0);
+	std::vector<byte> read_fs(count, 0);
+
+	parallel_for(count, [&](u32 i) {
+		ShaderBatchEntry &entry = batch[i];
+
+		for (auto [stage, o_read] : { std::pair{ &entry.vs, &read_vs[i] }, std::pair{ &entry.fs, &read_fs[i] } }) {
+			if (!stage->code.empty() || m_shader_cache.find_file(stage->path, &stage->code)) continue;
+
+			u32 size;
+			byte *data = read_whole_file(stage->path, &size);
+			if (!data || size < 1) continue;
+
+			stage->code.assign(data, data + size);
+			delete[] data;
+			*o_read = 1;
+		}
+
+		keys[i] = hash_pipeline_info(entry.pip, hash_stage_info(entry.fs, hash_stage_info(entry.vs)));
+	});
+
+	// Deduplicate on the main thread, against existing pipelines and within the batch
+	std::vector<u32> to_build;
+	Map<u64, u32> first_with_key;
+
+	for (u32 i = 0; i < count; i++) {
+		ShaderBatchEntry &entry = batch[i];
+		if (read_vs[i]) m_shader_cache.store_file(entry.vs.path, entry.vs.code);
+		if (read_fs[i]) m_shader_cache.store_file(entry.fs.path, entry.fs.code);
+
+		if (entry.vs.code.empty() || entry.fs.code.empty()) {
+			std::cout << "Could not read " << entry.vs.path << " or " << entry.fs.path << "\n";
+			continue;
+		}
+
+		u32 existing = m_shader_cache.find_pipeline(keys[i]);
+		if (existing != U32_BAD) {
+			rids[i] = RID(existing);
+		} else if (first_with_key.try_emplace(keys[i], i).second) {
+			to_build.push_back(i);
+		}
+	}
+
+	// Reflection and object creation are the slow part. SDL allows creating resources from any thread
+	std::vector<VisualShader> built(to_build.size());
+
+	parallel_for(to_build.size(), [&](u32 i) {
+		ShaderBatchEntry &entry = batch[to_build[i]];
+		built[i] = VisualShader(std::move(entry.vs), std::move(entry.fs), std::move(entry.pip), m_device);
+	});
+
+	for (u32 i = 0; i < to_build.size(); i++) {
+		if (!built[i].is_valid()) continue;
+
+		m_shaders.push_back(std::move(built[i]));
+		m_shader_cache.add_pipeline(keys[to_build[i]], m_shaders.size() - 1);
+		rids[to_build[i]] = RID(m_shaders.size() - 1);
+	}
+
+	// Duplicates within the batch share the pipeline of the first one
+	for (u32 i = 0; i < count; i++) {
+		if (*rids[i] != U32_BAD) continue;
+
+		auto it = first_with_key.find(keys[i]);
+		if (it != first_with_key.end() && it->second != i) {
+			rids[i] = rids[it->second];
+		}
+	}
+
+	return rids;
+}
+
+RID Renderer::reserve_shader() {
+	m_shaders.emplace_back();
+	return RID(m_shaders.size() - 1);
+}
+
+bool Renderer::rebuild_shader(RID shader, ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo &&pip) {
+	if (*shader >= m_shaders.size()) {
+		std::cout << "Tried to rebuild shader " << *shader << ", which doesn't exist\n";
+		return false;
+	}
+
+	if (vs.code.empty() && !m_shader_cache.read_file(vs.path, &vs.code)) {
+		std::cout << "Could not read vertex shader " << vs.path << "\n";
+		return false;
+	}
+
+	if (fs.code.empty() && !m_shader_cache.read_file(fs.path, &fs.code)) {
+		std::cout << "Could not read fragment shader " << fs.path << "\n";
+		return false;
+	}
+
+	u64 key = hash_pipeline_info(pip, hash_stage_info(fs, hash_stage_info(vs)));
+
+	VisualShader replacement(std::move(vs), std::move(fs), std::move(pip), m_device);
+	if (!replacement.is_valid()) {
+		return false;
+	}
+
+	m_shaders[*shader] = std::move(replacement);
+
+	m_shader_cache.remove_pipeline(*shader);
+	m_shader_cache.add_pipeline(key, *shader);
+
+	return true;
+}
+
 void Renderer::resize_window(u32 new_w, u32 new_h) {
 	m_winw = new_w;
 	m_winh = new_h;
@@ -149,32 +372,217 @@ void Renderer::resize_window(u32 new_w, u32 new_h) {
 	for (u32 i = 0; i < m_screen_textures.size(); ++i) {
 		if (!m_screen_textures[i]) continue;
 
-		SDL_ReleaseGPUTexture(m_device, m_screen_textures[i]);
-
-		SDL_GPUTextureCreateInfo ci = {
-			.type = SDL_GPU_TEXTURETYPE_2D,
-			.format = m_screen_tex_infos[i].format,
-			.usage = m_screen_tex_infos[i].usage,
-			.width = (u32) m_winw,
-			.height = (u32) m_winh,
-			.layer_count_or_depth = 1,
-			.num_levels = 1,
-			.sample_count = SDL_GPU_SAMPLECOUNT_1
-		};
+		m_frames[m_frame_index].textures.push_back(m_screen_textures[i]);
+		m_screen_textures[i] = create_window_sized(m_screen_tex_infos[i]);
+	}
+
+	if (m_window_msaa) {
+		m_frames[m_frame_index].textures.push_back(m_window_msaa);
+		m_window_msaa = create_window_sized({
+			.format = SDL_GetGPUSwapchainTextureFormat(m_device, m_targ_window),
+			.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+			.sample_count = m_window_samples
+		});
+	}
+}
+
+SDL_GPUSampleCount Renderer::set_window_sample_count(SDL_GPUSampleCount sample_count) {
+	SDL_GPUTextureFormat color_format = SDL_GetGPUSwapchainTextureFormat(m_device, m_targ_window);
+
+	// Both targets of a window pass need the same count
+	while (sample_count != SDL_GPU_SAMPLECOUNT_1 &&
+		(!SDL_GPUTextureSupportsSampleCount(m_device, color_format, sample_count) ||
+		!SDL_GPUTextureSupportsSampleCount(m_device, SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT, sample_count)))
+	{
+		sample_count = (SDL_GPUSampleCount) (sample_count - 1);
+	}
+
+	if (sample_count == m_window_samples) return sample_count;
+
+	m_window_samples = sample_count;
+
+	m_frames[m_frame_index].textures.push_back(m_screen_textures[0]);
+	m_screen_tex_infos[0].usage = get_window_depth_usage(sample_count);
+	m_screen_tex_infos[0].sample_count = sample_count;
+	m_screen_textures[0] = create_window_sized(m_screen_tex_infos[0]);
+
+	if (sample_count != SDL_GPU_SAMPLECOUNT_1) {
+		std::cout << "The window's depth is multisampled and can't be sampled, so culling against it (Hi-Z) is off\n";
+	}
+
+	if (m_window_msaa) {
+		m_frames[m_frame_index].textures.push_back(m_window_msaa);
+		m_window_msaa = nullptr;
+	}
+
+	if (sample_count != SDL_GPU_SAMPLECOUNT_1) {
+		m_window_msaa = create_window_sized({
+			.format = color_format,
+			.usage = SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+			.sample_count = sample_count
+		});
+	}
+
+	return sample_count;
+}
+
+SDL_GPUTexture *Renderer::create_window_sized(const ScreenTextureInfo &info) {
+	SDL_GPUTextureCreateInfo ci = {
+		.type = SDL_GPU_TEXTURETYPE_2D,
+		.format = info.format,
+		.usage = info.usage,
+		.width = (u32) m_winw,
+		.height = (u32) m_winh,
+		.layer_count_or_depth = 1,
+		.num_levels = 1,
+		.sample_count = info.sample_count
+	};
+
+	SDL_GPUTexture *texture = SDL_CreateGPUTexture(m_device, &ci);
+	if (!texture) {
+		std::cout << "SDL Error: " << SDL_GetError() << "\n";
+	}
+
+	return texture;
+}
+
+SDL_GPUTextureUsageFlags Renderer::get_window_depth_usage(SDL_GPUSampleCount sample_count) {
+	// Also sampled where the device allows it, eg. to build a depth pyramid for occlusion culling. Multisampled
+	// textures can't be bound as samplers
+	SDL_GPUTextureUsageFlags usage = SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
+	if (sample_count == SDL_GPU_SAMPLECOUNT_1 && SDL_GPUTextureSupportsFormat(m_device,
+		SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT, SDL_GPU_TEXTURETYPE_2D, usage | SDL_GPU_TEXTUREUSAGE_SAMPLER))
+	{
+		usage |= SDL_GPU_TEXTUREUSAGE_SAMPLER;
+	}
+
+	return usage;
+}
+
+void Renderer::submit(SDL_GPUCommandBuffer *cb) {
+	SDL_GPUFence *fence = SDL_SubmitGPUCommandBufferAndAcquireFence(cb);
+	if (fence) {
+		m_frames[m_frame_index].fences.push_back(fence);
+	}
+}
+
+void Renderer::retire_frame(FrameContext &frame) {
+	if (!frame.fences.empty()) {
+		SDL_WaitForGPUFences(m_device, true, frame.fences.data(), frame.fences.size());
+
+		for (SDL_GPUFence *fence : frame.fences) {
+			SDL_ReleaseGPUFence(m_device, fence);
+		}
+		frame.fences.clear();
+	}
+
+	for (SDL_GPUBuffer *buffer : frame.buffers) {
+		if (buffer) SDL_ReleaseGPUBuffer(m_device, buffer);
+	}
+
+	for (SDL_GPUTexture *texture : frame.textures) {
+		if (texture) SDL_ReleaseGPUTexture(m_device, texture);
+	}
+
+	// The slots may have been cleared along with everything else by clean_resources()
+	for (u32 slot : frame.buffer_slots) {
+		if (slot < m_buffer_retiring.size()) m_buffer_retiring[slot] = false;
+	}
+
+	for (u32 slot : frame.texture_slots) {
+		if (slot < m_texture_retiring.size()) m_texture_retiring[slot] = false;
+	}
+
+	frame.buffers.clear();
+	frame.textures.clear();
+	frame.buffer_slots.clear();
+	frame.texture_slots.clear();
+
+	frame.upload_offset = 0;
+}
+
+SDL_GPUTransferBuffer *Renderer::allocate_staging(u32 size, u32 *o_offset, bool *o_cycle) {
+	FrameContext &frame = m_frames[m_frame_index];
+
+	// Texel blocks are at most 16 bytes, keeping every offset aligned for texture uploads
+	u32 offset = (frame.upload_offset + 15) & ~15u;
+
+	if (offset + size > TRANSFER_BUFFER_SIZE) {
+		// Out of room this frame. Cycling hands out fresh memory without disturbing recorded uploads
+		offset = 0;
+		*o_cycle = true;
+	} else {
+		*o_cycle = false;
+	}
+
+	frame.upload_offset = offset + size;
+	*o_offset = offset;
+
+	return frame.upload;
+}
+
+SDL_GPUCommandBuffer *Renderer::acquire_command_buffer() {
+	return m_frame_cb ? m_frame_cb : SDL_AcquireGPUCommandBuffer(m_device);
+}
 
-		m_screen_textures[i] = SDL_CreateGPUTexture(m_device, &ci);
+void Renderer::finish_command_buffer(SDL_GPUCommandBuffer *cb) {
+	if (cb != m_frame_cb) {
+		submit(cb);
 	}
 }
 
+void Renderer::abandon_command_buffer(SDL_GPUCommandBuffer *cb) {
+	if (cb != m_frame_cb) {
+		SDL_CancelGPUCommandBuffer(cb);
+	}
+}
+
+void Renderer::begin_frame() {
+	if (m_frame_cb) {
+		std::cout << "begin_frame() called twice without end_frame()\n";
+		end_frame();
+	}
+
+	m_frame_index = (m_frame_index + 1) % FRAMES_IN_FLIGHT;
+	m_frame_number++;
+
+	// Only blocks if the GPU is more than FRAMES_IN_FLIGHT frames behind
+	retire_frame(m_frames[m_frame_index]);
+
+	m_frame_cb = SDL_AcquireGPUCommandBuffer(m_device);
+	m_frame_cb_serial++;
+	m_frames[m_frame_index].swapchain = nullptr;
+	m_frames[m_frame_index].swapchain_acquired = false;
+	m_frames[m_frame_index].swapchain_acquires = 0;
+}
+
+void Renderer::end_frame() {
+	if (!m_frame_cb) return;
+
+	submit(m_frame_cb);
+	m_frame_cb = nullptr;
+}
+
+void Renderer::flush_frame() {
+	if (!m_frame_cb) return;
+
+	submit(m_frame_cb);
+	m_frame_cb = SDL_AcquireGPUCommandBuffer(m_device);
+	m_frame_cb_serial++;
+
+	// The swapchain texture was presented with the submitted command buffer
+	m_frames[m_frame_index].swapchain = nullptr;
+	m_frames[m_frame_index].swapchain_acquired = false;
+}
+
 ActiveCopyPass Renderer::begin_copy_pass() {
-	SDL_GPUCommandBuffer *cb = SDL_AcquireGPUCommandBuffer(m_device);
+	SDL_GPUCommandBuffer *cb = acquire_command_buffer();
 
 	SDL_GPUCopyPass *cp = SDL_BeginGPUCopyPass(cb);
 
 	auto acp = ActiveCopyPass(*this);
 	acp.m_cb = cb;
 	acp.m_cp = cp;
-	acp.m_upload = m_upload_buffer;
 
 	return acp;
 }
@@ -186,30 +594,58 @@ void Renderer::end_copy_pass(ActiveCopyPass acp) {
 	SDL_EndGPUCopyPass(acp.m_cp);
 
 	// Do non-pass processing
-	for (u32 i = 0; i < m_user_textures.size(); ++i) {
-		if (m_user_textures[i] && m_texture_states[i].dirty_mip) {
-			SDL_GenerateMipmapsForGPUTexture(acp.m_cb, m_user_textures[i]);
+	m_mip_stats = {};
+
+	while (!m_mip_queue.empty()) {
+		u32 i = m_mip_queue.front();
+		if (!m_user_textures[i] || !m_texture_states[i].dirty_mip) {
+			m_mip_queue.pop_front();
+			continue;
 		}
+
+		const TextureRect &rect = m_texture_states[i].dirty_rect;
+		u64 texels = (u64) rect.w * rect.h * rect.num_layers;
+
+		bool over_budget = m_mip_texel_budget > 0 && m_mip_stats.texels_generated + texels > m_mip_texel_budget;
+		if (over_budget && m_mip_stats.textures_generated > 0) break;
+
+		m_mip_queue.pop_front();
+		regenerate_mips(acp.m_cb, i);
+
+		m_mip_stats.textures_generated++;
+		m_mip_stats.texels_generated += texels;
 	}
 
-	SDL_SubmitGPUCommandBuffer(acp.m_cb);
+	m_mip_stats.textures_deferred = m_mip_queue.size();
+
+	finish_command_buffer(acp.m_cb);
 }
 
-ActiveRenderPass Renderer::begin_window_render_pass() {
-	SDL_GPUCommandBuffer *cb = SDL_AcquireGPUCommandBuffer(m_device);
+ActiveRenderPass Renderer::begin_window_render_pass(const WindowPassInfo &description) {
+	SDL_GPUCommandBuffer *cb = acquire_command_buffer();
+	FrameContext &frame = m_frames[m_frame_index];
 
 	SDL_GPUTexture *color_target_tex = NULL;
 
-	if (!SDL_AcquireGPUSwapchainTexture(cb, m_targ_window, &color_target_tex, NULL, NULL)) {
-		SDL_CancelGPUCommandBuffer(cb);
-		return ActiveRenderPass();
-	}
+	// A command buffer may only acquire the swapchain once, and presents whatever it acquired
+	if (cb == m_frame_cb && frame.swapchain_acquired) {
+		color_target_tex = frame.swapchain;
+	} else {
+		if (!SDL_AcquireGPUSwapchainTexture(cb, m_targ_window, &color_target_tex, NULL, NULL)) {
+			abandon_command_buffer(cb);
+			return ActiveRenderPass();
+		}
 
-	// NOTE: Use SDL_SubmitGPUCommandBuffer from here ======
+		if (cb == m_frame_cb) {
+			frame.swapchain = color_target_tex;
+			frame.swapchain_acquired = true;
+			frame.swapchain_acquires++;
+		}
+	}
 
 	// Not a bad thing. Just means the window cannot display anything more at this point
 	if (!color_target_tex) {
-		SDL_SubmitGPUCommandBuffer(cb);
+		finish_command_buffer(cb);
 		return ActiveRenderPass();
 	}
 
@@ -218,22 +654,29 @@ ActiveRenderPass Renderer::begin_window_render_pass() {
 			.texture = color_target_tex,
 			.mip_level = 0,
 			.layer_or_depth_plane = 0,
-			.clear_color = {0.0f, 0.0f, 0.0f, 0.0f},
-			.load_op = SDL_GPU_LOADOP_CLEAR,
-			.store_op = SDL_GPU_STOREOP_STORE,
-			.cycle = true
+			.clear_color = description.clear_color,
+			.load_op = description.load_op,
+			.store_op = description.store_op,
+			.cycle = description.load_op != SDL_GPU_LOADOP_LOAD
 		}
 	};
 
+	// Draw into the samples and resolve them into the swapchain, which is overwritten whole
+	if (m_window_msaa) {
+		ctis[0].texture = m_window_msaa;
+		ctis[0].resolve_texture = color_target_tex;
+		if (description.store_op == SDL_GPU_STOREOP_STORE) ctis[0].store_op = SDL_GPU_STOREOP_RESOLVE;
+	}
+
 	SDL_GPUDepthStencilTargetInfo dsti = {
 		.texture = m_screen_textures[0],
-		.clear_depth = 1.0,
-		.load_op = SDL_GPU_LOADOP_CLEAR,
-		.store_op = SDL_GPU_STOREOP_STORE,
-		.stencil_load_op = SDL_GPU_LOADOP_CLEAR,
-		.stencil_store_op = SDL_GPU_STOREOP_STORE,
-		.cycle = true,
-		.clear_stencil = 0,
+		.clear_depth = description.clear_depth,
+		.load_op = description.depth_load_op,
+		.store_op = description.depth_store_op,
+		.stencil_load_op = description.stencil_load_op,
+		.stencil_store_op = description.stencil_store_op,
+		.cycle = description.depth_load_op != SDL_GPU_LOADOP_LOAD && description.stencil_load_op != SDL_GPU_LOADOP_LOAD,
+		.clear_stencil = description.clear_stencil,
 	};
 
 
@@ -249,7 +692,7 @@ ActiveRenderPass Renderer::begin_window_render_pass() {
 }
 
 ActiveRenderPass Renderer::begin_custom_render_pass(CustomInfo description) {
-	SDL_GPUCommandBuffer *cb = SDL_AcquireGPUCommandBuffer(m_device);
+	SDL_GPUCommandBuffer *cb = acquire_command_buffer();
 
 	SDL_GPUColorTargetInfo *ctis = new SDL_GPUColorTargetInfo[description.color_targets.size()];
 	for (u32 i = 0; i < description.color_targets.size(); ++i) {
@@ -258,10 +701,18 @@ ActiveRenderPass Renderer::begin_custom_render_pass(CustomInfo description) {
 			.mip_level = 0,
 			.layer_or_depth_plane = 0,
 			.clear_color = description.color_targets[i].clear_color,
-			.load_op = SDL_GPU_LOADOP_CLEAR,
-			.store_op = SDL_GPU_STOREOP_STORE,
-			.cycle = true
+			.load_op = description.color_targets[i].load_op,
+			.store_op = description.color_targets[i].store_op,
+			.resolve_texture = description.color_targets[i].resolve_texture,
+			.cycle = description.color_targets[i].cycle && description.color_targets[i].load_op != SDL_GPU_LOADOP_LOAD,
+			.cycle_resolve_texture = description.color_targets[i].cycle
 		};
+
+		bool resolves = ctis[i].store_op == SDL_GPU_STOREOP_RESOLVE || ctis[i].store_op == SDL_GPU_STOREOP_RESOLVE_AND_STORE;
+		if (resolves && !ctis[i].resolve_texture) {
+			std::cout << "Color target " << i << " resolves without a resolve texture, storing instead\n";
+			ctis[i].store_op = SDL_GPU_STOREOP_STORE;
+		}
 	}
 
 	SDL_GPUDepthStencilTargetInfo dsti;
@@ -269,19 +720,21 @@ ActiveRenderPass Renderer::begin_custom_render_pass(CustomInfo description) {
 	if (description.depth_enabled) {
 		dsti = {
 		   .texture = description.depth_texture,
-		   .clear_depth = 1.0,
-		   .load_op = SDL_GPU_LOADOP_CLEAR,
-		   .store_op = SDL_GPU_STOREOP_STORE,
-		   .stencil_load_op = SDL_GPU_LOADOP_CLEAR,
-		   .stencil_store_op = SDL_GPU_STOREOP_STORE,
-		   .cycle = true,
-		   .clear_stencil = 0,
+		   .clear_depth = description.clear_depth,
+		   .load_op = description.depth_load_op,
+		   .store_op = description.depth_store_op,
+		   .stencil_load_op = description.stencil_load_op,
+		   .stencil_store_op = description.stencil_store_op,
+		   .cycle = description.depth_cycle && description.depth_load_op != SDL_GPU_LOADOP_LOAD &&
+				description.stencil_load_op != SDL_GPU_LOADOP_LOAD,
+		   .clear_stencil = description.clear_stencil,
 		};
 
 		dstip = &dsti;
 	}
 
 	SDL_GPURenderPass *rp = SDL_BeginGPURenderPass(cb, ctis, description.color_targets.size(), dstip);
+	delete[] ctis;
 
 	SDL_SetGPUViewport(rp, &description.viewport);
 
@@ -298,7 +751,7 @@ void Renderer::end_render_pass(ActiveRenderPass arp) {
 
 	SDL_EndGPURenderPass(arp.m_rp);
 
-	SDL_SubmitGPUCommandBuffer(arp.m_cb);
+	finish_command_buffer(arp.m_cb);
 }
 
 mat4x4 Renderer::generate_perspective(float fov_rad) {
@@ -316,6 +769,7 @@ RID Renderer::create_buffer(SDL_GPUBufferUsageFlags usage, u32 size) {
 	if (location == U32_BAD) {
 		m_buffers.push_back(SDL_CreateGPUBuffer(m_device, &ci));
 		m_buffer_infos.push_back(ci);
+		m_buffer_retiring.push_back(false);
 
 		std::cout << "Created new slot " << m_buffers.size() - 1 << "\n";
 		return RID(m_buffers.size() - 1);
@@ -329,7 +783,8 @@ RID Renderer::create_buffer(SDL_GPUBufferUsageFlags usage, u32 size) {
 }
 
 void Renderer::resize_buffer(RID buffer, u32 size) {
-	SDL_ReleaseGPUBuffer(m_device, m_buffers[*buffer]);
+	// The RID keeps its slot, only the old contents need to outlive the frames using them
+	m_frames[m_frame_index].buffers.push_back(m_buffers[*buffer]);
 
 	SDL_GPUBufferCreateInfo &ci = m_buffer_infos[*buffer];
 	ci.size = size;
@@ -338,8 +793,16 @@ void Renderer::resize_buffer(RID buffer, u32 size) {
 }
 
 void Renderer::destroy_buffer(RID buffer) {
-	SDL_ReleaseGPUBuffer(m_device, m_buffers[*buffer]);
+	FrameContext &frame = m_frames[m_frame_index];
+	frame.buffers.push_back(m_buffers[*buffer]);
+	frame.buffer_slots.push_back(*buffer);
+
 	m_buffers[*buffer] = nullptr;
+	m_buffer_retiring[*buffer] = true;
+}
+
+bool Renderer::is_shader_valid(RID shader) const {
+	return *shader < m_shaders.size() && m_shaders[*shader].is_valid();
 }
 
 bool Renderer::is_buffer_valid(RID buffer) {
@@ -347,29 +810,23 @@ bool Renderer::is_buffer_valid(RID buffer) {
 	return m_buffers[*buffer];
 }
 
-RID Renderer::create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage) {
-	SDL_GPUTextureCreateInfo ci = {
-		.type = SDL_GPU_TEXTURETYPE_2D,
+RID Renderer::create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage,
+	SDL_GPUSampleCount sample_count)
+{
+	ScreenTextureInfo info = {
 		.format = format,
 		.usage = usage,
-		.width = (u32) m_winw,
-		.height = (u32) m_winh,
-		.layer_count_or_depth = 1,
-		.num_levels = 1,
-		.sample_count = SDL_GPU_SAMPLECOUNT_1
+		.sample_count = sample_count
 	};
 
-	m_screen_textures.push_back(SDL_CreateGPUTexture(m_device, &ci));
-	m_screen_tex_infos.push_back({
-		.format = format,
-		.usage = usage
-	});
+	m_screen_textures.push_back(create_window_sized(info));
+	m_screen_tex_infos.push_back(info);
 
 	return RID(m_screen_textures.size() - 1);
 }
 
 void Renderer::destroy_screen_texture(RID texture) {
-	SDL_ReleaseGPUTexture(m_device, m_screen_textures[*texture]);
+	m_frames[m_frame_index].textures.push_back(m_screen_textures[*texture]);
 
 	m_screen_textures[*texture] = nullptr;
 }
@@ -400,7 +857,8 @@ RID Renderer::create_texture(const SDL_GPUTextureCreateInfo *info) {
 		m_user_textures.push_back(SDL_CreateGPUTexture(m_device, &mut_info));
 		m_texture_states.push_back(TextureState{
 			.mip_levels = mut_info.num_levels,
-			.dirty_mip = mut_info.num_levels > 1,
+			.dirty_mip = false,
+			.dirty_rect = {},
 			.format = mut_info.format,
 			.type = mut_info.type,
 			.usage = mut_info.usage,
@@ -408,12 +866,14 @@ RID Renderer::create_texture(const SDL_GPUTextureCreateInfo *info) {
 			.height = mut_info.height,
 			.depth = mut_info.layer_count_or_depth
 		});
+		m_texture_retiring.push_back(false);
 		return RID(m_user_textures.size() - 1);
 	} else {
 		m_user_textures[location] = SDL_CreateGPUTexture(m_device, &mut_info);
 		m_texture_states[location] = TextureState{
 			.mip_levels = mut_info.num_levels,
-			.dirty_mip = mut_info.num_levels > 1,
+			.dirty_mip = false,
+			.dirty_rect = {},
 			.format = mut_info.format,
 			.type = mut_info.type,
 			.usage = mut_info.usage,
@@ -426,9 +886,39 @@ RID Renderer::create_texture(const SDL_GPUTextureCreateInfo *info) {
 	}
 }
 
+void Renderer::mark_mips_dirty(RID texture, const TextureRect &rect) {
+	TextureState &state = m_texture_states[*texture];
+	if (state.mip_levels <= 1) return;
+
+	if (!state.dirty_mip) {
+		state.dirty_rect = rect;
+		state.dirty_mip = true;
+		m_mip_queue.push_back(*texture);
+		return;
+	}
+
+	// Grow the existing rect to cover both
+	TextureRect &dr = state.dirty_rect;
+	u32 x1 = std::max(dr.x + dr.w, rect.x + rect.w);
+	u32 y1 = std::max(dr.y + dr.h, rect.y + rect.h);
+	u32 l1 = std::max(dr.first_layer + dr.num_layers, rect.first_layer + rect.num_layers);
+
+	dr.x = std::min(dr.x, rect.x);
+	dr.y = std::min(dr.y, rect.y);
+	dr.first_layer = std::min(dr.first_layer, rect.first_layer);
+	dr.w = x1 - dr.x;
+	dr.h = y1 - dr.y;
+	dr.num_layers = l1 - dr.first_layer;
+}
+
 void Renderer::destroy_texture(RID texture) {
-	SDL_ReleaseGPUTexture(m_device, m_user_textures[*texture]);
+	FrameContext &frame = m_frames[m_frame_index];
+	frame.textures.push_back(m_user_textures[*texture]);
+	frame.texture_slots.push_back(*texture);
+
 	m_user_textures[*texture] = nullptr;
+	m_texture_retiring[*texture] = true;
+	m_texture_states[*texture].dirty_mip = false;
 }
 
 bool Renderer::is_texture_valid(RID texture) {
@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "Shader.h"
+#include "ShaderCache.h"
 #include "ActiveCopyPass.h"
 #include "ActiveRenderPass.h"
 
@@ -9,11 +10,30 @@
 // Currently: 16MiB
 inline const u32 TRANSFER_BUFFER_SIZE = 1024 * 1024 * 16;
 
+// How many frames the CPU may record ahead of the GPU. Each one has its own staging memory and release list
+inline const u32 FRAMES_IN_FLIGHT = 2;
+
+// Where SPIR-V is kept between runs, relative to the working directory
+inline const char *SHADER_CACHE_PATH = "shader_cache.bin";
+
 // NOTE: Compressed texture formats are not supported (yet)
 
 struct CustomTargetInfo {
 	SDL_GPUTexture *texture;
 	SDL_FColor clear_color = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	// LOAD keeps the previous contents, so the texture isn't cycled. DONT_CARE skips the clear when every pixel
+	// gets overwritten anyway
+	SDL_GPULoadOp load_op = SDL_GPU_LOADOP_CLEAR;
+	// DONT_CARE skips writing the target back to memory, for targets nothing reads afterwards. RESOLVE and
+	// RESOLVE_AND_STORE require resolve_texture
+	SDL_GPUStoreOp store_op = SDL_GPU_STOREOP_STORE;
+
+	// Receives the resolved samples of a multisampled target
+	SDL_GPUTexture *resolve_texture = nullptr;
+
+	// Cycling gives the texture fresh memory if the GPU may still be using it. Disable to reuse the same memory
+	bool cycle = true;
 };
 
 struct CustomInfo {
@@ -22,12 +42,41 @@ struct CustomInfo {
 	bool depth_enabled = true;
 	SDL_GPUTexture *depth_texture; // Ignore if depth_enabled is false
 
+	float clear_depth = 1.0f;
+	SDL_GPULoadOp depth_load_op = SDL_GPU_LOADOP_CLEAR;
+	SDL_GPUStoreOp depth_store_op = SDL_GPU_STOREOP_STORE;
+
+	byte clear_stencil = 0;
+	SDL_GPULoadOp stencil_load_op = SDL_GPU_LOADOP_CLEAR;
+	SDL_GPUStoreOp stencil_store_op = SDL_GPU_STOREOP_STORE;
+
+	bool depth_cycle = true;
+
 	SDL_GPUViewport viewport;
 };
 
+// Load/store options of a window render pass. Depth and stencil are discarded by default, since the window's depth
+// texture is internal and only a later window pass could read it
+struct WindowPassInfo {
+	SDL_FColor clear_color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	SDL_GPULoadOp load_op = SDL_GPU_LOADOP_CLEAR;
+	// With a multisampled window, STORE resolves the samples into the swapchain and discards them. A later window
+	// pass that loads them needs RESOLVE_AND_STORE here
+	SDL_GPUStoreOp store_op = SDL_GPU_STOREOP_STORE;
+
+	float clear_depth = 1.0f;
+	SDL_GPULoadOp depth_load_op = SDL_GPU_LOADOP_CLEAR;
+	SDL_GPUStoreOp depth_store_op = SDL_GPU_STOREOP_DONT_CARE;
+
+	byte clear_stencil = 0;
+	SDL_GPULoadOp stencil_load_op = SDL_GPU_LOADOP_CLEAR;
+	SDL_GPUStoreOp stencil_store_op = SDL_GPU_STOREOP_DONT_CARE;
+};
+
 struct ScreenTextureInfo {
 	SDL_GPUTextureFormat format;
 	SDL_GPUTextureUsageFlags usage;
+	SDL_GPUSampleCount sample_count;
 };
 
 enum class RendererCleanupExclude {
@@ -36,9 +85,17 @@ enum class RendererCleanupExclude {
 	DEFAULT // Exclude both shaders and internals
 };
 
+// A region of a texture's base level across a range of layers (depth slices for 3D textures)
+struct TextureRect {
+	u32 x, y, w, h;
+	u32 first_layer, num_layers;
+};
+
 struct TextureState {
 	u32 mip_levels;
 	bool dirty_mip;
+	// The part of the base level that changed since the mips were last generated. Only valid if dirty_mip
+	TextureRect dirty_rect;
 
 	SDL_GPUTextureFormat format;
 	SDL_GPUTextureType type;
@@ -47,10 +104,41 @@ struct TextureState {
 	u32 width, height, depth;
 };
 
+// Counters for the mip generation done by the last end_copy_pass()
+struct MipStats {
+	u32 textures_generated;
+	u32 textures_deferred; // Still queued because the budget ran out
+	u64 texels_generated;
+};
+
+// Everything a frame owns until the GPU has finished with it
+struct FrameContext {
+	// One per command buffer submitted during the frame
+	std::vector<SDL_GPUFence *> fences;
+
+	// Staging memory is handed out linearly and only rewound once the fences have signalled
+	SDL_GPUTransferBuffer *upload = nullptr;
+	u32 upload_offset = 0;
+
+	// Released once the fences have signalled. The RID slots stay reserved until then
+	std::vector<SDL_GPUBuffer *> buffers;
+	std::vector<SDL_GPUTexture *> textures;
+	std::vector<u32> buffer_slots;
+	std::vector<u32> texture_slots;
+
+	// The window's swapchain texture, acquired by the first window pass recorded into the frame's command buffer
+	// and shared by the rest, so the frame presents once. nullptr if the window couldn't be drawn to
+	SDL_GPUTexture *swapchain = nullptr;
+	bool swapchain_acquired = false;
+	// How often the frame acquired it, across flush_frame() calls
+	u32 swapchain_acquires = 0;
+};
+
 class Renderer {
 	SDL_GPUDevice *m_device = nullptr;
 
 	std::vector<VisualShader> m_shaders;
+	ShaderCache m_shader_cache;
 
 	std::vector<SDL_GPUBuffer *> m_buffers;
 	std::vector<SDL_GPUBufferCreateInfo> m_buffer_infos;
@@ -61,6 +149,25 @@ class Renderer {
 	std::vector<SDL_GPUTexture *> m_user_textures;
 	std::vector<TextureState> m_texture_states;
 
+	// Slots whose resource was destroyed but may still be referenced by a frame in flight
+	std::vector<bool> m_buffer_retiring;
+	std::vector<bool> m_texture_retiring;
+
+	FrameContext m_frames[FRAMES_IN_FLIGHT];
+	u32 m_frame_index = 0;
+	u64 m_frame_number = 0;
+
+	// Every pass between begin_frame() and end_frame() records into this. nullptr outside of a frame
+	SDL_GPUCommandBuffer *m_frame_cb = nullptr;
+	// Bumped whenever m_frame_cb is replaced, so state tied to one command buffer can tell it was submitted
+	u64 m_frame_cb_serial = 0;
+
+	// Textures whose mips need rebuilding, in the order they were dirtied. Entries whose texture is no longer
+	// dirty (destroyed or already rebuilt) are skipped
+	std::deque<u32> m_mip_queue;
+	u64 m_mip_texel_budget = 0;
+	MipStats m_mip_stats = {};
+
 	std::vector<SDL_GPUSampler *> m_samplers;
 
 	SDL_Window *m_targ_window;
@@ -68,21 +175,56 @@ class Renderer {
 	int m_winh;
 	SDL_GPUViewport m_viewport;
 
-	SDL_GPUTransferBuffer *m_upload_buffer;
+	// Window passes draw into m_window_msaa and resolve into the swapchain. nullptr when single-sampled
+	SDL_GPUSampleCount m_window_samples = SDL_GPU_SAMPLECOUNT_1;
+	SDL_GPUTexture *m_window_msaa = nullptr;
+
+	SDL_GPUTransferBuffer *m_download_buffer;
 
 	friend class ActiveRenderPass;
+	friend class ActiveCopyPass;
 
 	inline SDL_GPUGraphicsPipeline *get_shader(RID shader) {
-		return m_shaders[*shader].m_rp;
+		return *shader < m_shaders.size() ? m_shaders[*shader].m_rp : nullptr;
 	}
 
+	// An RID that refers to no pipeline gets a layout with no vertex buffers and no uniforms
 	inline const CompiledPipelineInfo &get_shader_info(RID shader) const {
-		return m_shaders[*shader].get_info();
+		static const CompiledPipelineInfo NO_PIPELINE = { .vert_slot_offset = U32_BAD, .inst_slot_offset = U32_BAD };
+		return is_shader_valid(shader) ? m_shaders[*shader].get_info() : NO_PIPELINE;
 	}
 
 	u32 get_unused_buffer();
 	u32 get_unused_texture();
 
+	// Creates a texture the size of the window
+	SDL_GPUTexture *create_window_sized(const ScreenTextureInfo &info);
+
+	// The usage of the window's depth texture: also sampled where the device allows it and it has a single sample
+	SDL_GPUTextureUsageFlags get_window_depth_usage(SDL_GPUSampleCount sample_count);
+
+	// Rebuilds the mips of a texture from the dirty part of its base level. Must be called outside of a pass
+	void regenerate_mips(SDL_GPUCommandBuffer *cb, u32 texture);
+
+	// Submits a command buffer, tracking its fence in the current frame
+	void submit(SDL_GPUCommandBuffer *cb);
+
+	// Returns the frame's command buffer inside a frame, otherwise a new one
+	SDL_GPUCommandBuffer *acquire_command_buffer();
+
+	// Submits cb, unless it is the frame's, which end_frame() submits
+	void finish_command_buffer(SDL_GPUCommandBuffer *cb);
+
+	// Throws away cb if nothing was recorded into it. The frame's command buffer is kept for later passes
+	void abandon_command_buffer(SDL_GPUCommandBuffer *cb);
+
+	// Waits for a frame's fences, then releases what it deferred and rewinds its staging memory
+	void retire_frame(FrameContext &frame);
+
+	// Returns the current frame's staging buffer and where size bytes may be written. If the frame has run out,
+	// o_cycle is set and the buffer must be mapped with cycling, which gives it fresh memory starting at 0
+	SDL_GPUTransferBuffer *allocate_staging(u32 size, u32 *o_offset, bool *o_cycle);
+
 	friend class RenderRetarget;
 
 public:
@@ -111,14 +253,42 @@ public:
 	Renderer &operator=(Renderer &&) = default;
 
 	/// <summary>
-	/// Creates a graphical shader pipeline and assigns it an RID
+	/// Creates a graphical shader pipeline and assigns it an RID. If an identical pipeline (same SPIR-V and
+	/// state) was already created, its RID is returned instead. Resource counts left unspecified are read from
+	/// the SPIR-V
 	/// </summary>
 	/// <param name="vs">- A description of the vertex stage</param>
 	/// <param name="fs">- A description of the fragment stage</param>
 	/// <param name="pip">- A description of the resulting pipeline</param>
-	/// <returns></returns>
+	/// <returns>An RID representing the pipeline, or U32_BAD if the stages don't match each other or the pipeline</returns>
 	RID add_shader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo &&pip);
 
+	/// <summary>
+	/// Creates many pipelines at once, spreading file reads, reflection and SDL object creation across worker
+	/// threads. Deduplicates like add_shader(), including within the batch. Blocks until every pipeline is built
+	/// </summary>
+	/// <param name="batch">- A description of each pipeline</param>
+	/// <returns>An RID per entry in the same order, U32_BAD for entries that failed</returns>
+	std::vector<RID> add_shaders(std::vector<ShaderBatchEntry> batch);
+
+	/// <summary>
+	/// Assigns an RID that refers to no pipeline yet, eg. for a shader that failed to compile. rebuild_shader()
+	/// fills it in once the shader is fixed; until then is_shader_valid() returns false for it
+	/// </summary>
+	/// <returns>An RID representing the empty slot</returns>
+	RID reserve_shader();
+
+	/// <summary>
+	/// Rebuilds an existing pipeline in place, so its RID now refers to the new one. Must not be called while a
+	/// render pass that uses it is being recorded
+	/// </summary>
+	/// <param name="shader">- An RID from add_shader() or reserve_shader()</param>
+	/// <param name="vs">- A description of the new vertex stage</param>
+	/// <param name="fs">- A description of the new fragment stage</param>
+	/// <param name="pip">- A description of the new pipeline</param>
+	/// <returns>False if the new pipeline could not be created. The old one is kept in that case</returns>
+	bool rebuild_shader(RID shader, ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo &&pip);
+
 	/// <summary>
 	/// To be called whenever the target window is resized. This should only be called if the size changes,
 	/// and should only be called for the window assigned to it in the constructor
@@ -126,7 +296,49 @@ public:
 	/// <param name="new_w">- The width of the target window after resizing</param>
 	/// <param name="new_h">- The height of the target window after resizing</param>
 	void resize_window(u32 new_w, u32 new_h);
+
+	/// <summary>
+	/// Sets how many samples window passes draw with. Above 1, they draw into a multisampled texture that is
+	/// resolved into the swapchain as the pass ends, and the window's depth texture is multisampled too, so it can
+	/// no longer be sampled (see can_sample_depth()). Pipelines drawn in window passes need the same sample_count.
+	/// Must be called between frames
+	/// </summary>
+	/// <param name="sample_count">- The wanted count. Lowered to the highest the device supports for the window</param>
+	/// <returns>The count that was set</returns>
+	SDL_GPUSampleCount set_window_sample_count(SDL_GPUSampleCount sample_count);
+
+	inline SDL_GPUSampleCount get_window_sample_count() const { return m_window_samples; }
 	
+	/// <summary>
+	/// Starts a new frame. Waits until the GPU has finished the frame that last used this frame's context
+	/// (FRAMES_IN_FLIGHT frames ago), then releases the resources destroyed during it and reuses its staging memory.
+	/// 
+	/// Until end_frame(), every copy and render pass is recorded into a single command buffer that is submitted
+	/// once. Passes begun outside of a frame get a command buffer of their own, submitted when they end
+	/// </summary>
+	void begin_frame();
+
+	// Submits everything recorded since begin_frame()
+	void end_frame();
+
+	/// <summary>
+	/// Submits what the frame has recorded so far and continues in a new command buffer, eg. to get shadow
+	/// passes to the GPU while the CPU is still recording the main pass. Must be called between passes.
+	/// Presents the swapchain texture if a window pass already drew to it, so only flush before the window passes.
+	/// Does nothing outside of a frame
+	/// </summary>
+	void flush_frame();
+
+	// The command buffer passes are recorded into, for work the Renderer doesn't wrap (eg. compute passes).
+	// nullptr outside of a frame
+	inline SDL_GPUCommandBuffer *get_frame_command_buffer() { return m_frame_cb; }
+
+	// The number of begin_frame() calls so far
+	inline u64 get_frame_number() const { return m_frame_number; }
+
+	// How many swapchain textures the current frame has acquired. Above 1, it was presented in pieces
+	inline u32 get_swapchain_acquire_count() const { return m_frames[m_frame_index].swapchain_acquires; }
+
 	/// <summary>
 	/// Begins a copy pass which can be used to upload/download data from buffers and textures
 	/// </summary>
@@ -140,10 +352,12 @@ public:
 	void end_copy_pass(ActiveCopyPass pass);
 
 	/// <summary>
-	/// Begins a render pass. The render pass will target the window that was specified at creation
+	/// Begins a render pass. The render pass will target the window that was specified at creation. Inside a frame,
+	/// every window pass draws to the same swapchain texture, acquired by the first
 	/// </summary>
+	/// <param name="description">- (Optional) How the color and depth targets are loaded and stored</param>
 	/// <returns>An ActiveRenderPass which should be ended with end_render_pass()</returns>
-	ActiveRenderPass begin_window_render_pass();
+	ActiveRenderPass begin_window_render_pass(const WindowPassInfo &description = {});
 
 	/// <summary>
 	/// Begins a render pass. The render pass will target the specified textures
@@ -190,6 +404,9 @@ public:
 	
 	// Returns true if the RID is a valid index and the buffer has not been deleted
 	bool is_buffer_valid(RID buffer);
+
+	// Returns true if the RID refers to a pipeline that was built
+	bool is_shader_valid(RID shader) const;
 	
 	/// <summary>
 	/// Creates a 2D texture that resizes to the screen size. Once freed, the slot will not be reused, so
@@ -197,8 +414,11 @@ public:
 	/// </summary>
 	/// <param name="format">- The SDL format of the texture</param>
 	/// <param name="usage">- The SDL flags describing its purpose</param>
+	/// <param name="sample_count">- (Optional) Samples per pixel. Multisampled textures can't be sampled; resolve
+	/// them into a single-sampled one through CustomTargetInfo::resolve_texture</param>
 	/// <returns>An RID representing the texture</returns>
-	RID create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage);
+	RID create_screen_texture(SDL_GPUTextureFormat format, SDL_GPUTextureUsageFlags usage,
+		SDL_GPUSampleCount sample_count = SDL_GPU_SAMPLECOUNT_1);
 
 	// Returns the SDL handle for the RID representing the texture. This handle should only be acquired from
 	// create_screen_texture()
@@ -231,6 +451,23 @@ public:
 		return m_texture_states[*texture];
 	}
 	
+	/// <summary>
+	/// Marks part of a texture's base level as changed, so the mips derived from it are rebuilt at the end of
+	/// the next copy pass. Uploads through ActiveCopyPass do this automatically
+	/// </summary>
+	/// <param name="texture">- An RID representing the texture</param>
+	/// <param name="rect">- The changed region of the base level</param>
+	void mark_mips_dirty(RID texture, const TextureRect &rect);
+
+	/// <summary>
+	/// Limits how much mip generation end_copy_pass() does. Textures past the budget stay queued for the next
+	/// copy pass. At least one texture is always processed, so large textures still make progress
+	/// </summary>
+	/// <param name="texels">- The number of base level texels to rebuild per copy pass. 0 means no limit</param>
+	inline void set_mip_budget(u64 texels) { m_mip_texel_budget = texels; }
+
+	inline const MipStats &get_mip_stats() const { return m_mip_stats; }
+
 	// Destroys the texture, allowing a new one to replace its position
 	void destroy_texture(RID texture);
 	
@@ -253,6 +490,16 @@ public:
 		return *sampler == U32_BAD ? nullptr : m_samplers[*sampler];
 	}
 
+	// The depth texture of window passes (screen texture 0). Only holds the last frame's depth if its window passes
+	// store it, see WindowPassInfo
+	inline SDL_GPUTexture *get_depth_texture() { return m_screen_textures[0]; }
+
+	// Whether get_depth_texture() can be bound as a sampler
+	inline bool can_sample_depth() const { return m_screen_tex_infos[0].usage & SDL_GPU_TEXTUREUSAGE_SAMPLER; }
+
+	inline u32 get_window_width() const { return m_winw; }
+	inline u32 get_window_height() const { return m_winh; }
+
 	// Returns the SDL handle used for GPU operations
 	inline SDL_GPUDevice *get_device() { return m_device; }
 };
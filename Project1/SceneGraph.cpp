@@ -0,0 +1,279 @@
+#include "SceneGraph.h"
+#include "JobSystem.h"
+
+// SSE2 is part of x64, so this only falls back on other architectures
+#if defined(_M_X64) || defined(__SSE2__)
+#define SCENE_SSE 1
+#include <emmintrin.h>
+#else
+#define SCENE_SSE 0
+#endif
+
+u32 SceneGraph::create_node(u32 parent, const vec3 &position, const quat &rotation, const vec3 &scale) {
+	u32 parent_position = U32_BAD;
+	u32 depth = 0;
+
+	if (parent != U32_BAD) {
+		parent_position = position_of(parent);
+		depth = m_depths[parent_position] + 1;
+	}
+
+	u32 node;
+	if (!m_free_handles.empty()) {
+		node = m_free_handles.back();
+		m_free_handles.pop_back();
+	} else {
+		node = m_positions_of.size();
+		m_positions_of.push_back(U32_BAD);
+	}
+
+	u32 at = m_handles.size();
+	m_positions_of[node] = at;
+	m_handles.push_back(node);
+
+	m_positions.push_back(position);
+	m_rotations.push_back(rotation);
+	m_scales.push_back(scale);
+	m_parents.push_back(parent_position);
+	m_depths.push_back(depth);
+	m_world.push_back(glm::identity<mat4x4>());
+	m_dirty.push_back(1);
+	m_changed.push_back(0);
+	m_removed.push_back(0);
+
+	// Appending keeps the order as long as nothing deeper exists yet
+	if (!m_restructure) {
+		if (depth + 1 == m_level_ends.size()) {
+			m_level_ends.back() = at + 1;
+		} else if (depth == m_level_ends.size()) {
+			m_level_ends.push_back(at + 1);
+		} else {
+			m_restructure = true;
+		}
+	}
+
+	return node;
+}
+
+void SceneGraph::destroy_node(u32 node) {
+	m_removed[position_of(node)] = 1;
+	m_restructure = true;
+}
+
+void SceneGraph::set_parent(u32 node, u32 parent) {
+	u32 at = position_of(node);
+	u32 parent_position = parent == U32_BAD ? U32_BAD : position_of(parent);
+
+	for (u32 ancestor = parent_position; ancestor != U32_BAD; ancestor = m_parents[ancestor]) {
+		if (ancestor == at) {
+			std::cout << "Can't parent scene node " << node << " to its own descendant " << parent << "\n";
+			return;
+		}
+	}
+
+	m_parents[at] = parent_position;
+	m_dirty[at] = 1;
+	m_restructure = true;
+}
+
+void SceneGraph::set_position(u32 node, const vec3 &position) {
+	u32 at = position_of(node);
+	m_positions[at] = position;
+	m_dirty[at] = 1;
+}
+
+void SceneGraph::set_rotation(u32 node, const quat &rotation) {
+	u32 at = position_of(node);
+	m_rotations[at] = rotation;
+	m_dirty[at] = 1;
+}
+
+void SceneGraph::set_scale(u32 node, const vec3 &scale) {
+	u32 at = position_of(node);
+	m_scales[at] = scale;
+	m_dirty[at] = 1;
+}
+
+void SceneGraph::set_local(u32 node, const vec3 &position, const quat &rotation, const vec3 &scale) {
+	u32 at = position_of(node);
+	m_positions[at] = position;
+	m_rotations[at] = rotation;
+	m_scales[at] = scale;
+	m_dirty[at] = 1;
+}
+
+u32 SceneGraph::get_parent(u32 node) const {
+	u32 parent = m_parents[position_of(node)];
+	return parent == U32_BAD ? U32_BAD : m_handles[parent];
+}
+
+void SceneGraph::restructure() {
+	u32 count = m_handles.size();
+
+	// Parents may come after their children now, so resolve depths and removals by walking up to a known ancestor
+	std::vector<u32> depths(count, U32_BAD);
+	std::vector<u32> chain;
+
+	for (u32 i = 0; i < count; i++) {
+		u32 at = i;
+		while (at != U32_BAD && depths[at] == U32_BAD) {
+			chain.push_back(at);
+			at = m_parents[at];
+		}
+
+		u32 depth = at == U32_BAD ? 0 : depths[at] + 1;
+		byte removed = at == U32_BAD ? 0 : m_removed[at];
+
+		while (!chain.empty()) {
+			u32 node = chain.back();
+			chain.pop_back();
+
+			removed |= m_removed[node];
+			m_removed[node] = removed;
+			depths[node] = depth++;
+		}
+	}
+
+	// Counting sort by depth. Stable, so siblings keep their relative order
+	m_level_ends.clear();
+	for (u32 i = 0; i < count; i++) {
+		if (m_removed[i]) continue;
+
+		if (depths[i] >= m_level_ends.size()) m_level_ends.resize(depths[i] + 1, 0);
+		m_level_ends[depths[i]]++;
+	}
+
+	std::vector<u32> next(m_level_ends.size());
+	u32 total = 0;
+	for (u32 d = 0; d < m_level_ends.size(); d++) {
+		next[d] = total;
+		total += m_level_ends[d];
+		m_level_ends[d] = total;
+	}
+
+	std::vector<u32> new_position(count, U32_BAD);
+	for (u32 i = 0; i < count; i++) {
+		if (m_removed[i]) {
+			m_positions_of[m_handles[i]] = U32_BAD;
+			m_free_handles.push_back(m_handles[i]);
+			continue;
+		}
+
+		new_position[i] = next[depths[i]]++;
+	}
+
+	auto permute = [&](auto &array) {
+		std::remove_reference_t<decltype(array)> sorted(total);
+		for (u32 i = 0; i < count; i++) {
+			if (new_position[i] != U32_BAD) sorted[new_position[i]] = array[i];
+		}
+		array.swap(sorted);
+	};
+
+	permute(m_positions);
+	permute(m_rotations);
+	permute(m_scales);
+	permute(m_world);
+	permute(m_dirty);
+	permute(m_changed);
+	permute(m_handles);
+	permute(m_parents);
+
+	m_depths.resize(total);
+	m_removed.assign(total, 0);
+
+	for (u32 i = 0; i < total; i++) {
+		if (m_parents[i] != U32_BAD) m_parents[i] = new_position[m_parents[i]];
+		m_depths[i] = m_parents[i] == U32_BAD ? 0 : m_depths[m_parents[i]] + 1;
+		m_positions_of[m_handles[i]] = i;
+	}
+
+	m_restructure = false;
+}
+
+void SceneGraph::update_range(u32 begin, u32 end) {
+	for (u32 i = begin; i < end; i++) {
+		u32 parent = m_parents[i];
+
+		if (!m_dirty[i] && (parent == U32_BAD || !m_changed[parent])) {
+			m_changed[i] = 0;
+			continue;
+		}
+
+		m_dirty[i] = 0;
+		m_changed[i] = 1;
+
+		// Local TRS matrix: the rotation's columns scaled, then the translation
+		glm::mat3 rotation = glm::mat3_cast(m_rotations[i]);
+		const vec3 &scale = m_scales[i];
+		const vec3 &position = m_positions[i];
+
+		mat4x4 &world = m_world[i];
+
+		if (parent == U32_BAD) {
+			world[0] = vec4(rotation[0] * scale.x, 0.0f);
+			world[1] = vec4(rotation[1] * scale.y, 0.0f);
+			world[2] = vec4(rotation[2] * scale.z, 0.0f);
+			world[3] = vec4(position, 1.0f);
+			continue;
+		}
+
+		const mat4x4 &pw = m_world[parent];
+
+#if SCENE_SSE
+		// world = parent * local. Each column of the result is the parent's columns weighted by one column of local,
+		// whose last row is (0, 0, 0, 1)
+		__m128 p0 = _mm_loadu_ps(&pw[0][0]);
+		__m128 p1 = _mm_loadu_ps(&pw[1][0]);
+		__m128 p2 = _mm_loadu_ps(&pw[2][0]);
+		__m128 p3 = _mm_loadu_ps(&pw[3][0]);
+
+		for (u32 c = 0; c < 3; c++) {
+			vec3 l = rotation[c] * scale[c];
+
+			__m128 r = _mm_mul_ps(p0, _mm_set1_ps(l.x));
+			r = _mm_add_ps(r, _mm_mul_ps(p1, _mm_set1_ps(l.y)));
+			r = _mm_add_ps(r, _mm_mul_ps(p2, _mm_set1_ps(l.z)));
+			_mm_storeu_ps(&world[c][0], r);
+		}
+
+		__m128 t = _mm_mul_ps(p0, _mm_set1_ps(position.x));
+		t = _mm_add_ps(t, _mm_mul_ps(p1, _mm_set1_ps(position.y)));
+		t = _mm_add_ps(t, _mm_mul_ps(p2, _mm_set1_ps(position.z)));
+		t = _mm_add_ps(t, p3);
+		_mm_storeu_ps(&world[3][0], t);
+#else
+		mat4x4 local;
+		local[0] = vec4(rotation[0] * scale.x, 0.0f);
+		local[1] = vec4(rotation[1] * scale.y, 0.0f);
+		local[2] = vec4(rotation[2] * scale.z, 0.0f);
+		local[3] = vec4(position, 1.0f);
+
+		world = pw * local;
+#endif
+	}
+}
+
+void SceneGraph::update(u32 parallel_threshold) {
+	if (m_restructure) restructure();
+
+	u32 begin = 0;
+	for (u32 end : m_level_ends) {
+		u32 count = end - begin;
+
+		if (count < parallel_threshold || JobSystem::get_worker_count() <= 1) {
+			update_range(begin, end);
+		} else {
+			// Chunks of a few thousand nodes keep the scheduling cost well below the work
+			u32 chunk = std::max(parallel_threshold / 2, 1024u);
+			u32 num_chunks = (count + chunk - 1) / chunk;
+
+			JobSystem::parallel_for(num_chunks, 1, [&](u32 c) {
+				u32 chunk_begin = begin + c * chunk;
+				update_range(chunk_begin, std::min(chunk_begin + chunk, end));
+			});
+		}
+
+		begin = end;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "common.h"
+
+/* SceneGraph
+ * A transform hierarchy stored as parallel arrays (structure of arrays) instead of node objects. Nodes are kept
+ * sorted by depth, so every parent comes before its children and each depth is one contiguous range: update() walks
+ * the ranges in order, and the nodes of one range only read the (already finished) range above it, so a range can
+ * be split across the JobSystem's workers.
+ *
+ * Nodes are referred to by a stable handle. Their position in the arrays changes whenever the hierarchy is
+ * restructured, which is deferred to the next update().
+ *
+ * Only nodes whose local transform changed, or whose parent's world transform changed, are recomputed.
+*/
+class SceneGraph {
+	// Indexed by position in depth order
+	std::vector<vec3> m_positions;
+	std::vector<quat> m_rotations;
+	std::vector<vec3> m_scales;
+	std::vector<u32> m_parents;
+	std::vector<u32> m_depths;
+	std::vector<mat4x4> m_world;
+
+	// Set when the local transform changes, cleared by update()
+	std::vector<byte> m_dirty;
+	// Set by update() for every node whose world matrix it recomputed
+	std::vector<byte> m_changed;
+	// Set by destroy_node(), the node and its descendants are dropped by the next update()
+	std::vector<byte> m_removed;
+
+	// Position -> handle, and handle -> position (U32_BAD for free handles)
+	std::vector<u32> m_handles;
+	std::vector<u32> m_positions_of;
+	std::vector<u32> m_free_handles;
+
+	// m_level_ends[d] is one past the last node of depth d
+	std::vector<u32> m_level_ends;
+
+	// Set when nodes were removed, reparented or added above the deepest level
+	bool m_restructure = false;
+
+	// Recomputes depths, drops removed subtrees and sorts by depth
+	void restructure();
+
+	// Recomputes the world matrices of nodes [begin, end), which must all have the same depth
+	void update_range(u32 begin, u32 end);
+
+	inline u32 position_of(u32 node) const {
+		assert(node < m_positions_of.size() && m_positions_of[node] != U32_BAD);
+		return m_positions_of[node];
+	}
+
+public:
+	SceneGraph() = default;
+
+	/// <summary>
+	/// Adds a node. Its world matrix is valid after the next update()
+	/// </summary>
+	/// <param name="parent">- The node it is relative to, or U32_BAD for a root</param>
+	/// <param name="position">- The local translation</param>
+	/// <param name="rotation">- The local rotation</param>
+	/// <param name="scale">- The local scale</param>
+	/// <returns>A handle that stays valid until the node is destroyed</returns>
+	u32 create_node(u32 parent = U32_BAD, const vec3 &position = vec3(0.0f),
+		const quat &rotation = glm::identity<quat>(), const vec3 &scale = vec3(1.0f));
+
+	// Destroys the node and all of its descendants. Their handles are freed by the next update()
+	void destroy_node(u32 node);
+
+	// Moves the node under another parent, or makes it a root if parent is U32_BAD. Its local transform is kept
+	void set_parent(u32 node, u32 parent);
+
+	void set_position(u32 node, const vec3 &position);
+	void set_rotation(u32 node, const quat &rotation);
+	void set_scale(u32 node, const vec3 &scale);
+	void set_local(u32 node, const vec3 &position, const quat &rotation, const vec3 &scale);
+
+	inline const vec3 &get_position(u32 node) const { return m_positions[position_of(node)]; }
+	inline const quat &get_rotation(u32 node) const { return m_rotations[position_of(node)]; }
+	inline const vec3 &get_scale(u32 node) const { return m_scales[position_of(node)]; }
+
+	// The parent's handle, U32_BAD for roots
+	u32 get_parent(u32 node) const;
+
+	// As of the last update()
+	inline const mat4x4 &get_world(u32 node) const { return m_world[position_of(node)]; }
+
+	// Whether the last update() recomputed the node's world matrix, eg. to know which bounds to refit
+	inline bool was_changed(u32 node) const { return m_changed[position_of(node)]; }
+
+	/// <summary>
+	/// Applies pending restructuring, then recomputes every world matrix that is out of date. Depth ranges larger
+	/// than parallel_threshold are split across the JobSystem's workers
+	/// </summary>
+	/// <param name="parallel_threshold">- The smallest range worth splitting. U32_BAD never splits</param>
+	void update(u32 parallel_threshold = 4096);
+
+	inline u32 get_node_count() const { return m_handles.size(); }
+	inline u32 get_depth_count() const { return m_level_ends.size(); }
+
+	// Direct access to the arrays, in depth order, eg. to feed every world matrix to the GPU
+	inline const std::vector<mat4x4> &get_world_matrices() const { return m_world; }
+	inline const std::vector<u32> &get_handles() const { return m_handles; }
+};
@@ -1,20 +1,176 @@
 #include "Shader.h"
 
+u64 hash_stage_info(const ShaderStageInfo &stage, u64 seed) {
+	u64 hash = hash_bytes(stage.code.data(), stage.code.size(), seed);
+
+	u32 counts[4] = { stage.num_samplers, stage.num_storage_textures, stage.num_storage_buffers, stage.num_uniform_buffers };
+	return hash_bytes(counts, sizeof(counts), hash);
+}
+
+u64 hash_pipeline_info(const PipelineInfo &pip, u64 seed) {
+	u32 state[9] = { pip.depth_test, pip.stencil_test, (u32) pip.cull_mode, (u32) pip.targets.size(), (u32) pip.depth_format,
+		(u32) pip.depth_compare, pip.depth_write, (u32) pip.sample_count, get_vert_attribs_read(pip) };
+	u64 hash = hash_bytes(state, sizeof(state), seed);
+
+	float bias[2] = { pip.depth_bias_constant, pip.depth_bias_slope };
+	hash = hash_bytes(bias, sizeof(bias), hash);
+
+	for (const ColorTargetInfo &target : pip.targets) {
+		u32 target_state[4] = { (u32) target.format, target.alpha_blending, target.additive_blending, target.color_write };
+		hash = hash_bytes(target_state, sizeof(target_state), hash);
+	}
+
+	// Separate the lists so moving an attribute between them changes the hash
+	for (const AttributeList *list : { &pip.vert_attribs, &pip.inst_attribs }) {
+		u32 count = list->size();
+		hash = hash_bytes(&count, sizeof(count), hash);
+
+		for (const auto &attr : *list) {
+			hash = hash_bytes(&attr.first, sizeof(attr.first), hash);
+		}
+	}
+
+	return hash;
+}
+
+u32 get_vert_attribs_read(const PipelineInfo &pip) {
+	return std::min(pip.vert_attribs_read, (u32) pip.vert_attribs.size());
+}
+
+PipelineInfo make_depth_prepass_info(const PipelineInfo &pip) {
+	PipelineInfo prepass = pip;
+
+	prepass.vert_attribs_read = std::min(get_vert_attribs_read(pip), 1u);
+
+	prepass.depth_test = true;
+	prepass.depth_write = true;
+	prepass.depth_compare = SDL_GPU_COMPAREOP_LESS;
+
+	for (ColorTargetInfo &target : prepass.targets) {
+		target.alpha_blending = false;
+		target.additive_blending = false;
+		target.color_write = false;
+	}
+
+	return prepass;
+}
+
+bool resolve_stage_info(ShaderStageInfo &stage, SDL_GPUShaderStage expected, SpirvReflection *o_reflection) {
+	std::string error;
+	if (!reflect_spirv(stage.code, o_reflection, &error)) {
+		std::cout << "Could not reflect " << stage.path << ": " << error << "\n";
+		return false;
+	}
+
+	if (o_reflection->stage != expected) {
+		std::cout << stage.path << " is not a " << (expected == SDL_GPU_SHADERSTAGE_VERTEX ? "vertex" : "fragment") << " shader\n";
+		return false;
+	}
+
+	struct {
+		u32 *given;
+		u32 found;
+		const char *name;
+	} counts[4] = {
+		{ &stage.num_samplers, o_reflection->num_samplers, "samplers" },
+		{ &stage.num_storage_textures, o_reflection->num_storage_textures, "storage textures" },
+		{ &stage.num_storage_buffers, o_reflection->num_storage_buffers, "storage buffers" },
+		{ &stage.num_uniform_buffers, o_reflection->num_uniform_buffers, "uniform buffers" },
+	};
+
+	bool matches = true;
+	for (auto &count : counts) {
+		if (*count.given == U32_BAD) {
+			*count.given = count.found;
+		} else if (*count.given != count.found) {
+			std::cout << stage.path << " uses " << count.found << " " << count.name << ", but " << *count.given << " were specified\n";
+			matches = false;
+		}
+	}
+
+	return matches;
+}
+
+bool validate_vertex_inputs(const SpirvReflection &reflection, const std::string &path, const PipelineInfo &pip) {
+	bool valid = true;
+
+	for (const SpirvInput &input : reflection.inputs) {
+		for (u32 k = 0; k < input.locations; ++k) {
+			u32 location = input.location + k;
+
+			// Matches the locations assigned when the pipeline is created
+			MeshAttribute attribute = MESHATTRIBUTE_INVALID;
+			if (location < pip.vert_attribs.size()) {
+				if (location < get_vert_attribs_read(pip)) attribute = pip.vert_attribs[location].first;
+			} else if (location - pip.vert_attribs.size() < pip.inst_attribs.size()) {
+				attribute = pip.inst_attribs[location - pip.vert_attribs.size()].first;
+			}
+
+			if (attribute == MESHATTRIBUTE_INVALID) {
+				std::cout << path << ": input " << input.name << " (location " << location << ") has no matching attribute\n";
+				valid = false;
+				continue;
+			}
+
+			// All attributes are float for now
+			if (input.base_type != SpirvBaseType::FLOAT) {
+				std::cout << path << ": input " << input.name << " (location " << location << ") is not a float type\n";
+				valid = false;
+				continue;
+			}
+
+			// Allowed by the API (missing components are filled in), but usually a mistake
+			if (input.components != mesh_attribute_components[attribute]) {
+				std::cout << "Warning: " << path << ": input " << input.name << " has " << input.components
+					<< " components, but its attribute has " << mesh_attribute_components[attribute] << "\n";
+			}
+		}
+	}
+
+	return valid;
+}
+
 VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo &&pip, SDL_GPUDevice *device):
 	m_device(device)
 {
-	// Create vertex shader
-	u32 shader_len;
-	std::cout << "Reading vs\n";
-	byte *vs_shader_code = read_whole_file(vs.path, &shader_len);
+	// Load both stages before creating anything, so a bad module doesn't leave half a shader behind
+	if (vs.code.empty()) {
+		u32 shader_len;
+		std::cout << "Reading vs\n";
+		byte *vs_shader_code = read_whole_file(vs.path, &shader_len);
+
+		if (!vs_shader_code || shader_len < 1) {
+			return;
+		}
+
+		vs.code.assign(vs_shader_code, vs_shader_code + shader_len);
+		delete[] vs_shader_code;
+	}
+
+	if (fs.code.empty()) {
+		u32 shader_len;
+		std::cout << "Reading fs\n";
+		byte *fs_shader_code = read_whole_file(fs.path, &shader_len);
+
+		if (!fs_shader_code || shader_len < 1) {
+			return;
+		}
 
-	if (!vs_shader_code || shader_len < 1) {
+		fs.code.assign(fs_shader_code, fs_shader_code + shader_len);
+		delete[] fs_shader_code;
+	}
+
+	SpirvReflection vs_refl, fs_refl;
+	if (!resolve_stage_info(vs, SDL_GPU_SHADERSTAGE_VERTEX, &vs_refl) ||
+		!resolve_stage_info(fs, SDL_GPU_SHADERSTAGE_FRAGMENT, &fs_refl) ||
+		!validate_vertex_inputs(vs_refl, vs.path, pip)) {
 		return;
 	}
 
+	// Create vertex shader
 	SDL_GPUShaderCreateInfo sci = {
-		.code_size = shader_len,
-		.code = vs_shader_code,
+		.code_size = vs.code.size(),
+		.code = vs.code.data(),
 		.entrypoint = "main",
 		.format = SDL_GPU_SHADERFORMAT_SPIRV,
 		.stage = SDL_GPU_SHADERSTAGE_VERTEX,
@@ -25,20 +181,11 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 	};
 
 	m_vs = SDL_CreateGPUShader(m_device, &sci);
-	std::cout << "Deleting vs\n";
-	delete[] vs_shader_code;
 
 	// Create fragment shader
-	std::cout << "Reading vs\n";
-	byte *fs_shader_code = read_whole_file(fs.path, &shader_len);
-
-	if (!fs_shader_code || shader_len < 1) {
-		return;
-	}
-
 	sci = {
-		.code_size = shader_len,
-		.code = fs_shader_code,
+		.code_size = fs.code.size(),
+		.code = fs.code.data(),
 		.entrypoint = "main",
 		.format = SDL_GPU_SHADERFORMAT_SPIRV,
 		.stage = SDL_GPU_SHADERSTAGE_FRAGMENT,
@@ -49,8 +196,11 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 	};
 
 	m_fs = SDL_CreateGPUShader(m_device, &sci);
-	std::cout << "Deleting fs\n";
-	delete[] fs_shader_code;
+
+	if (!m_vs || !m_fs) {
+		std::cout << "Could not create shaders for " << vs.path << " + " << fs.path << ": " << SDL_GetError() << "\n";
+		return;
+	}
 
 	// Create pipeline
 	SDL_GPUGraphicsPipelineCreateInfo gpci = {
@@ -63,12 +213,19 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 	u32 vert_slot = 0;
 	u32 inst_slot = 1 - (u32) (pip.vert_attribs.empty());
 
-	u32 total_attribs = pip.vert_attribs.size() + pip.inst_attribs.size();
+	u32 vert_attribs_read = get_vert_attribs_read(pip);
+	u32 total_attribs = vert_attribs_read + pip.inst_attribs.size();
 	std::cout << "Allocating vertex attributes\n";
 	SDL_GPUVertexAttribute *vas = new SDL_GPUVertexAttribute[total_attribs];
 
 	u32 vert_attribs_step = 0;
 	for (u32 i = 0; i < pip.vert_attribs.size(); ++i) {
+		// Unread attributes only move the next ones along
+		if (i >= vert_attribs_read) {
+			vert_attribs_step += mesh_attribute_sizes[pip.vert_attribs[i].first];
+			continue;
+		}
+
 		vas[i] = {
 			.location = i,
 			.buffer_slot = vert_slot,
@@ -79,17 +236,18 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 		vert_attribs_step += mesh_attribute_sizes[pip.vert_attribs[i].first];
 	}
 
+	// Instance attributes continue the locations after the vertex attributes
 	u32 inst_attribs_step = 0;
 	for (u32 j = 0; j < pip.inst_attribs.size(); ++j) {
 		u32 i = j + pip.vert_attribs.size();
-		vas[j] = {
-			.location = j,
+		vas[j + vert_attribs_read] = {
+			.location = i,
 			.buffer_slot = inst_slot,
-			.format = common_to_SDL_GPUVertexElementFormat(pip.inst_attribs[i].first),
+			.format = common_to_SDL_GPUVertexElementFormat(pip.inst_attribs[j].first),
 			.offset = inst_attribs_step
 		};
 
-		inst_attribs_step += mesh_attribute_sizes[pip.inst_attribs[i].first];
+		inst_attribs_step += mesh_attribute_sizes[pip.inst_attribs[j].first];
 	}
 
 	u32 buffer_desc_count = 0;
@@ -132,33 +290,35 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 		.fill_mode = SDL_GPU_FILLMODE_FILL,
 		.cull_mode = pip.cull_mode,
 		.front_face = SDL_GPU_FRONTFACE_COUNTER_CLOCKWISE,
-		.depth_bias_constant_factor = 0.0f,
+		.depth_bias_constant_factor = pip.depth_bias_constant,
 		.depth_bias_clamp = 0.0f,
-		.depth_bias_slope_factor = 0.0f,
-		.enable_depth_bias = false,
+		.depth_bias_slope_factor = pip.depth_bias_slope,
+		.enable_depth_bias = pip.depth_bias_constant != 0.0f || pip.depth_bias_slope != 0.0f,
 		.enable_depth_clip = false
 	};
 
 	gpci.multisample_state = {
-		.sample_count = SDL_GPU_SAMPLECOUNT_1
+		.sample_count = pip.sample_count
 	};
 
 	gpci.depth_stencil_state = {
-		.compare_op = SDL_GPU_COMPAREOP_LESS,
+		.compare_op = pip.depth_compare,
 		.back_stencil_state = SDL_GPU_STENCILOP_REPLACE,
 		.front_stencil_state = SDL_GPU_STENCILOP_REPLACE,
 		.compare_mask = 0xFF,
 		.write_mask = 0xFF,
 		.enable_depth_test = pip.depth_test,
-		.enable_depth_write = pip.depth_test,
+		.enable_depth_write = pip.depth_test && pip.depth_write,
 		.enable_stencil_test = pip.stencil_test
 	};
 
 	std::cout << "Allocating color target descriptions\n";
 	SDL_GPUColorTargetDescription *ctds = new SDL_GPUColorTargetDescription[pip.targets.size()];
 	for (u32 i = 0; i < pip.targets.size(); ++i) {
+		const ColorTargetInfo &target = pip.targets[i];
+
 		ctds[i] = {
-			.format = pip.targets[0].format,
+			.format = target.format,
 			.blend_state = {
 				.src_color_blendfactor = SDL_GPU_BLENDFACTOR_SRC_ALPHA,
 				.dst_color_blendfactor = SDL_GPU_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
@@ -166,16 +326,24 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 				.src_alpha_blendfactor = SDL_GPU_BLENDFACTOR_SRC_ALPHA,
 				.dst_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
 				.alpha_blend_op = SDL_GPU_BLENDOP_ADD,
-				.enable_blend = pip.targets[0].alpha_blending,
-				.enable_color_write_mask = false,
+				// An empty mask when enabled writes nothing
+				.color_write_mask = 0,
+				.enable_blend = target.alpha_blending || target.additive_blending,
+				.enable_color_write_mask = !target.color_write,
 			}
 		};
+
+		if (target.additive_blending) {
+			SDL_GPUColorTargetBlendState &blend = ctds[i].blend_state;
+			blend.src_color_blendfactor = blend.src_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+			blend.dst_color_blendfactor = blend.dst_alpha_blendfactor = SDL_GPU_BLENDFACTOR_ONE;
+		}
 	}
 
 	gpci.target_info = {
 		.color_target_descriptions = ctds,
 		.num_color_targets = (u32) pip.targets.size(),
-		.depth_stencil_format = SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT,
+		.depth_stencil_format = pip.depth_format,
 		.has_depth_stencil_target = true
 	};
 
@@ -192,6 +360,16 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 	else
 		m_pipinfo.inst_slot_offset = U32_BAD;
 	
+	for (const SpirvUniformBlock &block : vs_refl.uniform_blocks) {
+		if (block.binding >= m_pipinfo.vert_uniform_sizes.size()) m_pipinfo.vert_uniform_sizes.resize(block.binding + 1, 0);
+		m_pipinfo.vert_uniform_sizes[block.binding] = block.size;
+	}
+
+	for (const SpirvUniformBlock &block : fs_refl.uniform_blocks) {
+		if (block.binding >= m_pipinfo.frag_uniform_sizes.size()) m_pipinfo.frag_uniform_sizes.resize(block.binding + 1, 0);
+		m_pipinfo.frag_uniform_sizes[block.binding] = block.size;
+	}
+
 	m_pipinfo.target_formats.resize(pip.targets.size());
 	for (u32 i = 0; i < pip.targets.size(); ++i) {
 		m_pipinfo.target_formats[i] = pip.targets[i].format;
@@ -203,6 +381,32 @@ VisualShader::VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo
 	delete[] ctds;
 }
 
+VisualShader::VisualShader(VisualShader &&other) noexcept:
+	m_vs(other.m_vs), m_fs(other.m_fs), m_rp(other.m_rp), m_device(other.m_device), m_pipinfo(std::move(other.m_pipinfo))
+{
+	other.m_vs = nullptr;
+	other.m_fs = nullptr;
+	other.m_rp = nullptr;
+}
+
+VisualShader &VisualShader::operator=(VisualShader &&other) noexcept {
+	if (this == &other) return *this;
+
+	this->~VisualShader();
+
+	m_vs = other.m_vs;
+	m_fs = other.m_fs;
+	m_rp = other.m_rp;
+	m_device = other.m_device;
+	m_pipinfo = std::move(other.m_pipinfo);
+
+	other.m_vs = nullptr;
+	other.m_fs = nullptr;
+	other.m_rp = nullptr;
+
+	return *this;
+}
+
 VisualShader::~VisualShader() {
 	if (m_rp) {
 		SDL_ReleaseGPUGraphicsPipeline(m_device, m_rp);
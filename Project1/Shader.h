@@ -1,19 +1,30 @@
 #pragma once
 #include "common.h"
 #include "MeshAttributes.h"
+#include "SpirvReflect.h"
 
 struct ShaderStageInfo {
 	std::string path;
 
-	u32 num_samplers;
-	u32 num_storage_textures;
-	u32 num_storage_buffers;
-	u32 num_uniform_buffers;
+	// SPIR-V for the stage. If empty, it is read from path
+	std::vector<byte> code;
+
+	// Left as U32_BAD, these are read from the SPIR-V. If given, they must match it
+	u32 num_samplers = U32_BAD;
+	u32 num_storage_textures = U32_BAD;
+	u32 num_storage_buffers = U32_BAD;
+	u32 num_uniform_buffers = U32_BAD;
 };
 
 struct ColorTargetInfo {
 	SDL_GPUTextureFormat format;
 	bool alpha_blending;
+
+	// Adds the output to what is in the target, eg. to count fragments. Takes precedence over alpha_blending
+	bool additive_blending = false;
+
+	// Off leaves the target untouched, eg. for a depth pre-pass sharing its render pass with the draws that follow
+	bool color_write = true;
 };
 
 struct PipelineInfo {
@@ -26,7 +37,33 @@ struct PipelineInfo {
 	AttributeList vert_attribs;
 	AttributeList inst_attribs;
 
+	// How many of vert_attribs, from the first, the vertex shader reads. The rest still count towards the pitch, so
+	// the same vertex buffers can be bound. U32_BAD reads them all
+	u32 vert_attribs_read = U32_BAD;
+
 	SDL_GPUCullMode cull_mode;
+
+	// The format of the depth target passes using this pipeline render to. Depth-only passes like shadow maps
+	// usually pick a format without stencil
+	SDL_GPUTextureFormat depth_format = SDL_GPU_TEXTUREFORMAT_D24_UNORM_S8_UINT;
+
+	// Pushes depth away from the viewer, eg. against shadow acne. The slope factor scales with the depth gradient
+	float depth_bias_constant = 0.0f;
+	float depth_bias_slope = 0.0f;
+
+	// Only used with depth_test. LESS_OR_EQUAL lets a pass draw over the depth a pre-pass laid down
+	SDL_GPUCompareOp depth_compare = SDL_GPU_COMPAREOP_LESS;
+	bool depth_write = true;
+
+	// Must match the targets of the passes using this pipeline, eg. Renderer::get_window_sample_count() in window passes
+	SDL_GPUSampleCount sample_count = SDL_GPU_SAMPLECOUNT_1;
+};
+
+// One pipeline of a Renderer::add_shaders() batch
+struct ShaderBatchEntry {
+	ShaderStageInfo vs;
+	ShaderStageInfo fs;
+	PipelineInfo pip;
 };
 
 struct CompiledPipelineInfo {
@@ -36,15 +73,40 @@ struct CompiledPipelineInfo {
 	u32 inst_slot_offset;
 
 	std::vector<SDL_GPUTextureFormat> target_formats;
+
+	// Size in bytes of each uniform block, indexed by slot. 0 means the slot is unused
+	std::vector<u32> vert_uniform_sizes;
+	std::vector<u32> frag_uniform_sizes;
 };
 
+// Fills in the resource counts left as U32_BAD from the SPIR-V, and checks the given ones against it. code must be
+// loaded. Prints the reason and returns false on a mismatch
+bool resolve_stage_info(ShaderStageInfo &stage, SDL_GPUShaderStage expected, SpirvReflection *o_reflection);
+
+// Checks that every input of a vertex stage is fed by an attribute. Prints the reason and returns false if not
+bool validate_vertex_inputs(const SpirvReflection &reflection, const std::string &path, const PipelineInfo &pip);
+
+// Hashes everything that affects the compiled stage, including the SPIR-V itself. code must be loaded
+u64 hash_stage_info(const ShaderStageInfo &stage, u64 seed = HASH_SEED);
+
+// Hashes everything that affects pipeline state. Attribute names are ignored since they don't reach the GPU
+u64 hash_pipeline_info(const PipelineInfo &pip, u64 seed = HASH_SEED);
+
+// Derives the pipeline of a depth pre-pass for pip: only the positions, which must be the first vertex attribute, are
+// read, but the pitch is kept so the same vertex buffers can be bound. The targets and depth format are the same, so
+// it can share pip's render pass, but with color writes and blending off. Draw pip with LESS_OR_EQUAL afterwards
+PipelineInfo make_depth_prepass_info(const PipelineInfo &pip);
+
+// How many vertex attributes a pipeline reads, see PipelineInfo::vert_attribs_read
+u32 get_vert_attribs_read(const PipelineInfo &pip);
+
 class VisualShader {
-	SDL_GPUShader *m_vs;
-	SDL_GPUShader *m_fs;
+	SDL_GPUShader *m_vs = nullptr;
+	SDL_GPUShader *m_fs = nullptr;
 
-	SDL_GPUGraphicsPipeline *m_rp;
+	SDL_GPUGraphicsPipeline *m_rp = nullptr;
 
-	SDL_GPUDevice *m_device;
+	SDL_GPUDevice *m_device = nullptr;
 
 	CompiledPipelineInfo m_pipinfo;
 
@@ -52,17 +114,21 @@ class VisualShader {
 public:
 	VisualShader() = default;
 
-	// Create a brand-new pipeline from a pair of SPIR-V shader files
+	// Create a brand-new pipeline from a pair of SPIR-V shaders, reading the files if the code isn't loaded
 	VisualShader(ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo &&pip, SDL_GPUDevice *device);
 
 	// Duplication is unsupported, use moves, alternate storage methods, or references.
 	VisualShader(const VisualShader &) = delete;
 	VisualShader &operator=(const VisualShader &) = delete;
 
-	VisualShader(VisualShader &&) noexcept = default;
-	VisualShader &operator=(VisualShader &&) noexcept = default;
+	// Moved-from shaders no longer own their SDL objects
+	VisualShader(VisualShader &&other) noexcept;
+	VisualShader &operator=(VisualShader &&other) noexcept;
 
 	~VisualShader();
 
 	const CompiledPipelineInfo &get_info() const;
+
+	// False if any stage or the pipeline failed to be created
+	inline bool is_valid() const { return m_vs && m_fs && m_rp; }
 };
\ No newline at end of file
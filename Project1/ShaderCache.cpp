@@ -0,0 +1,169 @@
+#include "ShaderCache.h"
+
+#include <filesystem>
+
+// "SCH1"
+static constexpr u32 PACK_MAGIC = 0x31484353;
+
+// Identifies the version of a file without reading it
+static u64 file_stamp(const std::string &path) {
+	std::error_code ec;
+	auto time = std::filesystem::last_write_time(path, ec);
+	if (ec) return 0;
+
+	u64 size = std::filesystem::file_size(path, ec);
+	if (ec) return 0;
+
+	u64 ticks = time.time_since_epoch().count();
+	return hash_bytes(&size, sizeof(size), hash_bytes(&ticks, sizeof(ticks)));
+}
+
+ShaderCache::ShaderCache(std::string path, u32 max_blobs):
+	m_path(std::move(path)),
+	m_max_blobs(max_blobs)
+{
+	u32 size;
+	byte *data = read_whole_file(m_path, &size);
+	if (!data) return;
+
+	// Layout: magic, count, then [key, stamp, length, bytes] for each blob, least recently used first
+	u32 pos = 0;
+	auto read = [&](void *dest, u32 length) {
+		if (pos + length > size) return false;
+		memmove(dest, data + pos, length);
+		pos += length;
+		return true;
+	};
+
+	u32 magic = 0, count = 0;
+	if (!read(&magic, sizeof(magic)) || magic != PACK_MAGIC || !read(&count, sizeof(count))) {
+		std::cout << "Shader cache " << m_path << " is invalid, ignoring it\n";
+		delete[] data;
+		return;
+	}
+
+	for (u32 i = 0; i < count; ++i) {
+		u64 key, stamp;
+		u32 length;
+		if (!read(&key, sizeof(key)) || !read(&stamp, sizeof(stamp)) || !read(&length, sizeof(length)) || pos + length > size) {
+			std::cout << "Shader cache " << m_path << " is truncated, keeping " << i << " blobs\n";
+			break;
+		}
+
+		m_blobs[key] = Blob{ .stamp = stamp, .data = std::vector<byte>(data + pos, data + pos + length), .last_used = m_use_clock++ };
+		pos += length;
+	}
+
+	delete[] data;
+
+	// Trim a pack written without the cap, or with a larger one
+	if (m_blobs.size() > m_max_blobs) m_blobs_changed = true;
+
+	std::cout << "Loaded " << m_blobs.size() << " cached shader blobs\n";
+}
+
+bool ShaderCache::read_file(const std::string &path, std::vector<byte> *o_code) {
+	if (find_file(path, o_code)) return true;
+
+	u32 size;
+	byte *data = read_whole_file(path, &size);
+	if (!data || size < 1) return false;
+
+	o_code->assign(data, data + size);
+	delete[] data;
+
+	store_file(path, *o_code);
+
+	return true;
+}
+
+bool ShaderCache::find_file(const std::string &path, std::vector<byte> *o_code) const {
+	const std::vector<byte> *cached = find_blob(hash_bytes(path.data(), path.size()), file_stamp(path));
+	if (!cached) return false;
+
+	*o_code = *cached;
+	return true;
+}
+
+void ShaderCache::store_file(const std::string &path, std::vector<byte> code) {
+	if (m_path.empty()) return;
+
+	store_blob(hash_bytes(path.data(), path.size()), file_stamp(path), std::move(code));
+}
+
+const std::vector<byte> *ShaderCache::find_blob(u64 key, u64 stamp) const {
+	auto it = m_blobs.find(key);
+	if (it == m_blobs.end() || it->second.stamp != stamp) return nullptr;
+	return &it->second.data;
+}
+
+const std::vector<byte> *ShaderCache::use_blob(u64 key, u64 stamp) {
+	auto it = m_blobs.find(key);
+	if (it == m_blobs.end() || it->second.stamp != stamp) return nullptr;
+
+	it->second.last_used = m_use_clock++;
+	return &it->second.data;
+}
+
+void ShaderCache::store_blob(u64 key, u64 stamp, std::vector<byte> data) {
+	m_blobs[key] = Blob{ .stamp = stamp, .data = std::move(data), .last_used = m_use_clock++ };
+	m_blobs_changed = true;
+}
+
+u32 ShaderCache::find_pipeline(u64 key) const {
+	auto it = m_pipelines.find(key);
+	return it == m_pipelines.end() ? U32_BAD : it->second;
+}
+
+void ShaderCache::remove_pipeline(u32 index) {
+	for (auto it = m_pipelines.begin(); it != m_pipelines.end();) {
+		if (it->second == index) {
+			it = m_pipelines.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void ShaderCache::save() {
+	if (m_path.empty() || !m_blobs_changed) return;
+
+	std::ofstream file(m_path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "Could not write shader cache " << m_path << "\n";
+		return;
+	}
+
+	// Written in the order they were used, so the next run knows which are the oldest
+	std::vector<std::pair<u64, u64>> order;
+	for (const auto &[key, blob] : m_blobs) {
+		order.push_back({ blob.last_used, key });
+	}
+	std::sort(order.begin(), order.end());
+
+	u32 evicted = 0;
+	if (order.size() > m_max_blobs) {
+		evicted = order.size() - m_max_blobs;
+
+		for (u32 i = 0; i < evicted; ++i) {
+			m_blobs.erase(order[i].second);
+		}
+	}
+
+	u32 count = m_blobs.size();
+	file.write((const char *) &PACK_MAGIC, sizeof(PACK_MAGIC));
+	file.write((const char *) &count, sizeof(count));
+
+	for (u32 i = evicted; i < order.size(); ++i) {
+		u64 key = order[i].second;
+		const Blob &blob = m_blobs[key];
+
+		u32 length = blob.data.size();
+		file.write((const char *) &key, sizeof(key));
+		file.write((const char *) &blob.stamp, sizeof(blob.stamp));
+		file.write((const char *) &length, sizeof(length));
+		file.write((const char *) blob.data.data(), length);
+	}
+
+	m_blobs_changed = false;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+
+/* ShaderCache
+ * Deduplicates pipelines within a run and keeps SPIR-V on disk between runs.
+ *
+ * SDL does not expose the backend's pipeline cache, so driver-level pipeline caching is left to the driver.
+ * What is persisted is every SPIR-V blob the renderer has seen, packed into a single file that is read once
+ * at startup. Blobs are keyed by a hash and a stamp; a stale stamp (eg. the source file changed) is a miss.
+*/
+class ShaderCache {
+	struct Blob {
+		u64 stamp;
+		std::vector<byte> data;
+
+		// Taken from m_use_clock when the blob was last stored or used. The oldest are evicted first
+		u64 last_used;
+	};
+
+	std::string m_path;
+
+	Map<u64, Blob> m_blobs;
+	bool m_blobs_changed = false;
+
+	u32 m_max_blobs = U32_BAD;
+	u64 m_use_clock = 0;
+
+	// Pipeline key -> index into the Renderer's shaders
+	Map<u64, u32> m_pipelines;
+
+public:
+	// This does nothing and loads nothing. Lookups will always miss and save() does nothing
+	inline ShaderCache() {}
+
+	/// <summary>
+	/// Loads the pack file at path if it exists. A missing or corrupt file starts an empty cache
+	/// </summary>
+	/// <param name="path">- The pack file</param>
+	/// <param name="max_blobs">- (Optional) The most blobs save() writes. The least recently used are dropped first</param>
+	ShaderCache(std::string path, u32 max_blobs = U32_BAD);
+
+	/// <summary>
+	/// Reads a SPIR-V file through the cache. Unchanged files are served from the pack without opening them
+	/// </summary>
+	/// <param name="path">- The file to read</param>
+	/// <param name="o_code">- Receives the file contents</param>
+	/// <returns>False if the file could not be read</returns>
+	bool read_file(const std::string &path, std::vector<byte> *o_code);
+
+	// Looks a file up without touching the disk beyond its timestamp. Safe to call from several threads as long as
+	// nothing is being stored at the same time
+	bool find_file(const std::string &path, std::vector<byte> *o_code) const;
+
+	// Stores a file that was read outside of the cache, so the next run is served from the pack
+	void store_file(const std::string &path, std::vector<byte> code);
+
+	// Returns the blob if it exists and its stamp matches, otherwise nullptr
+	const std::vector<byte> *find_blob(u64 key, u64 stamp) const;
+
+	// Like find_blob(), but also marks the blob as used, so a capped cache keeps it over older ones
+	const std::vector<byte> *use_blob(u64 key, u64 stamp);
+
+	void store_blob(u64 key, u64 stamp, std::vector<byte> data);
+
+	// Returns U32_BAD if no pipeline was created with this key
+	u32 find_pipeline(u64 key) const;
+
+	inline void add_pipeline(u64 key, u32 index) { m_pipelines[key] = index; }
+
+	// Forgets every key that refers to the pipeline, eg. because it was rebuilt with different code
+	void remove_pipeline(u32 index);
+
+	// To be called whenever the pipelines the keys refer to are destroyed
+	inline void clear_pipelines() { m_pipelines.clear(); }
+
+	// Writes the pack file if any blobs were added since it was loaded, without the least recently used blobs over
+	// the cap
+	void save();
+};
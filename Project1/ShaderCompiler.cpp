@@ -0,0 +1,375 @@
+#include "ShaderCompiler.h"
+
+#include <filesystem>
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+// How often the watcher checks for changes when it can't be notified
+static constexpr u32 WATCH_INTERVAL_MS = 250;
+
+static bool compile_glsl(const std::string &source, const std::string &name, EShLanguage lang,
+	const std::string &preamble, std::vector<byte> *o_spirv, std::string *o_log)
+{
+	const char *strings[1] = { source.c_str() };
+	const int lengths[1] = { (int) source.length() };
+	const char *names[1] = { name.c_str() };
+
+	glslang::TShader shader(lang);
+	shader.setStringsWithLengthsAndNames(strings, lengths, names, 1);
+	shader.setPreamble(preamble.c_str());
+	shader.setEntryPoint("main");
+	shader.setEnvInput(glslang::EShSourceGlsl, lang, glslang::EShClientVulkan, 100);
+	shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_0);
+	shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_0);
+
+	EShMessages messages = (EShMessages) (EShMsgSpvRules | EShMsgVulkanRules);
+
+	if (!shader.parse(GetDefaultResources(), 450, false, messages)) {
+		if (o_log) *o_log = shader.getInfoLog();
+		return false;
+	}
+
+	glslang::TProgram program;
+	program.addShader(&shader);
+
+	if (!program.link(messages)) {
+		if (o_log) *o_log = program.getInfoLog();
+		return false;
+	}
+
+	std::vector<unsigned int> spirv;
+	glslang::GlslangToSpv(*program.getIntermediate(lang), spirv);
+
+	o_spirv->assign((const byte *) spirv.data(), (const byte *) (spirv.data() + spirv.size()));
+	return true;
+}
+
+ShaderCompiler::ShaderCompiler():
+	m_cache(GLSL_CACHE_PATH, GLSL_CACHE_MAX_BLOBS)
+{
+	glslang::InitializeProcess();
+
+	m_running = true;
+	m_watcher = std::thread(&ShaderCompiler::watch_loop, this);
+	m_worker = std::thread(&ShaderCompiler::worker_loop, this);
+}
+
+ShaderCompiler::~ShaderCompiler() {
+	{
+		std::lock_guard lock(m_mutex);
+		m_running = false;
+	}
+	m_worker_wake.notify_all();
+
+	if (m_watcher.joinable()) {
+		m_watcher.join();
+	}
+
+	if (m_worker.joinable()) {
+		m_worker.join();
+	}
+
+	save_cache();
+
+	glslang::FinalizeProcess();
+}
+
+bool ShaderCompiler::compile(const std::string &path, SDL_GPUShaderStage stage, const std::string &preamble,
+	std::vector<byte> *o_spirv, std::string *o_log)
+{
+	EShLanguage lang = stage == SDL_GPU_SHADERSTAGE_VERTEX ? EShLangVertex : EShLangFragment;
+	return compile_language(path, lang, preamble, o_spirv, o_log);
+}
+
+bool ShaderCompiler::compile_compute(const std::string &path, const std::string &preamble, std::vector<byte> *o_spirv,
+	std::string *o_log)
+{
+	return compile_language(path, EShLangCompute, preamble, o_spirv, o_log);
+}
+
+bool ShaderCompiler::compile_language(const std::string &path, u32 language, const std::string &preamble,
+	std::vector<byte> *o_spirv, std::string *o_log)
+{
+	u32 size;
+	byte *data = read_whole_file(path, &size);
+	if (!data) {
+		if (o_log) *o_log = "Could not read " + path;
+		return false;
+	}
+
+	std::string source((const char *) data, size);
+	delete[] data;
+
+	// The source is the whole key, so the stamp is unused
+	u64 key = hash_bytes(source.data(), source.size());
+	key = hash_bytes(preamble.data(), preamble.size(), key);
+	key = hash_bytes(&language, sizeof(language), key);
+
+	{
+		std::lock_guard lock(m_mutex);
+		if (const std::vector<byte> *cached = m_cache.use_blob(key, 0)) {
+			*o_spirv = *cached;
+			return true;
+		}
+	}
+
+	// Compile without holding the lock, this is the slow part
+	if (!compile_glsl(source, path, (EShLanguage) language, preamble, o_spirv, o_log)) {
+		return false;
+	}
+
+	std::lock_guard lock(m_mutex);
+	m_cache.store_blob(key, 0, *o_spirv);
+
+	return true;
+}
+
+RID ShaderCompiler::add_shader(Renderer &renderer, ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo pip, const std::string &preamble) {
+	WatchedShader watched = {
+		.rid = U32_BAD,
+		.vs = vs,
+		.fs = fs,
+		.pip = pip,
+		.preamble = preamble
+	};
+
+	std::string log;
+	if (!compile(vs.path, SDL_GPU_SHADERSTAGE_VERTEX, preamble, &vs.code, &log)) {
+		std::cout << "Vertex shader " << vs.path << " failed to compile:\n" << log << "\n";
+	} else if (!compile(fs.path, SDL_GPU_SHADERSTAGE_FRAGMENT, preamble, &fs.code, &log)) {
+		std::cout << "Fragment shader " << fs.path << " failed to compile:\n" << log << "\n";
+	} else {
+		watched.rid = renderer.add_shader(std::move(vs), std::move(fs), std::move(pip));
+	}
+
+	// Still watched, so fixing the sources builds it into the same RID
+	if (*watched.rid == U32_BAD) {
+		std::cout << "Watching " << watched.vs.path << " + " << watched.fs.path << " for a fix\n";
+		watched.rid = renderer.reserve_shader();
+	}
+
+	std::lock_guard lock(m_mutex);
+	m_watched.push_back(std::move(watched));
+
+	return m_watched.back().rid;
+}
+
+void ShaderCompiler::watch(RID shader, ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo pip, const std::string &preamble) {
+	vs.code.clear();
+	fs.code.clear();
+
+	std::lock_guard lock(m_mutex);
+	m_watched.push_back(WatchedShader{
+		.rid = shader,
+		.vs = std::move(vs),
+		.fs = std::move(fs),
+		.pip = std::move(pip),
+		.preamble = preamble
+	});
+}
+
+u32 ShaderCompiler::compile_async(const std::string &vs_path, const std::string &fs_path, const std::string &preamble) {
+	u32 id;
+	{
+		std::lock_guard lock(m_mutex);
+		id = m_next_job++;
+		m_jobs.push_back(Job{
+			.id = id,
+			.vs_path = vs_path,
+			.fs_path = fs_path,
+			.preamble = preamble
+		});
+	}
+
+	m_worker_wake.notify_one();
+	return id;
+}
+
+bool ShaderCompiler::take_result(u32 job, std::vector<byte> *o_vs, std::vector<byte> *o_fs, bool *o_ok) {
+	std::lock_guard lock(m_mutex);
+
+	auto it = m_job_results.find(job);
+	if (it == m_job_results.end()) return false;
+
+	*o_ok = it->second.ok;
+	*o_vs = std::move(it->second.vs_code);
+	*o_fs = std::move(it->second.fs_code);
+	m_job_results.erase(it);
+
+	return true;
+}
+
+void ShaderCompiler::worker_loop() {
+	while (true) {
+		Job job;
+		{
+			std::unique_lock lock(m_mutex);
+			m_worker_wake.wait(lock, [&] { return !m_running || !m_jobs.empty(); });
+			if (!m_running) return;
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		JobResult result = {};
+		std::string log;
+
+		result.ok =
+			compile(job.vs_path, SDL_GPU_SHADERSTAGE_VERTEX, job.preamble, &result.vs_code, &log) &&
+			compile(job.fs_path, SDL_GPU_SHADERSTAGE_FRAGMENT, job.preamble, &result.fs_code, &log);
+
+		if (!result.ok) {
+			std::cout << "Background compile of " << job.vs_path << " + " << job.fs_path << " failed:\n" << log << "\n";
+		}
+
+		std::lock_guard lock(m_mutex);
+		m_job_results[job.id] = std::move(result);
+	}
+}
+
+void ShaderCompiler::rebuild_changed(const Set<std::string> &changed) {
+	// Copy what is needed, compile() takes the lock itself
+	std::vector<std::pair<u32, WatchedShader>> affected;
+	{
+		std::lock_guard lock(m_mutex);
+		for (u32 i = 0; i < m_watched.size(); ++i) {
+			if (changed.contains(m_watched[i].vs.path) || changed.contains(m_watched[i].fs.path)) {
+				affected.emplace_back(i, m_watched[i]);
+			}
+		}
+	}
+
+	for (auto &[index, watched] : affected) {
+		Rebuild rebuild = { .watched = index };
+		std::string log;
+
+		if (!compile(watched.vs.path, SDL_GPU_SHADERSTAGE_VERTEX, watched.preamble, &rebuild.vs_code, &log) ||
+			!compile(watched.fs.path, SDL_GPU_SHADERSTAGE_FRAGMENT, watched.preamble, &rebuild.fs_code, &log)) {
+			std::cout << "Hot reload failed, keeping the old pipeline:\n" << log << "\n";
+			continue;
+		}
+
+		std::lock_guard lock(m_mutex);
+		m_rebuilds.push_back(std::move(rebuild));
+	}
+}
+
+void ShaderCompiler::watch_loop() {
+#ifdef __linux__
+	// Watch directories rather than files, since editors often save by replacing the file
+	int fd = inotify_init1(IN_NONBLOCK);
+	Map<int, std::string> watch_dirs;
+	Set<std::string> watched_dirs;
+#endif
+
+	Map<std::string, std::filesystem::file_time_type> times;
+
+	while (m_running) {
+		Set<std::string> paths;
+		{
+			std::lock_guard lock(m_mutex);
+			for (const WatchedShader &watched : m_watched) {
+				paths.insert(watched.vs.path);
+				paths.insert(watched.fs.path);
+			}
+		}
+
+		Set<std::string> changed;
+
+#ifdef __linux__
+		if (fd >= 0) {
+			for (const std::string &path : paths) {
+				std::string dir = std::filesystem::absolute(path).parent_path().string();
+				if (watched_dirs.contains(dir)) continue;
+
+				int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+				if (wd >= 0) watch_dirs[wd] = dir;
+				watched_dirs.insert(dir);
+			}
+
+			pollfd pfd = { .fd = fd, .events = POLLIN };
+			if (::poll(&pfd, 1, WATCH_INTERVAL_MS) <= 0) continue;
+
+			alignas(inotify_event) char buf[4096];
+			ssize_t len;
+			while ((len = read(fd, buf, sizeof(buf))) > 0) {
+				for (char *ptr = buf; ptr < buf + len;) {
+					inotify_event *event = (inotify_event *) ptr;
+					ptr += sizeof(inotify_event) + event->len;
+
+					if (event->len == 0 || !watch_dirs.contains(event->wd)) continue;
+
+					std::filesystem::path file = std::filesystem::path(watch_dirs[event->wd]) / event->name;
+					for (const std::string &path : paths) {
+						if (std::filesystem::absolute(path) == file) changed.insert(path);
+					}
+				}
+			}
+
+			if (!changed.empty()) rebuild_changed(changed);
+			continue;
+		}
+#endif
+
+		// Fall back to comparing modification times
+		std::this_thread::sleep_for(std::chrono::milliseconds(WATCH_INTERVAL_MS));
+
+		for (const std::string &path : paths) {
+			std::error_code ec;
+			auto time = std::filesystem::last_write_time(path, ec);
+			if (ec) continue;
+
+			auto it = times.find(path);
+			if (it != times.end() && it->second != time) {
+				changed.insert(path);
+			}
+			times[path] = time;
+		}
+
+		if (!changed.empty()) rebuild_changed(changed);
+	}
+
+#ifdef __linux__
+	if (fd >= 0) close(fd);
+#endif
+}
+
+void ShaderCompiler::poll(Renderer &renderer) {
+	std::vector<Rebuild> rebuilds;
+	std::vector<WatchedShader> watched;
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_rebuilds.empty()) return;
+
+		rebuilds.swap(m_rebuilds);
+		for (const Rebuild &rebuild : rebuilds) {
+			watched.push_back(m_watched[rebuild.watched]);
+		}
+	}
+
+	for (u32 i = 0; i < rebuilds.size(); ++i) {
+		ShaderStageInfo vs = watched[i].vs;
+		ShaderStageInfo fs = watched[i].fs;
+		vs.code = std::move(rebuilds[i].vs_code);
+		fs.code = std::move(rebuilds[i].fs_code);
+
+		if (renderer.rebuild_shader(watched[i].rid, std::move(vs), std::move(fs), std::move(watched[i].pip))) {
+			std::cout << "Reloaded " << watched[i].vs.path << " + " << watched[i].fs.path << "\n";
+		} else {
+			std::cout << "Reloading " << watched[i].vs.path << " + " << watched[i].fs.path << " failed, keeping the old pipeline\n";
+		}
+	}
+}
+
+void ShaderCompiler::save_cache() {
+	std::lock_guard lock(m_mutex);
+	m_cache.save();
+}
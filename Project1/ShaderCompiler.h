@@ -0,0 +1,148 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+#include "ShaderCache.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// Where compiled GLSL is kept between runs, relative to the working directory
+inline const char *GLSL_CACHE_PATH = "glsl_cache.bin";
+
+// Every edit of a hot reloaded shader adds a blob, so the least recently used are dropped past this many
+inline constexpr u32 GLSL_CACHE_MAX_BLOBS = 512;
+
+/* ShaderCompiler
+ * Compiles GLSL to SPIR-V at runtime with glslang. Compiled code is cached by a hash of the source, so unchanged
+ * shaders are not recompiled between runs.
+ *
+ * Pipelines created through add_shader() are hot reloaded: a background thread watches their source files and
+ * recompiles them when they change. poll() then swaps the new pipelines in on the main thread, keeping their RIDs.
+*/
+class ShaderCompiler {
+	struct WatchedShader {
+		RID rid;
+
+		// Paths point to GLSL sources, code is left empty
+		ShaderStageInfo vs;
+		ShaderStageInfo fs;
+		PipelineInfo pip;
+
+		std::string preamble;
+	};
+
+	struct Rebuild {
+		u32 watched;
+
+		std::vector<byte> vs_code;
+		std::vector<byte> fs_code;
+	};
+
+	struct Job {
+		u32 id;
+
+		std::string vs_path;
+		std::string fs_path;
+		std::string preamble;
+	};
+
+	struct JobResult {
+		bool ok;
+
+		std::vector<byte> vs_code;
+		std::vector<byte> fs_code;
+	};
+
+	// Guards everything below that the watcher thread touches
+	std::mutex m_mutex;
+
+	ShaderCache m_cache;
+
+	std::vector<WatchedShader> m_watched;
+	std::vector<Rebuild> m_rebuilds;
+
+	std::deque<Job> m_jobs;
+	Map<u32, JobResult> m_job_results;
+	u32 m_next_job = 0;
+
+	std::thread m_watcher;
+	std::thread m_worker;
+	std::condition_variable m_worker_wake;
+	std::atomic<bool> m_running = false;
+
+	// Recompiles every watched shader that uses one of the files, queueing the results for poll()
+	void rebuild_changed(const Set<std::string> &changed);
+
+	void watch_loop();
+	void worker_loop();
+
+	// compile() for any glslang EShLanguage, kept out of the header so it doesn't need glslang
+	bool compile_language(const std::string &path, u32 language, const std::string &preamble,
+		std::vector<byte> *o_spirv, std::string *o_log);
+
+public:
+	ShaderCompiler();
+	~ShaderCompiler();
+
+	ShaderCompiler(const ShaderCompiler &) = delete;
+	ShaderCompiler &operator=(const ShaderCompiler &) = delete;
+
+	/// <summary>
+	/// Compiles a GLSL file, or fetches it from the cache if the source hasn't changed. Thread safe
+	/// </summary>
+	/// <param name="path">- The GLSL source file</param>
+	/// <param name="stage">- The stage the source is written for</param>
+	/// <param name="preamble">- Text inserted after the #version line, eg. #defines</param>
+	/// <param name="o_spirv">- Receives the SPIR-V</param>
+	/// <param name="o_log">- (Optional) Receives the errors if compilation fails</param>
+	/// <returns>False if the file could not be read or compiled</returns>
+	bool compile(const std::string &path, SDL_GPUShaderStage stage, const std::string &preamble,
+		std::vector<byte> *o_spirv, std::string *o_log = nullptr);
+
+	// compile() for a compute shader. SDL has no shader stage for those, they go straight to a compute pipeline
+	bool compile_compute(const std::string &path, const std::string &preamble, std::vector<byte> *o_spirv,
+		std::string *o_log = nullptr);
+
+	/// <summary>
+	/// Compiles a pair of GLSL files and creates a pipeline from them, then watches the files for changes
+	/// </summary>
+	/// <param name="renderer">- The Renderer to create the pipeline on</param>
+	/// <param name="vs">- A description of the vertex stage. The path must point to GLSL</param>
+	/// <param name="fs">- A description of the fragment stage. The path must point to GLSL</param>
+	/// <param name="pip">- A description of the resulting pipeline</param>
+	/// <param name="preamble">- (Optional) Text inserted after the #version line of both stages</param>
+	/// <returns>An RID representing the pipeline. If compilation failed it refers to no pipeline until the sources
+	/// are fixed, see Renderer::is_shader_valid()</returns>
+	RID add_shader(Renderer &renderer, ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo pip, const std::string &preamble = "");
+
+	// Watches the GLSL sources of an existing pipeline and rebuilds it in place when they change
+	void watch(RID shader, ShaderStageInfo vs, ShaderStageInfo fs, PipelineInfo pip, const std::string &preamble = "");
+
+	/// <summary>
+	/// Queues a pair of GLSL files to be compiled on a background thread. Never blocks
+	/// </summary>
+	/// <param name="vs_path">- The vertex stage source</param>
+	/// <param name="fs_path">- The fragment stage source</param>
+	/// <param name="preamble">- Text inserted after the #version line of both stages</param>
+	/// <returns>An ID to pass to take_result()</returns>
+	u32 compile_async(const std::string &vs_path, const std::string &fs_path, const std::string &preamble);
+
+	/// <summary>
+	/// Collects the result of compile_async() once it is done. Each result can only be taken once
+	/// </summary>
+	/// <param name="job">- The ID returned by compile_async()</param>
+	/// <param name="o_vs">- Receives the vertex stage SPIR-V</param>
+	/// <param name="o_fs">- Receives the fragment stage SPIR-V</param>
+	/// <param name="o_ok">- Set to false if either stage failed to compile</param>
+	/// <returns>False if the job hasn't finished yet</returns>
+	bool take_result(u32 job, std::vector<byte> *o_vs, std::vector<byte> *o_fs, bool *o_ok);
+
+	// Swaps in every pipeline that finished rebuilding. Call on the main thread, outside of any render pass
+	void poll(Renderer &renderer);
+
+	// Writes compiled SPIR-V to disk. Also done on destruction
+	void save_cache();
+};
@@ -0,0 +1,118 @@
+#include "ShaderPermutations.h"
+
+std::string make_feature_preamble(u32 features) {
+	std::string preamble;
+
+	for (u32 i = 0; i < sizeof(shader_feature_defines) / sizeof(shader_feature_defines[0]); i++) {
+		if (features & (1u << i)) {
+			preamble += "#define ";
+			preamble += shader_feature_defines[i];
+			preamble += " 1\n";
+		}
+	}
+
+	return preamble;
+}
+
+void depth_only_pipeline(u32 features, PipelineInfo &pip) {
+	pip.vert_attribs_read = (features & SHADERFEATURE_ALPHA_TEST) ? 2 : 1;
+}
+
+ShaderPermutations::ShaderPermutations(Renderer &renderer, ShaderCompiler &compiler, ShaderStageInfo vs, ShaderStageInfo fs,
+	PipelineInfo base, PermutationPipelineFunc adjust) :
+	m_renderer(&renderer),
+	m_compiler(&compiler),
+	m_vs(std::move(vs)),
+	m_fs(std::move(fs)),
+	m_base(std::move(base)),
+	m_adjust(std::move(adjust))
+{
+	m_vs.code.clear();
+	m_fs.code.clear();
+
+	// The fallback has to exist before anything is drawn, so it is the one variant built synchronously
+	m_generic = compiler.add_shader(renderer, m_vs, m_fs, make_pipeline_info(SHADERFEATURE_NONE),
+		make_feature_preamble(SHADERFEATURE_NONE));
+
+	if (!renderer.is_shader_valid(m_generic)) {
+		std::cout << "Generic variant of " << m_vs.path << " + " << m_fs.path << " failed to build\n";
+	}
+
+	m_variants[SHADERFEATURE_NONE] = Variant{ .rid = m_generic };
+}
+
+PipelineInfo ShaderPermutations::make_pipeline_info(u32 features) const {
+	PipelineInfo pip = m_base;
+	if (m_adjust) {
+		m_adjust(features, pip);
+	}
+
+	return pip;
+}
+
+RID ShaderPermutations::get(u32 features) {
+	features &= SHADERFEATURE_ALL;
+
+	auto it = m_variants.find(features);
+	if (it != m_variants.end() && m_renderer->is_shader_valid(it->second.rid)) {
+		return it->second.rid;
+	}
+
+	prewarm(features);
+
+	// Not until its sources are fixed, if it failed to build
+	return m_renderer->is_shader_valid(m_generic) ? m_generic : RID(U32_BAD);
+}
+
+bool ShaderPermutations::is_ready(u32 features) const {
+	auto it = m_variants.find(features & SHADERFEATURE_ALL);
+	if (it == m_variants.end()) return false;
+
+	return m_renderer->is_shader_valid(it->second.rid);
+}
+
+void ShaderPermutations::prewarm(u32 features) {
+	features &= SHADERFEATURE_ALL;
+
+	Variant &variant = m_variants[features];
+	if (*variant.rid != U32_BAD || variant.job != U32_BAD) return;
+
+	variant.job = m_compiler->compile_async(m_vs.path, m_fs.path, make_feature_preamble(features));
+	m_pending++;
+}
+
+void ShaderPermutations::poll(Renderer &renderer) {
+	if (m_pending == 0) return;
+
+	for (auto &[features, variant] : m_variants) {
+		if (variant.job == U32_BAD) continue;
+
+		ShaderStageInfo vs = m_vs;
+		ShaderStageInfo fs = m_fs;
+		bool ok;
+
+		if (!m_compiler->take_result(variant.job, &vs.code, &fs.code, &ok)) continue;
+
+		variant.job = U32_BAD;
+		m_pending--;
+
+		PipelineInfo pip = make_pipeline_info(features);
+		if (ok) variant.rid = renderer.add_shader(std::move(vs), std::move(fs), PipelineInfo(pip));
+
+		// Watched all the same, so it isn't retried every frame but fixing the sources builds it
+		if (*variant.rid == U32_BAD) {
+			std::cout << "Variant " << features << " of " << m_vs.path << " + " << m_fs.path << " failed to build\n";
+			variant.rid = renderer.reserve_shader();
+		}
+
+		m_compiler->watch(variant.rid, m_vs, m_fs, std::move(pip), make_feature_preamble(features));
+	}
+}
+
+RID ShaderPermutations::get_generic() const {
+	return m_generic;
+}
+
+u32 ShaderPermutations::get_pending() const {
+	return m_pending;
+}
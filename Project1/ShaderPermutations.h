@@ -0,0 +1,107 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+#include "ShaderCompiler.h"
+
+#include <functional>
+
+// Compile-time features a shader variant can be built with. Each one becomes a #define in the variant's preamble
+enum ShaderFeature : u32 {
+	SHADERFEATURE_NONE = 0,
+	SHADERFEATURE_SKINNING = 1 << 0,
+	SHADERFEATURE_ALPHA_TEST = 1 << 1,
+	SHADERFEATURE_NORMAL_MAP = 1 << 2,
+	SHADERFEATURE_INSTANCING = 1 << 3,
+
+	SHADERFEATURE_ALL = (1 << 4) - 1,
+};
+
+// Names of the #defines, indexed by bit
+inline const char *shader_feature_defines[] = {
+	"FEATURE_SKINNING",
+	"FEATURE_ALPHA_TEST",
+	"FEATURE_NORMAL_MAP",
+	"FEATURE_INSTANCING",
+};
+
+// Builds the preamble for a feature mask, eg. "#define FEATURE_SKINNING 1\n"
+std::string make_feature_preamble(u32 features);
+
+// Adjusts the pipeline description of one variant, eg. to add the skinning attributes. May be empty
+using PermutationPipelineFunc = std::function<void(u32 features, PipelineInfo &pip)>;
+
+// The PermutationPipelineFunc of depth_only.vert: alpha tested variants read the texture coordinates, the second
+// vertex attribute, on top of the positions
+void depth_only_pipeline(u32 features, PipelineInfo &pip);
+
+/* ShaderPermutations
+ * Builds variants of one pair of GLSL shaders from feature masks. The generic variant (no features) is built up
+ * front; every other variant is compiled on the ShaderCompiler's background thread the first time it is asked for.
+ * Until it is ready, get() hands out the generic variant instead, so drawing never waits on the compiler.
+ *
+ * Finished variants are picked up by poll(), which creates their pipelines on the main thread and registers them
+ * for hot reload. Variants that fail are registered too, so fixing the sources brings them in.
+*/
+class ShaderPermutations {
+	struct Variant {
+		// Set once compilation finished. If it failed, it refers to no pipeline until the sources are fixed
+		RID rid = U32_BAD;
+
+		// U32_BAD unless a background compile is in flight
+		u32 job = U32_BAD;
+	};
+
+	Renderer *m_renderer = nullptr;
+	ShaderCompiler *m_compiler = nullptr;
+
+	ShaderStageInfo m_vs;
+	ShaderStageInfo m_fs;
+	PipelineInfo m_base = {};
+	PermutationPipelineFunc m_adjust;
+
+	Map<u32, Variant> m_variants;
+	u32 m_pending = 0;
+
+	RID m_generic = U32_BAD;
+
+	PipelineInfo make_pipeline_info(u32 features) const;
+
+public:
+	// This does nothing and initializes nothing
+	ShaderPermutations() = default;
+
+	/// <summary>
+	/// Builds the generic variant immediately. Every other variant is built on demand
+	/// </summary>
+	/// <param name="renderer">- The Renderer to create pipelines on</param>
+	/// <param name="compiler">- Compiles the variants. Must outlive this object</param>
+	/// <param name="vs">- A description of the vertex stage. The path must point to GLSL</param>
+	/// <param name="fs">- A description of the fragment stage. The path must point to GLSL</param>
+	/// <param name="base">- The pipeline description shared by every variant</param>
+	/// <param name="adjust">- (Optional) Modifies the pipeline description per variant</param>
+	ShaderPermutations(Renderer &renderer, ShaderCompiler &compiler, ShaderStageInfo vs, ShaderStageInfo fs,
+		PipelineInfo base, PermutationPipelineFunc adjust = {});
+
+	/// <summary>
+	/// Gets the pipeline for a feature mask, queueing it to be built if it hasn't been yet. Never blocks
+	/// </summary>
+	/// <param name="features">- A combination of ShaderFeature bits</param>
+	/// <returns>The variant's RID if it is ready, otherwise the generic variant. U32_BAD if the generic variant
+	/// failed to build too, in which case nothing can be drawn with these shaders</returns>
+	RID get(u32 features);
+
+	// Returns true if the variant has been built
+	bool is_ready(u32 features) const;
+
+	// Queues a variant without using it yet, eg. while loading a level
+	void prewarm(u32 features);
+
+	// Creates the pipelines of every variant that finished compiling. Call on the main thread, once per frame
+	void poll(Renderer &renderer);
+
+	RID get_generic() const;
+
+	// Number of variants still compiling
+	u32 get_pending() const;
+};
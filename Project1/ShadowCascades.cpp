@@ -0,0 +1,206 @@
+#include "ShadowCascades.h"
+
+// How much larger than its part of the view a cascade is. The margin is what lets it trail the camera in steps
+static constexpr float CASCADE_MARGIN = 1.125f;
+
+ShadowCascades::ShadowCascades(Renderer &renderer, ShaderCompiler &compiler, const ShadowSettings &settings):
+	m_renderer(&renderer),
+	m_settings(settings)
+{
+	m_settings.cascade_count = std::clamp(m_settings.cascade_count, 1u, MAX_SHADOW_CASCADES);
+
+	// 32-bit float depth where it can be sampled, otherwise 16 bits, which every device supports
+	SDL_GPUTextureUsageFlags usage = SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET;
+	m_format = SDL_GPUTextureSupportsFormat(renderer.get_device(), SDL_GPU_TEXTUREFORMAT_D32_FLOAT, SDL_GPU_TEXTURETYPE_2D, usage)
+		? SDL_GPU_TEXTUREFORMAT_D32_FLOAT : SDL_GPU_TEXTUREFORMAT_D16_UNORM;
+
+	SDL_GPUTextureCreateInfo ci = {
+		.type = SDL_GPU_TEXTURETYPE_2D,
+		.format = m_format,
+		.usage = usage,
+		.width = m_settings.resolution * m_settings.cascade_count,
+		.height = m_settings.resolution,
+		.layer_count_or_depth = 1,
+		.num_levels = 1,
+	};
+
+	m_atlas = renderer.create_texture(&ci);
+
+	ci.width = m_settings.resolution;
+	for (u32 i = 0; i < m_settings.cascade_count; i++) {
+		m_cascades[i].static_map = renderer.create_texture(&ci);
+	}
+
+	m_sampler = renderer.create_sampler(false, true);
+
+	PipelineInfo compose_info = {
+		.depth_test = true,
+		.stencil_test = false,
+		.targets = {},
+		.vert_attribs = {},
+		.inst_attribs = {},
+		.cull_mode = SDL_GPU_CULLMODE_NONE,
+		.depth_format = m_format,
+	};
+
+	m_compose = compiler.add_shader(renderer, { .path = "shadow_compose.vert" }, { .path = "shadow_compose.frag" }, std::move(compose_info));
+	if (!renderer.is_shader_valid(m_compose)) {
+		std::cout << "Could not build the shadow compose shader, static casters won't cast until it is fixed\n";
+	}
+
+	m_constants = {};
+	m_constants.params = vec4((float) m_settings.cascade_count, 1.0f / (m_settings.resolution * m_settings.cascade_count),
+		1.0f / m_settings.resolution, m_settings.compare_bias);
+}
+
+void ShadowCascades::destroy() {
+	if (!m_renderer) return;
+
+	m_renderer->destroy_texture(m_atlas);
+	for (u32 i = 0; i < m_settings.cascade_count; i++) {
+		m_renderer->destroy_texture(m_cascades[i].static_map);
+	}
+
+	m_renderer = nullptr;
+}
+
+void ShadowCascades::update(const Camera &camera, const vec3 &light_dir, u64 static_hash) {
+	const ViewConstants &view = camera.get_constants();
+
+	// Anything cached was drawn from another direction or with other casters
+	if (light_dir != m_light_dir || static_hash != m_static_hash) {
+		for (Cascade &cascade : m_cascades) {
+			cascade.static_valid = false;
+		}
+
+		m_light_dir = light_dir;
+		m_static_hash = static_hash;
+	}
+
+	float near = view.params.x;
+	float far = std::min(view.params.y, m_settings.max_distance);
+	u32 count = m_settings.cascade_count;
+
+	// The slopes of the view's edges, from a symmetric perspective projection
+	float tan_x = 1.0f / view.proj[0][0];
+	float tan_y = 1.0f / view.proj[1][1];
+	float diagonal = tan_x * tan_x + tan_y * tan_y;
+
+	vec3 up = std::abs(light_dir.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+	mat4x4 light_rotation = glm::lookAt(vec3(0.0f), -light_dir, up);
+
+	float cascade_near = near;
+	for (u32 i = 0; i < count; i++) {
+		Cascade &cascade = m_cascades[i];
+
+		// Blend logarithmic and even splits
+		float t = (i + 1) / (float) count;
+		float log_split = near * std::pow(far / near, t);
+		float even_split = near + (far - near) * t;
+		float cascade_far = glm::mix(even_split, log_split, m_settings.split_lambda);
+		m_constants.splits[i] = cascade_far;
+
+		// The smallest sphere around this slice of the view. Its size only depends on the projection, so it
+		// doesn't shimmer as the camera turns
+		float center_depth = std::min((cascade_far + cascade_near) * (1.0f + diagonal) * 0.5f, cascade_far);
+		float radius = std::sqrt(cascade_far * cascade_far * diagonal + (cascade_far - center_depth) * (cascade_far - center_depth));
+		cascade_near = cascade_far;
+
+		// Snap the center to a grid in light space. A step is at most twice the margin, so the sphere stays inside
+		float half_size = radius * CASCADE_MARGIN;
+		float texel = half_size * 2.0f / m_settings.resolution;
+		float step = std::max(std::floor((half_size - radius) * 2.0f / texel), 1.0f) * texel;
+
+		vec3 center = vec3(camera.get_transform() * vec4(0.0f, 0.0f, -center_depth, 1.0f));
+		vec3 light_center = vec3(light_rotation * vec4(center, 1.0f));
+		glm::ivec3 origin = glm::ivec3(glm::round(light_center / step));
+
+		// A resize or FOV change gives the cascade another extent, and the grid another step
+		if (origin != cascade.static_origin || half_size != cascade.static_half_size) {
+			cascade.static_valid = false;
+			cascade.static_origin = origin;
+			cascade.static_half_size = half_size;
+		}
+
+		vec3 snapped = vec3(origin) * step;
+		cascade.camera.set_transform(glm::inverse(light_rotation) * glm::translate(glm::identity<mat4x4>(), snapped));
+		cascade.camera.set_projection(glm::orthoRH_ZO(-half_size, half_size, -half_size, half_size, -half_size, half_size),
+			-half_size, half_size);
+		cascade.camera.set_viewport((float) m_settings.resolution, (float) m_settings.resolution);
+
+		const mat4x4 &viewproj = cascade.camera.get_constants().viewproj;
+
+		// Casters in front of the cascade are still wanted, see the class description
+		cascade.frustum = Frustum::from_matrix(viewproj);
+		cascade.frustum.planes[4] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		// Into the cascade's part of the atlas, with y flipped since row 0 is the top
+		mat4x4 to_atlas = glm::translate(glm::identity<mat4x4>(), vec3((i + 0.5f) / count, 0.5f, 0.0f));
+		to_atlas = glm::scale(to_atlas, vec3(0.5f / count, -0.5f, 1.0f));
+
+		m_constants.cascades[i] = to_atlas * viewproj;
+		m_constants.texel_sizes[i] = texel;
+	}
+
+	m_constants.light_dir = vec4(light_dir, 0.0f);
+}
+
+void ShadowCascades::render(const ShadowDrawFunc &draw) {
+	m_static_redraws = 0;
+
+	float size = (float) m_settings.resolution;
+
+	for (u32 i = 0; i < m_settings.cascade_count; i++) {
+		Cascade &cascade = m_cascades[i];
+		if (cascade.static_valid) continue;
+
+		CustomInfo static_pass = {
+			.color_targets = {},
+			.depth_texture = m_renderer->get_texture(cascade.static_map),
+			.viewport = { .x = 0.0f, .y = 0.0f, .w = size, .h = size, .min_depth = 0.0f, .max_depth = 1.0f },
+		};
+
+		ActiveRenderPass arp = m_renderer->begin_custom_render_pass(std::move(static_pass));
+		if (arp.is_valid()) draw(arp, i, true);
+		m_renderer->end_render_pass(std::move(arp));
+
+		cascade.static_valid = true;
+		m_static_redraws++;
+	}
+
+	// The first pass clears the whole atlas. The rest keep what came before and only touch their own part
+	for (u32 i = 0; i < m_settings.cascade_count; i++) {
+		CustomInfo atlas_pass = {
+			.color_targets = {},
+			.depth_texture = m_renderer->get_texture(m_atlas),
+			.depth_load_op = i == 0 ? SDL_GPU_LOADOP_CLEAR : SDL_GPU_LOADOP_LOAD,
+			.viewport = { .x = i * size, .y = 0.0f, .w = size, .h = size, .min_depth = 0.0f, .max_depth = 1.0f },
+		};
+
+		ActiveRenderPass arp = m_renderer->begin_custom_render_pass(std::move(atlas_pass));
+		if (arp.is_valid()) {
+			if (m_renderer->is_shader_valid(m_compose)) {
+				arp.use_shader(m_compose);
+				arp.bind_frag_samplers(0, { m_sampler }, { m_cascades[i].static_map });
+				arp.bind_mesh(3, U32_BAD);
+				arp.draw();
+			}
+
+			draw(arp, i, false);
+		}
+		m_renderer->end_render_pass(std::move(arp));
+	}
+}
+
+void ShadowCascades::bind(ActiveRenderPass &arp) const {
+	arp.bind_frag_samplers(SHADOW_SAMPLER_SLOT, { m_sampler }, { m_atlas });
+	arp.upload_fragment_uniform_buffer(SHADOW_UNIFORM_SLOT, &m_constants, sizeof(m_constants));
+}
+
+void ShadowCascades::caster_pipeline(PipelineInfo &pip) const {
+	pip.targets.clear();
+	pip.depth_test = true;
+	pip.depth_format = m_format;
+	pip.depth_bias_constant = m_settings.depth_bias_constant;
+	pip.depth_bias_slope = m_settings.depth_bias_slope;
+}
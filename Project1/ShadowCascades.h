@@ -0,0 +1,155 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+#include "ShaderCompiler.h"
+#include "Camera.h"
+#include "Bounds.h"
+
+#include <functional>
+
+inline constexpr u32 MAX_SHADOW_CASCADES = 4;
+
+// Fragment slots of the shadow data. ViewData takes uniform slot 0 and the material texture sampler slot 0; the draw
+// index only goes to the vertex stage, so uniform slot 1 is free in the fragment stage
+inline constexpr u32 SHADOW_UNIFORM_SLOT = 1;
+inline constexpr u32 SHADOW_SAMPLER_SLOT = 1;
+
+// Matches ShadowData in shader0.frag, laid out for std140
+struct ShadowConstants {
+	// World space to the atlas: xy is the texture coordinate, z the depth to compare
+	mat4x4 cascades[MAX_SHADOW_CASCADES];
+
+	// The view depth each cascade ends at
+	vec4 splits;
+	// The world size of a texel of each cascade, to offset lookups along the normal by
+	vec4 texel_sizes;
+	// xyz points towards the light
+	vec4 light_dir;
+	// x = cascade count, yz = size of an atlas texel in texture coordinates, w = depth bias
+	vec4 params;
+};
+
+struct ShadowSettings {
+	u32 cascade_count = 4;
+	// Of each cascade's square map
+	u32 resolution = 1024;
+
+	// Nothing further away than this gets shadows
+	float max_distance = 100.0f;
+	// 0 splits the distance evenly, 1 logarithmically. Somewhere between keeps near cascades sharp without
+	// wasting the far ones
+	float split_lambda = 0.75f;
+
+	// Given to the caster pipelines, see caster_pipeline()
+	float depth_bias_constant = 1.0f;
+	float depth_bias_slope = 2.0f;
+	// Applied when comparing, in depth units
+	float compare_bias = 0.0005f;
+};
+
+// Draws the casters of one cascade. The pass has no pipeline bound yet, and get_camera(cascade) is the view to draw
+// with. statics says whether the static casters or the dynamic ones are wanted
+using ShadowDrawFunc = std::function<void(ActiveRenderPass &arp, u32 cascade, bool statics)>;
+
+/* ShadowCascades
+ * Shadows from a directional light, split into cascades along the camera's view so nearby shadows get more texels.
+ * The cascades sit side by side in one depth atlas, which shader0.frag samples with a 3x3 filter.
+ *
+ * Static casters are drawn into a depth map of their own per cascade, kept across frames. Each frame that map is
+ * copied into the atlas and only the dynamic casters are drawn over it, so the cost of the static scene is only paid
+ * when a cascade moves or changes size, the light turns, or the static casters change. To keep cascades still, each
+ * one is a little larger than the part of the view it covers and only follows the camera in steps of a few texels;
+ * the far cascades, being the largest, move the least.
+ *
+ * Casters between the light and a cascade are culled in and drawn with depth clipping off, so they are flattened
+ * onto its near plane and still cast.
+*/
+class ShadowCascades {
+	struct Cascade {
+		Camera camera;
+		Frustum frustum;
+
+		// The static casters, drawn only when the cache is invalid
+		RID static_map = U32_BAD;
+		bool static_valid = false;
+
+		// Where the light's view was snapped to when the static map was drawn, in steps, and how far it reached.
+		// The reach follows the camera's projection and the shadow distance
+		glm::ivec3 static_origin = glm::ivec3(0);
+		float static_half_size = 0.0f;
+	};
+
+	Renderer *m_renderer = nullptr;
+	ShadowSettings m_settings;
+
+	SDL_GPUTextureFormat m_format;
+	RID m_atlas = U32_BAD;
+	RID m_sampler = U32_BAD;
+
+	// Copies a static map into the atlas by writing its depth
+	RID m_compose = U32_BAD;
+
+	Cascade m_cascades[MAX_SHADOW_CASCADES];
+
+	vec3 m_light_dir = vec3(0.0f);
+	u64 m_static_hash = 0;
+
+	ShadowConstants m_constants;
+
+	u32 m_static_redraws = 0;
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline ShadowCascades() {}
+
+	/// <summary>
+	/// Creates the atlas, the static maps, and the pipeline that composes them
+	/// </summary>
+	/// <param name="renderer">- The Renderer to draw with</param>
+	/// <param name="compiler">- Compiles shadow_compose.vert and shadow_compose.frag</param>
+	/// <param name="settings">- (Optional) How many cascades, how large, and how far</param>
+	ShadowCascades(Renderer &renderer, ShaderCompiler &compiler, const ShadowSettings &settings = {});
+
+	ShadowCascades(const ShadowCascades &) = delete;
+	ShadowCascades &operator=(const ShadowCascades &) = delete;
+
+	inline ~ShadowCascades() { destroy(); }
+
+	void destroy();
+
+	/// <summary>
+	/// Fits the cascades to the camera, and finds which static maps have to be redrawn
+	/// </summary>
+	/// <param name="camera">- The view to shadow. Must have a perspective projection</param>
+	/// <param name="light_dir">- Points towards the light</param>
+	/// <param name="static_hash">- Changes whenever the static casters do, eg. a hash of their ids and bounds</param>
+	void update(const Camera &camera, const vec3 &light_dir, u64 static_hash);
+
+	// Whether render() will ask for the static casters of a cascade this frame
+	inline bool needs_static(u32 cascade) const { return !m_cascades[cascade].static_valid; }
+
+	// The volume a cascade's casters are culled against. It has no near plane, see the class description
+	inline const Frustum &get_frustum(u32 cascade) const { return m_cascades[cascade].frustum; }
+	inline const Camera &get_camera(u32 cascade) const { return m_cascades[cascade].camera; }
+
+	/// <summary>
+	/// Draws the static maps that need it, then composes the atlas and draws the dynamic casters into it. Call
+	/// between passes, after update()
+	/// </summary>
+	/// <param name="draw">- Draws the casters of a cascade</param>
+	void render(const ShadowDrawFunc &draw);
+
+	// Binds the atlas and pushes the shadow constants for shader0.frag. Call after use_shader()
+	void bind(ActiveRenderPass &arp) const;
+
+	// Fills in the depth format and bias of a pipeline that draws casters
+	void caster_pipeline(PipelineInfo &pip) const;
+
+	inline u32 get_cascade_count() const { return m_settings.cascade_count; }
+	inline SDL_GPUTextureFormat get_depth_format() const { return m_format; }
+	inline const ShadowConstants &get_constants() const { return m_constants; }
+
+	// How many static maps the last render() redrew
+	inline u32 get_static_redraw_count() const { return m_static_redraws; }
+};
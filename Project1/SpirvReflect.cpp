@@ -0,0 +1,330 @@
+#include "SpirvReflect.h"
+
+// The subset of the SPIR-V spec that reflection needs
+namespace spv {
+	constexpr u32 MAGIC = 0x07230203;
+
+	enum Op : u32 {
+		OP_NAME = 5,
+		OP_ENTRY_POINT = 15,
+		OP_TYPE_BOOL = 20,
+		OP_TYPE_INT = 21,
+		OP_TYPE_FLOAT = 22,
+		OP_TYPE_VECTOR = 23,
+		OP_TYPE_MATRIX = 24,
+		OP_TYPE_IMAGE = 25,
+		OP_TYPE_SAMPLER = 26,
+		OP_TYPE_SAMPLED_IMAGE = 27,
+		OP_TYPE_ARRAY = 28,
+		OP_TYPE_RUNTIME_ARRAY = 29,
+		OP_TYPE_STRUCT = 30,
+		OP_TYPE_POINTER = 32,
+		OP_CONSTANT = 43,
+		OP_VARIABLE = 59,
+		OP_DECORATE = 71,
+		OP_MEMBER_DECORATE = 72,
+	};
+
+	enum Decoration : u32 {
+		DECORATION_BLOCK = 2,
+		DECORATION_BUFFER_BLOCK = 3,
+		DECORATION_ARRAY_STRIDE = 6,
+		DECORATION_MATRIX_STRIDE = 7,
+		DECORATION_BUILT_IN = 11,
+		DECORATION_LOCATION = 30,
+		DECORATION_BINDING = 33,
+		DECORATION_DESCRIPTOR_SET = 34,
+		DECORATION_OFFSET = 35,
+	};
+
+	enum StorageClass : u32 {
+		STORAGE_UNIFORM_CONSTANT = 0,
+		STORAGE_INPUT = 1,
+		STORAGE_UNIFORM = 2,
+		STORAGE_STORAGE_BUFFER = 12,
+	};
+
+	enum ExecutionModel : u32 {
+		EXECUTION_VERTEX = 0,
+		EXECUTION_FRAGMENT = 4,
+	};
+}
+
+namespace {
+	struct Type {
+		u32 op = 0;
+		std::vector<u32> operands;
+	};
+
+	struct Decorations {
+		u32 location = U32_BAD;
+		u32 binding = U32_BAD;
+		u32 set = U32_BAD;
+		u32 array_stride = 0;
+		bool block = false;
+		bool buffer_block = false;
+		bool built_in = false;
+	};
+
+	struct MemberDecorations {
+		u32 offset = 0;
+		u32 matrix_stride = 0;
+		bool built_in = false;
+	};
+
+	struct Variable {
+		u32 id;
+		u32 pointer_type;
+		u32 storage;
+	};
+
+	struct Module {
+		Map<u32, Type> types;
+		Map<u32, u32> constants;
+		Map<u32, std::string> names;
+		Map<u32, Decorations> decorations;
+		Map<u64, MemberDecorations> member_decorations;
+
+		std::vector<Variable> variables;
+
+		static u64 member_key(u32 type, u32 member) { return ((u64) type << 32) | member; }
+
+		const Type *type(u32 id) const {
+			auto it = types.find(id);
+			return it == types.end() ? nullptr : &it->second;
+		}
+
+		// Strips arrays, returning the element type and multiplying o_count by the lengths
+		u32 element_type(u32 id, u32 *o_count) const {
+			const Type *t = type(id);
+			while (t && (t->op == spv::OP_TYPE_ARRAY || t->op == spv::OP_TYPE_RUNTIME_ARRAY)) {
+				if (t->op == spv::OP_TYPE_ARRAY) {
+					auto it = constants.find(t->operands[1]);
+					*o_count *= it == constants.end() ? 1 : it->second;
+				}
+				id = t->operands[0];
+				t = type(id);
+			}
+			return id;
+		}
+
+		u32 byte_size(u32 id, u32 matrix_stride = 0) const {
+			const Type *t = type(id);
+			if (!t) return 0;
+
+			switch (t->op) {
+			case spv::OP_TYPE_BOOL:
+				return 4;
+			case spv::OP_TYPE_INT:
+			case spv::OP_TYPE_FLOAT:
+				return t->operands[0] / 8;
+			case spv::OP_TYPE_VECTOR:
+				return byte_size(t->operands[0]) * t->operands[1];
+			case spv::OP_TYPE_MATRIX:
+				return (matrix_stride ? matrix_stride : byte_size(t->operands[0])) * t->operands[1];
+			case spv::OP_TYPE_ARRAY: {
+				auto it = constants.find(t->operands[1]);
+				u32 length = it == constants.end() ? 1 : it->second;
+
+				auto dit = decorations.find(id);
+				u32 stride = dit != decorations.end() && dit->second.array_stride ? dit->second.array_stride : byte_size(t->operands[0], matrix_stride);
+				return stride * length;
+			}
+			case spv::OP_TYPE_RUNTIME_ARRAY:
+				return 0;
+			case spv::OP_TYPE_STRUCT: {
+				u32 size = 0;
+				for (u32 i = 0; i < t->operands.size(); ++i) {
+					auto mit = member_decorations.find(member_key(id, i));
+					MemberDecorations md = mit == member_decorations.end() ? MemberDecorations{} : mit->second;
+
+					size = std::max(size, md.offset + byte_size(t->operands[i], md.matrix_stride));
+				}
+				return size;
+			}
+			default:
+				return 0;
+			}
+		}
+	};
+}
+
+bool reflect_spirv(const std::vector<byte> &code, SpirvReflection *o_reflection, std::string *o_error) {
+	auto fail = [&](const std::string &reason) {
+		if (o_error) *o_error = reason;
+		return false;
+	};
+
+	if (code.size() < 20 || code.size() % 4 != 0) return fail("SPIR-V is not a whole number of words");
+
+	const u32 *words = (const u32 *) code.data();
+	u32 word_count = code.size() / 4;
+
+	if (words[0] != spv::MAGIC) return fail("SPIR-V magic number is missing");
+
+	Module module;
+	u32 execution_model = U32_BAD;
+
+	for (u32 pos = 5; pos < word_count;) {
+		u32 length = words[pos] >> 16;
+		u32 op = words[pos] & 0xFFFF;
+
+		if (length == 0 || pos + length > word_count) return fail("SPIR-V instruction runs past the end of the module");
+
+		const u32 *args = words + pos + 1;
+		u32 num_args = length - 1;
+
+		switch (op) {
+		case spv::OP_NAME:
+			if (num_args >= 2) module.names[args[0]] = (const char *) (args + 1);
+			break;
+		case spv::OP_ENTRY_POINT:
+			if (execution_model == U32_BAD) execution_model = args[0];
+			break;
+		case spv::OP_TYPE_BOOL:
+		case spv::OP_TYPE_INT:
+		case spv::OP_TYPE_FLOAT:
+		case spv::OP_TYPE_VECTOR:
+		case spv::OP_TYPE_MATRIX:
+		case spv::OP_TYPE_IMAGE:
+		case spv::OP_TYPE_SAMPLER:
+		case spv::OP_TYPE_SAMPLED_IMAGE:
+		case spv::OP_TYPE_ARRAY:
+		case spv::OP_TYPE_RUNTIME_ARRAY:
+		case spv::OP_TYPE_STRUCT:
+		case spv::OP_TYPE_POINTER:
+			module.types[args[0]] = Type{ .op = op, .operands = std::vector<u32>(args + 1, args + num_args) };
+			break;
+		case spv::OP_CONSTANT:
+			if (num_args >= 3) module.constants[args[1]] = args[2];
+			break;
+		case spv::OP_VARIABLE:
+			module.variables.push_back({ .id = args[1], .pointer_type = args[0], .storage = args[2] });
+			break;
+		case spv::OP_DECORATE: {
+			Decorations &d = module.decorations[args[0]];
+			switch (args[1]) {
+			case spv::DECORATION_BLOCK: d.block = true; break;
+			case spv::DECORATION_BUFFER_BLOCK: d.buffer_block = true; break;
+			case spv::DECORATION_BUILT_IN: d.built_in = true; break;
+			case spv::DECORATION_ARRAY_STRIDE: d.array_stride = args[2]; break;
+			case spv::DECORATION_LOCATION: d.location = args[2]; break;
+			case spv::DECORATION_BINDING: d.binding = args[2]; break;
+			case spv::DECORATION_DESCRIPTOR_SET: d.set = args[2]; break;
+			}
+		} break;
+		case spv::OP_MEMBER_DECORATE: {
+			MemberDecorations &md = module.member_decorations[Module::member_key(args[0], args[1])];
+			switch (args[2]) {
+			case spv::DECORATION_OFFSET: md.offset = args[3]; break;
+			case spv::DECORATION_MATRIX_STRIDE: md.matrix_stride = args[3]; break;
+			case spv::DECORATION_BUILT_IN: md.built_in = true; break;
+			}
+		} break;
+		}
+
+		pos += length;
+	}
+
+	SpirvReflection result = {};
+
+	switch (execution_model) {
+	case spv::EXECUTION_VERTEX:
+		result.stage = SDL_GPU_SHADERSTAGE_VERTEX;
+		break;
+	case spv::EXECUTION_FRAGMENT:
+		result.stage = SDL_GPU_SHADERSTAGE_FRAGMENT;
+		break;
+	default:
+		return fail("SPIR-V entry point is not a vertex or fragment shader");
+	}
+
+	for (const Variable &var : module.variables) {
+		u32 id = var.id;
+		const Type *pointer = module.type(var.pointer_type);
+		if (!pointer || pointer->op != spv::OP_TYPE_POINTER) continue;
+
+		const Decorations &decor = module.decorations[id];
+		std::string name = module.names.contains(id) ? module.names[id] : "";
+
+		u32 count = 1;
+		u32 type_id = module.element_type(pointer->operands[1], &count);
+		const Type *type = module.type(type_id);
+		if (!type) continue;
+
+		const Decorations &type_decor = module.decorations[type_id];
+
+		switch (var.storage) {
+		case spv::STORAGE_INPUT: {
+			if (decor.built_in || decor.location == U32_BAD) break;
+
+			// Matrices take one location per column
+			u32 locations = count;
+			u32 scalar_id = type_id;
+			u32 components = 1;
+			if (type->op == spv::OP_TYPE_MATRIX) {
+				locations *= type->operands[1];
+				scalar_id = type->operands[0];
+			}
+			if (const Type *vec = module.type(scalar_id); vec && vec->op == spv::OP_TYPE_VECTOR) {
+				components = vec->operands[1];
+				scalar_id = vec->operands[0];
+			}
+
+			SpirvBaseType base = SpirvBaseType::UNKNOWN;
+			if (const Type *scalar = module.type(scalar_id)) {
+				if (scalar->op == spv::OP_TYPE_FLOAT) base = SpirvBaseType::FLOAT;
+				else if (scalar->op == spv::OP_TYPE_INT) base = scalar->operands[1] ? SpirvBaseType::INT : SpirvBaseType::UINT;
+				else if (scalar->op == spv::OP_TYPE_BOOL) base = SpirvBaseType::BOOL;
+			}
+
+			result.inputs.push_back(SpirvInput{
+				.location = decor.location,
+				.components = components,
+				.locations = locations,
+				.base_type = base,
+				.name = name
+			});
+		} break;
+		case spv::STORAGE_UNIFORM_CONSTANT:
+			if (type->op == spv::OP_TYPE_SAMPLED_IMAGE) {
+				result.num_samplers += count;
+			} else if (type->op == spv::OP_TYPE_IMAGE) {
+				// Sampled = 2 means it is only used without a sampler, ie. as a storage image
+				if (type->operands.size() >= 6 && type->operands[5] == 2) {
+					result.num_storage_textures += count;
+				} else {
+					result.num_samplers += count;
+				}
+			}
+			break;
+		case spv::STORAGE_UNIFORM:
+			if (type_decor.buffer_block) {
+				result.num_storage_buffers += count;
+			} else if (type_decor.block) {
+				result.num_uniform_buffers += count;
+				result.uniform_blocks.push_back(SpirvUniformBlock{
+					.set = decor.set,
+					.binding = decor.binding,
+					.size = module.byte_size(type_id),
+					.name = name
+				});
+			}
+			break;
+		case spv::STORAGE_STORAGE_BUFFER:
+			result.num_storage_buffers += count;
+			break;
+		}
+	}
+
+	std::sort(result.inputs.begin(), result.inputs.end(), [](const SpirvInput &a, const SpirvInput &b) {
+		return a.location < b.location;
+	});
+
+	std::sort(result.uniform_blocks.begin(), result.uniform_blocks.end(), [](const SpirvUniformBlock &a, const SpirvUniformBlock &b) {
+		return a.binding < b.binding;
+	});
+
+	*o_reflection = std::move(result);
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.h"
+
+enum class SpirvBaseType {
+	UNKNOWN,
+	FLOAT,
+	INT,
+	UINT,
+	BOOL
+};
+
+// A stage input with an explicit location (built-ins are skipped)
+struct SpirvInput {
+	u32 location;
+	u32 components; // Per location. Matrices use several locations
+	u32 locations;
+	SpirvBaseType base_type;
+	std::string name;
+};
+
+struct SpirvUniformBlock {
+	u32 set;
+	u32 binding;
+	u32 size; // In bytes, including padding between members but not after the last one
+	std::string name;
+};
+
+// What SDL needs to know about a shader stage, read straight from its SPIR-V
+struct SpirvReflection {
+	SDL_GPUShaderStage stage;
+
+	u32 num_samplers;
+	u32 num_storage_textures;
+	u32 num_storage_buffers;
+	u32 num_uniform_buffers;
+
+	// Sorted by location
+	std::vector<SpirvInput> inputs;
+
+	// Sorted by binding
+	std::vector<SpirvUniformBlock> uniform_blocks;
+};
+
+/// <summary>
+/// Parses a SPIR-V module once and collects its resources and inputs. Only vertex and fragment entry points are
+/// supported
+/// </summary>
+/// <param name="code">- The SPIR-V module</param>
+/// <param name="o_reflection">- Receives the results</param>
+/// <param name="o_error">- (Optional) Receives the reason if parsing fails</param>
+/// <returns>False if the module is malformed or uses an unsupported stage</returns>
+bool reflect_spirv(const std::vector<byte> &code, SpirvReflection *o_reflection, std::string *o_error = nullptr);
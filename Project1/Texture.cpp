@@ -0,0 +1,149 @@
+#include "Texture.h"
+
+Texture::Texture(Renderer &renderer, const SDL_GPUTextureCreateInfo &info, std::vector<byte> pixels):
+	m_renderer(&renderer), m_pixels(std::move(pixels)),
+	m_width(info.width), m_height(info.height), m_layers(info.layer_count_or_depth)
+{
+	m_texture = renderer.create_texture(&info);
+	m_pixel_size = SDL_GPUTextureFormatTexelBlockSize(info.format);
+
+	for (u32 layer = 0; layer < m_layers; ++layer) {
+		mark_dirty(0, 0, m_width, m_height, layer);
+	}
+}
+
+Texture &Texture::operator=(Texture &&other) noexcept {
+	if (this == &other) return *this;
+
+	destroy();
+
+	m_renderer = other.m_renderer;
+	m_texture = other.m_texture;
+	m_pixels = std::move(other.m_pixels);
+	m_width = other.m_width;
+	m_height = other.m_height;
+	m_layers = other.m_layers;
+	m_pixel_size = other.m_pixel_size;
+	m_dirty_rects = std::move(other.m_dirty_rects);
+
+	other.m_renderer = nullptr;
+	other.m_texture = U32_BAD;
+	other.m_pixels.clear();
+	other.m_dirty_rects.clear();
+
+	return *this;
+}
+
+void Texture::destroy() {
+	if (!m_renderer) return;
+
+	m_renderer->destroy_texture(m_texture);
+
+	m_texture = U32_BAD;
+	m_dirty_rects.clear();
+
+	m_renderer = nullptr;
+}
+
+void Texture::add_dirty_rect(TextureRect rect) {
+	u32 best = U32_BAD;
+	u64 best_growth = ~(u64) 0;
+	bool overlapping = false;
+
+	for (u32 i = 0; i < m_dirty_rects.size(); ++i) {
+		const TextureRect &other = m_dirty_rects[i];
+		if (other.first_layer != rect.first_layer) continue;
+
+		u32 x0 = std::min(other.x, rect.x);
+		u32 y0 = std::min(other.y, rect.y);
+		u32 x1 = std::max(other.x + other.w, rect.x + rect.w);
+		u32 y1 = std::max(other.y + other.h, rect.y + rect.h);
+
+		bool overlaps =
+			rect.x <= other.x + other.w && other.x <= rect.x + rect.w &&
+			rect.y <= other.y + other.h && other.y <= rect.y + rect.h;
+
+		// Touching or overlapping rects are always merged, they would upload the same texels twice otherwise
+		if (overlaps) {
+			best = i;
+			overlapping = true;
+			break;
+		}
+
+		u64 growth = (u64) (x1 - x0) * (y1 - y0) - (u64) other.w * other.h - (u64) rect.w * rect.h;
+		if (growth < best_growth) {
+			best_growth = growth;
+			best = i;
+		}
+	}
+
+	u32 layer_rects = 0;
+	for (const TextureRect &other : m_dirty_rects) {
+		if (other.first_layer == rect.first_layer) layer_rects++;
+	}
+
+	bool must_merge = best != U32_BAD && (overlapping || layer_rects >= MAX_DIRTY_RECTS);
+	if (!must_merge) {
+		m_dirty_rects.push_back(rect);
+		return;
+	}
+
+	TextureRect merged = m_dirty_rects[best];
+	m_dirty_rects.erase(m_dirty_rects.begin() + best);
+
+	u32 x1 = std::max(merged.x + merged.w, rect.x + rect.w);
+	u32 y1 = std::max(merged.y + merged.h, rect.y + rect.h);
+	merged.x = std::min(merged.x, rect.x);
+	merged.y = std::min(merged.y, rect.y);
+	merged.w = x1 - merged.x;
+	merged.h = y1 - merged.y;
+
+	// The merged rect may now overlap others
+	add_dirty_rect(merged);
+}
+
+void Texture::update_region(u32 x, u32 y, u32 w, u32 h, const byte *data, u32 layer) {
+	if (x + w > m_width || y + h > m_height || layer >= m_layers) {
+		std::cout << "Texture region is out of bounds\n";
+		return;
+	}
+
+	u32 row_size = w * m_pixel_size;
+	u32 pitch = m_width * m_pixel_size;
+
+	byte *dst = m_pixels.data() + layer * pitch * m_height + y * pitch + x * m_pixel_size;
+	for (u32 row = 0; row < h; ++row) {
+		memmove(dst + row * pitch, data + row * row_size, row_size);
+	}
+
+	mark_dirty(x, y, w, h, layer);
+}
+
+void Texture::mark_dirty(u32 x, u32 y, u32 w, u32 h, u32 layer) {
+	if (w == 0 || h == 0) return;
+
+	add_dirty_rect(TextureRect{
+		.x = x,
+		.y = y,
+		.w = w,
+		.h = h,
+		.first_layer = layer,
+		.num_layers = 1
+	});
+}
+
+void Texture::upload(ActiveCopyPass &acp) {
+	for (const TextureRect &rect : m_dirty_rects) {
+		acp.upload_texture(m_pixels.data(), m_pixels.size(), m_texture, TextureUploadRegion{
+			.x = rect.x,
+			.y = rect.y,
+			.w = rect.w,
+			.h = rect.h,
+			.mip_level = 0,
+			.first_layer = rect.first_layer,
+			.num_layers = 1
+		});
+	}
+
+	m_dirty_rects.clear();
+}
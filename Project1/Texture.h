@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+
+/* Texture
+ * A CPU-side copy of a texture's base level. Edits are tracked as dirty rectangles so that upload() only
+ * transfers the parts that changed since the last upload.
+*/
+class Texture {
+	// Past this many rects per layer, new rects are merged into their closest neighbour
+	static constexpr u32 MAX_DIRTY_RECTS = 8;
+
+	Renderer *m_renderer = nullptr;
+
+	RID m_texture = U32_BAD;
+
+	std::vector<byte> m_pixels = {};
+
+	u32 m_width = 0, m_height = 0, m_layers = 0;
+	u32 m_pixel_size = 0;
+
+	// Each rect covers exactly one layer
+	std::vector<TextureRect> m_dirty_rects = {};
+
+	void add_dirty_rect(TextureRect rect);
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline Texture() {}
+
+	/// <summary>
+	/// Creates a new texture from prexisting data. The whole texture starts out dirty
+	/// </summary>
+	/// <param name="renderer">- The Renderer to create the texture on</param>
+	/// <param name="info">- The info that will be provided to Renderer::create_texture()</param>
+	/// <param name="pixels">- The base level of every layer, tightly packed</param>
+	Texture(Renderer &renderer, const SDL_GPUTextureCreateInfo &info, std::vector<byte> pixels);
+
+	Texture(const Texture &) = delete;
+	Texture &operator=(const Texture &) = delete;
+
+	// Moved-from textures own nothing, so only the new one releases the RID
+	inline Texture(Texture &&other) noexcept { *this = std::move(other); }
+	Texture &operator=(Texture &&other) noexcept;
+
+	inline ~Texture() { destroy(); }
+
+	void destroy();
+
+	/// <summary>
+	/// Replaces a rectangle of texels on one layer and marks it dirty
+	/// </summary>
+	/// <param name="x">- The left edge of the rectangle</param>
+	/// <param name="y">- The top edge of the rectangle</param>
+	/// <param name="w">- The width of the rectangle</param>
+	/// <param name="h">- The height of the rectangle</param>
+	/// <param name="data">- w * h texels, tightly packed</param>
+	/// <param name="layer">- (Optional) The layer to write to</param>
+	void update_region(u32 x, u32 y, u32 w, u32 h, const byte *data, u32 layer = 0);
+
+	// Marks a rectangle dirty after editing get_pixels() directly
+	void mark_dirty(u32 x, u32 y, u32 w, u32 h, u32 layer = 0);
+
+	// Uploads every dirty rectangle, then clears them
+	void upload(ActiveCopyPass &acp);
+
+	inline bool is_dirty() const { return !m_dirty_rects.empty(); }
+
+	inline byte *get_pixels() { return m_pixels.data(); }
+
+	inline RID get_rid() const { return m_texture; }
+};
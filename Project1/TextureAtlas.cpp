@@ -0,0 +1,224 @@
+#include "TextureAtlas.h"
+
+SkylinePacker::SkylinePacker(u32 width, u32 height):
+	m_width(width), m_height(height)
+{
+	m_skyline.push_back({ .x = 0, .y = 0, .w = width });
+}
+
+u32 SkylinePacker::fit(u32 segment, u32 w, u32 h) const {
+	u32 x = m_skyline[segment].x;
+	if (x + w > m_width) return U32_BAD;
+
+	// The rect rests on the tallest segment it spans
+	u32 y = 0;
+	u32 remaining = w;
+	for (u32 i = segment; remaining > 0; ++i) {
+		if (i >= m_skyline.size()) return U32_BAD;
+
+		y = std::max(y, m_skyline[i].y);
+		if (y + h > m_height) return U32_BAD;
+
+		remaining -= std::min(remaining, m_skyline[i].w);
+	}
+
+	return y;
+}
+
+bool SkylinePacker::insert(u32 w, u32 h, u32 *o_x, u32 *o_y) {
+	u32 best = U32_BAD;
+	u32 best_y = U32_BAD;
+	u32 best_w = U32_BAD;
+
+	for (u32 i = 0; i < m_skyline.size(); ++i) {
+		u32 y = fit(i, w, h);
+		if (y == U32_BAD) continue;
+
+		// Lowest top edge first, then the narrowest segment to keep gaps small
+		if (y + h < best_y || (y + h == best_y && m_skyline[i].w < best_w)) {
+			best = i;
+			best_y = y + h;
+			best_w = m_skyline[i].w;
+		}
+	}
+
+	if (best == U32_BAD) return false;
+
+	Segment placed = {
+		.x = m_skyline[best].x,
+		.y = best_y,
+		.w = w
+	};
+
+	*o_x = placed.x;
+	*o_y = best_y - h;
+
+	m_skyline.insert(m_skyline.begin() + best, placed);
+
+	// Shrink or remove the segments now covered by the new one
+	u32 end = placed.x + placed.w;
+	for (u32 i = best + 1; i < m_skyline.size();) {
+		Segment &seg = m_skyline[i];
+		if (seg.x >= end) break;
+
+		u32 seg_end = seg.x + seg.w;
+		if (seg_end <= end) {
+			m_skyline.erase(m_skyline.begin() + i);
+			continue;
+		}
+
+		seg.w = seg_end - end;
+		seg.x = end;
+		break;
+	}
+
+	// Merge neighbours of equal height
+	for (u32 i = 0; i + 1 < m_skyline.size();) {
+		if (m_skyline[i].y == m_skyline[i + 1].y) {
+			m_skyline[i].w += m_skyline[i + 1].w;
+			m_skyline.erase(m_skyline.begin() + i + 1);
+		} else {
+			++i;
+		}
+	}
+
+	return true;
+}
+
+TextureAtlas::TextureAtlas(Renderer &renderer, SDL_GPUTextureFormat format, const std::vector<AtlasImage> &images,
+	AtlasMode mode, u32 page_size, u32 padding)
+{
+	m_entries.resize(images.size());
+
+	u32 layer_w = page_size;
+	u32 layer_h = page_size;
+
+	if (mode == AtlasMode::ARRAY) {
+		layer_w = 1;
+		layer_h = 1;
+		for (const AtlasImage &image : images) {
+			layer_w = std::max(layer_w, image.width);
+			layer_h = std::max(layer_h, image.height);
+		}
+
+		// Padding only matters between neighbours, and layers have none
+		padding = 0;
+
+		for (u32 i = 0; i < images.size(); ++i) {
+			m_entries[i] = {
+				.layer = i,
+				.x = 0,
+				.y = 0,
+				.w = images[i].width,
+				.h = images[i].height
+			};
+		}
+
+		m_layer_count = images.size();
+	} else {
+		// Tallest first packs noticeably tighter with a skyline
+		std::vector<u32> order(images.size());
+		for (u32 i = 0; i < order.size(); ++i) order[i] = i;
+
+		std::sort(order.begin(), order.end(), [&](u32 a, u32 b) {
+			if (images[a].height != images[b].height) return images[a].height > images[b].height;
+			return images[a].width > images[b].width;
+		});
+
+		std::vector<SkylinePacker> pages;
+
+		for (u32 i : order) {
+			const AtlasImage &image = images[i];
+			u32 w = image.width + padding * 2;
+			u32 h = image.height + padding * 2;
+
+			m_entries[i].layer = U32_BAD;
+
+			if (w > page_size || h > page_size) {
+				std::cout << "Atlas image " << i << " (" << image.width << "x" << image.height << ") does not fit in a "
+					<< page_size << "x" << page_size << " page\n";
+				continue;
+			}
+
+			u32 x, y;
+			u32 layer = 0;
+			for (; layer < pages.size(); ++layer) {
+				if (pages[layer].insert(w, h, &x, &y)) break;
+			}
+
+			if (layer == pages.size()) {
+				pages.emplace_back(page_size, page_size);
+				pages.back().insert(w, h, &x, &y);
+			}
+
+			m_entries[i] = {
+				.layer = layer,
+				.x = x + padding,
+				.y = y + padding,
+				.w = image.width,
+				.h = image.height
+			};
+		}
+
+		m_layer_count = pages.size();
+	}
+
+	if (m_layer_count == 0) return;
+
+	// Copy every image into its place, extending its edges into the padding
+	u32 pixel_size = SDL_GPUTextureFormatTexelBlockSize(format);
+	u32 pitch = layer_w * pixel_size;
+	std::vector<byte> pixels((size_t) pitch * layer_h * m_layer_count, 0);
+
+	for (u32 i = 0; i < images.size(); ++i) {
+		AtlasEntry &entry = m_entries[i];
+		if (entry.layer == U32_BAD) continue;
+
+		const AtlasImage &image = images[i];
+		byte *layer = pixels.data() + (size_t) entry.layer * pitch * layer_h;
+
+		for (u32 row = 0; row < image.height + padding * 2; ++row) {
+			u32 src_row = std::min(row > padding ? row - padding : 0, image.height - 1);
+			const byte *src = image.pixels + (size_t) src_row * image.width * pixel_size;
+			byte *dst = layer + (size_t) (entry.y - padding + row) * pitch + (entry.x - padding) * pixel_size;
+
+			for (u32 p = 0; p < padding; ++p) {
+				memmove(dst + p * pixel_size, src, pixel_size);
+				memmove(dst + (padding + image.width + p) * pixel_size, src + (image.width - 1) * pixel_size, pixel_size);
+			}
+
+			memmove(dst + padding * pixel_size, src, image.width * pixel_size);
+		}
+
+		entry.uv_scale = vec2((float) image.width / layer_w, (float) image.height / layer_h);
+		entry.uv_offset = vec2((float) entry.x / layer_w, (float) entry.y / layer_h);
+	}
+
+	SDL_GPUTextureCreateInfo ci = {
+		// An array even with one layer, so shaders can declare sampler2DArray however much the atlas holds
+		.type = SDL_GPU_TEXTURETYPE_2D_ARRAY,
+		.format = format,
+		.usage = SDL_GPU_TEXTUREUSAGE_SAMPLER | SDL_GPU_TEXTUREUSAGE_COLOR_TARGET,
+		.width = layer_w,
+		.height = layer_h,
+		.layer_count_or_depth = m_layer_count,
+		.num_levels = 0,
+	};
+
+	new (&m_texture) Texture(renderer, ci, std::move(pixels));
+
+	std::cout << "Packed " << images.size() << " images into " << m_layer_count << " atlas layers\n";
+}
+
+TextureAtlas &TextureAtlas::operator=(TextureAtlas &&other) noexcept {
+	if (this == &other) return *this;
+
+	m_texture = std::move(other.m_texture);
+	m_entries = std::move(other.m_entries);
+	m_layer_count = other.m_layer_count;
+
+	other.m_entries.clear();
+	other.m_layer_count = 0;
+
+	return *this;
+}
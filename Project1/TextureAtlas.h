@@ -0,0 +1,97 @@
+#pragma once
+
+#include "common.h"
+#include "Texture.h"
+
+// A source image for the atlas. Pixels must be tightly packed and in the atlas' format
+struct AtlasImage {
+	const byte *pixels;
+	u32 width, height;
+};
+
+// Where an image ended up inside the atlas
+struct AtlasEntry {
+	// U32_BAD if the image could not be placed
+	u32 layer;
+
+	// Apply to the image's own UVs with uv * uv_scale + uv_offset
+	vec2 uv_scale;
+	vec2 uv_offset;
+
+	// Texel rectangle on the layer, excluding padding
+	u32 x, y, w, h;
+};
+
+enum class AtlasMode {
+	ARRAY, // One image per layer. Layers are sized to fit the largest image
+	PACKED // Images are packed into as few layers as possible using a skyline packer
+};
+
+/* SkylinePacker
+ * Packs rectangles into a fixed-size area by tracking the height of the filled area along the x axis.
+ * Each rectangle is placed where it leaves the lowest top edge (bottom-left heuristic).
+*/
+class SkylinePacker {
+	struct Segment {
+		u32 x, y, w;
+	};
+
+	std::vector<Segment> m_skyline;
+
+	u32 m_width, m_height;
+
+	// Returns the y a rect would rest at if placed at the given segment, or U32_BAD if it doesn't fit
+	u32 fit(u32 segment, u32 w, u32 h) const;
+
+public:
+	SkylinePacker(u32 width, u32 height);
+
+	// Returns false if there is no room left. o_x and o_y are the top-left corner of the placed rect
+	bool insert(u32 w, u32 h, u32 *o_x, u32 *o_y);
+};
+
+/* TextureAtlas
+ * Combines many small textures of the same format into one texture at import time, so draws that sample
+ * any of them can share a single sampler binding. The texture is always a 2D array, sampled with sampler2DArray
+ * and AtlasEntry::layer, even when everything fits in one layer.
+*/
+class TextureAtlas {
+	Texture m_texture;
+
+	std::vector<AtlasEntry> m_entries;
+
+	u32 m_layer_count = 0;
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline TextureAtlas() {}
+
+	/// <summary>
+	/// Packs the images and creates the atlas texture. Entries keep the order of the images
+	/// </summary>
+	/// <param name="renderer">- The Renderer to create the texture on</param>
+	/// <param name="format">- The SDL format shared by every image</param>
+	/// <param name="images">- The images to pack</param>
+	/// <param name="mode">- (Optional) How to lay out the images</param>
+	/// <param name="page_size">- (Optional) The width and height of each layer when packing</param>
+	/// <param name="padding">- (Optional) Texels of edge-extended border around each image, limits mip bleeding</param>
+	TextureAtlas(Renderer &renderer, SDL_GPUTextureFormat format, const std::vector<AtlasImage> &images,
+		AtlasMode mode = AtlasMode::PACKED, u32 page_size = 2048, u32 padding = 2);
+
+	TextureAtlas(const TextureAtlas &) = delete;
+	TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+	// The Texture member releases the target's texture and empties the source's, see Texture's moves
+	inline TextureAtlas(TextureAtlas &&other) noexcept { *this = std::move(other); }
+	TextureAtlas &operator=(TextureAtlas &&other) noexcept;
+
+	inline void destroy() { m_texture.destroy(); }
+
+	inline void upload(ActiveCopyPass &acp) { m_texture.upload(acp); }
+
+	inline const AtlasEntry &get_entry(u32 image) const { return m_entries[image]; }
+
+	inline u32 get_layer_count() const { return m_layer_count; }
+
+	inline RID get_rid() const { return m_texture.get_rid(); }
+};
@@ -0,0 +1,94 @@
+#include "TextureReadback.h"
+
+TextureReadback::TextureReadback(Renderer &renderer):
+	m_renderer(&renderer)
+{}
+
+void TextureReadback::destroy() {
+	if (!m_renderer) return;
+
+	for (Slot &slot : m_slots) {
+		if (slot.buffer) SDL_ReleaseGPUTransferBuffer(m_renderer->get_device(), slot.buffer);
+		slot = Slot();
+	}
+
+	m_renderer = nullptr;
+}
+
+u32 TextureReadback::download(SDL_GPUTexture *texture, u32 width, u32 height, u32 texel_size) {
+	SDL_GPUCommandBuffer *cb = m_renderer ? m_renderer->get_frame_command_buffer() : nullptr;
+	if (!cb) return U32_BAD;
+
+	u32 index = m_renderer->get_frame_number() % FRAMES_IN_FLIGHT;
+	Slot &slot = m_slots[index];
+	u32 size = width * height * texel_size;
+
+	if (slot.capacity < size) {
+		if (slot.buffer) SDL_ReleaseGPUTransferBuffer(m_renderer->get_device(), slot.buffer);
+
+		SDL_GPUTransferBufferCreateInfo ci = {
+			.usage = SDL_GPU_TRANSFERBUFFERUSAGE_DOWNLOAD,
+			.size = size
+		};
+
+		slot.buffer = SDL_CreateGPUTransferBuffer(m_renderer->get_device(), &ci);
+		slot.capacity = slot.buffer ? size : 0;
+		slot.pending = false;
+
+		if (!slot.buffer) {
+			std::cout << "SDL Error: " << SDL_GetError() << "\n";
+			return U32_BAD;
+		}
+	}
+
+	SDL_GPUCopyPass *copy = SDL_BeginGPUCopyPass(cb);
+
+	SDL_GPUTextureRegion region = {
+		.texture = texture,
+		.w = width,
+		.h = height,
+		.d = 1,
+	};
+
+	SDL_GPUTextureTransferInfo destination = {
+		.transfer_buffer = slot.buffer,
+		.offset = 0,
+		.pixels_per_row = width,
+		.rows_per_layer = height,
+	};
+
+	SDL_DownloadFromGPUTexture(copy, &region, &destination);
+	SDL_EndGPUCopyPass(copy);
+
+	slot.pending = true;
+	slot.frame = m_renderer->get_frame_number();
+	slot.width = width;
+	slot.height = height;
+
+	return index;
+}
+
+void TextureReadback::poll(const ReadbackFunc &read) {
+	if (!m_renderer) return;
+
+	SDL_GPUDevice *device = m_renderer->get_device();
+
+	for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		Slot &slot = m_slots[i];
+
+		// begin_frame() has waited for the frame that used this slot, so the download is complete
+		if (!slot.pending || m_renderer->get_frame_number() < slot.frame + FRAMES_IN_FLIGHT) continue;
+
+		slot.pending = false;
+
+		const void *texels = SDL_MapGPUTransferBuffer(device, slot.buffer, false);
+		if (!texels) {
+			std::cout << "SDL Error: " << SDL_GetError() << "\n";
+			continue;
+		}
+
+		read(texels, slot.width, slot.height, i);
+
+		SDL_UnmapGPUTransferBuffer(device, slot.buffer);
+	}
+}
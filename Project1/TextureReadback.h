@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+
+// Called by TextureReadback::poll() for each finished download. texels are tightly packed, row by row
+using ReadbackFunc = std::function<void(const void *texels, u32 width, u32 height, u32 slot)>;
+
+/* TextureReadback
+ * Downloads textures to the CPU without stalling. Each frame in flight has a transfer buffer of its own, and a
+ * download recorded into a frame is read once begin_frame() has waited for that frame, FRAMES_IN_FLIGHT frames later.
+*/
+class TextureReadback {
+	struct Slot {
+		SDL_GPUTransferBuffer *buffer = nullptr;
+		u32 capacity = 0;
+
+		// Frame number of the download, if one is pending
+		bool pending = false;
+		u64 frame;
+		u32 width, height;
+	};
+
+	Renderer *m_renderer = nullptr;
+
+	Slot m_slots[FRAMES_IN_FLIGHT];
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline TextureReadback() {}
+
+	TextureReadback(Renderer &renderer);
+
+	TextureReadback(const TextureReadback &) = delete;
+	TextureReadback &operator=(const TextureReadback &) = delete;
+
+	inline ~TextureReadback() { destroy(); }
+
+	void destroy();
+
+	/// <summary>
+	/// Records a download of a whole texture into the frame. A download still pending in the frame's slot was never
+	/// polled and is dropped. Call between passes
+	/// </summary>
+	/// <param name="texture">- The texture to read, with a single layer and mip level</param>
+	/// <param name="width">- The width of the texture</param>
+	/// <param name="height">- The height of the texture</param>
+	/// <param name="texel_size">- The size of one texel in bytes</param>
+	/// <returns>The slot the download went into, so callers can keep data of their own alongside it. U32_BAD if
+	/// it could not be recorded</returns>
+	u32 download(SDL_GPUTexture *texture, u32 width, u32 height, u32 texel_size);
+
+	// Calls read for every download the GPU has finished. Call after Renderer::begin_frame()
+	void poll(const ReadbackFunc &read);
+};
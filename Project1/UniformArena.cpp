@@ -0,0 +1,101 @@
+#include "UniformArena.h"
+#include "DrawCommandList.h"
+
+UniformArena::UniformArena(Renderer &renderer, u32 stride, u32 initial_count):
+	m_renderer(&renderer), m_stride(stride)
+{
+	if (stride == 0 || stride % 16 != 0) {
+		std::cout << "Uniform arena stride " << stride << " is not a multiple of 16\n";
+	}
+
+	m_capacity = stride * std::max(initial_count, 1u);
+	m_buffer = renderer.create_buffer(SDL_GPU_BUFFERUSAGE_GRAPHICS_STORAGE_READ, m_capacity);
+	m_data.reserve(m_capacity);
+}
+
+UniformArena &UniformArena::operator=(UniformArena &&other) noexcept {
+	if (this == &other) return *this;
+
+	destroy();
+
+	m_renderer = other.m_renderer;
+	m_buffer = other.m_buffer;
+	m_capacity = other.m_capacity;
+	m_stride = other.m_stride;
+	m_data = std::move(other.m_data);
+
+	other.m_renderer = nullptr;
+	other.m_buffer = U32_BAD;
+	other.m_capacity = 0;
+	other.m_data.clear();
+
+	return *this;
+}
+
+void UniformArena::destroy() {
+	if (!m_renderer) return;
+
+	m_renderer->destroy_buffer(m_buffer);
+
+	m_buffer = U32_BAD;
+	m_data.clear();
+
+	m_renderer = nullptr;
+}
+
+void UniformArena::reset() {
+	m_data.clear();
+}
+
+u32 UniformArena::push(const void *data, u32 length) {
+	if (length > m_stride) {
+		std::cout << "Uniform arena record of " << length << " bytes exceeds the stride of " << m_stride << "\n";
+		length = m_stride;
+	}
+
+	u32 index = get_count();
+
+	m_data.resize(m_data.size() + m_stride, 0);
+	memcpy(m_data.data() + index * m_stride, data, length);
+
+	return index;
+}
+
+void UniformArena::upload(ActiveCopyPass &acp) {
+	if (m_data.empty()) return;
+
+	if (m_data.size() > m_capacity) {
+		// Grow geometrically so a busy frame doesn't reallocate every frame after it
+		while (m_capacity < m_data.size()) m_capacity *= 2;
+		m_renderer->resize_buffer(m_buffer, m_capacity);
+	}
+
+	acp.upload_buffer(m_data.data(), m_data.size(), m_buffer);
+}
+
+void UniformArena::bind_vertex(ActiveRenderPass &arp, u32 storage_slot) const {
+	arp.bind_vert_storage_buffers(storage_slot, { m_buffer });
+}
+
+void UniformArena::bind_fragment(ActiveRenderPass &arp, u32 storage_slot) const {
+	arp.bind_frag_storage_buffers(storage_slot, { m_buffer });
+}
+
+void UniformArena::select(ActiveRenderPass &arp, u32 draw_slot, u32 index, bool use_fragment) {
+	// std140 rounds uniform blocks up to 16 bytes
+	u32 block[4] = { index, 0, 0, 0 };
+
+	arp.upload_vertex_uniform_buffer(draw_slot, block, sizeof(block));
+	if (use_fragment) {
+		arp.upload_fragment_uniform_buffer(draw_slot, block, sizeof(block));
+	}
+}
+
+void UniformArena::select(DrawCommandList &list, u32 draw_slot, u32 index, bool use_fragment) {
+	u32 block[4] = { index, 0, 0, 0 };
+
+	list.upload_vertex_uniform_buffer(draw_slot, block, sizeof(block));
+	if (use_fragment) {
+		list.upload_fragment_uniform_buffer(draw_slot, block, sizeof(block));
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include "Renderer.h"
+
+class DrawCommandList;
+
+/* UniformArena
+ * Per-draw constants for a whole frame, packed into one storage buffer. Draws push their data while the frame is
+ * being built, the arena is uploaded once in the copy pass, and each draw then selects its record with a 16-byte
+ * draw index push instead of pushing the full block.
+ *
+ * Records all have the same stride, so the shader sees them as a readonly std430 array, eg:
+ *
+ *   layout(std430, binding = 0, set = 0) readonly buffer Draws { DrawData draws[]; };
+ *   layout(binding = 0, set = 1) uniform DrawIndex { uint draw_index; };
+*/
+class UniformArena {
+	Renderer *m_renderer = nullptr;
+
+	RID m_buffer = U32_BAD;
+	// Size in bytes of the GPU buffer
+	u32 m_capacity = 0;
+
+	u32 m_stride = 0;
+	std::vector<byte> m_data;
+
+public:
+	// This does nothing and initializes nothing. NEVER use instances initialized this way.
+	inline UniformArena() {}
+
+	/// <summary>
+	/// Creates the storage buffer. It grows as needed, so initial_count only avoids early reallocation
+	/// </summary>
+	/// <param name="renderer">- The Renderer to create the buffer on</param>
+	/// <param name="stride">- The size in bytes of one record. Must be a multiple of 16, as std430 requires for structs</param>
+	/// <param name="initial_count">- The number of records to allocate room for up front</param>
+	UniformArena(Renderer &renderer, u32 stride, u32 initial_count = 256);
+
+	UniformArena(const UniformArena &) = delete;
+	UniformArena &operator=(const UniformArena &) = delete;
+
+	// Moved-from arenas own nothing, so only the new one releases the buffer
+	inline UniformArena(UniformArena &&other) noexcept { *this = std::move(other); }
+	UniformArena &operator=(UniformArena &&other) noexcept;
+
+	inline ~UniformArena() { destroy(); }
+
+	void destroy();
+
+	// Forgets every record. Call once at the start of each frame
+	void reset();
+
+	/// <summary>
+	/// Appends a record. Must happen before upload() for the record to be visible this frame
+	/// </summary>
+	/// <param name="data">- A pointer to binary data</param>
+	/// <param name="length">- The length of the data. Anything short of the stride is zeroed</param>
+	/// <returns>The index of the record, to be passed to the shader</returns>
+	u32 push(const void *data, u32 length);
+
+	template<class T>
+	inline u32 push(const T &value) {
+		return push(&value, sizeof(T));
+	}
+
+	// Copies every record to the GPU in a single upload, growing the buffer first if needed
+	void upload(ActiveCopyPass &acp);
+
+	// Binds the arena to a storage buffer slot. Once per pass is enough, records are picked with select()
+	void bind_vertex(ActiveRenderPass &arp, u32 storage_slot) const;
+	void bind_fragment(ActiveRenderPass &arp, u32 storage_slot) const;
+
+	// Pushes the draw index for subsequent draws to the vertex (and fragment, if use_fragment) uniform slot
+	static void select(ActiveRenderPass &arp, u32 draw_slot, u32 index, bool use_fragment = false);
+	static void select(DrawCommandList &list, u32 draw_slot, u32 index, bool use_fragment = false);
+
+	inline RID get_buffer() const { return m_buffer; }
+	inline u32 get_count() const { return m_stride ? m_data.size() / m_stride : 0; }
+};
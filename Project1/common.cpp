@@ -1,5 +1,7 @@
 #include "common.h"
 
+#include "JobSystem.h"
+
 byte *read_whole_file(std::string filename, u32 *o_size) {
     std::ifstream file(filename, std::ios::binary);
     
@@ -24,3 +26,20 @@ byte *read_whole_file(std::string filename, u32 *o_size) {
 
     return buf;
 }
+
+u64 hash_bytes(const void *data, size_t length, u64 seed) {
+    const byte *bytes = (const byte *) data;
+    u64 hash = seed;
+
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+void parallel_for(u32 count, const std::function<void(u32)> &func) {
+    // Callers hand over few, heavy items (files, chunks of draws), so every item gets its own job
+    JobSystem::parallel_for(count, 1, func);
+}
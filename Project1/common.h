@@ -4,13 +4,17 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <map>
+#include <algorithm>
 #include <unordered_set>
 #include <random>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
+#include <atomic>
 
 #include <SDL3/SDL.h>
 
@@ -40,6 +44,7 @@ inline auto deg_to_rad = glm::radians<float>;
 
 using byte = uint8_t;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 /*
  * Allocates a buffer with new and fills it with the contents of the file.
@@ -48,6 +53,15 @@ typedef uint32_t u32;
 */
 byte *read_whole_file(std::string filename, u32 *o_size);
 
+#define HASH_SEED 14695981039346656037ull
+
+// 64-bit FNV-1a. Pass a previous result as the seed to hash several pieces of data together
+u64 hash_bytes(const void *data, size_t length, u64 seed = HASH_SEED);
+
+// Runs func(i) for every i in [0, count) on the JobSystem's workers, returning once all are done. The calling thread
+// takes part
+void parallel_for(u32 count, const std::function<void(u32)> &func);
+
 class RID {
 	u32 m_number;
 
@@ -70,7 +84,8 @@ public:
 	}
 };
 
-inline size_t total_allocs = 0;
+// Atomic since job workers allocate too
+inline std::atomic<size_t> total_allocs = 0;
 
 inline void *operator new(size_t size) {
 	//std::cout << "Allocated " << size << " bytes (" << total_allocs << ")\n";
@@ -0,0 +1,16 @@
+#version 450
+
+// Depth only, for shadow casters and depth pre-passes. Alpha tested draws still need their texture to cut out holes
+#ifdef FEATURE_ALPHA_TEST
+layout(binding = 0, set = 2) uniform sampler2D tex;
+#endif
+
+#ifdef FEATURE_ALPHA_TEST
+layout(location = 0) in vec2 frag_uv;
+#endif
+
+void main() {
+#ifdef FEATURE_ALPHA_TEST
+	if (texture(tex, frag_uv).a < 0.5) discard;
+#endif
+}
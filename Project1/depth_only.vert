@@ -0,0 +1,46 @@
+#version 450
+
+layout(location = 0) in vec3 vert_pos;
+
+// Only read by alpha tested variants, see depth_only_pipeline()
+#ifdef FEATURE_ALPHA_TEST
+layout(location = 1) in vec2 vert_uv;
+#endif
+
+struct DrawData {
+	mat4x4 world;
+};
+
+// Every draw of the frame, written once by the UniformArena
+layout(std430, binding = 0, set = 0) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+
+// The camera or shadow cascade drawn from, pushed once per pass by Camera::bind()
+layout(binding = 0, set = 1) uniform ViewData {
+	mat4x4 view;
+	mat4x4 proj;
+	mat4x4 viewproj;
+	vec4 eye;
+	vec4 params;
+} vd;
+
+layout(binding = 1, set = 1) uniform DrawIndex {
+	uint draw_index;
+};
+
+#ifdef FEATURE_ALPHA_TEST
+layout(location = 0) out vec2 frag_uv;
+#endif
+
+// Depth pre-passes rely on this matching shader0.vert exactly, so both compute it the same way
+invariant gl_Position;
+
+void main() {
+	vec4 world = draws[draw_index].world * vec4(vert_pos, 1.0);
+
+	gl_Position = vd.viewproj * world;
+#ifdef FEATURE_ALPHA_TEST
+	frag_uv = vert_uv;
+#endif
+}
@@ -1,6 +1,11 @@
 #define SDL_MAIN_USE_CALLBACKS
 
 #include "AppImpl.h"
+#include "JobSystem.h"
+#include "Bvh.h"
+#include "OcclusionRasterizer.h"
+#include "ClusteredLights.h"
+#include "RenderGraphTest.h"
 
 #include <iostream>
 
@@ -50,6 +55,42 @@ SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
 	SDL_GetOriginalMemoryFunctions(&original_malloc, &original_calloc, &original_realloc, &original_free);
 	SDL_SetMemoryFunctions(my_malloc, my_calloc, my_realloc, my_free);
 
+#ifdef _DEBUG
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--render-graph-test") == 0) {
+			*appstate = nullptr;
+			return test_render_graph_window_passes() ? SDL_APP_SUCCESS : SDL_APP_FAILURE;
+		}
+	}
+#endif
+
+	// Benchmarks run instead of the app. Several can be given at once
+	bool benchmarked = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--job-benchmark") == 0) {
+			JobSystem::benchmark();
+			benchmarked = true;
+		} else if (strcmp(argv[i], "--bvh-benchmark") == 0) {
+			JobSystem::start();
+			Bvh::benchmark();
+			benchmarked = true;
+		} else if (strcmp(argv[i], "--occlusion-benchmark") == 0) {
+			JobSystem::start();
+			OcclusionRasterizer::benchmark();
+			benchmarked = true;
+		} else if (strcmp(argv[i], "--cluster-benchmark") == 0) {
+			JobSystem::start();
+			ClusteredLights::benchmark();
+			benchmarked = true;
+		}
+	}
+
+	if (benchmarked) {
+		JobSystem::stop();
+		*appstate = nullptr;
+		return SDL_APP_SUCCESS;
+	}
+
 	std::cout << "Allocating app\n";
 	AppImpl *app = new AppImpl();
 	
@@ -74,12 +115,14 @@ SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
 
 void SDL_AppQuit(void *appstate, SDL_AppResult result) {
 	AppImpl *app = (AppImpl *) appstate;
+	if (!app) return;
 	
 	if (result == SDL_APP_SUCCESS) {
 		app->_on_success();
 	} else {
 		app->_on_fail();
 	}
+	app->_quit();
 
 	std::cout << "Deallocating app\n";
 	delete app;
@@ -0,0 +1,24 @@
+#version 450
+
+// Counts fragments for OverdrawCounter: every fragment passing the depth test adds the weight to the target
+#ifdef FEATURE_ALPHA_TEST
+layout(binding = 0, set = 2) uniform sampler2D tex;
+#endif
+
+// Pushed once per pass by OverdrawCounter::bind()
+layout(binding = 0, set = 3) uniform Weight {
+	vec4 weight;
+};
+
+#ifdef FEATURE_ALPHA_TEST
+layout(location = 0) in vec2 frag_uv;
+#endif
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+#ifdef FEATURE_ALPHA_TEST
+	if (texture(tex, frag_uv).a < 0.5) discard;
+#endif
+	out_color = weight;
+}
@@ -1,18 +1,126 @@
 #version 450
 
 layout(binding = 0, set = 2) uniform sampler2D tex;
+// The cascades side by side, see ShadowCascades
+layout(binding = 1, set = 2) uniform sampler2D shadow_atlas;
+
+// Filled by ClusteredLights every frame. Storage buffers follow the samplers in set 2
+struct LightData {
+	vec4 position_range;
+	vec4 color;
+	vec4 direction_cone;
+};
+
+layout(std430, binding = 2, set = 2) readonly buffer LightBuffer {
+	LightData lights[];
+};
+
+// Offset into light_indices and light count of each froxel
+layout(std430, binding = 3, set = 2) readonly buffer ClusterGrid {
+	uvec2 clusters[];
+};
+
+layout(std430, binding = 4, set = 2) readonly buffer LightIndices {
+	uint light_indices[];
+};
+
+// Pushed once per pass by Camera::bind()
+layout(binding = 0, set = 3) uniform ViewData {
+	mat4x4 view;
+	mat4x4 proj;
+	mat4x4 viewproj;
+	vec4 eye;
+	vec4 params;
+} vd;
+
+// Pushed once per pass by ShadowCascades::bind()
+layout(binding = 1, set = 3) uniform ShadowData {
+	mat4x4 cascades[4];
+	vec4 splits;
+	vec4 texel_sizes;
+	vec4 light_dir;
+	vec4 params;
+} sd;
+
+// Pushed once per pass by ClusteredLights::bind()
+layout(binding = 2, set = 3) uniform ClusterData {
+	vec4 slicing;
+	vec4 tiles;
+} cd;
 
 layout(location = 0) out vec4 out_color;
 
 layout(location = 0) in vec2 frag_uv;
 layout(location = 1) in vec3 frag_norm;
+layout(location = 2) in vec3 frag_world;
+
+// 1 where the light reaches, 0 in full shadow
+float shadow(vec3 N, float depth) {
+	int count = int(sd.params.x);
+	int cascade = 0;
+	while (cascade < count && depth > sd.splits[cascade]) cascade++;
+	if (cascade == count) return 1.0;
+
+	// A texel along the normal keeps surfaces from shadowing themselves
+	vec3 offset = N * sd.texel_sizes[cascade];
+	vec3 p = (sd.cascades[cascade] * vec4(frag_world + offset, 1.0)).xyz;
+
+	// Keep the filter within the cascade's part of the atlas
+	vec2 texel = sd.params.yz;
+	float cascade_width = 1.0 / count;
+	float min_u = cascade * cascade_width + texel.x;
+	float max_u = (cascade + 1) * cascade_width - texel.x;
+
+	float lit = 0.0;
+	for (int y = -1; y <= 1; y++) {
+		for (int x = -1; x <= 1; x++) {
+			vec2 uv = p.xy + vec2(x, y) * texel;
+			uv.x = clamp(uv.x, min_u, max_u);
 
-const vec3 SUN = normalize(vec3(-1.0, 1.0, 1.0));
+			lit += p.z - sd.params.w <= texture(shadow_atlas, uv).r ? 1.0 : 0.0;
+		}
+	}
+
+	return lit / 9.0;
+}
+
+// The point and spot lights of this pixel's froxel
+vec3 clustered_lights(vec3 N, float depth) {
+	uvec2 tile = min(uvec2(gl_FragCoord.xy * cd.tiles.xy), uvec2(cd.tiles.zw) - 1u);
+	uint slice = depth < cd.slicing.z ? 0u : min(uint(log(depth) * cd.slicing.x + cd.slicing.y) + 1u, uint(cd.slicing.w) - 1u);
+	uvec2 cluster = clusters[(slice * uint(cd.tiles.w) + tile.y) * uint(cd.tiles.z) + tile.x];
+
+	vec3 light = vec3(0.0);
+	for (uint i = 0u; i < cluster.y; i++) {
+		LightData l = lights[light_indices[cluster.x + i]];
+
+		vec3 to_light = l.position_range.xyz - frag_world;
+		float dist_sq = max(dot(to_light, to_light), 1e-8);
+		float range_sq = l.position_range.w * l.position_range.w;
+		if (dist_sq >= range_sq) continue;
+
+		vec3 L = to_light * inversesqrt(dist_sq);
+
+		// Inverse square, windowed so it reaches exactly 0 at the range
+		float window = clamp(1.0 - (dist_sq * dist_sq) / (range_sq * range_sq), 0.0, 1.0);
+		float falloff = window * window / (dist_sq + 1.0);
+
+		float cone = clamp((dot(-L, l.direction_cone.xyz) - l.direction_cone.w) * l.color.w, 0.0, 1.0);
+
+		light += l.color.rgb * clamp(dot(N, L), 0.0, 1.0) * falloff * cone * cone;
+	}
+
+	return light;
+}
 
 void main() {
 	vec3 N = normalize(frag_norm);
 	vec4 samp = texture(tex, frag_uv);
-	vec3 albedo = samp.rgb;
-	albedo *= clamp(dot(N, SUN), 0.0, 1.0);
-	out_color = vec4(albedo, samp.a);
-}
\ No newline at end of file
+#ifdef FEATURE_ALPHA_TEST
+	if (samp.a < 0.5) discard;
+#endif
+	float depth = -(vd.view * vec4(frag_world, 1.0)).z;
+
+	vec3 light = clamp(dot(N, sd.light_dir.xyz), 0.0, 1.0) * shadow(N, depth) + clustered_lights(N, depth);
+	out_color = vec4(samp.rgb * light, samp.a);
+}
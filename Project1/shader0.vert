@@ -4,16 +4,42 @@ layout(location = 0) in vec3 vert_pos;
 layout(location = 1) in vec2 vert_uv;
 layout(location = 2) in vec3 vert_norm;
 
-layout(binding = 0, set = 1) uniform UniformData0 {
-	mat4x4 eyeproj;
+struct DrawData {
 	mat4x4 world;
-} ud0;
+};
+
+// Every draw of the frame, written once by the UniformArena
+layout(std430, binding = 0, set = 0) readonly buffer DrawBuffer {
+	DrawData draws[];
+};
+
+// Pushed once per pass by Camera::bind()
+layout(binding = 0, set = 1) uniform ViewData {
+	mat4x4 view;
+	mat4x4 proj;
+	mat4x4 viewproj;
+	vec4 eye;
+	vec4 params;
+} vd;
+
+layout(binding = 1, set = 1) uniform DrawIndex {
+	uint draw_index;
+};
 
 layout(location = 0) out vec2 frag_uv;
 layout(location = 1) out vec3 frag_norm;
+layout(location = 2) out vec3 frag_world;
+
+// Must match depth_only.vert, which lays down depth for this shader to test against with LESS_OR_EQUAL
+invariant gl_Position;
 
 void main() {
-	gl_Position = ud0.eyeproj * ud0.world * vec4(vert_pos, 1.0);
+	DrawData dd = draws[draw_index];
+
+	vec4 world = dd.world * vec4(vert_pos, 1.0);
+
+	gl_Position = vd.viewproj * world;
+	frag_world = world.xyz;
 	frag_uv = vert_uv;
-	frag_norm = normalize((ud0.world * vec4(vert_norm, 0.0)).xyz);
+	frag_norm = normalize((dd.world * vec4(vert_norm, 0.0)).xyz);
 }
\ No newline at end of file
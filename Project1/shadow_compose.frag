@@ -0,0 +1,10 @@
+#version 450
+
+// A cascade's static casters. The viewport is the same size, so each fragment reads exactly one texel
+layout(binding = 0, set = 2) uniform sampler2D static_map;
+
+layout(location = 0) in vec2 frag_uv;
+
+void main() {
+	gl_FragDepth = texture(static_map, frag_uv).r;
+}
@@ -0,0 +1,9 @@
+#version 450
+
+layout(location = 0) out vec2 frag_uv;
+
+// One triangle covering the viewport, no vertex buffer needed
+void main() {
+	frag_uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(frag_uv.x * 2.0 - 1.0, 1.0 - frag_uv.y * 2.0, 0.0, 1.0);
+}